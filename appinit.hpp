@@ -0,0 +1,20 @@
+#ifndef __APPINIT_HPP__
+#define __APPINIT_HPP__
+
+#include "stdtype.h"
+#include <vector>
+#include <string>
+
+// start-up code shared by vgmplay and vgmplay-bench
+
+class Configuration;
+class PlayerA;
+struct GeneralOptions;
+struct ChipOptions;
+
+std::string InitAppSearchPaths(const char* argv_0, std::vector<std::string>& searchPaths);	// returns the user's config directory
+int IniValHandler(void* user, const char* section, const char* name, const char* value);
+UINT8 LoadConfig(const std::string& iniPath, Configuration& cfg);
+void InitPlayerEngines(PlayerA& player, const GeneralOptions& genOpts, const ChipOptions* chipOpts);	// chipOpts: 0x100 entries
+
+#endif	// __APPINIT_HPP__
@@ -0,0 +1,99 @@
+#ifndef __ATOMICS_HPP__
+#define __ATOMICS_HPP__
+
+// minimal set of atomic operations on 32-bit values, usable with C++98 compilers
+// Loads have "acquire", stores "release" semantics. All read-modify-write operations are full barriers.
+
+#include <stdtype.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+
+static inline UINT32 Atomic_LoadU32(const volatile UINT32* ptr)
+{
+	return (UINT32)InterlockedCompareExchange((volatile LONG*)const_cast<volatile UINT32*>(ptr), 0, 0);
+}
+
+static inline void Atomic_StoreU32(volatile UINT32* ptr, UINT32 val)
+{
+	InterlockedExchange((volatile LONG*)ptr, (LONG)val);
+}
+
+static inline UINT32 Atomic_ExchangeU32(volatile UINT32* ptr, UINT32 val)
+{
+	return (UINT32)InterlockedExchange((volatile LONG*)ptr, (LONG)val);
+}
+
+// returns true if *ptr was equal to "expected" and got replaced by "val"
+static inline bool Atomic_CompareSwapU32(volatile UINT32* ptr, UINT32 expected, UINT32 val)
+{
+	return (UINT32)InterlockedCompareExchange((volatile LONG*)ptr, (LONG)val, (LONG)expected) == expected;
+}
+
+// returns the value before the addition
+static inline UINT32 Atomic_FetchAddU32(volatile UINT32* ptr, UINT32 val)
+{
+	return (UINT32)InterlockedExchangeAdd((volatile LONG*)ptr, (LONG)val);
+}
+
+#elif defined(__ATOMIC_ACQUIRE)	// GCC 4.7+, Clang
+
+static inline UINT32 Atomic_LoadU32(const volatile UINT32* ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void Atomic_StoreU32(volatile UINT32* ptr, UINT32 val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static inline UINT32 Atomic_ExchangeU32(volatile UINT32* ptr, UINT32 val)
+{
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline bool Atomic_CompareSwapU32(volatile UINT32* ptr, UINT32 expected, UINT32 val)
+{
+	return __atomic_compare_exchange_n(ptr, &expected, val, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline UINT32 Atomic_FetchAddU32(volatile UINT32* ptr, UINT32 val)
+{
+	return __atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+#else	// older GCC versions
+
+static inline UINT32 Atomic_LoadU32(const volatile UINT32* ptr)
+{
+	UINT32 val = *ptr;
+	__sync_synchronize();
+	return val;
+}
+
+static inline void Atomic_StoreU32(volatile UINT32* ptr, UINT32 val)
+{
+	__sync_synchronize();
+	*ptr = val;
+}
+
+static inline UINT32 Atomic_ExchangeU32(volatile UINT32* ptr, UINT32 val)
+{
+	__sync_synchronize();	// __sync_lock_test_and_set is only an "acquire" barrier
+	return __sync_lock_test_and_set(ptr, val);
+}
+
+static inline bool Atomic_CompareSwapU32(volatile UINT32* ptr, UINT32 expected, UINT32 val)
+{
+	return __sync_bool_compare_and_swap(ptr, expected, val);
+}
+
+static inline UINT32 Atomic_FetchAddU32(volatile UINT32* ptr, UINT32 val)
+{
+	return __sync_fetch_and_add(ptr, val);
+}
+
+#endif
+
+#endif	// __ATOMICS_HPP__
@@ -0,0 +1,136 @@
+#include <string.h>
+
+#include "stdtype.h"
+#include "atomics.hpp"
+#include "utils.hpp"
+#include "audiostats.hpp"
+
+static const UINT32 BUCKET_LIMITS[ACS_BUCKETS] =
+{
+	10, 25, 50, 75, 90, 110, 125, 150, 200, 300, 500, (UINT32)-1
+};
+
+AudioCallbackStats::AudioCallbackStats() :
+	_smplRate(44100),
+	_smplSize(4),
+	_lastCall(0),
+	_resetReq(1),
+	_skipReq(0)
+{
+}
+
+void AudioCallbackStats::SetFormat(UINT32 smplRate, UINT32 smplSize)
+{
+	_smplRate = smplRate;
+	_smplSize = smplSize;
+	return;
+}
+
+void AudioCallbackStats::Reset(void)
+{
+	Atomic_StoreU32(&_resetReq, 1);
+	return;
+}
+
+void AudioCallbackStats::SkipInterval(void)
+{
+	Atomic_StoreU32(&_skipReq, 1);
+	return;
+}
+
+void AudioCallbackStats::GetSummary(Summary& sum) const
+{
+	memset(&sum, 0x00, sizeof(Summary));
+	if (Atomic_LoadU32(&_resetReq))
+		return;	// The counters are about to be cleared.
+	
+	sum.calls = Atomic_LoadU32(&_calls);
+	sum.underruns = Atomic_LoadU32(&_underruns);
+	sum.transUnderruns = Atomic_LoadU32(&_transUnderruns);
+	sum.lateCalls = Atomic_LoadU32(&_lateCalls);
+	sum.slowCalls = Atomic_LoadU32(&_slowCalls);
+	sum.bufTime = Atomic_LoadU32(&_bufTime);
+	sum.maxInterval = Atomic_LoadU32(&_maxInterval);
+	sum.maxRender = Atomic_LoadU32(&_maxRender);
+	sum.avgLoad = sum.calls ? (Atomic_LoadU32(&_loadSum) / sum.calls) : 0;
+	for (UINT32 curBkt = 0; curBkt < ACS_BUCKETS; curBkt ++)
+	{
+		sum.intvHist[curBkt] = Atomic_LoadU32(&_intvHist[curBkt]);
+		sum.renderHist[curBkt] = Atomic_LoadU32(&_renderHist[curBkt]);
+	}
+	return;
+}
+
+/*static*/ const UINT32* AudioCallbackStats::GetBucketLimits(void)
+{
+	return BUCKET_LIMITS;
+}
+
+void AudioCallbackStats::Record(UINT64 startTime, UINT32 bufSize, bool underrun, bool transition)
+{
+	UINT64 endTime = GetTimeUSec();
+	UINT64 period = (UINT64)(bufSize / _smplSize) * 1000000 / _smplRate;
+	UINT64 renderTime = endTime - startTime;
+	
+	if (Atomic_LoadU32(&_resetReq))
+	{
+		Atomic_StoreU32(&_calls, 0);
+		Atomic_StoreU32(&_underruns, 0);
+		Atomic_StoreU32(&_transUnderruns, 0);
+		Atomic_StoreU32(&_lateCalls, 0);
+		Atomic_StoreU32(&_slowCalls, 0);
+		Atomic_StoreU32(&_maxInterval, 0);
+		Atomic_StoreU32(&_maxRender, 0);
+		Atomic_StoreU32(&_loadSum, 0);
+		for (UINT32 curBkt = 0; curBkt < ACS_BUCKETS; curBkt ++)
+		{
+			Atomic_StoreU32(&_intvHist[curBkt], 0);
+			Atomic_StoreU32(&_renderHist[curBkt], 0);
+		}
+		_lastCall = 0;
+		Atomic_StoreU32(&_resetReq, 0);
+	}
+	if (Atomic_ExchangeU32(&_skipReq, 0))
+		_lastCall = 0;
+	if (period == 0)
+		return;
+	
+	Atomic_StoreU32(&_bufTime, (UINT32)period);
+	Atomic_FetchAddU32(&_calls, 1);
+	if (underrun)
+		Atomic_FetchAddU32(&_underruns, 1);
+	if (transition)
+		Atomic_FetchAddU32(&_transUnderruns, 1);
+	if (renderTime > period)
+		Atomic_FetchAddU32(&_slowCalls, 1);
+	if (_maxRender < renderTime)
+		Atomic_StoreU32(&_maxRender, (UINT32)renderTime);
+	Atomic_FetchAddU32(&_loadSum, (UINT32)(renderTime * 1000 / period));
+	Atomic_FetchAddU32(&_renderHist[GetBucket(renderTime, period)], 1);
+	
+	if (_lastCall != 0)
+	{
+		UINT64 interval = startTime - _lastCall;
+		if (interval * 2 > period * 3)
+			Atomic_FetchAddU32(&_lateCalls, 1);
+		if (_maxInterval < interval)
+			Atomic_StoreU32(&_maxInterval, (UINT32)interval);
+		Atomic_FetchAddU32(&_intvHist[GetBucket(interval, period)], 1);
+	}
+	_lastCall = startTime;
+	
+	return;
+}
+
+/*static*/ UINT32 AudioCallbackStats::GetBucket(UINT64 time, UINT64 period)
+{
+	UINT64 percent = time * 100 / period;
+	UINT32 curBkt;
+	
+	for (curBkt = 0; curBkt < ACS_BUCKETS - 1; curBkt ++)
+	{
+		if (percent < BUCKET_LIMITS[curBkt])
+			break;
+	}
+	return curBkt;
+}
@@ -0,0 +1,62 @@
+#ifndef __AUDIOSTATS_HPP__
+#define __AUDIOSTATS_HPP__
+
+#include "stdtype.h"
+
+#define ACS_BUCKETS	12
+
+// lock-free statistics about the calls of the audio callback
+// The callback is the only writer. All other threads may read the counters at any time without blocking it.
+// Call intervals and render times are sorted into histogram buckets relative to the buffer period
+// (the playback duration of the data that was requested by the call).
+class AudioCallbackStats
+{
+public:
+	struct Summary
+	{
+		UINT32 calls;
+		UINT32 underruns;	// not enough data was available
+		UINT32 transUnderruns;	// underruns while switching to the next song (gapless playback), included in "underruns"
+		UINT32 lateCalls;	// more than 1.5 buffer periods since the previous call
+		UINT32 slowCalls;	// rendering took longer than the buffer period
+		UINT32 bufTime;	// buffer period of the last call, in usec
+		UINT32 maxInterval;	// in usec
+		UINT32 maxRender;	// in usec
+		UINT32 avgLoad;	// average render time, in 1/10 % of the buffer period
+		UINT32 intvHist[ACS_BUCKETS];
+		UINT32 renderHist[ACS_BUCKETS];
+	};
+	
+	AudioCallbackStats();
+	void SetFormat(UINT32 smplRate, UINT32 smplSize);	// not thread-safe
+	void Reset(void);	// applied by the callback on its next call
+	void SkipInterval(void);	// don't count the time until the next call (e.g. after pausing)
+	void GetSummary(Summary& sum) const;
+	static const UINT32* GetBucketLimits(void);	// upper limit of each bucket, in % of the buffer period
+	
+	// audio callback side
+	// "startTime" is the time from GetTimeUSec() at the beginning of the callback.
+	void Record(UINT64 startTime, UINT32 bufSize, bool underrun, bool transition = false);
+
+private:
+	static UINT32 GetBucket(UINT64 time, UINT64 period);
+	
+	UINT32 _smplRate;
+	UINT32 _smplSize;
+	UINT64 _lastCall;	// used by the callback only, 0 = don't count the next interval
+	volatile UINT32 _resetReq;
+	volatile UINT32 _skipReq;
+	volatile UINT32 _calls;
+	volatile UINT32 _underruns;
+	volatile UINT32 _transUnderruns;
+	volatile UINT32 _lateCalls;
+	volatile UINT32 _slowCalls;
+	volatile UINT32 _bufTime;
+	volatile UINT32 _maxInterval;
+	volatile UINT32 _maxRender;
+	volatile UINT32 _loadSum;	// sum of all render times, in 1/10 % of the buffer period
+	volatile UINT32 _intvHist[ACS_BUCKETS];
+	volatile UINT32 _renderHist[ACS_BUCKETS];
+};
+
+#endif	// __AUDIOSTATS_HPP__
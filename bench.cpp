@@ -0,0 +1,1840 @@
+// vgmplay-bench: offline render benchmark
+// Renders songs without any audio device, using the same player setup as the player itself,
+// and reports the render speed as JSON.
+// The "core matrix" mode additionally renders each song with every available emulation core of the
+// used sound chips and all resampling modes, and compares the output with the configured setup.
+// The "golden" mode hashes the output in blocks and compares it with a manifest of known-good hashes.
+// The "seek" mode compares seeking with rendering the song up to the same position and checks the audio after the seek.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <getopt.h>
+
+#include <stdtype.h>
+#include <utils/DataLoader.h>
+#include <utils/FileLoader.h>
+#include <utils/MemoryLoader.h>
+#include <utils/OSMutex.h>
+#include <utils/OSThread.h>
+#include <player/playerbase.hpp>
+#include <player/playera.hpp>
+#include <emu/SoundEmu.h>	// for SndEmu_GetDevName(), SndEmu_GetDevDecl()
+
+#include "utils.hpp"
+#include "config.hpp"
+#include "playcfg.hpp"
+#include "appinit.hpp"
+#include "romcache.hpp"
+#include "atomics.hpp"
+#include "version.h"
+
+
+struct BenchOptions
+{
+	UINT32 warmupRuns;	// untimed runs before the measurement
+	UINT32 repeatRuns;	// timed runs, the median is reported
+	UINT32 maxSeconds;	// limit for the rendered length (0 = whole song)
+	bool perChip;	// measure the cost of each sound chip
+	bool coreMatrix;	// compare all emulation cores and resampling modes
+	UINT32 jobCount;	// number of threads for the core matrix
+	std::string goldenFile;	// manifest with the expected output hashes
+	bool goldenUpdate;	// write the manifest instead of checking against it
+	std::string goldenLabel;	// name of the render time written by goldenUpdate
+	bool seekTest;	// measure seeking and the audio after the seek
+	std::string outFile;	// JSON output, empty = stdout
+};
+
+// PlayerA instance with everything needed for rendering, one per thread
+struct BenchPlayer
+{
+	PlayerA player;
+	volatile UINT8 playState;
+	std::vector<UINT8> smplBuf;
+};
+
+// comparison of the rendered output with a reference
+struct PCMDiff
+{
+	const std::vector<UINT8>* refPCM;	// NULL = store the output in outPCM instead
+	std::vector<UINT8>* outPCM;
+	UINT64 valCnt;	// number of compared sample values
+	double refPower;	// sum of squared reference values
+	double diffPower;	// sum of squared differences
+	UINT32 maxDiff;
+};
+
+// hashes of the rendered output, one per block of GOLDEN_BLOCK_SECS seconds
+struct PCMHash
+{
+	UINT32 blockSize;	// in bytes
+	UINT32 blockFill;	// number of bytes in the current block
+	UINT64 curHash;
+	std::vector<UINT64>* blocks;
+};
+
+// render time of a manifest entry, one per version/commit
+struct GoldenTime
+{
+	std::string label;
+	double renderMS;
+};
+
+// manifest entry of the golden mode
+struct GoldenEntry
+{
+	std::string fileName;
+	UINT32 smplCnt;
+	std::vector<GoldenTime> times;	// oldest first
+	std::vector<UINT64> blocks;
+};
+
+struct BenchRun
+{
+	UINT64 loadUSec;	// LoadFile() + Start()
+	UINT64 renderUSec;
+	UINT32 smplCnt;
+};
+
+struct ChipResult
+{
+	UINT32 devID;	// PLR_DEV_ID(type, instance)
+	UINT8 instance;
+	std::string name;
+	std::string core;
+	double renderMS;	// render time of all other chips
+	double costMS;	// render time saved by disabling this chip
+};
+
+// seek to 25%, 50% and 75% of the song
+struct SeekResult
+{
+	UINT32 percent;
+	UINT32 smplPos;
+	double seekMS;	// PlayerA::Seek(), only processes the commands
+	double renderMS;	// rendering from the start to the same position
+	PCMDiff diff;	// audio after the seek vs. the complete render
+};
+
+// seek results of all files that use a certain chip type
+struct SeekChipStats
+{
+	std::string name;
+	UINT32 files;
+	UINT32 exactFiles;	// files whose audio after seeking is identical to the complete render
+	double seekMS;
+	double renderMS;
+	double minSNR;	// worst SNR of the files that differ
+};
+
+#define GOLD_NEW		0x00	// not in the manifest yet
+#define GOLD_MATCH		0x01
+#define GOLD_DIFF		0x02
+
+#define MVAR_REF		0x00	// configured setup
+#define MVAR_CORE		0x01	// different emulation core for one chip
+#define MVAR_RESMPL		0x02	// different ResamplingMode
+#define MVAR_CHIPSMPL	0x03	// different ChipSmplMode
+
+struct MatrixJob
+{
+	UINT8 varType;	// MVAR_xxx
+	UINT8 chipType;	// MVAR_CORE: chip whose options are changed
+	UINT8 coreSlot;	// MVAR_CORE: 0 = main core, 1 = sub core (linked device)
+	UINT32 coreID;	// MVAR_CORE
+	UINT8 mode;	// MVAR_RESMPL/MVAR_CHIPSMPL: new value
+	std::string chip;
+	std::string core;
+	// results
+	UINT8 status;
+	UINT32 smplCnt;
+	double renderMS;	// median of all timed runs
+	PCMDiff diff;
+};
+
+struct FileResult
+{
+	std::string fileName;
+	std::string format;
+	UINT8 status;	// 0x00 = OK, else error code
+	UINT32 smplCnt;
+	double loadMS;
+	std::vector<double> renderMS;	// one entry per timed run
+	std::vector<ChipResult> chips;
+	std::vector<MatrixJob> matrix;
+	std::vector<UINT64> blockHashes;
+	UINT8 goldenState;	// GOLD_xxx
+	UINT32 diffBlock;	// GOLD_DIFF: first block that differs
+	double goldenMS;	// latest render time stored in the manifest
+	std::string goldenLabel;	// label of goldenMS
+	std::vector<SeekResult> seeks;
+	std::vector<std::string> seekChips;	// names of the chip types used by the song
+};
+
+struct MatrixCtx
+{
+	const std::vector<UINT8>* fileData;
+	const std::vector<UINT8>* refPCM;
+	std::vector<MatrixJob>* jobs;
+	volatile UINT32 nextJob;
+};
+
+
+static void PrintUsage(const char* appName);
+static int ParseArguments(int argc, char* argv[], Configuration& argCfg);
+static UINT8 InitBenchPlayer(BenchPlayer& bp, const GeneralOptions& gOpts);
+static void SetChipCore(PlayerA& player, UINT8 chipType, UINT8 coreSlot, UINT32 coreID);
+static UINT8 LoadFileData(const std::string& fileName, std::vector<UINT8>& data);
+static UINT8 RenderSong(BenchPlayer& bp, const std::vector<UINT8>& fileData, UINT32 disableDev, BenchRun& run,
+	std::vector<PLR_DEV_INFO>* devList, PCMDiff* diff, PCMHash* hash);
+static void ComparePCM(PCMDiff& diff, UINT32 smplOfs, UINT32 dataSize, const UINT8* data);
+static void HashPCM(PCMHash& hash, UINT32 dataSize, const UINT8* data);
+static INT32 ReadSample(const UINT8* data, UINT8 bits);
+static UINT8 BenchmarkFile(const std::string& fileName, FileResult& result);
+static void BenchmarkChips(const std::vector<UINT8>& fileData, const std::vector<PLR_DEV_INFO>& devList,
+	FileResult& result);
+static double GetChipParallelSpeedup(const FileResult& result);
+static void BenchmarkMatrix(const std::vector<UINT8>& fileData, const std::vector<UINT8>& refPCM,
+	const std::vector<PLR_DEV_INFO>& devList, FileResult& result);
+static void MatrixWorker(void* args);
+static UINT8 InitMatrixPlayer(BenchPlayer& bp, const MatrixJob& job);
+static void RunMatrixJob(BenchPlayer& bp, const MatrixCtx& ctx, MatrixJob& job);
+static void TimeMatrixJob(BenchPlayer& bp, const MatrixCtx& ctx, MatrixJob& job);
+static std::string GetMatrixJobName(const MatrixJob& job);
+static void BenchmarkSeek(const std::vector<UINT8>& fileData, const std::vector<UINT8>& refPCM,
+	const std::vector<PLR_DEV_INFO>& devList, FileResult& result);
+static UINT8 SeekSong(BenchPlayer& bp, const std::vector<UINT8>& fileData, UINT32 destPos, bool render,
+	UINT64& seekUSec, PCMDiff* diff);
+static void PrintSeek(const FileResult& result);
+static void GetSeekChipStats(const std::vector<FileResult>& results, std::vector<SeekChipStats>& chipStats);
+static void PrintSeekChips(const std::vector<SeekChipStats>& chipStats);
+static double GetMatrixSNR(const PCMDiff& diff);
+static void PrintMatrix(const FileResult& result);
+static void WriteMatrixJSON(FILE* hFile, const FileResult& result);
+static std::string GetGoldenSettings(void);
+static bool ReadLine(FILE* hFile, std::string& line);
+static UINT8 LoadManifest(const std::string& fileName, std::string& settings, std::vector<GoldenEntry>& entries);
+static UINT8 SaveManifest(const std::string& fileName, std::vector<GoldenEntry>& entries);
+static void CheckGolden(FileResult& result, const std::vector<GoldenEntry>& entries);
+static void UpdateGolden(const FileResult& result, std::vector<GoldenEntry>& entries);
+static bool GoldenEntryLess(const GoldenEntry& a, const GoldenEntry& b);
+static void PrintGolden(const FileResult& result);
+static double GetMedian(std::vector<double> values);
+static double GetMean(const std::vector<double>& values);
+static std::string JSONString(const std::string& text);
+static void WriteResultsJSON(FILE* hFile, const std::vector<FileResult>& results);
+static UINT8 FilePlayCallback(PlayerBase* player, void* userParam, UINT8 evtType, void* evtParam);
+static DATA_LOADER* PlayerFileReqCallback(void* userParam, PlayerBase* player, const char* fileName);
+
+
+#define BENCH_ROM_CACHE_SIZE	0x4000000	// keep sample ROMs loaded between runs
+#define GOLDEN_BLOCK_SECS	1	// length of the hashed blocks in golden mode
+#define SEEK_POINTS			3	// seek mode: seek to 25%, 50% and 75% of the song
+#define SEEK_CHECK_SECS		1	// seek mode: length of the audio compared after seeking
+
+static std::vector<std::string> cfgFileNames;
+static std::vector<std::string> appSearchPaths;
+static Configuration benchCfg;
+static BenchOptions benchOpts;
+static GeneralOptions genOpts;
+static ChipOptions chipOpts[0x100];
+static BenchPlayer mainPlr;
+static RomCache romCache;
+static UINT32 smplSize;
+static OS_MUTEX* startMtx;	// serializes PlayerA::Start(), see BatchRenderSong() in playctrl.cpp
+
+int main(int argc, char* argv[])
+{
+	int argbase;
+	UINT8 retVal;
+	Configuration argCfg;
+	std::vector<FileResult> results;
+	std::vector<std::string> fileList;
+	std::vector<GoldenEntry> golden;
+	std::string goldenSettings;
+	UINT32 goldenFails;
+	
+	setlocale(LC_ALL, "");
+	setlocale(LC_NUMERIC, "C");	// enforce decimal dot, the JSON output depends on it
+	
+	benchOpts.warmupRuns = 1;
+	benchOpts.repeatRuns = 3;
+	benchOpts.maxSeconds = 0;
+	benchOpts.perChip = false;
+	benchOpts.coreMatrix = false;
+	benchOpts.jobCount = 0;
+	benchOpts.goldenUpdate = false;
+	benchOpts.goldenLabel = VGMPLAY_VER_STR;
+	benchOpts.seekTest = false;
+	
+	InitAppSearchPaths(argv[0], appSearchPaths);
+	
+	argbase = ParseArguments(argc, argv, argCfg);
+	if (argbase == 0)
+		return 0;
+	else if (argbase < 0)
+		return 1;
+	for (int curFile = argbase; curFile < argc; curFile ++)
+		fileList.push_back(argv[curFile]);
+	if (! benchOpts.goldenFile.empty())
+	{
+		retVal = LoadManifest(benchOpts.goldenFile, goldenSettings, golden);
+		if (retVal && ! benchOpts.goldenUpdate)
+		{
+			fprintf(stderr, "Error loading %s!\n", benchOpts.goldenFile.c_str());
+			return 1;
+		}
+		if (fileList.empty())
+		{
+			for (size_t curEnt = 0; curEnt < golden.size(); curEnt ++)
+				fileList.push_back(golden[curEnt].fileName);
+		}
+	}
+	if (fileList.empty())
+	{
+		PrintUsage(argv[0]);
+		return 0;
+	}
+	
+	// The golden mode uses the default settings, so that the results don't depend on the user's configuration.
+	if (cfgFileNames.empty() && benchOpts.goldenFile.empty())
+	{
+		cfgFileNames.push_back("VGMPlay.ini");
+		cfgFileNames.push_back("vgmplay.ini");
+	}
+	if (! cfgFileNames.empty())
+	{
+		std::string cfgFilePath = FindFile_List(cfgFileNames, appSearchPaths);
+		if (! cfgFilePath.empty())
+		{
+			retVal = LoadConfig(cfgFilePath, benchCfg);
+			if (retVal)
+				fprintf(stderr, "%s: Error 0x%02X\n", cfgFilePath.c_str(), retVal);
+		}
+	}
+	benchCfg += argCfg;
+	
+	ParseConfiguration(genOpts, 0x100, chipOpts, benchCfg);
+	if (genOpts.smplBits != 16 && genOpts.smplBits != 24 && genOpts.smplBits != 32)
+		genOpts.smplBits = 16;
+	if (! genOpts.maxLoops && ! benchOpts.maxSeconds)
+	{
+		fprintf(stderr, "Songs are set to loop forever, limiting them to 10 minutes.\n");
+		benchOpts.maxSeconds = 600;
+	}
+	
+	if (! benchOpts.jobCount)
+		benchOpts.jobCount = GetCPUCoreCount();
+	if (! benchOpts.goldenFile.empty() && ! benchOpts.goldenUpdate && goldenSettings != GetGoldenSettings())
+	{
+		fprintf(stderr, "The settings don't match the ones of the manifest.\n");
+		fprintf(stderr, "    manifest: %s\n", goldenSettings.c_str());
+		fprintf(stderr, "    current:  %s\n", GetGoldenSettings().c_str());
+		return 1;
+	}
+	
+	retVal = OSMutex_Init(&startMtx, 0);
+	if (retVal)
+	{
+		fprintf(stderr, "Error creating mutex!\n");
+		return 1;
+	}
+	romCache.Init(BENCH_ROM_CACHE_SIZE);
+	smplSize = 2 * genOpts.smplBits / 8;
+	retVal = InitBenchPlayer(mainPlr, genOpts);
+	if (retVal)
+	{
+		fprintf(stderr, "Unsupported sample rate / bps\n");
+		return 1;
+	}
+	
+	goldenFails = 0;
+	for (size_t curFile = 0; curFile < fileList.size(); curFile ++)
+	{
+		FileResult fRes;
+		
+		fprintf(stderr, "[%u/%u] %s ... ", (unsigned)(1 + curFile), (unsigned)fileList.size(), fileList[curFile].c_str());
+		fflush(stderr);
+		retVal = BenchmarkFile(fileList[curFile], fRes);
+		if (retVal)
+		{
+			fprintf(stderr, "error 0x%02X\n", retVal);
+			if (! benchOpts.goldenFile.empty())
+				goldenFails ++;
+		}
+		else
+		{
+			double renderSec = GetMedian(fRes.renderMS) / 1000.0;
+			double songSec = (double)fRes.smplCnt / genOpts.smplRate;
+			fprintf(stderr, "%.2fx realtime\n", (renderSec > 0.0) ? songSec / renderSec : 0.0);
+			if (fRes.chips.size() >= 2)
+				fprintf(stderr, "    one thread per chip: up to %.2fx faster\n", GetChipParallelSpeedup(fRes));
+			if (benchOpts.coreMatrix)
+				PrintMatrix(fRes);
+			if (benchOpts.seekTest)
+				PrintSeek(fRes);
+			if (! benchOpts.goldenFile.empty())
+			{
+				CheckGolden(fRes, golden);
+				PrintGolden(fRes);
+				if (benchOpts.goldenUpdate)
+					UpdateGolden(fRes, golden);
+				else if (fRes.goldenState != GOLD_MATCH)
+					goldenFails ++;
+			}
+		}
+		results.push_back(fRes);
+	}
+	
+	mainPlr.player.UnregisterAllPlayers();
+	romCache.Deinit();
+	OSMutex_Deinit(startMtx);	startMtx = NULL;
+	if (benchOpts.seekTest)
+	{
+		std::vector<SeekChipStats> chipStats;
+		GetSeekChipStats(results, chipStats);
+		PrintSeekChips(chipStats);
+	}
+	
+	if (! benchOpts.goldenFile.empty())
+	{
+		if (benchOpts.goldenUpdate)
+		{
+			retVal = SaveManifest(benchOpts.goldenFile, golden);
+			if (retVal)
+			{
+				fprintf(stderr, "Error writing %s!\n", benchOpts.goldenFile.c_str());
+				goldenFails ++;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "Golden output: %u of %u files match.\n",
+				(unsigned)(fileList.size() - goldenFails), (unsigned)fileList.size());
+		}
+	}
+	
+	if (benchOpts.outFile.empty())
+	{
+		WriteResultsJSON(stdout, results);
+	}
+	else
+	{
+		FILE* hFile = fopen(benchOpts.outFile.c_str(), "wt");
+		if (hFile == NULL)
+		{
+			fprintf(stderr, "Error writing %s!\n", benchOpts.outFile.c_str());
+			return 2;
+		}
+		WriteResultsJSON(hFile, results);
+		fclose(hFile);
+	}
+	
+	return goldenFails ? 3 : 0;
+}
+
+static void PrintUsage(const char* appName)
+{
+	printf("VGMPlay render benchmark %s\n", VGMPLAY_VER_STR);
+	printf("Usage: %s [options] file1.vgm [file2.vgz] [...]\n", appName);
+	printf("Options:\n");
+	printf("    -h, --help              show this help screen\n");
+	printf("    -w, --warmup n          untimed runs per file before measuring (default: 1)\n");
+	printf("    -r, --repeat n          timed runs per file, the median is reported (default: 3)\n");
+	printf("    -t, --time sec          render at most this many seconds per file (default: whole song)\n");
+	printf("    -p, --per-chip          measure the render time of each sound chip\n");
+	printf("    -m, --matrix            compare all cores of the used chips and all resampling modes\n");
+	printf("    -j, --jobs n            number of threads for --matrix (default: number of CPU cores)\n");
+	printf("                            (only for comparing the output, the timed runs use one thread)\n");
+	printf("    -g, --golden path       compare the output with the hashes in this manifest\n");
+	printf("                            (without files: check all files of the manifest)\n");
+	printf("    -u, --update            write the hashes to the manifest instead of checking them\n");
+	printf("    -l, --label name        name of the render time stored by --update, e.g. the commit\n");
+	printf("                            (default: version, render times with other names are kept)\n");
+	printf("    -s, --seek              compare seeking with rendering up to the same position\n");
+	printf("    -o, --output path       write JSON results to a file instead of stdout\n");
+	printf("    -c, --config option     set configuration option, format: section.key=Data\n");
+	printf("    -C, --cfg-file path     path of config.ini to load, overrides default configuration\n");
+	return;
+}
+
+static int ParseArguments(int argc, char* argv[], Configuration& argCfg)
+{
+	static const struct option LONG_OPTS[] =
+	{
+		{"help",     no_argument,       NULL, 'h'},
+		{"warmup",   required_argument, NULL, 'w'},
+		{"repeat",   required_argument, NULL, 'r'},
+		{"time",     required_argument, NULL, 't'},
+		{"per-chip", no_argument,       NULL, 'p'},
+		{"matrix",   no_argument,       NULL, 'm'},
+		{"jobs",     required_argument, NULL, 'j'},
+		{"golden",   required_argument, NULL, 'g'},
+		{"update",   no_argument,       NULL, 'u'},
+		{"label",    required_argument, NULL, 'l'},
+		{"seek",     no_argument,       NULL, 's'},
+		{"output",   required_argument, NULL, 'o'},
+		{"config",   required_argument, NULL, 'c'},
+		{"cfg-file", required_argument, NULL, 'C'},
+		{NULL,       0,                 NULL, 0},
+	};
+	
+	optind = 1;
+	while(true)
+	{
+		int retVal = getopt_long(argc, argv, "hw:r:t:pmj:g:ul:so:c:C:", LONG_OPTS, NULL);
+		if (retVal == -1)
+			break;	// finished argument parsing
+		else if (retVal == '?')
+			return -1;
+		
+		switch(retVal)
+		{
+		case 'h':	// help
+			PrintUsage(argv[0]);
+			return 0;
+		case 'w':	// warmup
+			benchOpts.warmupRuns = (UINT32)strtoul(optarg, NULL, 0);
+			break;
+		case 'r':	// repeat
+			benchOpts.repeatRuns = (UINT32)strtoul(optarg, NULL, 0);
+			if (benchOpts.repeatRuns < 1)
+				benchOpts.repeatRuns = 1;
+			break;
+		case 't':	// time
+			benchOpts.maxSeconds = (UINT32)strtoul(optarg, NULL, 0);
+			break;
+		case 'p':	// per-chip
+			benchOpts.perChip = true;
+			break;
+		case 'm':	// matrix
+			benchOpts.coreMatrix = true;
+			break;
+		case 'j':	// jobs
+			benchOpts.jobCount = (UINT32)strtoul(optarg, NULL, 0);
+			break;
+		case 'g':	// golden
+			benchOpts.goldenFile = optarg;
+			break;
+		case 'u':	// update
+			benchOpts.goldenUpdate = true;
+			break;
+		case 'l':	// label
+			benchOpts.goldenLabel = optarg;
+			break;
+		case 's':	// seek
+			benchOpts.seekTest = true;
+			break;
+		case 'o':	// output
+			benchOpts.outFile = optarg;
+			break;
+		case 'c':	// configuration setting
+			{
+				std::string optstr = optarg;
+				char* sect = &optstr[0];
+				char* key = strchr(sect, '.');
+				if (key == NULL)
+					break;
+				*key = '\0';	key ++;
+				char* val = strchr(key, '=');
+				if (val == NULL)
+					break;
+				*val = '\0';	val ++;
+				IniValHandler(&argCfg, sect, key, val);
+			}
+			break;
+		case 'C':	// cfg-file
+			cfgFileNames.clear();
+			cfgFileNames.push_back(optarg);
+			break;
+		}
+	}
+	
+	return optind;
+}
+
+// same setup as InitPlayerEngines() in playctrl.cpp
+static UINT8 InitBenchPlayer(BenchPlayer& bp, const GeneralOptions& gOpts)
+{
+	PlayerA& player = bp.player;
+	
+	InitPlayerEngines(player, gOpts, chipOpts);
+	player.SetEventCallback(FilePlayCallback, &bp);
+	player.SetFileReqCallback(PlayerFileReqCallback, NULL);
+	player.SetLogCallback(NULL, NULL);
+	
+	bp.playState = 0x00;
+	bp.smplBuf.resize(gOpts.smplRate / 4 * smplSize);	// same block size as the audio callback
+	return player.SetOutputSettings(gOpts.smplRate, 2, gOpts.smplBits, (UINT32)(bp.smplBuf.size() / smplSize));
+}
+
+// coreSlot: 0 = main core, 1 = sub core (used by linked devices, e.g. the SSG of the YM2203)
+static void SetChipCore(PlayerA& player, UINT8 chipType, UINT8 coreSlot, UINT32 coreID)
+{
+	const std::vector<PlayerBase*>& plrs = player.GetRegisteredPlayers();
+	
+	for (size_t curPlr = 0; curPlr < plrs.size(); curPlr ++)
+	{
+		for (UINT8 curInst = 0; curInst < 2; curInst ++)
+		{
+			PLR_DEV_OPTS devOpts;
+			
+			if (plrs[curPlr]->GetDeviceOptions(PLR_DEV_ID(chipType, curInst), devOpts))
+				continue;	// this player doesn't support this chip
+			devOpts.emuCore[coreSlot] = coreID;
+			plrs[curPlr]->SetDeviceOptions(PLR_DEV_ID(chipType, curInst), devOpts);
+		}
+	}
+	
+	return;
+}
+
+// loads (and decompresses) the whole file, so that file I/O isn't part of the measurement
+static UINT8 LoadFileData(const std::string& fileName, std::vector<UINT8>& data)
+{
+	DATA_LOADER* dLoad;
+	UINT8 retVal;
+	
+	dLoad = FileLoader_Init(fileName.c_str());
+	if (dLoad == NULL)
+		return 0xFF;
+	retVal = DataLoader_Load(dLoad);
+	if (retVal)
+	{
+		DataLoader_Deinit(dLoad);
+		return 0xFF;
+	}
+	DataLoader_ReadAll(dLoad);
+	data.assign(DataLoader_GetData(dLoad), DataLoader_GetData(dLoad) + DataLoader_GetSize(dLoad));
+	DataLoader_Deinit(dLoad);
+	
+	return data.empty() ? 0xFE : 0x00;
+}
+
+// renders a song once, "disableDev" is excluded from emulation ((UINT32)-1 = none)
+// Only the Render() calls are timed, comparing/storing/hashing the output for "diff"/"hash" is not.
+static UINT8 RenderSong(BenchPlayer& bp, const std::vector<UINT8>& fileData, UINT32 disableDev, BenchRun& run,
+	std::vector<PLR_DEV_INFO>* devList, PCMDiff* diff, PCMHash* hash)
+{
+	PlayerA& player = bp.player;
+	std::vector<UINT8>& smplBuf = bp.smplBuf;
+	DATA_LOADER* dLoad;
+	PLR_DEV_OPTS oldDevOpts;
+	UINT32 maxSmpls;
+	UINT64 startTime;
+	UINT8 retVal;
+	
+	dLoad = MemoryLoader_Init(&fileData[0], (UINT32)fileData.size());
+	if (dLoad == NULL)
+		return 0xFF;
+	DataLoader_Load(dLoad);
+	
+	startTime = GetTimeUSec();
+	retVal = player.LoadFile(dLoad);
+	if (retVal)
+	{
+		DataLoader_Deinit(dLoad);
+		return 0xFE;
+	}
+	PlayerBase* pBase = player.GetPlayer();
+	if (disableDev != (UINT32)-1)
+	{
+		PLR_DEV_OPTS devOpts;
+		
+		pBase->GetDeviceOptions(disableDev, oldDevOpts);
+		devOpts = oldDevOpts;
+		devOpts.muteOpts.disable |= 0x01;
+		pBase->SetDeviceOptions(disableDev, devOpts);
+	}
+	// Some sound cores initialize global lookup tables when being started,
+	// so device initialization is serialized.
+	OSMutex_Lock(startMtx);
+	player.Start();
+	OSMutex_Unlock(startMtx);
+	bp.playState = PLAYSTATE_PLAY;
+	run.loadUSec = GetTimeUSec() - startTime;
+	if (devList != NULL)
+		pBase->GetSongDeviceInfo(*devList);
+	
+	maxSmpls = benchOpts.maxSeconds ? benchOpts.maxSeconds * genOpts.smplRate : (UINT32)-1;
+	run.smplCnt = 0;
+	run.renderUSec = 0;
+	while(! (bp.playState & PLAYSTATE_FIN) && run.smplCnt < maxSmpls)
+	{
+		UINT32 renderSize = (UINT32)smplBuf.size();
+		if (maxSmpls - run.smplCnt < renderSize / smplSize)
+			renderSize = (maxSmpls - run.smplCnt) * smplSize;
+		startTime = GetTimeUSec();
+		UINT32 wrtBytes = player.Render(renderSize, &smplBuf[0]);
+		run.renderUSec += GetTimeUSec() - startTime;
+		if (wrtBytes == 0)
+			break;
+		if (diff != NULL)
+			ComparePCM(*diff, run.smplCnt, wrtBytes, &smplBuf[0]);
+		if (hash != NULL)
+			HashPCM(*hash, wrtBytes, &smplBuf[0]);
+		run.smplCnt += wrtBytes / smplSize;
+	}
+	if (hash != NULL && hash->blockFill > 0)
+	{
+		hash->blocks->push_back(hash->curHash);
+		hash->blockFill = 0;
+	}
+	
+	bp.playState = 0x00;
+	player.Stop();
+	if (disableDev != (UINT32)-1)
+		pBase->SetDeviceOptions(disableDev, oldDevOpts);
+	player.UnloadFile();
+	DataLoader_Deinit(dLoad);
+	
+	return 0x00;
+}
+
+// compares the rendered data with the reference or stores it as the reference
+static void ComparePCM(PCMDiff& diff, UINT32 smplOfs, UINT32 dataSize, const UINT8* data)
+{
+	UINT32 bytesPerVal = genOpts.smplBits / 8;
+	
+	if (diff.refPCM == NULL)
+	{
+		diff.outPCM->insert(diff.outPCM->end(), data, data + dataSize);
+		return;
+	}
+	
+	const std::vector<UINT8>& refPCM = *diff.refPCM;
+	size_t refOfs = (size_t)smplOfs * smplSize;
+	if (refOfs >= refPCM.size())
+		return;
+	if (dataSize > refPCM.size() - refOfs)
+		dataSize = (UINT32)(refPCM.size() - refOfs);
+	for (UINT32 curPos = 0; curPos < dataSize; curPos += bytesPerVal)
+	{
+		INT32 refVal = ReadSample(&refPCM[refOfs + curPos], genOpts.smplBits);
+		INT32 newVal = ReadSample(&data[curPos], genOpts.smplBits);
+		double valDiff = (double)newVal - refVal;
+		UINT32 absDiff = (UINT32)fabs(valDiff);
+		
+		diff.refPower += (double)refVal * refVal;
+		diff.diffPower += valDiff * valDiff;
+		if (diff.maxDiff < absDiff)
+			diff.maxDiff = absDiff;
+	}
+	diff.valCnt += dataSize / bytesPerVal;
+	
+	return;
+}
+
+static void HashPCM(PCMHash& hash, UINT32 dataSize, const UINT8* data)
+{
+	while(dataSize > 0)
+	{
+		UINT32 hashSize = hash.blockSize - hash.blockFill;
+		if (hashSize > dataSize)
+			hashSize = dataSize;
+		hash.curHash = HashFNV1a(data, hashSize, hash.curHash);
+		hash.blockFill += hashSize;
+		data += hashSize;
+		dataSize -= hashSize;
+		if (hash.blockFill == hash.blockSize)
+		{
+			hash.blocks->push_back(hash.curHash);
+			hash.curHash = FNV1A_INIT;
+			hash.blockFill = 0;
+		}
+	}
+	
+	return;
+}
+
+// reads a signed little-endian sample with 16, 24 or 32 bits
+static INT32 ReadSample(const UINT8* data, UINT8 bits)
+{
+	if (bits == 16)
+		return (INT16)(data[0] | (data[1] << 8));
+	else if (bits == 24)
+		return (INT32)((data[0] << 8) | (data[1] << 16) | ((UINT32)data[2] << 24)) >> 8;
+	else
+		return (INT32)(data[0] | (data[1] << 8) | (data[2] << 16) | ((UINT32)data[3] << 24));
+}
+
+static UINT8 BenchmarkFile(const std::string& fileName, FileResult& result)
+{
+	std::vector<UINT8> fileData;
+	std::vector<PLR_DEV_INFO> devList;
+	std::vector<double> loadMS;
+	std::vector<UINT8> refPCM;
+	PCMDiff refStore;
+	PCMHash blkHash;
+	BenchRun run;
+	UINT32 curRun;
+	UINT8 retVal;
+	
+	result.fileName = fileName;
+	result.smplCnt = 0;
+	result.loadMS = 0.0;
+	result.status = LoadFileData(fileName, fileData);
+	if (result.status)
+		return result.status;
+	
+	memset(&refStore, 0x00, sizeof(PCMDiff));
+	refStore.outPCM = &refPCM;
+	blkHash.blockSize = GOLDEN_BLOCK_SECS * genOpts.smplRate * smplSize;
+	blkHash.blockFill = 0;
+	blkHash.curHash = FNV1A_INIT;
+	blkHash.blocks = &result.blockHashes;
+	for (curRun = 0; curRun < benchOpts.warmupRuns + benchOpts.repeatRuns; curRun ++)
+	{
+		bool firstRun = (curRun == 0);
+		retVal = RenderSong(mainPlr, fileData, (UINT32)-1, run, firstRun ? &devList : NULL,
+			(firstRun && (benchOpts.coreMatrix || benchOpts.seekTest)) ? &refStore : NULL,
+			(firstRun && ! benchOpts.goldenFile.empty()) ? &blkHash : NULL);
+		if (retVal)
+		{
+			result.status = retVal;
+			return retVal;
+		}
+		if (curRun < benchOpts.warmupRuns)
+			continue;
+		result.smplCnt = run.smplCnt;
+		loadMS.push_back(run.loadUSec / 1000.0);
+		result.renderMS.push_back(run.renderUSec / 1000.0);
+	}
+	result.format = FCC2Str(mainPlr.player.GetPlayer()->GetPlayerType());
+	result.loadMS = GetMedian(loadMS);
+	
+	if (benchOpts.perChip)
+		BenchmarkChips(fileData, devList, result);
+	if (benchOpts.coreMatrix)
+		BenchmarkMatrix(fileData, refPCM, devList, result);
+	if (benchOpts.seekTest)
+		BenchmarkSeek(fileData, refPCM, devList, result);
+	
+	return 0x00;
+}
+
+// The players don't expose the time spent per chip, so each chip's cost is measured
+// by rendering the song with this chip disabled.
+static void BenchmarkChips(const std::vector<UINT8>& fileData, const std::vector<PLR_DEV_INFO>& devList,
+	FileResult& result)
+{
+	double fullMS = GetMedian(result.renderMS);
+	
+	for (size_t curDev = 0; curDev < devList.size(); curDev ++)
+	{
+		const PLR_DEV_INFO& pdi = devList[curDev];
+		if (pdi.parentIdx != (UINT32)-1)
+			continue;	// linked devices are disabled together with their parent
+		
+		ChipResult cRes;
+		std::vector<double> renderMS;
+		BenchRun run;
+		UINT32 curRun;
+		
+		cRes.devID = PLR_DEV_ID(pdi.type, pdi.instance);
+		cRes.instance = pdi.instance;
+		cRes.name = SndEmu_GetDevName(pdi.type, 0x01, pdi.devCfg);
+		cRes.core = FCC2Str(pdi.core);
+		for (curRun = 0; curRun < benchOpts.repeatRuns; curRun ++)
+		{
+			if (RenderSong(mainPlr, fileData, cRes.devID, run, NULL, NULL, NULL))
+				break;
+			renderMS.push_back(run.renderUSec / 1000.0);
+		}
+		if (renderMS.empty())
+			continue;
+		cRes.renderMS = GetMedian(renderMS);
+		cRes.costMS = (fullMS > cRes.renderMS) ? (fullMS - cRes.renderMS) : 0.0;
+		result.chips.push_back(cRes);
+	}
+	
+	return;
+}
+
+// best-case speed-up when every chip is rendered by its own thread:
+// The rest (command processing, resampling, mixing) stays serial and the chips take as long as the slowest one.
+// Thread synchronization isn't included.
+static double GetChipParallelSpeedup(const FileResult& result)
+{
+	double fullMS = GetMedian(result.renderMS);
+	double chipSumMS = 0.0;
+	double chipMaxMS = 0.0;
+	double parallelMS;
+	
+	for (size_t curChip = 0; curChip < result.chips.size(); curChip ++)
+	{
+		double costMS = result.chips[curChip].costMS;
+		chipSumMS += costMS;
+		if (chipMaxMS < costMS)
+			chipMaxMS = costMS;
+	}
+	if (chipSumMS > fullMS)
+		chipSumMS = fullMS;	// The measurement by disabling chips isn't exact.
+	parallelMS = fullMS - chipSumMS + chipMaxMS;
+	return (parallelMS > 0.0) ? fullMS / parallelMS : 1.0;
+}
+
+// Renders the song once for every available core of each used chip and for each resampling mode.
+// All variants (including the configured setup) are rendered in parallel and compared with the
+// output of the configured setup. The timed runs are done one variant at a time afterwards,
+// so that the speed isn't affected by the other threads.
+static void BenchmarkMatrix(const std::vector<UINT8>& fileData, const std::vector<UINT8>& refPCM,
+	const std::vector<PLR_DEV_INFO>& devList, FileResult& result)
+{
+	std::vector<MatrixJob>& jobs = result.matrix;
+	std::vector<OS_THREAD*> threads;
+	MatrixCtx ctx;
+	MatrixJob job;
+	UINT8 curMode;
+	
+	job.varType = MVAR_REF;
+	job.chipType = 0xFF;
+	job.coreSlot = 0;
+	job.coreID = 0;
+	job.mode = 0;
+	jobs.clear();
+	jobs.push_back(job);
+	
+	for (size_t curDev = 0; curDev < devList.size(); curDev ++)
+	{
+		const PLR_DEV_INFO& pdi = devList[curDev];
+		const DEV_DECL* devDecl = SndEmu_GetDevDecl(pdi.type, NULL, 0x00);
+		if (devDecl == NULL)
+			continue;
+		
+		job.varType = MVAR_CORE;
+		job.chipType = pdi.type;
+		job.coreSlot = 0;
+		if (pdi.parentIdx != (UINT32)-1)
+		{
+			// The cores of linked devices are set via the parent's sub core.
+			job.chipType = devList[pdi.parentIdx].type;
+			job.coreSlot = 1;
+		}
+		size_t curJob;
+		for (curJob = 0; curJob < jobs.size(); curJob ++)
+		{
+			if (jobs[curJob].varType == MVAR_CORE && jobs[curJob].chipType == job.chipType &&
+				jobs[curJob].coreSlot == job.coreSlot)
+				break;
+		}
+		if (curJob < jobs.size())
+			continue;	// another instance of this chip was already handled
+		
+		job.chip = SndEmu_GetDevName(pdi.type, 0x01, pdi.devCfg);
+		for (size_t coreIdx = 0; devDecl->cores[coreIdx] != NULL; coreIdx ++)
+		{
+			job.coreID = devDecl->cores[coreIdx]->coreID;
+			if (job.coreID == pdi.core)
+				continue;	// same as the reference
+			job.core = FCC2Str(job.coreID);
+			jobs.push_back(job);
+		}
+	}
+	job.chip.clear();
+	job.core.clear();
+	job.chipType = 0xFF;
+	job.coreSlot = 0;
+	job.coreID = 0;
+	for (curMode = 0; curMode <= 2; curMode ++)
+	{
+		if (curMode == genOpts.resmplMode)
+			continue;
+		job.varType = MVAR_RESMPL;
+		job.mode = curMode;
+		jobs.push_back(job);
+	}
+	for (curMode = 0; curMode <= 3; curMode ++)
+	{
+		if (curMode == genOpts.chipSmplMode)
+			continue;
+		job.varType = MVAR_CHIPSMPL;
+		job.mode = curMode;
+		jobs.push_back(job);
+	}
+	
+	ctx.fileData = &fileData;
+	ctx.refPCM = &refPCM;
+	ctx.jobs = &jobs;
+	ctx.nextJob = 0;
+	for (UINT32 curThr = 1; curThr < benchOpts.jobCount && curThr < jobs.size(); curThr ++)
+	{
+		OS_THREAD* hThread;
+		if (OSThread_Init(&hThread, MatrixWorker, &ctx))
+			break;
+		threads.push_back(hThread);
+	}
+	MatrixWorker(&ctx);	// the main thread works as well
+	for (size_t curThr = 0; curThr < threads.size(); curThr ++)
+	{
+		OSThread_Join(threads[curThr]);
+		OSThread_Deinit(threads[curThr]);
+	}
+	
+	BenchPlayer* bp = new BenchPlayer;
+	for (size_t curJob = 0; curJob < jobs.size(); curJob ++)
+		TimeMatrixJob(*bp, ctx, jobs[curJob]);
+	delete bp;
+	
+	return;
+}
+
+static void MatrixWorker(void* args)
+{
+	MatrixCtx* ctx = (MatrixCtx*)args;
+	BenchPlayer* bp = new BenchPlayer;
+	
+	while(true)
+	{
+		UINT32 jobIdx = Atomic_FetchAddU32(&ctx->nextJob, 1);
+		if (jobIdx >= ctx->jobs->size())
+			break;
+		RunMatrixJob(*bp, *ctx, (*ctx->jobs)[jobIdx]);
+	}
+	delete bp;
+	
+	return;
+}
+
+static UINT8 InitMatrixPlayer(BenchPlayer& bp, const MatrixJob& job)
+{
+	GeneralOptions gOpts = genOpts;
+	UINT8 retVal;
+	
+	if (job.varType == MVAR_RESMPL)
+		gOpts.resmplMode = job.mode;
+	else if (job.varType == MVAR_CHIPSMPL)
+		gOpts.chipSmplMode = job.mode;
+	retVal = InitBenchPlayer(bp, gOpts);
+	if (! retVal && job.varType == MVAR_CORE)
+		SetChipCore(bp.player, job.chipType, job.coreSlot, job.coreID);
+	return retVal;
+}
+
+// parallel pass: renders the variant once and compares the output
+static void RunMatrixJob(BenchPlayer& bp, const MatrixCtx& ctx, MatrixJob& job)
+{
+	BenchRun run;
+	
+	memset(&job.diff, 0x00, sizeof(PCMDiff));
+	job.diff.refPCM = ctx.refPCM;
+	job.smplCnt = 0;
+	job.renderMS = 0.0;
+	job.status = InitMatrixPlayer(bp, job);
+	if (! job.status)
+		job.status = RenderSong(bp, *ctx.fileData, (UINT32)-1, run, NULL, &job.diff, NULL);
+	if (! job.status)
+		job.smplCnt = run.smplCnt;
+	bp.player.UnregisterAllPlayers();
+	
+	return;
+}
+
+// serial pass: measures the render time without other threads running
+static void TimeMatrixJob(BenchPlayer& bp, const MatrixCtx& ctx, MatrixJob& job)
+{
+	std::vector<double> renderMS;
+	BenchRun run;
+	UINT32 curRun;
+	UINT8 retVal;
+	
+	if (job.status)
+		return;
+	retVal = InitMatrixPlayer(bp, job);
+	for (curRun = 0; curRun < benchOpts.warmupRuns + benchOpts.repeatRuns && ! retVal; curRun ++)
+	{
+		retVal = RenderSong(bp, *ctx.fileData, (UINT32)-1, run, NULL, NULL, NULL);
+		if (curRun < benchOpts.warmupRuns)
+			continue;
+		renderMS.push_back(run.renderUSec / 1000.0);
+	}
+	if (retVal)
+		job.status = retVal;
+	job.renderMS = GetMedian(renderMS);
+	bp.player.UnregisterAllPlayers();
+	
+	return;
+}
+
+static std::string GetMatrixJobName(const MatrixJob& job)
+{
+	char buffer[0x20];
+	
+	switch(job.varType)
+	{
+	case MVAR_REF:
+		return "reference";
+	case MVAR_CORE:
+		return job.chip + (job.coreSlot ? " sub core " : " core ") + job.core;
+	case MVAR_RESMPL:
+		sprintf(buffer, "ResamplingMode %u", job.mode);
+		return buffer;
+	case MVAR_CHIPSMPL:
+		sprintf(buffer, "ChipSmplMode %u", job.mode);
+		return buffer;
+	}
+	return "";
+}
+
+// difference to the reference as signal-to-difference ratio, in dB
+static double GetMatrixSNR(const PCMDiff& diff)
+{
+	if (diff.diffPower <= 0.0)
+		return 0.0;
+	if (diff.refPower <= 0.0)
+		return -999.0;
+	return 10.0 * log10(diff.refPower / diff.diffPower);
+}
+
+static void PrintMatrix(const FileResult& result)
+{
+	double songSec = (double)result.smplCnt / genOpts.smplRate;
+	
+	for (size_t curJob = 0; curJob < result.matrix.size(); curJob ++)
+	{
+		const MatrixJob& job = result.matrix[curJob];
+		
+		fprintf(stderr, "    %-32s ", GetMatrixJobName(job).c_str());
+		if (job.status)
+			fprintf(stderr, "error 0x%02X\n", job.status);
+		else if (job.diff.diffPower <= 0.0)
+			fprintf(stderr, "%8.2fx realtime, identical\n", (job.renderMS > 0.0) ? songSec * 1000.0 / job.renderMS : 0.0);
+		else
+			fprintf(stderr, "%8.2fx realtime, SNR %.1f dB\n", (job.renderMS > 0.0) ? songSec * 1000.0 / job.renderMS : 0.0,
+				GetMatrixSNR(job.diff));
+	}
+	
+	return;
+}
+
+static void WriteMatrixJSON(FILE* hFile, const FileResult& result)
+{
+	double fullScale = (double)(1U << (genOpts.smplBits - 1));
+	double refMS = result.matrix.empty() ? 0.0 : result.matrix[0].renderMS;
+	
+	fprintf(hFile, ",\n\t\t\"matrix\": [");
+	for (size_t curJob = 0; curJob < result.matrix.size(); curJob ++)
+	{
+		const MatrixJob& job = result.matrix[curJob];
+		double songSec = (double)job.smplCnt / genOpts.smplRate;
+		
+		fprintf(hFile, "%s\n\t\t\t{\"variant\": %s, ", curJob ? "," : "", JSONString(GetMatrixJobName(job)).c_str());
+		if (job.varType == MVAR_CORE)
+			fprintf(hFile, "\"chip\": %s, \"coreSlot\": %u, \"core\": %s, ",
+				JSONString(job.chip).c_str(), job.coreSlot, JSONString(job.core).c_str());
+		else if (job.varType == MVAR_RESMPL)
+			fprintf(hFile, "\"resamplingMode\": %u, ", job.mode);
+		else if (job.varType == MVAR_CHIPSMPL)
+			fprintf(hFile, "\"chipSmplMode\": %u, ", job.mode);
+		if (job.status)
+		{
+			fprintf(hFile, "\"error\": %u}", job.status);
+			continue;
+		}
+		fprintf(hFile, "\"renderMS\": %.3f, \"realtimeFactor\": %.3f, \"relativeSpeed\": %.3f, ",
+			job.renderMS, (job.renderMS > 0.0) ? songSec * 1000.0 / job.renderMS : 0.0,
+			(job.renderMS > 0.0) ? refMS / job.renderMS : 0.0);
+		if (job.diff.diffPower <= 0.0)
+		{
+			fprintf(hFile, "\"identical\": true}");
+		}
+		else
+		{
+			fprintf(hFile, "\"identical\": false, \"snrDB\": %.2f, \"rmsDiffDB\": %.2f, \"peakDiffDB\": %.2f}",
+				GetMatrixSNR(job.diff),
+				10.0 * log10(job.diff.diffPower / job.diff.valCnt / (fullScale * fullScale)),
+				20.0 * log10(job.diff.maxDiff / fullScale));
+		}
+	}
+	fprintf(hFile, "\n\t\t]");
+	
+	return;
+}
+
+// Seeking only processes the song's commands without emulating the sound chips, the player's
+// SeekRender option renders everything up to the destination instead.
+// This measures both ways and checks whether the audio after the seek matches the complete render,
+// which shows for which chips the seek doesn't restore the chip state correctly.
+static void BenchmarkSeek(const std::vector<UINT8>& fileData, const std::vector<UINT8>& refPCM,
+	const std::vector<PLR_DEV_INFO>& devList, FileResult& result)
+{
+	std::vector<SeekResult>& seeks = result.seeks;
+	UINT32 curPt;
+	
+	result.seekChips.clear();
+	for (size_t curDev = 0; curDev < devList.size(); curDev ++)
+	{
+		const PLR_DEV_INFO& pdi = devList[curDev];
+		if (pdi.parentIdx != (UINT32)-1)
+			continue;
+		std::string name = SndEmu_GetDevName(pdi.type, 0x01, pdi.devCfg);
+		if (std::find(result.seekChips.begin(), result.seekChips.end(), name) == result.seekChips.end())
+			result.seekChips.push_back(name);
+	}
+	
+	seeks.resize(SEEK_POINTS);
+	for (curPt = 0; curPt < SEEK_POINTS; curPt ++)
+	{
+		SeekResult& sRes = seeks[curPt];
+		std::vector<double> seekMS;
+		std::vector<double> renderMS;
+		UINT64 usec;
+		UINT32 curRun;
+		
+		sRes.percent = (curPt + 1) * 100 / (SEEK_POINTS + 1);
+		sRes.smplPos = (UINT32)((UINT64)result.smplCnt * sRes.percent / 100);
+		memset(&sRes.diff, 0x00, sizeof(PCMDiff));
+		sRes.diff.refPCM = &refPCM;
+		for (curRun = 0; curRun < benchOpts.warmupRuns + benchOpts.repeatRuns; curRun ++)
+		{
+			// The audio after the seek is compared during the first run only.
+			if (SeekSong(mainPlr, fileData, sRes.smplPos, false, usec, (curRun == 0) ? &sRes.diff : NULL))
+				break;
+			if (curRun >= benchOpts.warmupRuns)
+				seekMS.push_back(usec / 1000.0);
+			if (SeekSong(mainPlr, fileData, sRes.smplPos, true, usec, NULL))
+				break;
+			if (curRun >= benchOpts.warmupRuns)
+				renderMS.push_back(usec / 1000.0);
+		}
+		sRes.seekMS = GetMedian(seekMS);
+		sRes.renderMS = GetMedian(renderMS);
+	}
+	
+	return;
+}
+
+// moves to destPos either by seeking or by rendering, only that part is timed
+// The audio after destPos is compared with the reference when "diff" is set.
+static UINT8 SeekSong(BenchPlayer& bp, const std::vector<UINT8>& fileData, UINT32 destPos, bool render,
+	UINT64& seekUSec, PCMDiff* diff)
+{
+	PlayerA& player = bp.player;
+	std::vector<UINT8>& smplBuf = bp.smplBuf;
+	DATA_LOADER* dLoad;
+	UINT64 startTime;
+	UINT32 smplCnt;
+	
+	dLoad = MemoryLoader_Init(&fileData[0], (UINT32)fileData.size());
+	if (dLoad == NULL)
+		return 0xFF;
+	DataLoader_Load(dLoad);
+	if (player.LoadFile(dLoad))
+	{
+		DataLoader_Deinit(dLoad);
+		return 0xFE;
+	}
+	OSMutex_Lock(startMtx);
+	player.Start();
+	OSMutex_Unlock(startMtx);
+	bp.playState = PLAYSTATE_PLAY;
+	
+	startTime = GetTimeUSec();
+	if (! render)
+	{
+		player.Seek(PLAYPOS_SAMPLE, destPos);
+	}
+	else
+	{
+		smplCnt = 0;
+		while(smplCnt < destPos && ! (bp.playState & PLAYSTATE_FIN))
+		{
+			UINT32 renderSize = (UINT32)smplBuf.size();
+			if (destPos - smplCnt < renderSize / smplSize)
+				renderSize = (destPos - smplCnt) * smplSize;
+			UINT32 wrtBytes = player.Render(renderSize, &smplBuf[0]);
+			if (wrtBytes == 0)
+				break;
+			smplCnt += wrtBytes / smplSize;
+		}
+	}
+	seekUSec = GetTimeUSec() - startTime;
+	
+	if (diff != NULL)
+	{
+		UINT32 checkSmpls = SEEK_CHECK_SECS * genOpts.smplRate;
+		smplCnt = 0;
+		while(smplCnt < checkSmpls && ! (bp.playState & PLAYSTATE_FIN))
+		{
+			UINT32 renderSize = (UINT32)smplBuf.size();
+			if (checkSmpls - smplCnt < renderSize / smplSize)
+				renderSize = (checkSmpls - smplCnt) * smplSize;
+			UINT32 wrtBytes = player.Render(renderSize, &smplBuf[0]);
+			if (wrtBytes == 0)
+				break;
+			ComparePCM(*diff, destPos + smplCnt, wrtBytes, &smplBuf[0]);
+			smplCnt += wrtBytes / smplSize;
+		}
+	}
+	
+	bp.playState = 0x00;
+	player.Stop();
+	player.UnloadFile();
+	DataLoader_Deinit(dLoad);
+	
+	return 0x00;
+}
+
+static void PrintSeek(const FileResult& result)
+{
+	for (size_t curPt = 0; curPt < result.seeks.size(); curPt ++)
+	{
+		const SeekResult& sRes = result.seeks[curPt];
+		
+		fprintf(stderr, "    seek to %2u%%: %8.3f ms, rendering %9.3f ms (%.1fx faster), ", sRes.percent,
+			sRes.seekMS, sRes.renderMS, (sRes.seekMS > 0.0) ? sRes.renderMS / sRes.seekMS : 0.0);
+		if (sRes.diff.diffPower <= 0.0)
+			fprintf(stderr, "identical\n");
+		else
+			fprintf(stderr, "differs, SNR %.1f dB\n", GetMatrixSNR(sRes.diff));
+	}
+	
+	return;
+}
+
+// Files that use several chips count for each of them, so single-chip files give the clearest results.
+static void GetSeekChipStats(const std::vector<FileResult>& results, std::vector<SeekChipStats>& chipStats)
+{
+	chipStats.clear();
+	for (size_t curFile = 0; curFile < results.size(); curFile ++)
+	{
+		const FileResult& fRes = results[curFile];
+		if (fRes.status || fRes.seeks.empty())
+			continue;
+		
+		double seekMS = 0.0;
+		double renderMS = 0.0;
+		double minSNR = 0.0;
+		bool identical = true;
+		for (size_t curPt = 0; curPt < fRes.seeks.size(); curPt ++)
+		{
+			const SeekResult& sRes = fRes.seeks[curPt];
+			seekMS += sRes.seekMS;
+			renderMS += sRes.renderMS;
+			if (sRes.diff.diffPower > 0.0)
+			{
+				double snr = GetMatrixSNR(sRes.diff);
+				if (identical || minSNR > snr)
+					minSNR = snr;
+				identical = false;
+			}
+		}
+		
+		for (size_t curChip = 0; curChip < fRes.seekChips.size(); curChip ++)
+		{
+			size_t curStat;
+			for (curStat = 0; curStat < chipStats.size(); curStat ++)
+			{
+				if (chipStats[curStat].name == fRes.seekChips[curChip])
+					break;
+			}
+			if (curStat == chipStats.size())
+			{
+				SeekChipStats cs;
+				cs.name = fRes.seekChips[curChip];
+				cs.files = 0;
+				cs.exactFiles = 0;
+				cs.seekMS = 0.0;
+				cs.renderMS = 0.0;
+				cs.minSNR = 0.0;
+				chipStats.push_back(cs);
+			}
+			
+			SeekChipStats& cs = chipStats[curStat];
+			if (! identical && (cs.exactFiles == cs.files || cs.minSNR > minSNR))
+				cs.minSNR = minSNR;
+			cs.files ++;
+			if (identical)
+				cs.exactFiles ++;
+			cs.seekMS += seekMS;
+			cs.renderMS += renderMS;
+		}
+	}
+	
+	return;
+}
+
+static void PrintSeekChips(const std::vector<SeekChipStats>& chipStats)
+{
+	if (chipStats.empty())
+		return;
+	
+	fprintf(stderr, "Seek speed-up per chip type:\n");
+	for (size_t curStat = 0; curStat < chipStats.size(); curStat ++)
+	{
+		const SeekChipStats& cs = chipStats[curStat];
+		
+		fprintf(stderr, "    %-12s %8.1fx faster, %u of %u files identical after seeking", cs.name.c_str(),
+			(cs.seekMS > 0.0) ? cs.renderMS / cs.seekMS : 0.0, cs.exactFiles, cs.files);
+		if (cs.exactFiles < cs.files)
+			fprintf(stderr, " (worst SNR %.1f dB, consider SeekRender)", cs.minSNR);
+		fprintf(stderr, "\n");
+	}
+	
+	return;
+}
+
+// all settings that affect the output, stored in the manifest
+// Each chip is listed with its core, sub core and options, so that "-c"/"-C" changes are detected.
+static std::string GetGoldenSettings(void)
+{
+	char buffer[0x100];
+	std::string result;
+	
+	sprintf(buffer, "SampleRate=%u SampleBits=%u MaxLoops=%u ResamplingMode=%u ChipSmplMode=%u ChipSmplRate=%u "
+		"MaxSeconds=%u BlockSeconds=%u", genOpts.smplRate, genOpts.smplBits, genOpts.maxLoops,
+		genOpts.resmplMode, genOpts.chipSmplMode, genOpts.chipSmplRate, benchOpts.maxSeconds, GOLDEN_BLOCK_SECS);
+	result = buffer;
+	sprintf(buffer, " Volume=%.3f PlaybackSpeed=%.3f PlaybackRate=%u PseudoSurround=%u FadeTime=%u JinglePause=%u "
+		"HardStopOld=%u", genOpts.volume, genOpts.pbSpeed, genOpts.pbRate, genOpts.pseudoSurround ? 1 : 0,
+		genOpts.fadeTime_single, genOpts.pauseTime_jingle, genOpts.hardStopOld);
+	result += buffer;
+	for (size_t curChp = 0; curChp < 0x100; curChp ++)
+	{
+		const ChipOptions& cOpt = chipOpts[curChp];
+		if (cOpt.chipType == 0xFF)
+			continue;
+		
+		sprintf(buffer, " Chip%02X=%s/%s/%X", cOpt.chipType, FCC2Str(cOpt.emuCore).c_str(),
+			FCC2Str(cOpt.emuCoreSub).c_str(), cOpt.addOpts);
+		result += buffer;
+		// muting and panning are only listed when used, to keep the line short
+		if (cOpt.chipDisable || cOpt.muteMask[0] || cOpt.muteMask[1])
+		{
+			sprintf(buffer, "/D%X/M%X,%X", cOpt.chipDisable, cOpt.muteMask[0], cOpt.muteMask[1]);
+			result += buffer;
+		}
+		const double* panVals = &cOpt.panMask[0][0];
+		bool usesPan = false;
+		for (size_t curChn = 0; curChn < sizeof(cOpt.panMask) / sizeof(cOpt.panMask[0][0]); curChn ++)
+		{
+			if (panVals[curChn] != 0.0)
+			{
+				usesPan = true;
+				break;
+			}
+		}
+		if (usesPan)
+		{
+			UINT64 panHash = HashFNV1a((const UINT8*)panVals, sizeof(cOpt.panMask), FNV1A_INIT);
+			sprintf(buffer, "/P%08X%08X", (UINT32)(panHash >> 32), (UINT32)(panHash >> 0));
+			result += buffer;
+		}
+	}
+	return result;
+}
+
+// reads a whole line (without line break), returns false at the end of the file
+static bool ReadLine(FILE* hFile, std::string& line)
+{
+	char buffer[0x100];
+	
+	line.clear();
+	while(fgets(buffer, sizeof(buffer), hFile) != NULL)
+	{
+		line += buffer;
+		if (line[line.length() - 1] == '\n')
+			break;
+	}
+	if (line.empty())
+		return false;
+	while(! line.empty() && (line[line.length() - 1] == '\n' || line[line.length() - 1] == '\r'))
+		line.erase(line.length() - 1);
+	return true;
+}
+
+// File format: one line per song with the fields (separated by tabs)
+//	file name, number of samples, render times, block hashes (separated by spaces)
+// The render times are "label=ms" pairs (separated by spaces), one per version/commit, oldest first.
+// The "settings" line lists the settings the hashes were made with. Lines starting with # are comments.
+static UINT8 LoadManifest(const std::string& fileName, std::string& settings, std::vector<GoldenEntry>& entries)
+{
+	FILE* hFile;
+	std::string line;
+	
+	entries.clear();
+	settings.clear();
+	hFile = fopen(fileName.c_str(), "rt");
+	if (hFile == NULL)
+		return 0xFF;
+	
+	while(ReadLine(hFile, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+		if (! line.compare(0, 9, "settings\t"))
+		{
+			settings = line.substr(9);
+			continue;
+		}
+		
+		size_t tab1 = line.find('\t');
+		size_t tab2 = (tab1 == std::string::npos) ? tab1 : line.find('\t', tab1 + 1);
+		size_t tab3 = (tab2 == std::string::npos) ? tab2 : line.find('\t', tab2 + 1);
+		if (tab3 == std::string::npos)
+			continue;	// invalid line
+		
+		GoldenEntry ge;
+		ge.fileName = line.substr(0, tab1);
+		ge.smplCnt = (UINT32)strtoul(line.c_str() + tab1 + 1, NULL, 0);
+		for (size_t pos = tab2 + 1; pos < tab3; )
+		{
+			size_t end = line.find(' ', pos);
+			if (end == std::string::npos || end > tab3)
+				end = tab3;
+			std::string timeStr = line.substr(pos, end - pos);
+			pos = end + 1;
+			if (timeStr.empty())
+				continue;
+			
+			GoldenTime gt;
+			size_t sepPos = timeStr.rfind('=');
+			if (sepPos == std::string::npos)
+			{
+				gt.renderMS = strtod(timeStr.c_str(), NULL);	// no label (old manifests)
+			}
+			else
+			{
+				gt.label = timeStr.substr(0, sepPos);
+				gt.renderMS = strtod(timeStr.c_str() + sepPos + 1, NULL);
+			}
+			ge.times.push_back(gt);
+		}
+		for (size_t pos = tab3 + 1; pos + 16 <= line.length(); pos += 17)
+		{
+			UINT32 hashHi = (UINT32)strtoul(line.substr(pos, 8).c_str(), NULL, 16);
+			UINT32 hashLo = (UINT32)strtoul(line.substr(pos + 8, 8).c_str(), NULL, 16);
+			ge.blocks.push_back(((UINT64)hashHi << 32) | hashLo);
+		}
+		entries.push_back(ge);
+	}
+	fclose(hFile);
+	
+	return 0x00;
+}
+
+static UINT8 SaveManifest(const std::string& fileName, std::vector<GoldenEntry>& entries)
+{
+	FILE* hFile;
+	
+	hFile = fopen(fileName.c_str(), "wt");
+	if (hFile == NULL)
+		return 0xFF;
+	
+	std::sort(entries.begin(), entries.end(), GoldenEntryLess);	// keep diffs of the manifest small
+	fprintf(hFile, "# vgmplay-bench golden output manifest\n");
+	fprintf(hFile, "# file name, samples, render times (label=ms), FNV-1a hashes of %u second blocks\n", GOLDEN_BLOCK_SECS);
+	fprintf(hFile, "settings\t%s\n", GetGoldenSettings().c_str());
+	for (size_t curEnt = 0; curEnt < entries.size(); curEnt ++)
+	{
+		const GoldenEntry& ge = entries[curEnt];
+		fprintf(hFile, "%s\t%u\t", ge.fileName.c_str(), ge.smplCnt);
+		for (size_t curTime = 0; curTime < ge.times.size(); curTime ++)
+			fprintf(hFile, "%s%s=%.3f", curTime ? " " : "", ge.times[curTime].label.c_str(), ge.times[curTime].renderMS);
+		fprintf(hFile, "\t");
+		for (size_t curBlk = 0; curBlk < ge.blocks.size(); curBlk ++)
+			fprintf(hFile, "%s%08X%08X", curBlk ? " " : "",
+				(UINT32)(ge.blocks[curBlk] >> 32), (UINT32)(ge.blocks[curBlk] >> 0));
+		fprintf(hFile, "\n");
+	}
+	fclose(hFile);
+	
+	return 0x00;
+}
+
+static void CheckGolden(FileResult& result, const std::vector<GoldenEntry>& entries)
+{
+	size_t curEnt;
+	
+	result.goldenState = GOLD_NEW;
+	result.diffBlock = 0;
+	result.goldenMS = 0.0;
+	result.goldenLabel.clear();
+	for (curEnt = 0; curEnt < entries.size(); curEnt ++)
+	{
+		if (entries[curEnt].fileName == result.fileName)
+			break;
+	}
+	if (curEnt >= entries.size())
+		return;
+	
+	const GoldenEntry& ge = entries[curEnt];
+	size_t blkCnt = std::min(ge.blocks.size(), result.blockHashes.size());
+	if (! ge.times.empty())
+	{
+		result.goldenMS = ge.times.back().renderMS;
+		result.goldenLabel = ge.times.back().label;
+	}
+	for (result.diffBlock = 0; result.diffBlock < blkCnt; result.diffBlock ++)
+	{
+		if (ge.blocks[result.diffBlock] != result.blockHashes[result.diffBlock])
+			break;
+	}
+	if (result.diffBlock < blkCnt || ge.blocks.size() != result.blockHashes.size() || ge.smplCnt != result.smplCnt)
+		result.goldenState = GOLD_DIFF;
+	else
+		result.goldenState = GOLD_MATCH;
+	
+	return;
+}
+
+static void UpdateGolden(const FileResult& result, std::vector<GoldenEntry>& entries)
+{
+	size_t curEnt;
+	
+	for (curEnt = 0; curEnt < entries.size(); curEnt ++)
+	{
+		if (entries[curEnt].fileName == result.fileName)
+			break;
+	}
+	if (curEnt >= entries.size())
+		entries.push_back(GoldenEntry());
+	
+	GoldenEntry& ge = entries[curEnt];
+	ge.fileName = result.fileName;
+	ge.smplCnt = result.smplCnt;
+	ge.blocks = result.blockHashes;
+	
+	// The render times of other labels are kept, so that the speed can be compared between commits.
+	GoldenTime gt;
+	gt.label = benchOpts.goldenLabel;
+	for (size_t curChr = 0; curChr < gt.label.length(); curChr ++)
+	{
+		char& c = gt.label[curChr];
+		if (c == ' ' || c == '\t' || c == '=')
+			c = '_';	// would break the manifest format
+	}
+	gt.renderMS = GetMedian(result.renderMS);
+	for (size_t curTime = 0; curTime < ge.times.size(); curTime ++)
+	{
+		if (ge.times[curTime].label == gt.label)
+		{
+			ge.times.erase(ge.times.begin() + curTime);
+			break;
+		}
+	}
+	ge.times.push_back(gt);
+	
+	return;
+}
+
+static bool GoldenEntryLess(const GoldenEntry& a, const GoldenEntry& b)
+{
+	return a.fileName < b.fileName;
+}
+
+static void PrintGolden(const FileResult& result)
+{
+	double renderMS = GetMedian(result.renderMS);
+	
+	if (result.goldenState == GOLD_NEW)
+	{
+		fprintf(stderr, "    golden output: not in the manifest\n");
+	}
+	else if (result.goldenState == GOLD_DIFF)
+	{
+		UINT32 diffSec = result.diffBlock * GOLDEN_BLOCK_SECS;
+		fprintf(stderr, "    golden output: DIFFERS from block %u (at %u:%02u)\n",
+			result.diffBlock, diffSec / 60, diffSec % 60);
+	}
+	else
+	{
+		fprintf(stderr, "    golden output: matches, render time %+.1f %% compared to \"%s\"\n",
+			(result.goldenMS > 0.0) ? (renderMS / result.goldenMS - 1.0) * 100.0 : 0.0, result.goldenLabel.c_str());
+	}
+	
+	return;
+}
+
+static double GetMedian(std::vector<double> values)
+{
+	size_t midIdx;
+	
+	if (values.empty())
+		return 0.0;
+	std::sort(values.begin(), values.end());
+	midIdx = values.size() / 2;
+	if (values.size() & 1)
+		return values[midIdx];
+	else
+		return (values[midIdx - 1] + values[midIdx]) / 2.0;
+}
+
+static double GetMean(const std::vector<double>& values)
+{
+	double sum = 0.0;
+	
+	if (values.empty())
+		return 0.0;
+	for (size_t curVal = 0; curVal < values.size(); curVal ++)
+		sum += values[curVal];
+	return sum / values.size();
+}
+
+static std::string JSONString(const std::string& text)
+{
+	std::string result = "\"";
+	
+	for (size_t curChr = 0; curChr < text.length(); curChr ++)
+	{
+		unsigned char c = (unsigned char)text[curChr];
+		if (c == '"' || c == '\\')
+		{
+			result += '\\';
+			result += c;
+		}
+		else if (c < 0x20)
+		{
+			char escStr[0x08];
+			sprintf(escStr, "\\u%04X", c);
+			result += escStr;
+		}
+		else
+		{
+			result += c;
+		}
+	}
+	result += '"';
+	
+	return result;
+}
+
+static void WriteResultsJSON(FILE* hFile, const std::vector<FileResult>& results)
+{
+	UINT64 totalSmpls = 0;
+	double totalMS = 0.0;
+	size_t curFile;
+	
+	fprintf(hFile, "{\n");
+	fprintf(hFile, "\t\"version\": %s,\n", JSONString(VGMPLAY_VER_STR).c_str());
+	fprintf(hFile, "\t\"cpuCores\": %u,\n", GetCPUCoreCount());
+	fprintf(hFile, "\t\"settings\": {\"sampleRate\": %u, \"sampleBits\": %u, \"maxLoops\": %u, "
+		"\"resamplingMode\": %u, \"chipSmplMode\": %u, \"chipSmplRate\": %u, "
+		"\"warmupRuns\": %u, \"repeatRuns\": %u, \"maxSeconds\": %u, \"jobs\": %u},\n",
+		genOpts.smplRate, genOpts.smplBits, genOpts.maxLoops,
+		genOpts.resmplMode, genOpts.chipSmplMode, genOpts.chipSmplRate,
+		benchOpts.warmupRuns, benchOpts.repeatRuns, benchOpts.maxSeconds,
+		benchOpts.coreMatrix ? benchOpts.jobCount : 1);
+	fprintf(hFile, "\t\"files\": [");
+	for (curFile = 0; curFile < results.size(); curFile ++)
+	{
+		const FileResult& fRes = results[curFile];
+		
+		fprintf(hFile, "%s\n\t\t{\"file\": %s, ", curFile ? "," : "", JSONString(fRes.fileName).c_str());
+		if (fRes.status)
+		{
+			fprintf(hFile, "\"error\": %u}", fRes.status);
+			continue;
+		}
+		
+		double renderMS = GetMedian(fRes.renderMS);
+		double songSec = (double)fRes.smplCnt / genOpts.smplRate;
+		totalSmpls += fRes.smplCnt;
+		totalMS += renderMS;
+		fprintf(hFile, "\"format\": %s, \"samples\": %u, \"seconds\": %.3f,\n",
+			JSONString(fRes.format).c_str(), fRes.smplCnt, songSec);
+		fprintf(hFile, "\t\t\"loadMS\": %.3f, \"renderMS\": {\"median\": %.3f, \"mean\": %.3f, \"min\": %.3f, \"max\": %.3f},\n",
+			fRes.loadMS, renderMS, GetMean(fRes.renderMS),
+			*std::min_element(fRes.renderMS.begin(), fRes.renderMS.end()),
+			*std::max_element(fRes.renderMS.begin(), fRes.renderMS.end()));
+		fprintf(hFile, "\t\t\"samplesPerSec\": %.1f, \"realtimeFactor\": %.3f",
+			(renderMS > 0.0) ? fRes.smplCnt * 1000.0 / renderMS : 0.0,
+			(renderMS > 0.0) ? songSec * 1000.0 / renderMS : 0.0);
+		if (benchOpts.perChip)
+		{
+			fprintf(hFile, ",\n\t\t\"chips\": [");
+			for (size_t curChip = 0; curChip < fRes.chips.size(); curChip ++)
+			{
+				const ChipResult& cRes = fRes.chips[curChip];
+				fprintf(hFile, "%s\n\t\t\t{\"chip\": %s, \"instance\": %u, \"core\": %s, \"costMS\": %.3f, \"share\": %.4f}",
+					curChip ? "," : "", JSONString(cRes.name).c_str(), cRes.instance,
+					JSONString(cRes.core).c_str(), cRes.costMS, (renderMS > 0.0) ? cRes.costMS / renderMS : 0.0);
+			}
+			fprintf(hFile, "\n\t\t]");
+			fprintf(hFile, ",\n\t\t\"chipParallelSpeedup\": %.3f", GetChipParallelSpeedup(fRes));
+		}
+		if (benchOpts.coreMatrix)
+			WriteMatrixJSON(hFile, fRes);
+		if (! benchOpts.goldenFile.empty())
+		{
+			static const char* GOLD_STATES[] = {"new", "match", "differs"};
+			fprintf(hFile, ",\n\t\t\"golden\": {\"status\": \"%s\", \"blocks\": %u, \"manifestRenderMS\": %.3f, \"manifestLabel\": %s",
+				GOLD_STATES[fRes.goldenState], (unsigned)fRes.blockHashes.size(), fRes.goldenMS,
+				JSONString(fRes.goldenLabel).c_str());
+			if (fRes.goldenState == GOLD_DIFF)
+				fprintf(hFile, ", \"firstDiffBlock\": %u, \"firstDiffSec\": %u",
+					fRes.diffBlock, fRes.diffBlock * GOLDEN_BLOCK_SECS);
+			fprintf(hFile, "}");
+		}
+		if (benchOpts.seekTest)
+		{
+			fprintf(hFile, ",\n\t\t\"seek\": [");
+			for (size_t curPt = 0; curPt < fRes.seeks.size(); curPt ++)
+			{
+				const SeekResult& sRes = fRes.seeks[curPt];
+				fprintf(hFile, "%s\n\t\t\t{\"percent\": %u, \"sample\": %u, \"seekMS\": %.3f, \"renderMS\": %.3f, "
+					"\"speedup\": %.1f, ", curPt ? "," : "", sRes.percent, sRes.smplPos, sRes.seekMS, sRes.renderMS,
+					(sRes.seekMS > 0.0) ? sRes.renderMS / sRes.seekMS : 0.0);
+				if (sRes.diff.diffPower <= 0.0)
+					fprintf(hFile, "\"identical\": true}");
+				else
+					fprintf(hFile, "\"identical\": false, \"snrDB\": %.2f}", GetMatrixSNR(sRes.diff));
+			}
+			fprintf(hFile, "\n\t\t]");
+		}
+		fprintf(hFile, "}");
+	}
+	fprintf(hFile, "\n\t],\n");
+	if (benchOpts.seekTest)
+	{
+		std::vector<SeekChipStats> chipStats;
+		GetSeekChipStats(results, chipStats);
+		fprintf(hFile, "\t\"seekChips\": [");
+		for (size_t curStat = 0; curStat < chipStats.size(); curStat ++)
+		{
+			const SeekChipStats& cs = chipStats[curStat];
+			fprintf(hFile, "%s\n\t\t{\"chip\": %s, \"files\": %u, \"identicalFiles\": %u, "
+				"\"seekMS\": %.3f, \"renderMS\": %.3f, \"speedup\": %.1f",
+				curStat ? "," : "", JSONString(cs.name).c_str(), cs.files, cs.exactFiles,
+				cs.seekMS, cs.renderMS, (cs.seekMS > 0.0) ? cs.renderMS / cs.seekMS : 0.0);
+			if (cs.exactFiles < cs.files)
+				fprintf(hFile, ", \"minSnrDB\": %.2f", cs.minSNR);
+			fprintf(hFile, "}");
+		}
+		fprintf(hFile, "\n\t],\n");
+	}
+	fprintf(hFile, "\t\"total\": {\"samples\": %.0f, \"renderMS\": %.3f, \"samplesPerSec\": %.1f, \"realtimeFactor\": %.3f}\n",
+		(double)totalSmpls, totalMS,
+		(totalMS > 0.0) ? totalSmpls * 1000.0 / totalMS : 0.0,
+		(totalMS > 0.0) ? (double)totalSmpls / genOpts.smplRate * 1000.0 / totalMS : 0.0);
+	fprintf(hFile, "}\n");
+	
+	return;
+}
+
+static UINT8 FilePlayCallback(PlayerBase* player, void* userParam, UINT8 evtType, void* evtParam)
+{
+	BenchPlayer* bp = (BenchPlayer*)userParam;
+	if (evtType == PLREVT_END)
+		bp->playState |= PLAYSTATE_FIN;
+	return 0x00;
+}
+
+static DATA_LOADER* PlayerFileReqCallback(void* userParam, PlayerBase* player, const char* fileName)
+{
+	DATA_LOADER* dLoad = romCache.GetFile(fileName, appSearchPaths);
+	if (dLoad == NULL)
+		fprintf(stderr, "Unable to find %s!\n", fileName);
+	return dLoad;
+}
@@ -0,0 +1,291 @@
+#include <stddef.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+#endif
+
+#include "stdtype.h"
+#include "utils.hpp"	// for GetTimeUSec()
+#include "evtwait.hpp"
+
+#ifdef _WIN32
+#define Sleep_ms(msec)	Sleep(msec)
+#else
+#define Sleep_ms(msec)	usleep((msec) * 1000)
+#endif
+
+#ifdef _WIN32
+static bool DrainConsoleInput(HANDLE hInput);
+#endif
+
+#ifdef _WIN32
+// removes mouse, focus, key release and modifier key records from the console input buffer
+// Nothing else reads them, so they would keep the input handle signalled forever.
+// Returns true when there is a key press left for _kbhit()/_getch().
+static bool DrainConsoleInput(HANDLE hInput)
+{
+	INPUT_RECORD inRec;
+	DWORD recCnt;
+	
+	while(PeekConsoleInputW(hInput, &inRec, 1, &recCnt) && recCnt > 0)
+	{
+		if (inRec.EventType == KEY_EVENT && inRec.Event.KeyEvent.bKeyDown)
+		{
+			switch(inRec.Event.KeyEvent.wVirtualKeyCode)
+			{
+			case VK_SHIFT:
+			case VK_CONTROL:
+			case VK_MENU:
+			case VK_CAPITAL:
+			case VK_NUMLOCK:
+			case VK_SCROLL:
+			case VK_LWIN:
+			case VK_RWIN:
+				break;	// modifier keys alone don't produce characters
+			default:
+				return true;
+			}
+		}
+		if (! ReadConsoleInputW(hInput, &inRec, 1, &recCnt))
+			break;
+	}
+	return false;
+}
+#endif
+
+EventWaiter::EventWaiter() :
+	_initialized(false),
+	_watchInput(false),
+	_timerEnd((UINT64)-1)
+{
+#ifdef _WIN32
+	_hInput = NULL;
+	_hWakeEvt = NULL;
+#else
+	_wakeFD[0] = _wakeFD[1] = -1;
+	_timerFD = -1;
+#endif
+}
+
+EventWaiter::~EventWaiter()
+{
+	Deinit();
+}
+
+UINT8 EventWaiter::Init(bool watchInput)
+{
+	if (_initialized)
+		return 0x01;
+	
+#ifdef _WIN32
+	_hInput = NULL;
+	if (watchInput)
+	{
+		DWORD conMode;
+		HANDLE hInput = GetStdHandle(STD_INPUT_HANDLE);
+		if (hInput != INVALID_HANDLE_VALUE && GetConsoleMode(hInput, &conMode))
+			_hInput = hInput;	// waiting works only for real console handles
+	}
+	_hWakeEvt = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (_hWakeEvt == NULL)
+		return 0xFF;
+	_watchInput = (_hInput != NULL);
+#else
+#ifdef __linux__
+	_wakeFD[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_wakeFD[0] < 0)
+		return 0xFF;
+	_wakeFD[1] = _wakeFD[0];
+	_timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);	// falls back to poll() timeouts on failure
+#else
+	if (pipe(_wakeFD))
+		return 0xFF;
+	fcntl(_wakeFD[0], F_SETFL, fcntl(_wakeFD[0], F_GETFL) | O_NONBLOCK);
+	fcntl(_wakeFD[1], F_SETFL, fcntl(_wakeFD[1], F_GETFL) | O_NONBLOCK);
+	_timerFD = -1;
+#endif
+	// Don't wait for non-terminals. (stdin at EOF would always be "readable")
+	_watchInput = watchInput && isatty(STDIN_FILENO);
+#endif
+	_timerEnd = (UINT64)-1;
+	_initialized = true;
+	
+	return 0x00;
+}
+
+void EventWaiter::Deinit(void)
+{
+	if (! _initialized)
+		return;
+	
+#ifdef _WIN32
+	CloseHandle(_hWakeEvt);	_hWakeEvt = NULL;
+	_hInput = NULL;
+#else
+	if (_timerFD >= 0)
+		close(_timerFD);
+	_timerFD = -1;
+	if (_wakeFD[1] != _wakeFD[0])
+		close(_wakeFD[1]);
+	close(_wakeFD[0]);
+	_wakeFD[0] = _wakeFD[1] = -1;
+#endif
+	_initialized = false;
+	
+	return;
+}
+
+void EventWaiter::Wake(void)
+{
+	if (! _initialized)
+		return;
+	
+#ifdef _WIN32
+	SetEvent(_hWakeEvt);
+#elif defined(__linux__)
+	UINT64 cnt = 1;
+	ssize_t wrtBytes = write(_wakeFD[1], &cnt, sizeof(UINT64));
+	(void)wrtBytes;	// may fail only when the counter overflows - it is nonzero anyway in that case
+#else
+	char dummy = 0;
+	ssize_t wrtBytes = write(_wakeFD[1], &dummy, 1);
+	(void)wrtBytes;	// a full pipe is fine, it will wake us up anyway
+#endif
+	
+	return;
+}
+
+void EventWaiter::SetTimer(UINT32 msec)
+{
+	if (msec == (UINT32)-1)
+		_timerEnd = (UINT64)-1;
+	else
+		_timerEnd = GetTimeUSec() + (UINT64)msec * 1000;
+#if ! defined(_WIN32) && defined(__linux__)
+	if (_timerFD >= 0)
+	{
+		struct itimerspec its;
+		
+		its.it_interval.tv_sec = 0;
+		its.it_interval.tv_nsec = 0;
+		its.it_value.tv_sec = msec / 1000;
+		its.it_value.tv_nsec = (msec % 1000) * 1000000;
+		if (msec == 0)
+			its.it_value.tv_nsec = 1;	// a zero value would disarm the timer
+		else if (msec == (UINT32)-1)
+			its.it_value.tv_sec = its.it_value.tv_nsec = 0;	// disarm
+		timerfd_settime(_timerFD, 0, &its, NULL);
+	}
+#endif
+	
+	return;
+}
+
+void EventWaiter::ClearTimer(void)
+{
+	_timerEnd = (UINT64)-1;
+#if ! defined(_WIN32) && defined(__linux__)
+	if (_timerFD >= 0)
+	{
+		UINT64 expCnt;
+		ssize_t rdBytes = read(_timerFD, &expCnt, sizeof(UINT64));
+		(void)rdBytes;
+	}
+#endif
+	
+	return;
+}
+
+UINT8 EventWaiter::Wait(void)
+{
+	UINT32 timeout;	// in ms, (UINT32)-1 = infinite
+	UINT8 result;
+	
+	timeout = (UINT32)-1;
+	if (_timerEnd != (UINT64)-1)
+	{
+		UINT64 curTime = GetTimeUSec();
+		timeout = (curTime >= _timerEnd) ? 0 : (UINT32)((_timerEnd - curTime + 999) / 1000);
+	}
+	
+	if (! _initialized)
+	{
+		// fallback: behave like the old polling loop
+		Sleep_ms((timeout < 50) ? timeout : 50);
+		if (_timerEnd != (UINT64)-1 && GetTimeUSec() >= _timerEnd)
+		{
+			ClearTimer();
+			return EWAIT_TIMER;
+		}
+		return EWAIT_INPUT;
+	}
+	
+	result = 0x00;
+#ifdef _WIN32
+	HANDLE waitHandles[2];
+	DWORD handleCnt = 0;
+	DWORD waitRes;
+	
+	waitHandles[handleCnt++] = _hWakeEvt;
+	if (_watchInput)
+		waitHandles[handleCnt++] = _hInput;
+	waitRes = WaitForMultipleObjects(handleCnt, waitHandles, FALSE, (timeout == (UINT32)-1) ? INFINITE : timeout);
+	if (waitRes == WAIT_OBJECT_0 + 0)
+		result |= EWAIT_WAKE;
+	else if (waitRes == WAIT_OBJECT_0 + 1 && DrainConsoleInput(_hInput))
+		result |= EWAIT_INPUT;
+#else
+	struct pollfd pfds[3];
+	nfds_t pfdCnt = 0;
+	int pfdInput = -1;
+	int pfdTimer = -1;
+	int pollRes;
+	
+	pfds[pfdCnt].fd = _wakeFD[0];	pfds[pfdCnt].events = POLLIN;	pfdCnt ++;
+	if (_watchInput)
+	{
+		pfdInput = pfdCnt;
+		pfds[pfdCnt].fd = STDIN_FILENO;	pfds[pfdCnt].events = POLLIN;	pfdCnt ++;
+	}
+	if (_timerFD >= 0 && _timerEnd != (UINT64)-1)
+	{
+		pfdTimer = pfdCnt;
+		pfds[pfdCnt].fd = _timerFD;	pfds[pfdCnt].events = POLLIN;	pfdCnt ++;
+		timeout = (UINT32)-1;	// the timerfd takes care of it
+	}
+	pollRes = poll(pfds, pfdCnt, (timeout == (UINT32)-1) ? -1 : (int)timeout);
+	if (pollRes > 0)
+	{
+		if (pfds[0].revents & POLLIN)
+		{
+			// reset the eventfd counter / empty the pipe
+			char buffer[0x10];
+			while(read(_wakeFD[0], buffer, sizeof(buffer)) > 0)
+				;
+			result |= EWAIT_WAKE;
+		}
+		if (pfdInput >= 0 && (pfds[pfdInput].revents & (POLLIN | POLLHUP | POLLERR)))
+			result |= EWAIT_INPUT;
+		if (pfdTimer >= 0 && (pfds[pfdTimer].revents & POLLIN))
+			result |= EWAIT_TIMER;
+	}
+	else if (pollRes < 0 && errno == EINTR)
+	{
+		return 0x00;	// interrupted by a signal handler, e.g. terminal resize
+	}
+#endif
+	if (! (result & EWAIT_TIMER) && _timerEnd != (UINT64)-1 && GetTimeUSec() >= _timerEnd)
+		result |= EWAIT_TIMER;
+	if (result & EWAIT_TIMER)
+		ClearTimer();
+	
+	return result;
+}
@@ -0,0 +1,40 @@
+#ifndef __EVTWAIT_HPP__
+#define __EVTWAIT_HPP__
+
+#include "stdtype.h"
+
+#define EWAIT_INPUT		0x01	// keyboard input is available
+#define EWAIT_WAKE		0x02	// Wake() was called
+#define EWAIT_TIMER		0x04	// timer elapsed
+
+// Lets the main loop sleep until there is keyboard input, a control event or a timer expiry.
+// Linux: poll() on stdin, an eventfd and a timerfd
+// other POSIX systems: poll() on stdin and a pipe
+// Windows: WaitForMultipleObjects() on the console input and an event object
+class EventWaiter
+{
+public:
+	EventWaiter();
+	~EventWaiter();
+	UINT8 Init(bool watchInput);
+	void Deinit(void);
+	void Wake(void);	// thread-safe
+	void SetTimer(UINT32 msec);	// one-shot timer, (UINT32)-1 = disable
+	UINT8 Wait(void);	// returns EWAIT_* flags
+	
+private:
+	void ClearTimer(void);
+	
+	bool _initialized;
+	bool _watchInput;
+	UINT64 _timerEnd;	// in usec, (UINT64)-1 = timer disabled
+#ifdef _WIN32
+	void* _hInput;
+	void* _hWakeEvt;
+#else
+	int _wakeFD[2];	// [0] = read end, [1] = write end (both equal when using eventfd)
+	int _timerFD;	// -1 when not using timerfd
+#endif
+};
+
+#endif	// __EVTWAIT_HPP__
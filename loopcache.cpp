@@ -0,0 +1,161 @@
+#include <string.h>
+#include <vector>
+
+#include "stdtype.h"
+#include "loopcache.hpp"
+
+LoopCache::LoopCache() :
+	_state(LCS_IDLE),
+	_maxSize(0),
+	_smplSize(1),
+	_startPos(0),
+	_loopLen(0),
+	_endSeen(false),
+	_feedValid(false),
+	_feedPos(0)
+{
+}
+
+void LoopCache::Init(UINT64 maxSize, UINT32 smplSize)
+{
+	_maxSize = maxSize;
+	_smplSize = smplSize ? smplSize : 1;
+	Reset();
+	
+	return;
+}
+
+void LoopCache::Reset(void)
+{
+	_state = LCS_IDLE;
+	_startPos = 0;
+	_loopLen = 0;
+	_endSeen = false;
+	_feedValid = false;
+	std::vector<UINT8>().swap(_data);	// free the memory, loops can be quite large
+	
+	return;
+}
+
+void LoopCache::SetFailed(void)
+{
+	_state = LCS_FAILED;
+	std::vector<UINT8>().swap(_data);
+	
+	return;
+}
+
+void LoopCache::LoopJump(UINT32 pos)
+{
+	switch(_state)
+	{
+	case LCS_IDLE:
+		_startPos = pos;
+		_loopLen = 0;
+		_endSeen = false;
+		_data.clear();
+		_state = LCS_RECORD;
+		break;
+	case LCS_RECORD:
+		_loopLen = pos - _startPos;
+		if (pos <= _startPos || _data.size() > (size_t)_loopLen * _smplSize)
+			SetFailed();
+		else
+			_state = LCS_VERIFY;
+		break;
+	case LCS_VERIFY:
+		if (pos - _startPos == _loopLen * 2)
+			_endSeen = true;
+		else
+			SetFailed();	// The second loop has a different length.
+		break;
+	}
+	
+	return;
+}
+
+void LoopCache::Feed(UINT32 pos, UINT32 smplCnt, const void* data)
+{
+	const UINT8* dataPtr = (const UINT8*)data;
+	bool continuous = (_feedValid && pos == _feedPos);
+	UINT32 ofs;
+	
+	_feedPos = pos + smplCnt;
+	_feedValid = true;
+	if (_state != LCS_RECORD && _state != LCS_VERIFY)
+		return;
+	if (pos + smplCnt <= _startPos)
+		return;	// still before the loop jump
+	if (pos > _startPos && ! continuous)
+	{
+		SetFailed();
+		return;
+	}
+	if (pos < _startPos)
+	{
+		UINT32 skipSmpls = _startPos - pos;
+		dataPtr += skipSmpls * _smplSize;
+		smplCnt -= skipSmpls;
+		pos = _startPos;
+	}
+	ofs = pos - _startPos;
+	
+	if (_loopLen == 0 || ofs < _loopLen)
+	{
+		// first loop: record
+		UINT32 recSmpls = smplCnt;
+		if (_loopLen > 0 && recSmpls > _loopLen - ofs)
+			recSmpls = _loopLen - ofs;
+		if ((UINT64)(ofs + recSmpls) * _smplSize > _maxSize)
+		{
+			SetFailed();
+			return;
+		}
+		_data.insert(_data.end(), dataPtr, dataPtr + recSmpls * _smplSize);
+		ofs += recSmpls;
+		dataPtr += recSmpls * _smplSize;
+		smplCnt -= recSmpls;
+	}
+	if (smplCnt > 0)
+	{
+		// second loop: compare with the first one
+		if (ofs + smplCnt > _loopLen * 2)
+		{
+			if (! _endSeen)
+			{
+				SetFailed();	// The second loop is longer than the first one.
+				return;
+			}
+			smplCnt = _loopLen * 2 - ofs;
+		}
+		if (memcmp(&_data[(ofs - _loopLen) * _smplSize], dataPtr, smplCnt * _smplSize))
+		{
+			SetFailed();
+			return;
+		}
+		ofs += smplCnt;
+	}
+	if (_endSeen && ofs >= _loopLen * 2)
+		_state = LCS_READY;
+	
+	return;
+}
+
+void LoopCache::Read(UINT32 pos, UINT32 smplCnt, void* data) const
+{
+	UINT8* dataPtr = (UINT8*)data;
+	UINT32 ofs = (pos - _startPos) % _loopLen;
+	
+	while(smplCnt > 0)
+	{
+		UINT32 readSmpls = _loopLen - ofs;
+		if (readSmpls > smplCnt)
+			readSmpls = smplCnt;
+		memcpy(dataPtr, &_data[ofs * _smplSize], readSmpls * _smplSize);
+		dataPtr += readSmpls * _smplSize;
+		smplCnt -= readSmpls;
+		ofs = 0;
+	}
+	
+	return;
+}
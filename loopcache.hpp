@@ -0,0 +1,49 @@
+#ifndef __LOOPCACHE_HPP__
+#define __LOOPCACHE_HPP__
+
+#include <vector>
+#include "stdtype.h"
+
+// rendered audio of one loop of the song
+// The loop after the first loop jump is recorded and compared with the one after it. When both
+// match, all later loops can be played from here instead of emulating them again.
+// Positions are in samples, as returned by PlayerA::GetCurPos(PLAYPOS_SAMPLE).
+// Not thread-safe.
+class LoopCache
+{
+public:
+	LoopCache();
+	void Init(UINT64 maxSize, UINT32 smplSize);	// maxSize = memory limit in bytes, 0 = disabled
+	void Reset(void);	// forget the recorded loop and wait for the next loop jump
+	bool IsEnabled(void) const	{ return _maxSize > 0; }
+	bool IsReady(void) const	{ return _state == LCS_READY; }
+	UINT32 GetLoopLength(void) const	{ return _loopLen; }
+	void LoopJump(UINT32 pos);	// to be called for each loop jump of the player
+	void Feed(UINT32 pos, UINT32 smplCnt, const void* data);	// to be called for all rendered audio
+	// reads from the loop, pos may be any position after the first loop jump, wraps around at the loop end
+	void Read(UINT32 pos, UINT32 smplCnt, void* data) const;
+	
+private:
+	enum
+	{
+		LCS_IDLE,	// waiting for the first loop jump
+		LCS_RECORD,	// recording the first loop
+		LCS_VERIFY,	// comparing the second loop with the first one
+		LCS_READY,
+		LCS_FAILED	// the loops differ or don't fit into memory
+	};
+	
+	void SetFailed(void);
+	
+	UINT8 _state;
+	UINT64 _maxSize;
+	UINT32 _smplSize;
+	UINT32 _startPos;	// position of the first loop jump
+	UINT32 _loopLen;	// 0 = not known yet
+	bool _endSeen;	// the loop jump at the end of the second loop happened
+	bool _feedValid;
+	UINT32 _feedPos;	// expected position of the next Feed() call
+	std::vector<UINT8> _data;
+};
+
+#endif	// __LOOPCACHE_HPP__
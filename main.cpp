@@ -34,7 +34,6 @@
 #define MAX_PATH	PATH_MAX
 #endif
 
-#include <ini.h>
 #include <getopt.h>
 
 #include "stdtype.h"
@@ -43,11 +42,16 @@
 #include "m3uargparse.hpp"
 #include "config.hpp"
 #include "playcfg.hpp"
+#include "appinit.hpp"
+#include "songindex.hpp"
+#include "songquery.hpp"
 #include "version.h"
 
 
 // from playctrl.cpp
 extern UINT8 PlayerMain(UINT8 showFileName);
+extern UINT8 ScanMain(const std::vector<std::string>& scanDirs);
+extern UINT8 CacheStatsMain(void);
 
 
 struct OptionItem
@@ -61,17 +65,14 @@ struct OptionItem
 typedef std::vector<OptionItem> OptionList;
 
 
-static char* GetAppFilePath(void);
-static void InitAppSearchPaths(const char* argv_0);
 static std::string ReadLineAsUTF8(void);
 
-static int IniValHandler(void* user, const char* section, const char* name, const char* value);
-static UINT8 LoadConfig(const std::string& iniPath, Configuration& cfg);
 static std::string GenerateOptData(const OptionList& optList, std::vector<struct option>* longOpts);
 static void PrintVersion(void);
 static void PrintArgumentHelp(const OptionList& optList);
 static int ParseArguments(int argc, char* argv[], const OptionList& optList, Configuration& argCfg);
 static void PrintLibraryInfo(void);
+static UINT8 QuerySongIndex(const std::vector<std::string>& queries, std::vector<SongFileList>& songList);
 
 
 // can't initialize an std::vector directly in C++98
@@ -82,7 +83,11 @@ static const OptionItem OPT_LIST_ARR[] =
 	{0, 'L', "lib-info",        NULL,     "show libvgm information (supported formats, sound cores)"},
 	{0, 'w', "dump-wav",        NULL,     "enable WAV dumping"},
 	{1, 'W', "dump-path",       "path",   "path of where WAV dumps should be written to"},
+	{1, 'j', "jobs",            "n",      "number of files to dump in parallel (0 = all CPU cores), implies -w"},
 	{1, 'd', "output-device",   "id",     "output device ID"},
+	{1, 's', "scan",            "dir",    "add all songs in a directory (and subdirectories) to the song index"},
+	{1, 'q', "query",           "expr",   "play all indexed songs that match the search expression"},
+	{0, 'S', "cache-stats",     NULL,     "show render cache statistics"},
 	{1, 'c', "config",          "option", "set configuration option, format: section.key=Data"},
 	{1, 'C', "cfg-file",        "path",   "path of config.ini to load, overrides default configuration"},
 };
@@ -90,7 +95,11 @@ static const size_t OPT_LIST_SIZE = sizeof(OPT_LIST_ARR) / sizeof(OPT_LIST_ARR[0
 
 
        std::vector<std::string> appSearchPaths;
+       std::string userCfgDir;
 static std::vector<std::string> cfgFileNames;
+static std::vector<std::string> scanDirs;
+static std::vector<std::string> queryList;
+static bool showCacheStats = false;
        Configuration playerCfg;
 
        std::vector<SongFileList> songList;
@@ -128,7 +137,7 @@ int main(int argc, char* argv[])
 	printf(APP_NAME);
 	printf("\n----------\n");
 	
-	InitAppSearchPaths(argv[0]);
+	userCfgDir = InitAppSearchPaths(argv[0], appSearchPaths);
 	cfgFileNames.push_back("VGMPlay.ini");
 	cfgFileNames.push_back("vgmplay.ini");
 	
@@ -163,9 +172,9 @@ int main(int argc, char* argv[])
 			printf("%s not found - falling back to defaults.\n", cfgFileNames[cfgFileNames.size() - 1].c_str());
 		}
 	}
-
-	playerCfg += argCfg;	// override INI settings with commandline options
 	
+	playerCfg += argCfg;	// override INI settings with commandline options
+
 #if 0	// print current configuration
 	{
 		printf("Config File:\n");
@@ -180,11 +189,33 @@ int main(int argc, char* argv[])
 	}
 #endif
 	
+	if (showCacheStats)
+		return CacheStatsMain();
+	
+	if (! scanDirs.empty())
+	{
+		retVal = ScanMain(scanDirs);
+		if (argbase >= argc && queryList.empty())
+			return retVal;	// scan only
+		printf("\n");
+	}
+	
+	if (! queryList.empty())
+	{
+		retVal = QuerySongIndex(queryList, songList);
+		if (retVal)
+			return 1;
+	}
 	if (argbase < argc)
 	{
 		fnEnterMode = 1;
 		retVal = ParseSongFiles(std::vector<const char*>(argv + argbase, argv + argc), songList, plList);
 	}
+	else if (! queryList.empty())
+	{
+		fnEnterMode = 1;
+		retVal = 0x00;
+	}
 	else
 	{
 		fnEnterMode = 0;
@@ -215,95 +246,6 @@ int main(int argc, char* argv[])
 	return 0;
 }
 
-static char* GetAppFilePath(void)
-{
-	char* appPath;
-	int retVal;
-	
-#ifdef _WIN32
-#ifdef USE_WMAIN
-	std::vector<wchar_t> appPathW;
-	
-	appPathW.resize(MAX_PATH);
-	retVal = GetModuleFileNameW(NULL, &appPathW[0], appPathW.size());
-	if (! retVal)
-		appPathW[0] = L'\0';
-	
-	retVal = WideCharToMultiByte(CP_UTF8, 0, &appPathW[0], -1, NULL, 0, NULL, NULL);
-	if (retVal < 0)
-		retVal = 1;
-	appPath = (char*)malloc(retVal);
-	retVal = WideCharToMultiByte(CP_UTF8, 0, &appPathW[0], -1, appPath, retVal, NULL, NULL);
-	if (retVal < 0)
-		appPath[0] = '\0';
-	appPathW.clear();
-#else
-	appPath = (char*)malloc(MAX_PATH * sizeof(char));
-	retVal = GetModuleFileNameA(NULL, appPath, MAX_PATH);
-	if (! retVal)
-		appPath[0] = '\0';
-#endif
-#else
-	appPath = (char*)malloc(PATH_MAX * sizeof(char));
-	retVal = readlink("/proc/self/exe", appPath, PATH_MAX);
-	if (retVal == -1)
-		appPath[0] = '\0';
-#endif
-	
-	return appPath;
-}
-
-static void InitAppSearchPaths(const char* argv_0)
-{
-	appSearchPaths.clear();
-	
-#ifndef _WIN32
-	// 1. [Unix only] global share directory
-	appSearchPaths.push_back(INSTALL_DATADIR "/vgmplay/");
-#endif
-	
-	// 2. actual application path (potentially resolved symlink)
-	char* appPath = GetAppFilePath();
-	const char* appTitle = GetFileTitle(appPath);
-	if (appTitle != appPath)
-		appSearchPaths.push_back(std::string(appPath, appTitle - appPath));
-	free(appPath);
-	
-	// 3. called path
-	appTitle = GetFileTitle(argv_0);
-	if (appTitle != argv_0)
-	{
-		std::string callPath(argv_0, appTitle - argv_0);
-		if (callPath != appSearchPaths[appSearchPaths.size() - 1])
-			appSearchPaths.push_back(callPath);
-	}
-	
-	// 4. home/config directory
-	std::string cfgDir;
-#ifdef _WIN32
-	cfgDir = getenv("USERPROFILE");
-	cfgDir += "/.vgmplay/";
-#else
-	char* xdgPath = getenv("XDG_CONFIG_HOME");
-	if (xdgPath != NULL && xdgPath[0] != '\0')
-	{
-		cfgDir = xdgPath;
-	}
-	else
-	{
-		cfgDir = getenv("HOME");
-		cfgDir += "/.config";
-	}
-	cfgDir += "/vgmplay/";
-#endif
-	appSearchPaths.push_back(cfgDir);
-	
-	// 5. working directory
-	appSearchPaths.push_back("./");
-	
-	return;
-}
-
 static std::string ReadLineAsUTF8(void)
 {
 	std::string fileName(MAX_PATH, '\0');
@@ -356,38 +298,6 @@ static std::string ReadLineAsUTF8(void)
 }
 
 
-static int IniValHandler(void* user, const char* section, const char* name, const char* value)
-{
-	Configuration* cfg = (Configuration*)user;
-	
-	bool ordered = false;
-	if (! strnicmp(name, "Mute", 4))
-		ordered = true;
-	else if (! strnicmp(name, "Pan", 3))
-		ordered = true;
-	
-	cfg->AddEntry(section, name, value, ordered);
-	
-	return 1;
-}
-
-static UINT8 LoadConfig(const std::string& iniPath, Configuration& cfg)
-{
-	int retVal;
-	
-	retVal = ini_parse(iniPath.c_str(), IniValHandler, &cfg);
-	if (retVal == -2)
-		return 0xF8;	// malloc error
-	else if (retVal == -1)
-		return 0xF0;	// file not found
-	else if (retVal < 0)
-		return 0xFF;	// unknown error
-	else if (retVal > 0)
-		return 0x01;	// parse error
-	else
-		return 0x00;
-}
-
 static std::string GenerateOptData(const OptionList& optList, std::vector<struct option>* longOpts)
 {
 	size_t curOpt;
@@ -503,9 +413,22 @@ static int ParseArguments(int argc, char* argv[], const OptionList& optList, Con
 		case 'W':	// dump-path
 			argCfg.AddEntry("General", "LogPath", optarg);
 			break;
+		case 'j':	// jobs
+			argCfg.AddEntry("General", "LogSound", "1");
+			argCfg.AddEntry("General", "RenderJobs", optarg);
+			break;
 		case 'd':	// output-device
 			argCfg.AddEntry("General", "OutputDevice", optarg);
 			break;
+		case 's':	// scan
+			scanDirs.push_back(optarg);
+			break;
+		case 'q':	// query
+			queryList.push_back(optarg);
+			break;
+		case 'S':	// cache-stats
+			showCacheStats = true;
+			break;
 		case 'c':	// configuration setting
 			{
 				std::string optstr = optarg;
@@ -621,3 +544,50 @@ static void PrintLibraryInfo(void)
 	
 	return;
 }
+
+static UINT8 QuerySongIndex(const std::vector<std::string>& queries, std::vector<SongFileList>& songList)
+{
+	SongIndex songIdx;
+	std::vector<std::string> fileList;
+	size_t curQry;
+	size_t curFile;
+	UINT8 retVal;
+	
+	retVal = songIdx.Load(userCfgDir + SONG_INDEX_FILE);
+	if (retVal)
+	{
+		fprintf(stderr, "Error loading song index!\n");
+		return retVal;
+	}
+	if (! songIdx.GetStoredCount())
+	{
+		printf("The song index is empty. Use --scan to add songs to it.\n");
+		return 0x00;
+	}
+	
+	SongQuery query(songIdx);
+	for (curQry = 0; curQry < queries.size(); curQry ++)
+	{
+		fileList.clear();
+		retVal = query.Run(queries[curQry], fileList);
+		if (retVal)
+		{
+			fprintf(stderr, "Invalid query \"%s\": %s\n", queries[curQry].c_str(), query.GetError().c_str());
+			return retVal;
+		}
+		printf("Query \"%s\": %u %s\n", queries[curQry].c_str(), (unsigned)fileList.size(),
+			(fileList.size() == 1) ? "song" : "songs");
+		
+		for (curFile = 0; curFile < fileList.size(); curFile ++)
+		{
+			SongFileList sfl;
+			sfl.fileName = fileList[curFile];
+			sfl.playlistID = (size_t)-1;
+			sfl.playlistSongID = (size_t)-1;
+			songList.push_back(sfl);
+		}
+	}
+	songIdx.Unload();
+	
+	return 0x00;
+}
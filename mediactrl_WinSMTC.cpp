@@ -259,7 +259,7 @@ static HRESULT PlaybackPosCallback(WinMedia::ISystemMediaTransportControls*, Win
 		return S_FALSE;
 	}
 	
-	mInf->Event(MI_EVT_SEEK_ABS, WinTicks2Samples(tSpan.Duration, mInf->_player));
+	mInf->Event(MI_EVT_SEEK_ABS, WinTicks2Samples(tSpan.Duration, *mInf->_player));
 	return S_OK;
 }
 
@@ -352,8 +352,8 @@ static void SetTrackTime(void)
 	}
 	
 	time0.Duration = 0;
-	songLen.Duration = Time2WinTicks(mInf->_player.GetTotalTime(1));
-	pbPos.Duration = Time2WinTicks(mInf->_player.GetCurTime(1));
+	songLen.Duration = Time2WinTicks(mInf->_player->GetTotalTime(1));
+	pbPos.Duration = Time2WinTicks(mInf->GetCurTime(1));
 	
 	timeProps->put_StartTime(time0);
 	timeProps->put_EndTime(songLen);
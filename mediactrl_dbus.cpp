@@ -266,8 +266,8 @@ static void DBusSendMetadata(DBusMessageIter* dict_root)
 	// Prepare metadata
 	const char* utf8album = mInf->GetSongTagForDisp("GAME"); // Album
 	const char* utf8title = mInf->GetSongTagForDisp("TITLE"); // Title
-	dbus_int64_t songlen = Time2USec(mInf->_player.GetTotalTime(1)); // Length
-	dbus_int64_t looplen = Time2USec(mInf->_player.GetLoopTime()); // Loop point
+	dbus_int64_t songlen = Time2USec(mInf->_player->GetTotalTime(1)); // Length
+	dbus_int64_t looplen = Time2USec(mInf->_player->GetLoopTime()); // Loop point
 	dbus_uint32_t version = mInf->_fileVerNum; // VGM File version
 	const char* utf8artist = mInf->GetSongTagForDisp("ARTIST"); // Artist
 	const char* utf8release = mInf->GetSongTagForDisp("DATE"); // Game release date
@@ -391,7 +391,7 @@ static void DBus_EmitSignal(UINT8 type)
 		msg = dbus_message_new_signal(DBUS_MPRIS_PATH, DBUS_MPRIS_PLAYER, "Seeked");
 
 		dbus_message_iter_init_append(msg, &args);
-		dbus_int64_t response = Time2USec(mInf->_player.GetCurTime(1));
+		dbus_int64_t response = Time2USec(mInf->GetCurTime(1));
 		dbus_message_iter_append_basic(&args, DBUS_TYPE_INT64, &response);
 
 		dbus_connection_send(connection, msg, NULL);
@@ -452,7 +452,7 @@ static void DBus_EmitSignal(UINT8 type)
 			dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY, NULL, &dict_entry);
 				const char* playing = "Position";
 				dbus_message_iter_append_basic(&dict_entry, DBUS_TYPE_STRING, &playing);
-				dbus_int64_t response = Time2USec(mInf->_player.GetCurTime(1));
+				dbus_int64_t response = Time2USec(mInf->GetCurTime(1));
 				DBusReplyWithVariant(&dict_entry, DBUS_TYPE_INT64, DBUS_TYPE_INT64_AS_STRING, &response);
 			dbus_message_iter_close_container(&dict, &dict_entry);
 		}
@@ -631,7 +631,7 @@ static DBusHandlerResult DBusHandler(DBusConnection* connection, DBusMessage* me
 			}
 			else if(!strcmp(method_property_arg, "Position"))
 			{
-				dbus_int64_t response = Time2USec(mInf->_player.GetCurTime(1));
+				dbus_int64_t response = Time2USec(mInf->GetCurTime(1));
 				DBusReplyWithVariant(&args, DBUS_TYPE_INT64, DBUS_TYPE_INT64_AS_STRING, &response);
 			}
 			//Dummy volume
@@ -839,7 +839,7 @@ static DBusHandlerResult DBusHandler(DBusConnection* connection, DBusMessage* me
 					// Field Title
 					title = "Position";
 					dbus_message_iter_append_basic(&dict_entry, DBUS_TYPE_STRING, &title);
-					dbus_int64_t position = Time2USec(mInf->_player.GetCurTime(1));
+					dbus_int64_t position = Time2USec(mInf->GetCurTime(1));
 					DBusReplyWithVariant(&dict_entry, DBUS_TYPE_INT64, DBUS_TYPE_INT64_AS_STRING, &position);
 				dbus_message_iter_close_container(&dict, &dict_entry);
 
@@ -876,7 +876,7 @@ static DBusHandlerResult DBusHandler(DBusConnection* connection, DBusMessage* me
 #ifdef DBUS_DEBUG
 		printf("Seek called with %lld\n", (long long)offset);
 #endif
-		mInf->Event(MI_EVT_SEEK_REL, USec2Samples(offset, mInf->_player));
+		mInf->Event(MI_EVT_SEEK_REL, USec2Samples(offset, *mInf->_player));
 		// the "seeked" signal will be emitted automatically by the player
 		return DBUS_HANDLER_RESULT_HANDLED;
 	}
@@ -924,7 +924,7 @@ static DBusHandlerResult DBusHandler(DBusConnection* connection, DBusMessage* me
 			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 		DBusEmptyMethodResponse(connection, message);
-		mInf->Event(MI_EVT_SEEK_ABS, USec2Samples(pos, mInf->_player));
+		mInf->Event(MI_EVT_SEEK_ABS, USec2Samples(pos, *mInf->_player));
 		// the "seeked" signal will be emitted automatically by the player
 		return DBUS_HANDLER_RESULT_HANDLED;
 	}
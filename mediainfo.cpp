@@ -36,6 +36,13 @@ MediaInfo::MediaInfo()
 	CPConv_Init(&_cpcUTF8toAPI, "UTF-8", "UTF-16LE");
 	CPConv_Init(&_cpcAPItoUTF8, "UTF-16LE", "UTF-8");
 #endif
+	_player = new PlayerA;
+	_wakeCb = NULL;
+	_wakeParam = NULL;
+	_replaySmpls = 0;
+	_loopSmpls = 0;
+	_loopCnt = 0;
+	_loopLen = 0;
 }
 
 MediaInfo::~MediaInfo()
@@ -44,11 +51,12 @@ MediaInfo::~MediaInfo()
 	CPConv_Deinit(_cpcUTF8toAPI);
 	CPConv_Deinit(_cpcAPItoUTF8);
 #endif
+	delete _player;
 }
 
 void MediaInfo::PreparePlayback(void)
 {
-	PlayerBase* player = _player.GetPlayer();
+	PlayerBase* player = _player->GetPlayer();
 	PLR_SONG_INFO sInf;
 	char verStr[0x20];
 	
@@ -173,7 +181,7 @@ static void Tags_LangFilter(std::map<std::string, std::string>& tags, const std:
 
 void MediaInfo::EnumerateTags(void)
 {
-	PlayerBase* player = _player.GetPlayer();
+	PlayerBase* player = _player->GetPlayer();
 	std::vector<std::string> langPostfixes;
 	int defaultLang = _genOpts.preferJapTag ? 1 : 0;
 	
@@ -200,6 +208,38 @@ void MediaInfo::EnumerateTags(void)
 	return;
 }
 
+double MediaInfo::GetCurTime(UINT8 flags) const
+{
+	double curTime = _player->GetCurTime(flags);
+	UINT32 replaySmpls = _replaySmpls;
+	UINT32 loopSmpls = _loopSmpls;
+	UINT32 loopCnt = _loopCnt;
+	
+	if (replaySmpls > 0)
+	{
+		curTime -= replaySmpls / (double)_player->GetSampleRate();
+		if (curTime < 0.0)
+			curTime = 0.0;
+	}
+	if (loopSmpls > 0 || loopCnt > 0)
+	{
+		curTime += loopSmpls / (double)_player->GetSampleRate();
+		if (flags & PLAYTIME_LOOP_INCL)
+		{
+			curTime += (double)loopCnt * _loopLen / _player->GetSampleRate();
+		}
+		else
+		{
+			// wrap around at the song end, like the player does
+			double songTime = _player->GetTotalTime(flags & ~PLAYTIME_WITH_FADE);
+			double loopTime = _player->GetLoopTime();
+			if (loopTime > 0.0 && curTime >= songTime)
+				curTime = songTime - loopTime + fmod(curTime - songTime, loopTime);
+		}
+	}
+	return curTime;
+}
+
 const char* MediaInfo::GetSongTagForDisp(const std::string& tagName)
 {
 	std::map<std::string, std::string>::const_iterator tagIt = _songTags.find(tagName);
@@ -208,7 +248,7 @@ const char* MediaInfo::GetSongTagForDisp(const std::string& tagName)
 
 void MediaInfo::EnumerateChips(void)
 {
-	PlayerBase* player = _player.GetPlayer();
+	PlayerBase* player = _player->GetPlayer();
 	std::vector<PLR_DEV_INFO> diList;
 	
 	player->GetSongDeviceInfo(diList);
@@ -400,7 +440,33 @@ void MediaInfo::RemoveSignalCallback(MI_SIGNAL_CB func, void* param)
 void MediaInfo::Event(UINT8 evtType, INT32 evtParam)
 {
 	EventData ed = {evtType, evtParam};
-	_evtQueue.push(ed);
+	if (! _evtQueue.Push(ed))
+		return;	// queue full - drop the event
+	WakeUp();
+	return;
+}
+
+bool MediaInfo::PopEvent(UINT8& evtType, INT32& evtParam)
+{
+	EventData ed;
+	if (! _evtQueue.Pop(ed))
+		return false;
+	evtType = ed.evt;
+	evtParam = ed.value;
+	return true;
+}
+
+void MediaInfo::SetWakeupCallback(MI_WAKEUP_CB func, void* param)
+{
+	_wakeCb = func;
+	_wakeParam = param;
+	return;
+}
+
+void MediaInfo::WakeUp(void)
+{
+	if (_wakeCb != NULL)
+		_wakeCb(this, _wakeParam);
 	return;
 }
 
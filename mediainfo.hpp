@@ -4,12 +4,12 @@
 #include <string>
 #include <vector>
 #include <map>
-#include <queue>
 
 #include <stdtype.h>
 #include <player/playera.hpp>
 #include <utils/StrUtils.h>
 #include "playcfg.hpp"
+#include "mpscqueue.hpp"
 
 #define MI_SIG_NEW_SONG		0x01	// triggered when a new song starts (-> metadata refresh)
 #define MI_SIG_PLAY_STATE	0x02	// playback status change
@@ -39,6 +39,7 @@
 
 class MediaInfo;
 typedef void (*MI_SIGNAL_CB)(MediaInfo* mInfo, void* userParam, UINT8 signalMask);
+typedef void (*MI_WAKEUP_CB)(MediaInfo* mInfo, void* userParam);
 
 class MediaInfo
 {
@@ -50,10 +51,14 @@ public:
 	void EnumerateTags(void);	// implicitly called by PreparePlayback(), as that one may parse some of the tags
 	void EnumerateChips(void);	// must be called after starting playback in order to retrieve used sound core IDs
 	void SearchAlbumImage(void);
+	double GetCurTime(UINT8 flags) const;	// audible position, takes audio replayed from the seek history into account
 	
 	void AddSignalCallback(MI_SIGNAL_CB func, void* param);
 	void RemoveSignalCallback(MI_SIGNAL_CB func, void* param);	// TODO
-	void Event(UINT8 evtType, INT32 evtParam);
+	void Event(UINT8 evtType, INT32 evtParam);	// thread-safe, may be called from any thread
+	bool PopEvent(UINT8& evtType, INT32& evtParam);	// consumer (main thread) only
+	void SetWakeupCallback(MI_WAKEUP_CB func, void* param);	// called when the main loop has work to do
+	void WakeUp(void);
 	void Signal(UINT8 signalMask);
 	
 private:
@@ -83,7 +88,7 @@ public:
 	volatile UINT8 _playState;
 	GeneralOptions _genOpts;
 	ChipOptions _chipOpts[0x100];
-	PlayerA _player;
+	PlayerA* _player;	// may be replaced by a prepared player while playing (seeking, gapless song changes)
 	
 	std::string _fileFmt;
 	std::string _fileVerStr;
@@ -93,6 +98,10 @@ public:
 	UINT32 _fileStartPos;
 	UINT32 _fileEndPos;
 	double _volGain;
+	volatile UINT32 _replaySmpls;	// the player is this many samples ahead of the audible position
+	volatile UINT32 _loopSmpls;	// the audible position is this many samples ahead of the player (loop cache)
+	volatile UINT32 _loopCnt;	// plus this many loops of _loopLen samples, so that _loopSmpls stays below one loop
+	volatile UINT32 _loopLen;
 	
 	std::vector<DeviceItem> _chipList;
 	std::map<std::string, std::string> _songTags;
@@ -111,7 +120,9 @@ public:
 #endif
 	
 	std::vector<SignalHandler> _sigCb;
-	std::queue<EventData> _evtQueue;
+	MPSCQueue<EventData, 0x40> _evtQueue;
+	MI_WAKEUP_CB _wakeCb;
+	void* _wakeParam;
 	bool _enableAlbumImage;
 };
 
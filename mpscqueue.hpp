@@ -0,0 +1,74 @@
+#ifndef __MPSCQUEUE_HPP__
+#define __MPSCQUEUE_HPP__
+
+#include "stdtype.h"
+#include "atomics.hpp"
+
+// bounded lock-free multi-producer/single-consumer queue
+// Each slot carries a sequence number that tells whether it is free, being written or ready to be read.
+// CAPACITY must be a power of 2.
+template<typename T, UINT32 CAPACITY>
+class MPSCQueue
+{
+public:
+	MPSCQueue() : _enqPos(0), _deqPos(0)
+	{
+		for (UINT32 curSlot = 0; curSlot < CAPACITY; curSlot ++)
+			_slots[curSlot].seq = curSlot;
+	}
+	
+	// returns false when the queue is full
+	bool Push(const T& item)
+	{
+		UINT32 pos = Atomic_LoadU32(&_enqPos);
+		Slot* slot;
+		
+		while(true)
+		{
+			slot = &_slots[pos & (CAPACITY - 1)];
+			INT32 seqDiff = (INT32)(Atomic_LoadU32(&slot->seq) - pos);
+			if (seqDiff == 0)
+			{
+				if (Atomic_CompareSwapU32(&_enqPos, pos, pos + 1))
+					break;	// slot reserved
+				pos = Atomic_LoadU32(&_enqPos);
+			}
+			else if (seqDiff < 0)
+			{
+				return false;	// slot wasn't read yet
+			}
+			else
+			{
+				pos = Atomic_LoadU32(&_enqPos);	// another producer was faster
+			}
+		}
+		slot->data = item;
+		Atomic_StoreU32(&slot->seq, pos + 1);	// publish
+		return true;
+	}
+	
+	// consumer side, returns false when the queue is empty
+	bool Pop(T& item)
+	{
+		Slot* slot = &_slots[_deqPos & (CAPACITY - 1)];
+		INT32 seqDiff = (INT32)(Atomic_LoadU32(&slot->seq) - (_deqPos + 1));
+		if (seqDiff < 0)
+			return false;	// empty or not yet published
+		item = slot->data;
+		Atomic_StoreU32(&slot->seq, _deqPos + CAPACITY);	// make the slot available for the next round
+		_deqPos ++;
+		return true;
+	}
+	
+private:
+	struct Slot
+	{
+		volatile UINT32 seq;
+		T data;
+	};
+	Slot _slots[CAPACITY];
+	volatile UINT32 _enqPos;
+	UINT32 _deqPos;	// only used by the consumer
+};
+
+#endif	// __MPSCQUEUE_HPP__
@@ -261,8 +261,12 @@ static void ParseCfg_General(GeneralOptions& opts, const CfgSection& cfg)
 	opts.fadeTime_plist =	(UINT32)Cfg_GetUIntOrDefault(ceList, "FadeTimePL", 2000);
 	opts.pauseTime_jingle =	(UINT32)Cfg_GetUIntOrDefault(ceList, "JinglePause", 1000);
 	opts.pauseTime_loop =	(UINT32)Cfg_GetUIntOrDefault(ceList, "FadePause", 0);
+	opts.gaplessPb =		  (bool)Cfg_GetBoolOrDefault(ceList, "GaplessPlayback", false);
 	
 	opts.pbMode =			 (UINT8)Cfg_GetUIntOrDefault(ceList, "LogSound", 0);
+	opts.renderJobs =		(UINT32)Cfg_GetUIntOrDefault(ceList, "RenderJobs", 1);
+	opts.segmentLen =		(UINT32)Cfg_GetUIntOrDefault(ceList, "SegmentLength", 0);
+	opts.segmentWarmup =	(UINT32)Cfg_GetUIntOrDefault(ceList, "SegmentWarmup", 5);
 	opts.wavLogPath =		        Cfg_GetStrOrDefault (ceList, "LogPath", "");
 	opts.soundWhilePaused =	  (bool)Cfg_GetBoolOrDefault(ceList, "EmulatePause", false);
 	opts.pseudoSurround =	  (bool)Cfg_GetBoolOrDefault(ceList, "SurroundSound", false);
@@ -287,6 +291,17 @@ static void ParseCfg_General(GeneralOptions& opts, const CfgSection& cfg)
 		opts.audDriverID = (UINT32)-1;
 	opts.audBufCnt =		(UINT32)Cfg_GetUIntOrDefault(ceList, "AudioBuffers", 0);
 	opts.audBufTime =		(UINT32)Cfg_GetUIntOrDefault(ceList, "AudioBufferSize", 0);
+	opts.renderAhead =		(UINT32)Cfg_GetUIntOrDefault(ceList, "RenderAhead", 100);
+	opts.prefetchMem =		(UINT32)Cfg_GetUIntOrDefault(ceList, "PrefetchMemory", 64);
+	opts.seekHistory =		(UINT32)Cfg_GetUIntOrDefault(ceList, "SeekHistory", 60);
+	opts.loopCache =		(UINT32)Cfg_GetUIntOrDefault(ceList, "LoopCache", 0);
+	opts.renderCache =		(UINT32)Cfg_GetUIntOrDefault(ceList, "RenderCache", 0);
+	opts.renderCacheDir =	        Cfg_GetStrOrDefault (ceList, "RenderCacheDir", "");
+	opts.songIndex =		  (bool)Cfg_GetBoolOrDefault(ceList, "SongIndex", false);
+	opts.chipTiming =		  (bool)Cfg_GetBoolOrDefault(ceList, "ChipTiming", false);
+	opts.chipTimingLog =	        Cfg_GetStrOrDefault (ceList, "ChipTimingLog", "");
+	opts.audioStats =		  (bool)Cfg_GetBoolOrDefault(ceList, "AudioStats", false);
+	opts.audioStatsLog =	        Cfg_GetStrOrDefault (ceList, "AudioStatsLog", "");
 	opts.audOutDev =		(UINT32)Cfg_GetUIntOrDefault(ceList, "OutputDevice", 0);
 	
 	return;
@@ -566,6 +581,7 @@ static void ParseCfg_ChipSection(ChipOptions& opts, const CfgSection& cfg, UINT8
 	}	// end for (ceoIt)
 	
 	opts.chipDisable = Cfg_GetBoolOrDefault(ceuList, "Disabled", false) ? 0x01 : 0x00;
+	opts.seekRender = Cfg_GetBoolOrDefault(ceuList, "SeekRender", false);
 	{
 		UINT8 emuType = (UINT8)Cfg_GetUIntOrDefault(ceuList, "EmulatorType", 0xFF);
 		// select emuCore based on number
@@ -23,9 +23,13 @@ struct GeneralOptions
 	UINT32 fadeTime_plist;
 	UINT32 pauseTime_jingle;
 	UINT32 pauseTime_loop;
+	bool gaplessPb;	// switch between songs of the same playlist without gaps
 	
 	std::string wavLogPath;
 	UINT8 pbMode;	// playback mode (0 = play, 1 = log to WAV, 2 = play+log)
+	UINT32 renderJobs;	// number of files rendered in parallel in "log only" mode (0 = one per CPU core)
+	UINT32 segmentLen;	// "log only" mode: minimum length of song segments rendered in parallel, in seconds (0 = disabled)
+	UINT32 segmentWarmup;	// rendered before each segment and thrown away, in seconds
 	bool soundWhilePaused;
 	bool pseudoSurround;
 	bool preferJapTag;
@@ -45,6 +49,17 @@ struct GeneralOptions
 	UINT32 audOutDev;
 	UINT32 audBufCnt;
 	UINT32 audBufTime;
+	UINT32 renderAhead;	// render thread lookahead in ms (0 = render in the audio callback)
+	UINT32 prefetchMem;	// memory limit for loading the next song in the background, in MB (0 = disabled)
+	UINT32 seekHistory;	// amount of played audio kept for seeking backwards, in seconds (0 = disabled)
+	UINT32 loopCache;	// memory limit for replaying loops of endlessly looping songs, in MB (0 = disabled)
+	UINT32 renderCache;	// size limit of the on-disk cache of rendered songs, in MB (0 = disabled)
+	std::string renderCacheDir;	// empty = "rendercache" in the user's config directory
+	bool songIndex;	// keep song lengths/tags in an index file in the user's config directory
+	bool chipTiming;	// measure render time per song (can be toggled during playback)
+	std::string chipTimingLog;	// file that per-song timing results are appended to
+	bool audioStats;	// show audio callback statistics (can be toggled during playback)
+	std::string audioStatsLog;	// file that per-song audio callback statistics are appended to
 };
 struct ChipOptions
 {
@@ -56,6 +71,7 @@ struct ChipOptions
 	UINT32 muteMask[2];
 	double panMask[2][32];
 	UINT32 addOpts;
+	bool seekRender;	// seek by rendering the skipped audio (for cores that need it to end up in the right state)
 };
 
 class Configuration;
@@ -5,6 +5,7 @@
 #include <ctype.h>
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <math.h>
 
 #ifndef M_LN2
@@ -30,6 +31,9 @@ extern "C" int __cdecl _kbhit(void);
 
 #ifdef _MSC_VER
 #define snprintf	_snprintf
+#define stricmp		_stricmp
+#else
+#define stricmp		strcasecmp
 #endif
 
 #include <stdtype.h>
@@ -44,15 +48,33 @@ extern "C" int __cdecl _kbhit(void);
 #include <audio/AudioStream.h>
 #include <audio/AudioStream_SpcDrvFuns.h>
 #include <utils/OSMutex.h>
+#include <utils/OSThread.h>
+#include <utils/OSSignal.h>
 #include <utils/StrUtils.h>
 
 #include "utils.hpp"
 #include "config.hpp"
 #include "m3uargparse.hpp"
 #include "playcfg.hpp"
+#include "appinit.hpp"
 #include "mediainfo.hpp"
 #include "version.h"
 #include "mediactrl.hpp"
+#include "ringbuffer.hpp"
+#include "audiostats.hpp"
+#include "evtwait.hpp"
+#include "seekhist.hpp"
+#include "loopcache.hpp"
+#include "rendercache.hpp"
+#include "romcache.hpp"
+#include "songindex.hpp"
+
+
+struct IndexScanWorker
+{
+	OS_THREAD* hThread;
+	MediaInfo* mInfo;
+};
 
 
 struct AudioDriver
@@ -66,14 +88,96 @@ struct AudioDriver
 };
 
 
+struct BatchWorker
+{
+	OS_THREAD* hThread;
+	MediaInfo* mInfo;		// each worker has its own player instance
+	void* drvLog;			// WAV writer driver instance
+	std::vector<UINT8> smplBuf;
+	UINT32 smplSize;
+	UINT32 songCnt;			// number of successfully rendered songs
+};
+
+// part of a song that is rendered by one thread (SegmentLength setting)
+struct SegmentJob
+{
+	OS_THREAD* hThread;
+	BatchWorker* bw;
+	size_t songIdx;
+	UINT32 startPos;		// in samples
+	UINT32 endPos;			// (UINT32)-1 = until the song ends
+	std::string tmpFile;	// rendered audio of the segment
+	std::vector<UINT8> headData;	// start of the segment
+	std::vector<UINT8> tailData;	// audio after endPos, must match the next segment's headData
+	UINT8 status;
+};
+
+
 UINT8 PlayerMain(UINT8 showFileName);
+UINT8 ScanMain(const std::vector<std::string>& scanDirs);
+UINT8 CacheStatsMain(void);
+static void FindSongFiles(const std::string& dirPath, std::vector<std::string>& fileList, std::vector<std::string>& failDirs);
 static bool AdvanceSongList(size_t& songIdx, int controlVal);
 static DATA_LOADER* GetFileLoaderUTF8(const std::string& fileName);
-static UINT8 OpenFile(const std::string& fileName, DATA_LOADER*& dLoad, PlayerBase*& player);
-static void PreparePlayback(void);
+static void InitPlayerEngines(MediaInfo& mInfo);
+static UINT8 OpenFile(const std::string& fileName, DATA_LOADER*& dLoad, PlayerA& player);
+static UINT8 LoadFileToPlayer(DATA_LOADER* dLoad, PlayerA& player);
+static UINT8 StartPrefetchThread(void);
+static void StopPrefetchThread(void);
+static void PrefetchThread(void* args);
+static UINT8 PrefetchLoadData(DATA_LOADER* dLoad);
+static void PrefetchAlbumImage(size_t songIdx, DATA_LOADER* dLoad, std::string& imgPath);
+static void PrefetchSong(size_t songIdx);
+static void WaitForPrefetch(void);
+static void CancelPrefetch(void);
+static DATA_LOADER* TakePrefetchedSong(size_t songIdx, bool& hasAlbumImg, std::string& albumImgPath);
+static DATA_LOADER* LoadSongInBackground(size_t songIdx, bool& hasAlbumImg, std::string& albumImgPath, bool& aborted);
+static bool IsGaplessTransition(size_t songIdx);
+static void ArmGaplessSwitch(void);
+static void FreeGaplessSong(void);
+static bool GaplessSwitch(void);
+static void PreparePlayback(MediaInfo& mInfo, PlayerA& myPlayer, size_t songIdx);
+static UINT32 CheckRawLogFade(MediaInfo& mInfo);
+static UINT32 RenderOfflineBlock(MediaInfo& mInfo, UINT32 bufSize, UINT8* data, UINT32 smplSize);
+static UINT32 GetSongLengthEstimate(const std::string& fileName, UINT32 maxLoops);
+static std::string GetIndexPath(const std::string& fileName);
+static bool LookupSongIndex(const std::string& fileName, SongIndexEntry& sie);
+static bool GetSongIndexInfo(PlayerA& player, SongIndexEntry& sie);
+static void AddSongToIndex(SongIndexEntry& sie, DATA_LOADER* dLoad, const std::string& fileName);
+static void AddSongToIndex(PlayerA& player, DATA_LOADER* dLoad, const std::string& fileName);
+static double GetIndexedSongLength(const SongIndexEntry& sie, UINT32 maxLoops);
+static void CloseSongIndex(void);
+static UINT8 StartIndexScan(UINT32 thrCnt);
+static void StopIndexScan(bool cancel);
+static void IndexScanThread(void* args);
+static UINT8 ScanSongFile(MediaInfo& mInfo, size_t fileIdx);
+static std::string GetPlaylistLengthStr(size_t playlistID);
+static void StartChipTiming(void);
+static void StopChipTiming(bool showResult);
+static std::string GetChipTimingStr(void);
+static void WriteChipTimingLog(double songTime, double cpuLoad);
+static std::string GetAudioStatsStr(void);
+static std::string GetHistogramStr(const UINT32* hist);
+static void PrintAudioStats(const AudioCallbackStats::Summary& sum);
+static void WriteAudioStatsLog(const AudioCallbackStats::Summary& sum);
+static std::string GetJSONSongPath(void);
+static UINT8 BatchRenderMain(UINT32 jobCount);
+static void BatchRenderThread(void* args);
+static UINT8 BatchRenderSong(BatchWorker& bw, size_t songIdx);
+static MediaInfo* CreateBatchPlayer(const AUDIO_OPTS* logOpts);
+static UINT8 SegmentRenderMain(UINT32 jobCount);
+static UINT8 SegmentRenderSong(std::vector<BatchWorker>& workers, size_t songIdx);
+static void SegmentRenderThread(void* args);
+static UINT8 RenderSegmentData(BatchWorker& bw, UINT32 smplCnt, FILE* hFile, std::vector<UINT8>* data, size_t dataSize);
+static UINT8 JoinSegments(BatchWorker& bw, const std::string& outFName, const std::vector<SegmentJob>& segments);
 static void ShowSongInfo(void);
 static void ShowConsoleTitle(void);
+static void ShowPlaybackStatus(void);
 static UINT8 PlayFile(void);
+static UINT8 PlayFileOffline(void);
+static void CheckSongEnd(void);
+static UINT8 ProcessControls(void);
+static void MainLoopWakeup(MediaInfo* mInfo, void* userParam);
 static UINT8 HandleCtrlEvent(UINT8 evtType, INT32 evtParam);
 
 static int GetPressedKey(void);
@@ -82,6 +186,41 @@ static INT8 GetTimeDispMode(double seconds);
 static std::string GetTimeStr(double seconds, INT8 showHours = 0);
 static UINT32 FillBuffer(void* drvStruct, void* userParam, UINT32 bufSize, void* Data);
 static UINT32 FillBufferDummy(void* drvStruct, void* userParam, UINT32 bufSize, void* data);
+static UINT32 FillBufferFromRing(void* drvStruct, void* userParam, UINT32 bufSize, void* data);
+static void RenderThread(void* args);
+static UINT32 RenderToRing(void);
+static inline UINT32 RenderTimed(PlayerA& player, UINT32 bufSize, void* data);
+static inline void DiscardRenderAhead(void);
+static void SeekPlayer(UINT8 unit, UINT32 pos);
+static bool SeekInRenderedAudio(UINT32 destPos);
+static bool NeedsRenderedSeek(void);
+static void StartRenderedSeek(UINT32 destPos);
+static bool RenderSeekBlock(void);
+static void StopReplay(bool seekBack);
+static void ClearSeekHistory(void);
+static void StartLoopReplay(void);
+static void StopLoopReplay(bool resync);
+static std::string GetRenderCacheDir(void);
+static UINT64 GetRenderCacheKey(PlayerA& myPlayer, DATA_LOADER* dLoad);
+static void StartRenderCache(UINT64 key);
+static void StopRenderCache(bool resync);
+static void RequestSeek(UINT8 unit, UINT32 pos);
+static UINT32 GetSeekBasePos(void);
+static void SeekThread(void* args);
+static void ProcessSeekRequest(std::vector<UINT8>& renderBuf);
+static bool IsSeekCancelled(UINT32 gen);
+static bool PrepareSeekPlayer(DATA_LOADER* dLoad, const PlayerA::Config& pCfg);
+static bool RenderSeekPlayer(UINT32 destPos, UINT32 gen, std::vector<UINT8>& buf);
+static void SwapSeekPlayer(void);
+static void CancelSeekRequest(void);
+static void WaitForSeekThread(void);
+static void ResetSeekPlayer(void);
+static PlayerA* CreateSparePlayer(UINT32 smplRate, UINT32 smplAlloc);
+static void DeleteSparePlayer(PlayerA* player);
+static UINT8 StartSeekThread(UINT32 smplRate, UINT32 smplAlloc);
+static void StopSeekThread(void);
+static UINT8 StartRenderThread(UINT32 smplRate, UINT32 smplSize, UINT32 blockSize);
+static void StopRenderThread(void);
 static UINT8 FilePlayCallback(PlayerBase* player, void* userParam, UINT8 evtType, void* evtParam);
 static DATA_LOADER* PlayerFileReqCallback(void* userParam, PlayerBase* player, const char* fileName);
 static void PlayerLogCallback(void* userParam, PlayerBase* player, UINT8 level, UINT8 srcType,
@@ -92,6 +231,7 @@ static UINT8 InitAudioSystem(void);
 static UINT8 DeinitAudioSystem(void);
 static UINT8 StartAudioDevice(void);
 static UINT8 StopAudioDevice(void);
+static std::string GetWavLogFileName(const std::string& songFileName);
 static UINT8 StartDiskWriter(const std::string& songFileName);
 static UINT8 StopDiskWriter(void);
 static void InitMediaControls(void);
@@ -115,12 +255,83 @@ static void cls(void);
 #define KEY_SHIFT		0x2000
 #define KEY_ALT			0x4000
 
+#define STATUS_REFRESH_TIME	50	// status line update interval during playback, in ms
+#define OFFLINE_CTRL_INTERVAL	200	// check keys/update display every 200 ms when rendering offline
+#define ROM_CACHE_SIZE	0x4000000	// keep up to 64 MB of unused sample ROMs in memory
+#define SEGMENT_CHECK_TIME	1	// amount of audio (in seconds) that is compared at segment borders
+
+#ifndef LIBVGM_VER_STR
+#define LIBVGM_VER_STR	""	// set by the build system when libvgm provides its version
+#endif
+
 
 static AudioDriver adOut /*= {ADRVTYPE_OUT, -1, "", 0, 0, NULL}*/;
 static AudioDriver adLog /*= {ADRVTYPE_DISK, -1, "", 0, 0, NULL}*/;
 
 static std::vector<UINT8> audioBuf;
 static OS_MUTEX* renderMtx;	// render thread mutex
+static OS_MUTEX* startMtx;	// serializes PlayerA::Start(), some sound cores initialize global tables there
+
+// "render ahead" mode: a separate thread renders into renderRing, the audio callback only copies from there
+static RingBuffer renderRing;
+static OS_THREAD* renderThread = NULL;
+static OS_SIGNAL* renderSignal = NULL;	// wakes the render thread up when there is space in the ring buffer
+static volatile bool renderThrStop;
+static volatile bool renderRingActive = false;
+static UINT32 renderBlkSize;	// number of bytes rendered at once
+
+static AudioCallbackStats cbStats;	// timing of the audio callback, reset for every song
+static bool showAudioStats = false;	// AudioStats setting, toggled with L
+
+// When seeking back, the render thread replays audio from seekHist until it reaches the player's position again.
+// All of these are protected by renderMtx.
+static SeekHistory seekHist;
+static UINT32 replayPos;	// replay position in samples
+static UINT32 replayEnd;	// player position, replayPos == replayEnd: no replay active
+
+// When looping endlessly, the render thread records one loop in loopCache. Once it was verified,
+// the player stays where it is and the audio is read from the cache.
+// All of these are protected by renderMtx.
+static LoopCache loopCache;
+static bool loopReplay = false;
+static UINT32 loopReplayPos;	// read position, kept within [player position, player position + loop length)
+
+// Songs that were played from start to end are stored in renderCache. When a song is found there,
+// the player stays at the song start and the audio is read from the cache.
+// All of these are protected by renderMtx.
+static RenderCache renderCache;
+static bool cacheReplay = false;
+static UINT32 cacheReplayPos;	// read position, 0 = song start
+static UINT32 cacheStartPos;	// player position at the song start
+static volatile bool cacheReplayEnd = false;	// the end of the cached song was reached
+
+// Seeks are done asynchronously by the seek thread on a second player. Until they are finished,
+// the render thread keeps playing the old position. Then both players are swapped.
+struct SeekRequest
+{
+	bool pending;
+	bool busy;	// the seek thread is working on the request
+	UINT8 unit;	// PLAYPOS_SAMPLE or PLAYPOS_TICK
+	UINT32 pos;
+};
+static SeekRequest seekReq;	// protected by seekMtx
+static UINT32 seekGen;	// changed when a seek that is being prepared must not be used, protected by seekMtx
+static OS_MUTEX* seekMtx;
+static OS_THREAD* seekThread = NULL;
+static OS_SIGNAL* seekSignal = NULL;	// new request
+static OS_SIGNAL* seekIdleSignal = NULL;	// request finished
+static volatile bool seekThrStop;
+static volatile bool seekDone = false;	// tells the main thread to send a "position changed" signal
+static PlayerA* seekPlayer = NULL;	// only used by the seek thread, except for swapping it with mediaInfo._player
+static DATA_LOADER* seekPlayerData;	// song that is loaded into seekPlayer
+
+// SeekRender without render thread: the player is rendered up to seekRenderEnd one block at a time
+// and the audio is thrown away.
+// All of these are protected by renderMtx.
+static bool seekRendering = false;
+static UINT32 seekRenderEnd;
+static UINT32 seekRenderSmplSize;	// bytes per sample of the player's output
+static std::vector<UINT8> seekRenderBuf;
 
 #ifdef _WIN32
 static CPCONV* cpcU8_Wide;
@@ -135,6 +346,7 @@ static bool dummyRenderAtLoad = false;
 static INT8 timeDispMode = 0;
 
 extern std::vector<std::string> appSearchPaths;
+extern std::string userCfgDir;
 extern Configuration playerCfg;
 extern std::vector<SongFileList> songList;
 extern std::vector<PlaylistFileList> plList;
@@ -143,24 +355,108 @@ static int controlVal;
 static size_t curSong;
 
 static MediaInfo mediaInfo;
+static RomCache romCache;	// files requested by the players, shared by all player instances
+static SongIndex songIndex;	// lengths/tags of all songs that were played or scanned
 static MediaControl* mediaCtrl = NULL;
+static EventWaiter evtWaiter;	// lets the main loop sleep until there is something to do
 static INT32 masterVol;
 static double masterSpeed;
 static INT32 noDispTime;
 static bool pauseAfterEnd;
 static bool quitAfterEnd;
 
+#define PFSTAT_IDLE		0x00
+#define PFSTAT_QUEUED	0x01
+#define PFSTAT_LOADING	0x02
+#define PFSTAT_READY	0x03
+#define PFSTAT_FAILED	0x04
+#define PFSTAT_PARTIAL	0x05	// exceeds the memory budget, the player loads the rest
+struct PrefetchState
+{
+	size_t songIdx;	// (size_t)-1 = nothing requested
+	DATA_LOADER* dLoad;
+	bool searchAlbumImg;
+	std::string albumImgPath;
+	UINT8 status;	// PFSTAT_*
+};
+// The prefetch thread loads the next song's data while the current one is playing.
+static PrefetchState prefetch;
+static MediaInfo* prefetchInfo = NULL;	// used for parsing tags for the album image search
+static OS_THREAD* prefetchThread = NULL;
+static OS_MUTEX* prefetchMtx;	// protects "prefetch"
+static OS_SIGNAL* prefetchReqSignal;	// new request
+static OS_SIGNAL* prefetchDoneSignal;	// request finished
+static volatile bool prefetchStop;
+static volatile bool prefetchCancel;
+
+struct GaplessState
+{
+	size_t songIdx;	// song to switch to, (size_t)-1 = not armed
+	DATA_LOADER* dLoad;	// its already loaded data
+	PlayerA* player;	// started player for the song, after the switch: the previous song's player
+	UINT64 cacheKey;	// render cache key of the song
+	bool hasAlbumImg;
+	std::string albumImgPath;
+	UINT32 fileStartPos;
+	volatile bool switched;	// set by the render thread when the next song was started
+};
+// gapless mode: The main thread prepares the next song on a second player. The render thread
+// swaps the players as soon as the current song ends.
+// All members are protected by renderMtx.
+static GaplessState gapless;
+static bool gaplessNext = false;	// the current song was started by the render thread
+static PlayerA* gaplessPlayer = NULL;	// unused player for preparing the next song, main thread only
+static volatile bool gaplessSwitching = false;	// the song ended, the next one isn't in the ring buffer yet
+
+// Files are added to the song index by multiple scan threads.
+// During playback, the songs of the song list are scanned in the background to get the total playlist lengths.
+static std::vector<IndexScanWorker> scanWorkers;
+static std::vector<std::string> scanFiles;
+static std::vector<double> songLengths;	// per scanFiles entry, in seconds, < 0 = unknown, protected by scanMtx
+static size_t scanNextFile;
+static size_t scanDoneCnt;	// number of processed files
+static size_t scanNewCnt;	// number of files that had to be parsed
+static size_t scanFailCnt;
+static OS_MUTEX* scanMtx = NULL;
+static volatile bool scanStop;
+
+// render time measurement (ChipTiming setting, toggled with T)
+// For a breakdown by sound chip, use "vgmplay-bench --per-chip".
+static volatile bool chipTimingOn = false;
+static UINT64 chipRenderTime;	// time spent in PlayerA::Render() for the current song, in microseconds
+static UINT64 chipRenderSmpls;
+static UINT32 chipPeakLoad;	// render time of the slowest block, in percent of its duration
+static UINT32 chipSmplSize;
+// all of the above are protected by renderMtx
+static DATA_LOADER* curSongData = NULL;	// data of the current song, for seekPlayer
+
+static std::vector<size_t> batchQueue;	// song IDs, longest song first
+static size_t batchNextJob;
+static size_t batchDoneCnt;
+static OS_MUTEX* batchMtx;
+
 static inline UINT32 MSec2Samples(UINT32 val, const PlayerA& player)
 {
 	return (UINT32)(((UINT64)val * player.GetSampleRate() + 500) / 1000);
 }
 
+static inline UINT16 ReadLE16(const UINT8* data)
+{
+	return (data[0x01] << 8) | (data[0x00] << 0);
+}
+
+static inline UINT32 ReadLE32(const UINT8* data)
+{
+	return	(data[0x03] << 24) | (data[0x02] << 16) |
+			(data[0x01] <<  8) | (data[0x00] <<  0);
+}
+
 UINT8 PlayerMain(UINT8 showFileName)
 {
-	PlayerA& myPlayer = mediaInfo._player;
 	GeneralOptions& genOpts = mediaInfo._genOpts;
 	UINT8 retVal;
 	UINT8 fnShowMode;
+	DATA_LOADER* dLoad;
 	
 #ifdef ENABLE_WINRT
 	// The Windows Runtime (with COM) MUST be initialized before the audio API,
@@ -209,27 +505,41 @@ UINT8 PlayerMain(UINT8 showFileName)
 	}
 #endif
 #endif
+	romCache.Init(ROM_CACHE_SIZE);
+	if (genOpts.songIndex)
+		songIndex.Load(userCfgDir + SONG_INDEX_FILE);	// errors result in an empty index that is recreated
 	
-	// I'll keep the instances of the players for the program's life time.
-	// This way player/chip options are kept between track changes.
-	myPlayer.RegisterPlayerEngine(new VGMPlayer);
-	myPlayer.RegisterPlayerEngine(new S98Player);
-	myPlayer.RegisterPlayerEngine(new DROPlayer);
-	myPlayer.RegisterPlayerEngine(new GYMPlayer);
-	myPlayer.SetEventCallback(FilePlayCallback, NULL);
-	myPlayer.SetFileReqCallback(PlayerFileReqCallback, NULL);
-	myPlayer.SetLogCallback(PlayerLogCallback, NULL);
-	ApplyCfg_General(myPlayer, genOpts);
-	for (size_t curChp = 0; curChp < 0x100; curChp ++)
+	if (genOpts.pbMode == 1 && genOpts.renderJobs != 1 && adLog.data != NULL)
 	{
-		const ChipOptions& cOpt = mediaInfo._chipOpts[curChp];
-		if (cOpt.chipType == 0xFF)
-			continue;
-		ApplyCfg_Chip(myPlayer, genOpts, cOpt);
+		// "log only" mode with multiple jobs: render files in parallel, no interactive playback
+		UINT32 jobCount = genOpts.renderJobs ? genOpts.renderJobs : GetCPUCoreCount();
+		if (genOpts.segmentLen > 0 && songList.size() < jobCount)
+			SegmentRenderMain(jobCount);	// not enough files to keep all threads busy
+		else
+			BatchRenderMain(jobCount);
+		if (genOpts.logLvlFile >= PLRLOG_DEBUG && romCache.GetHitCount() + romCache.GetMissCount() > 0)
+			printf("ROM cache: %u hits, %u misses\n", romCache.GetHitCount(), romCache.GetMissCount());
+		romCache.Deinit();
+		CloseSongIndex();
+		
+#ifdef _WIN32
+		CPConv_Deinit(cpcU8_Wide);
+#if ! HAVE_FILELOADER_W
+		CPConv_Deinit(cpcU8_ACP);
+#endif
+#endif
+		StopAudioDevice();
+		DeinitAudioSystem();
+		return 0;
 	}
+	
+	// I'll keep the instances of the players for the program's life time.
+	// This way player/chip options are kept between track changes.
+	InitPlayerEngines(mediaInfo);
+	mediaInfo._player->SetEventCallback(FilePlayCallback, &mediaInfo);
 	mediaInfo._pbSongCnt = songList.size();
-	masterVol = myPlayer.GetMasterVolume();
-	masterSpeed = myPlayer.GetPlaybackSpeed();
+	masterVol = mediaInfo._player->GetMasterVolume();
+	masterSpeed = mediaInfo._player->GetPlaybackSpeed();
 	
 	mediaInfo._enableAlbumImage = false;	// disable by default, MediaCtrl objects will enable it on demand
 	//mediaInfo.AddSignalCallback(SignalCB, NULL);
@@ -237,15 +547,43 @@ UINT8 PlayerMain(UINT8 showFileName)
 	InitMediaControls();
 	
 #ifndef _WIN32
+	setvbuf(stdin, NULL, _IONBF, 0);	// else buffered key codes would be invisible to poll()
 	changemode(1);
 #endif
+	retVal = evtWaiter.Init(true);
+	if (retVal)
+		fprintf(stderr, "Warning: Event notification init failed - falling back to polling.\n");
+	mediaInfo.SetWakeupCallback(MainLoopWakeup, NULL);
+	if (genOpts.prefetchMem > 0)
+	{
+		retVal = StartPrefetchThread();
+		if (retVal)
+			fprintf(stderr, "Warning: Unable to start prefetch thread (error 0x%02X)\n", retVal);
+	}
+	if (songIndex.IsLoaded() && fnShowMode == 0)
+	{
+		UINT32 thrCnt = GetCPUCoreCount();
+		scanFiles.resize(songList.size());
+		for (size_t curSng = 0; curSng < songList.size(); curSng ++)
+			scanFiles[curSng] = songList[curSng].fileName;
+		retVal = StartIndexScan((thrCnt > 1) ? (thrCnt - 1) : 1);	// leave one core for playback
+		if (retVal)
+			fprintf(stderr, "Warning: Unable to start song scan threads (error 0x%02X)\n", retVal);
+	}
+	gapless.songIdx = (size_t)-1;
+	gapless.dLoad = NULL;
+	gapless.player = NULL;
+	gapless.switched = false;
+	gaplessNext = false;
+	chipTimingOn = genOpts.chipTiming;
+	showAudioStats = genOpts.audioStats;
 	//resVal = 0;
 	controlVal = +1;	// default: next song
+	dLoad = NULL;
 	for (curSong = 0; curSong < songList.size(); )
 	{
 		const SongFileList& sfl = songList[curSong];
-		DATA_LOADER* dLoad;
-		PlayerBase* player;
+		PlayerA& myPlayer = *mediaInfo._player;	// The seek thread may replace it during PlayFile().
 		
 		mediaInfo._pbSongID = curSong;
 		mediaInfo._songPath = sfl.fileName;
@@ -277,7 +615,8 @@ UINT8 PlayerMain(UINT8 showFileName)
 			}
 			else
 			{
-				u8printf("Playlist File:  %s\n", mediaInfo._playlistPath.c_str());
+				u8printf("Playlist File:  %s%s\n", mediaInfo._playlistPath.c_str(),
+					GetPlaylistLengthStr(sfl.playlistID).c_str());
 				//printf("Playlist File:  %s [song %u/%u]\n", mediaInfo._playlistPath.c_str(),
 				//	1 + (unsigned)mediaInfo._playlistTrkID, (unsigned)mediaInfo._playlistTrkCnt);
 			}
@@ -286,17 +625,61 @@ UINT8 PlayerMain(UINT8 showFileName)
 		}
 		fflush(stdout);
 		
-		retVal = OpenFile(sfl.fileName, dLoad, player);
+		bool hasAlbumImg;
+		std::string albumImgPath;
+		if (gaplessNext)
+		{
+			// The render thread has already switched to the song that ArmGaplessSwitch() prepared.
+			DATA_LOADER* prevDLoad = dLoad;
+			PlayerA* prevPlayer;
+			
+			OSMutex_Lock(renderMtx);
+			prevPlayer = gapless.player;
+			dLoad = gapless.dLoad;
+			hasAlbumImg = gapless.hasAlbumImg;
+			albumImgPath = gapless.albumImgPath;
+			gapless.songIdx = (size_t)-1;
+			gapless.dLoad = NULL;
+			gapless.player = NULL;
+			gapless.switched = false;
+			OSMutex_Unlock(renderMtx);
+			prevPlayer->Stop();
+			prevPlayer->UnloadFile();
+			gaplessPlayer = prevPlayer;
+			ResetSeekPlayer();
+			DataLoader_Deinit(prevDLoad);
+			retVal = 0x00;
+		}
+		else
+		{
+			bool aborted;
+			dLoad = TakePrefetchedSong(curSong, hasAlbumImg, albumImgPath);
+			if (dLoad == NULL)
+			{
+				dLoad = LoadSongInBackground(curSong, hasAlbumImg, albumImgPath, aborted);
+				if (aborted)
+				{
+					if (! AdvanceSongList(curSong, controlVal))
+						break;
+					else
+						continue;
+				}
+			}
+			if (dLoad != NULL)
+				retVal = LoadFileToPlayer(dLoad, myPlayer);	// also reads the rest of partly prefetched files
+			else
+				retVal = OpenFile(sfl.fileName, dLoad, myPlayer);	// prefetching failed or is disabled
+		}
 		if (retVal & 0x80)
 		{
 			if (curSong == 0 && controlVal < 0)
 				controlVal = +1;
 			HandleKeyPress(true);
-			if (! mediaInfo._evtQueue.empty())
 			{
-				MediaInfo::EventData ed = mediaInfo._evtQueue.front();
-				mediaInfo._evtQueue.pop();
-				retVal = HandleCtrlEvent(ed.evt, ed.value);
+				UINT8 evtType;
+				INT32 evtParam;
+				if (mediaInfo.PopEvent(evtType, evtParam))
+					retVal = HandleCtrlEvent(evtType, evtParam);
 			}
 			if (! AdvanceSongList(curSong, controlVal))
 				break;
@@ -305,18 +688,46 @@ UINT8 PlayerMain(UINT8 showFileName)
 		}
 		printf("\n");
 		
-		mediaInfo._fileEndPos = myPlayer.GetFileSize();
-		mediaInfo.PreparePlayback();
-		PreparePlayback();
-		mediaInfo.SearchAlbumImage();
-		
-		// call "start" before showing song info, so that we can get the sound cores
-		myPlayer.Start();
-		mediaInfo._playState |= PLAYSTATE_PLAY;	// tell the key handler to enable playback controls
-		
-		mediaInfo.EnumerateChips();
-		myPlayer.Render(0, NULL);	// process first sample
-		mediaInfo._fileStartPos = myPlayer.GetCurPos(PLAYPOS_FILEOFS);	// get position after processing initialization block
+		if (gaplessNext)
+		{
+			SongIndexEntry sie;
+			
+			OSMutex_Lock(renderMtx);
+			mediaInfo._fileEndPos = myPlayer.GetFileSize();
+			mediaInfo.PreparePlayback();
+			mediaInfo.EnumerateChips();
+			mediaInfo._fileStartPos = gapless.fileStartPos;
+			bool haveSie = GetSongIndexInfo(myPlayer, sie);
+			OSMutex_Unlock(renderMtx);
+			// hashing the song can take a while, so the render thread mustn't wait for it
+			if (haveSie)
+				AddSongToIndex(sie, dLoad, sfl.fileName);
+			if (hasAlbumImg && mediaInfo._enableAlbumImage)
+				mediaInfo._albumImgPath = albumImgPath;
+			else
+				mediaInfo.SearchAlbumImage();
+		}
+		else
+		{
+			mediaInfo._fileEndPos = myPlayer.GetFileSize();
+			mediaInfo.PreparePlayback();
+			PreparePlayback(mediaInfo, myPlayer, curSong);
+			AddSongToIndex(myPlayer, dLoad, sfl.fileName);
+			if (hasAlbumImg && mediaInfo._enableAlbumImage)
+				mediaInfo._albumImgPath = albumImgPath;
+			else
+				mediaInfo.SearchAlbumImage();
+			
+			// call "start" before showing song info, so that we can get the sound cores
+			OSMutex_Lock(startMtx);
+			myPlayer.Start();
+			OSMutex_Unlock(startMtx);
+			mediaInfo._playState |= PLAYSTATE_PLAY;	// tell the key handler to enable playback controls
+			
+			mediaInfo.EnumerateChips();
+			myPlayer.Render(0, NULL);	// process first sample
+			mediaInfo._fileStartPos = myPlayer.GetCurPos(PLAYPOS_FILEOFS);	// get position after processing initialization block
+		}
 		timeDispMode = GetTimeDispMode(myPlayer.GetTotalTime(genOpts.timeDispStyle));
 		if (genOpts.setTermTitle)
 			ShowConsoleTitle();
@@ -327,15 +738,27 @@ UINT8 PlayerMain(UINT8 showFileName)
 			fprintf(stderr, "Warning: File writer failed with error 0x%02X\n", retVal);
 		
 		mediaInfo.Signal(MI_SIG_NEW_SONG);
+		if (curSong + 1 < songList.size())
+			PrefetchSong(curSong + 1);
+		curSongData = dLoad;
+		if (chipTimingOn && adOut.data != NULL)
+			StartChipTiming();
 		PlayFile();
+		StopChipTiming(true);
+		curSongData = NULL;
 		StopDiskWriter();
 		
-		mediaInfo._playState &= ~PLAYSTATE_PLAY;
-		myPlayer.Stop();
-		mediaInfo.Signal(MI_SIG_PLAY_STATE);
-		
-		myPlayer.UnloadFile();
-		DataLoader_Deinit(dLoad);
+		if (! gaplessNext)
+		{
+			mediaInfo._playState &= ~PLAYSTATE_PLAY;
+			ResetSeekPlayer();
+			mediaInfo._player->Stop();
+			mediaInfo.Signal(MI_SIG_PLAY_STATE);
+			
+			mediaInfo._player->UnloadFile();
+			FreeGaplessSong();	// in case it was loaded, but we didn't switch to it
+			DataLoader_Deinit(dLoad);	dLoad = NULL;
+		}
 		
 		if (! AdvanceSongList(curSong, controlVal))
 			break;
@@ -343,6 +766,12 @@ UINT8 PlayerMain(UINT8 showFileName)
 #ifndef _WIN32
 	changemode(0);
 #endif
+	StopPrefetchThread();
+	StopIndexScan(true);
+	if (genOpts.logLvlFile >= PLRLOG_DEBUG && romCache.GetHitCount() + romCache.GetMissCount() > 0)
+		printf("ROM cache: %u hits, %u misses\n", romCache.GetHitCount(), romCache.GetMissCount());
+	mediaInfo.SetWakeupCallback(NULL, NULL);
+	evtWaiter.Deinit();
 	if (mediaCtrl != NULL)
 	{
 		mediaCtrl->Deinit();
@@ -350,8 +779,8 @@ UINT8 PlayerMain(UINT8 showFileName)
 		mediaCtrl = NULL;
 	}
 	
-	myPlayer.UnregisterAllPlayers();
-	
+	mediaInfo._player->UnregisterAllPlayers();
+
 #ifdef _WIN32
 	CPConv_Deinit(cpcU8_Wide);
 #if ! HAVE_FILELOADER_W
@@ -359,12 +788,204 @@ UINT8 PlayerMain(UINT8 showFileName)
 #endif
 #endif
 	
+	romCache.Deinit();
+	CloseSongIndex();
 	StopAudioDevice();
 	DeinitAudioSystem();
 	
 	return 0;
 }
 
+UINT8 ScanMain(const std::vector<std::string>& scanDirs)
+{
+	GeneralOptions& genOpts = mediaInfo._genOpts;
+	std::vector<std::string> idxPaths;
+	std::vector<std::string> failDirs;
+	size_t curDir;
+	size_t curFile;
+	size_t lastDone;
+	UINT8 retVal;
+	
+	ParseConfiguration(genOpts, 0x100, mediaInfo._chipOpts, playerCfg);
+	romCache.Init(ROM_CACHE_SIZE);
+	retVal = songIndex.Load(userCfgDir + SONG_INDEX_FILE);
+	if (retVal == 0xFF)
+	{
+		fprintf(stderr, "Error opening song index %s%s!\n", userCfgDir.c_str(), SONG_INDEX_FILE);
+		romCache.Deinit();
+		return 1;
+	}
+#ifdef _WIN32
+	retVal = CPConv_Init(&cpcU8_Wide, "UTF-8", "UTF-16LE");
+#if ! HAVE_FILELOADER_W
+	{
+		std::string cpName(0x10, '\0');
+		snprintf(&cpName[0], cpName.size(), "CP%u", GetACP());
+		retVal = CPConv_Init(&cpcU8_ACP, "UTF-8", cpName.c_str());
+	}
+#endif
+#endif
+	
+	scanFiles.clear();
+	for (curDir = 0; curDir < scanDirs.size(); curDir ++)
+	{
+		std::string dirPath = GetIndexPath(scanDirs[curDir]);
+		if (! PathIsDirectory(dirPath))
+		{
+			u8printf("%s: Directory not found\n", scanDirs[curDir].c_str());
+			continue;
+		}
+		if (dirPath[dirPath.length() - 1] != '/')
+			dirPath += '/';
+		size_t dirStart = scanFiles.size();
+		failDirs.clear();
+		FindSongFiles(dirPath, scanFiles, failDirs);
+		
+		// remove files that were deleted since the last scan
+		// Entries in directories that couldn't be read are kept.
+		std::vector<std::string> dirFiles(scanFiles.begin() + dirStart, scanFiles.end());
+		std::sort(dirFiles.begin(), dirFiles.end());
+		songIndex.GetPathsInDir(dirPath, idxPaths);
+		for (curFile = 0; curFile < idxPaths.size(); curFile ++)
+		{
+			const std::string& idxPath = idxPaths[curFile];
+			if (std::binary_search(dirFiles.begin(), dirFiles.end(), idxPath))
+				continue;
+			size_t curFail;
+			for (curFail = 0; curFail < failDirs.size(); curFail ++)
+			{
+				if (! idxPath.compare(0, failDirs[curFail].length(), failDirs[curFail]))
+					break;
+			}
+			if (curFail >= failDirs.size())
+				songIndex.Remove(idxPath);
+		}
+	}
+	
+	retVal = 0x00;
+	if (! scanFiles.empty())
+	{
+		UINT32 thrCnt = GetCPUCoreCount();
+		size_t fileCnt = scanFiles.size();
+		
+		printf("Scanning %u %s using %u %s ...\n", (unsigned)fileCnt, (fileCnt == 1) ? "file" : "files",
+			thrCnt, (thrCnt == 1) ? "thread" : "threads");
+		retVal = StartIndexScan(thrCnt);
+		lastDone = (size_t)-1;
+		while(! retVal)
+		{
+			size_t doneCnt;
+			
+			OSMutex_Lock(scanMtx);
+			doneCnt = scanDoneCnt;
+			OSMutex_Unlock(scanMtx);
+			if (doneCnt != lastDone)
+			{
+				printf("\r%*u/%u", count_digits((int)fileCnt), (unsigned)doneCnt, (unsigned)fileCnt);
+				fflush(stdout);
+				lastDone = doneCnt;
+			}
+			if (doneCnt >= fileCnt)
+				break;
+			Sleep(OFFLINE_CTRL_INTERVAL);
+		}
+		printf("\n");
+		if (! retVal)
+		{
+			printf("Done. %u new/changed, %u unchanged, %u failed\n", (unsigned)scanNewCnt,
+				(unsigned)(scanDoneCnt - scanNewCnt - scanFailCnt), (unsigned)scanFailCnt);
+		}
+		StopIndexScan(false);
+	}
+	
+	if (songIndex.Save())
+	{
+		fprintf(stderr, "Error writing song index %s%s!\n", userCfgDir.c_str(), SONG_INDEX_FILE);
+		retVal = 0xFF;
+	}
+	songIndex.Unload();
+	romCache.Deinit();
+	
+#ifdef _WIN32
+	CPConv_Deinit(cpcU8_Wide);
+#if ! HAVE_FILELOADER_W
+	CPConv_Deinit(cpcU8_ACP);
+#endif
+#endif
+	return retVal ? 1 : 0;
+}
+
+UINT8 CacheStatsMain(void)
+{
+	GeneralOptions& genOpts = mediaInfo._genOpts;
+	RenderCache::Stats stats;
+	UINT8 retVal;
+	
+	ParseConfiguration(genOpts, 0x100, mediaInfo._chipOpts, playerCfg);
+	retVal = renderCache.Init(GetRenderCacheDir(), (UINT64)genOpts.renderCache * 1024 * 1024,
+		genOpts.smplRate, 2, genOpts.smplBits);
+	if (retVal)
+	{
+		fprintf(stderr, "Error opening render cache %s!\n", GetRenderCacheDir().c_str());
+		return 1;
+	}
+	renderCache.GetStats(stats);
+	
+	printf("Render cache: %s\n", renderCache.GetDirectory().c_str());
+	if (! stats.maxSize)
+		printf("The render cache is disabled. (RenderCache setting)\n");
+	printf("Entries: %u, size: %.1f MB", stats.entries, stats.fileSize / 1048576.0);
+	if (stats.maxSize)
+		printf(" of %.1f MB (%.1f %%)", stats.maxSize / 1048576.0, 100.0 * stats.fileSize / stats.maxSize);
+	printf("\n");
+	if (stats.pcmSize)
+		printf("Compression: %.1f MB of audio stored in %.1f MB (%.1f %%)\n", stats.pcmSize / 1048576.0,
+			stats.fileSize / 1048576.0, 100.0 * stats.fileSize / stats.pcmSize);
+	printf("Hits: %u, misses: %u", stats.hits, stats.misses);
+	if (stats.hits + stats.misses > 0)
+		printf(" (%.1f %% hit rate)", 100.0 * stats.hits / (stats.hits + stats.misses));
+	printf("\n");
+	printf("Stored: %u, evicted: %u\n", stats.stored, stats.evicted);
+	renderCache.Deinit();
+	
+	return 0;
+}
+
+// adds all files with song file extensions from a directory and its subdirectories
+// Directories that can't be read are reported and added to failDirs.
+static void FindSongFiles(const std::string& dirPath, std::vector<std::string>& fileList, std::vector<std::string>& failDirs)
+{
+	static const char* SONG_EXTS[] = {"vgm", "vgz", "s98", "dro", "gym", NULL};
+	std::vector<std::string> fileNames;
+	std::vector<std::string> dirNames;
+	size_t curItm;
+	
+	if (! ReadDirectory(dirPath, fileNames, dirNames))
+	{
+		u8printf("%s: Error reading directory\n", dirPath.c_str());
+		failDirs.push_back(dirPath);
+		return;
+	}
+	for (curItm = 0; curItm < fileNames.size(); curItm ++)
+	{
+		const char* fileExt = GetFileExtension(fileNames[curItm].c_str());
+		if (fileExt == NULL)
+			continue;
+		for (const char* const* ext = SONG_EXTS; *ext != NULL; ext ++)
+		{
+			if (! stricmp(fileExt, *ext))
+			{
+				fileList.push_back(dirPath + fileNames[curItm]);
+				break;
+			}
+		}
+	}
+	for (curItm = 0; curItm < dirNames.size(); curItm ++)
+		FindSongFiles(dirPath + dirNames[curItm] + '/', fileList, failDirs);
+	
+	return;
+}
+
 static bool AdvanceSongList(size_t& songIdx, int controlVal)
 {
 	if (controlVal == +9)
@@ -411,7 +1032,18 @@ static DATA_LOADER* GetFileLoaderUTF8(const std::string& fileNameU8)
 #endif
 }
 
-static UINT8 OpenFile(const std::string& fileName, DATA_LOADER*& dLoad, PlayerBase*& player)
+static void InitPlayerEngines(MediaInfo& mInfo)
+{
+	PlayerA& player = *mInfo._player;
+	
+	InitPlayerEngines(player, mInfo._genOpts, mInfo._chipOpts);
+	player.SetFileReqCallback(PlayerFileReqCallback, NULL);
+	player.SetLogCallback(PlayerLogCallback, NULL);
+	
+	return;
+}
+
+static UINT8 OpenFile(const std::string& fileName, DATA_LOADER*& dLoad, PlayerA& player)
 {
 	UINT8 retVal;
 	
@@ -427,7 +1059,15 @@ static UINT8 OpenFile(const std::string& fileName, DATA_LOADER*& dLoad, PlayerBa
 		fprintf(stderr, "Error 0x%02X opening file!\n", retVal);
 		return 0xFF;
 	}
-	retVal = mediaInfo._player.LoadFile(dLoad);
+	return LoadFileToPlayer(dLoad, player);
+}
+
+// Note: frees the data loader in case of an error
+static UINT8 LoadFileToPlayer(DATA_LOADER* dLoad, PlayerA& player)
+{
+	UINT8 retVal;
+	
+	retVal = player.LoadFile(dLoad);
 	if (retVal)
 	{
 		DataLoader_CancelLoading(dLoad);
@@ -438,810 +1078,3468 @@ static UINT8 OpenFile(const std::string& fileName, DATA_LOADER*& dLoad, PlayerBa
 	return 0x00;
 }
 
-static void PreparePlayback(void)
+static UINT8 StartPrefetchThread(void)
 {
-	PlayerA& myPlayer = mediaInfo._player;
-	const GeneralOptions& genOpts = mediaInfo._genOpts;
-	UINT32 timeMS;
+	UINT8 retVal;
 	
-	if (myPlayer.GetPlayer()->GetPlayerType() == FCC_VGM)
+	prefetch.songIdx = (size_t)-1;
+	prefetch.dLoad = NULL;
+	prefetch.status = PFSTAT_IDLE;
+	prefetchStop = false;
+	prefetchCancel = false;
+	
+	prefetchInfo = new MediaInfo;
+	prefetchInfo->_genOpts = mediaInfo._genOpts;
+	for (size_t curChp = 0; curChp < 0x100; curChp ++)
+		prefetchInfo->_chipOpts[curChp] = mediaInfo._chipOpts[curChp];
+	prefetchInfo->_playState = 0x00;
+	InitPlayerEngines(*prefetchInfo);
+	
+	prefetchMtx = NULL;
+	prefetchReqSignal = NULL;
+	prefetchDoneSignal = NULL;
+	retVal = OSMutex_Init(&prefetchMtx, 0);
+	if (! retVal)
+		retVal = OSSignal_Init(&prefetchReqSignal, 0);
+	if (! retVal)
+		retVal = OSSignal_Init(&prefetchDoneSignal, 0);
+	if (! retVal)
+		retVal = OSThread_Init(&prefetchThread, PrefetchThread, NULL);
+	if (retVal)
 	{
-		VGMPlayer* vgmplay = dynamic_cast<VGMPlayer*>(myPlayer.GetPlayer());
-		myPlayer.SetLoopCount(vgmplay->GetModifiedLoopCount(genOpts.maxLoops));
+		prefetchThread = NULL;
+		if (prefetchDoneSignal != NULL)
+			OSSignal_Deinit(prefetchDoneSignal);
+		if (prefetchReqSignal != NULL)
+			OSSignal_Deinit(prefetchReqSignal);
+		if (prefetchMtx != NULL)
+			OSMutex_Deinit(prefetchMtx);
+		prefetchInfo->_player->UnregisterAllPlayers();
+		delete prefetchInfo;	prefetchInfo = NULL;
+		return retVal;
 	}
 	
-	// last song: fadeTime_single, others: fadeTime_plist
-	timeMS = (curSong + 1 == songList.size()) ? genOpts.fadeTime_single : genOpts.fadeTime_plist;
-	myPlayer.SetFadeSamples(MSec2Samples(timeMS, myPlayer));
+	return 0x00;
+}
+
+static void StopPrefetchThread(void)
+{
+	if (prefetchThread == NULL)
+		return;
 	
-	timeMS = (myPlayer.GetPlayer()->GetLoopTicks() == 0) ? genOpts.pauseTime_jingle : genOpts.pauseTime_loop;
-	myPlayer.SetEndSilenceSamples(MSec2Samples(timeMS, myPlayer));
+	CancelPrefetch();
+	prefetchStop = true;
+	OSSignal_Signal(prefetchReqSignal);
+	OSThread_Join(prefetchThread);
+	OSThread_Deinit(prefetchThread);	prefetchThread = NULL;
+	OSSignal_Deinit(prefetchDoneSignal);	prefetchDoneSignal = NULL;
+	OSSignal_Deinit(prefetchReqSignal);	prefetchReqSignal = NULL;
+	OSMutex_Deinit(prefetchMtx);	prefetchMtx = NULL;
+	prefetchInfo->_player->UnregisterAllPlayers();
+	delete prefetchInfo;	prefetchInfo = NULL;
 	
 	return;
 }
 
-static void ShowSongInfo(void)
+static void PrefetchThread(void* args)
 {
-	PlayerBase* player = mediaInfo._player.GetPlayer();
-	
-	u8printf("Track Title:    %s\n", mediaInfo.GetSongTagForDisp("TITLE"));
-	u8printf("Game Name:      %s\n", mediaInfo.GetSongTagForDisp("GAME"));
-	if (player->GetPlayerType() == FCC_GYM)
-		u8printf("Emulator:       %s\n", mediaInfo.GetSongTagForDisp("EMULATOR"));
-	else
-		u8printf("System:         %s\n", mediaInfo.GetSongTagForDisp("SYSTEM"));
-	if (player->GetPlayerType() == FCC_GYM)
-		u8printf("Publisher:      %s\n", mediaInfo.GetSongTagForDisp("PUBLISHER"));
-	else
-		u8printf("Composer:       %s\n", mediaInfo.GetSongTagForDisp("ARTIST"));
-	if (player->GetPlayerType() == FCC_S98)
+	while(true)
 	{
-		S98Player* s98play = dynamic_cast<S98Player*>(player);
-		const S98_HEADER* s98hdr = s98play->GetFileHeader();
+		OSSignal_Wait(prefetchReqSignal);
+		if (prefetchStop)
+			break;
 		
-		u8printf("Release:        %-11s Tick Rate: %u/%u\n", mediaInfo.GetSongTagForDisp("DATE"),
-			s98hdr->tickMult, s98hdr->tickDiv);
+		OSMutex_Lock(prefetchMtx);
+		if (prefetch.status != PFSTAT_QUEUED)
+		{
+			OSMutex_Unlock(prefetchMtx);
+			continue;
+		}
+		prefetch.status = PFSTAT_LOADING;
+		size_t songIdx = prefetch.songIdx;
+		DATA_LOADER* dLoad = prefetch.dLoad;
+		bool searchImg = prefetch.searchAlbumImg;
+		OSMutex_Unlock(prefetchMtx);
+		
+		std::string imgPath;
+		UINT8 status = PrefetchLoadData(dLoad);
+		if (status == PFSTAT_READY && searchImg && ! prefetchCancel)
+			PrefetchAlbumImage(songIdx, dLoad, imgPath);
+		
+		OSMutex_Lock(prefetchMtx);
+		prefetch.albumImgPath = imgPath;
+		prefetch.status = status;
+		OSMutex_Unlock(prefetchMtx);
+		OSSignal_Signal(prefetchDoneSignal);
+		mediaInfo.WakeUp();	// for LoadSongInBackground()
 	}
-	else
+	
+	return;
+}
+
+// reads (and decompresses) the whole file, returns PFSTAT_READY/PARTIAL/FAILED
+// Files that exceed the memory budget stay partly loaded. The player reads the rest when the song starts.
+static UINT8 PrefetchLoadData(DATA_LOADER* dLoad)
+{
+	UINT64 maxSize = (UINT64)mediaInfo._genOpts.prefetchMem * 1024 * 1024;
+	
+	DataLoader_SetPreloadBytes(dLoad, 0x100);
+	if (DataLoader_Load(dLoad))
+		return PFSTAT_FAILED;
+	while(DataLoader_GetStatus(dLoad) != DLSTAT_LOADED)
 	{
-		u8printf("Release:        %s\n", mediaInfo.GetSongTagForDisp("DATE"));
-	}
-	printf("Format:         %-11s ", mediaInfo._fileVerStr.c_str());
-	printf("Gain:%5.2f    ", mediaInfo._volGain);
-	if (player->GetPlayerType() == FCC_DRO)
-	{
-		DROPlayer* droplay = dynamic_cast<DROPlayer*>(player);
-		const DRO_HEADER* drohdr = droplay->GetFileHeader();
-		const char* hwType;
-		
-		if (drohdr->hwType == 0)
-			hwType = "OPL2";
-		else if (drohdr->hwType == 1)
-			hwType = "DualOPL2";
-		else if (drohdr->hwType == 2)
-			hwType = "OPL3";
-		else
-			hwType = "unknown";
-		printf("HWType: %s\n", hwType);
-	}
-	else
-	{
-		if (mediaInfo._looping)
-			printf("Loop: Yes (%s)\n", GetTimeStr(mediaInfo._player.GetLoopTime(), -1).c_str());
-		else if (mediaInfo._isRawLog && mediaInfo._genOpts.fadeRawLogs)
-			printf("Loop: No (raw)\n");
-		else
-			printf("Loop: No\n");
+		if (prefetchCancel)
+			return PFSTAT_FAILED;
+		if (DataLoader_GetSize(dLoad) >= maxSize)
+			return PFSTAT_PARTIAL;
+		if (! DataLoader_Read(dLoad, 0x100000))	// read in 1 MB steps, so that we can cancel in time
+			break;
 	}
-	u8printf("VGM by:         %s\n", mediaInfo.GetSongTagForDisp("ENCODED_BY"));
-	u8printf("Notes:          %s\n", mediaInfo.GetSongTagForDisp("COMMENT"));
-	printf("\n");
 	
-	printf("Used chips:     ");
-	for (size_t curDev = 0; curDev < mediaInfo._chipList.size(); curDev ++)
-	{
-		const MediaInfo::DeviceItem& di = mediaInfo._chipList[curDev];
-		unsigned int devCnt = 1;
-		
-		for (; curDev + 1 < mediaInfo._chipList.size(); curDev ++)
-		{
-			const MediaInfo::DeviceItem& di1 = mediaInfo._chipList[curDev + 1];
-			if (di1.name != di.name)
-				break;
-			if (mediaInfo._genOpts.showDevCore && di1.core != di.core)
-				break;
-			devCnt ++;
-		}
-		
-		if (devCnt > 1)
-			printf("%ux", devCnt);
-		if (mediaInfo._genOpts.showDevCore)
-			printf("%s (%s), ", di.name.c_str(), di.core.c_str());
-		else
-			printf("%s, ", di.name.c_str());
-	}
-	printf("\b\b \n\n");
+	return (DataLoader_GetStatus(dLoad) == DLSTAT_LOADED) ? PFSTAT_READY : PFSTAT_FAILED;
+}
+
+static void PrefetchAlbumImage(size_t songIdx, DATA_LOADER* dLoad, std::string& imgPath)
+{
+	const SongFileList& sfl = songList[songIdx];
+	MediaInfo& pInf = *prefetchInfo;
+	
+	pInf._songPath = sfl.fileName;
+	pInf._playlistTrkID = sfl.playlistSongID;
+	pInf._playlistPath = (sfl.playlistSongID == (size_t)-1) ? std::string() : plList[sfl.playlistID].fileName;
+	if (pInf._player->LoadFile(dLoad))
+		return;
+	pInf._enableAlbumImage = true;
+	pInf.EnumerateTags();
+	pInf.SearchAlbumImage();
+	imgPath = pInf._albumImgPath;
+	pInf._player->UnloadFile();
+	
 	return;
 }
 
-static void ShowConsoleTitle(void)
+// start loading a song in the background
+static void PrefetchSong(size_t songIdx)
 {
-	const std::string& fileName = mediaInfo._songPath;
-	std::string titleTag = mediaInfo.GetSongTagForDisp("TITLE");
-	std::string gameTag = mediaInfo.GetSongTagForDisp("GAME");
-	std::string titleStr;
+	DATA_LOADER* dLoad;
 	
-	// show "Song (Game) - VGM Player" as console title
-	if (! titleTag.empty())
-		titleStr = titleTag;
-	else
-		titleStr = GetFileTitle(fileName.c_str());
+	if (prefetchThread == NULL)
+		return;
 	
-	if (! gameTag.empty())
-		titleStr = titleStr + " (" + gameTag + ")";
+	CancelPrefetch();
+	dLoad = GetFileLoaderUTF8(songList[songIdx].fileName);
+	if (dLoad == NULL)
+		return;
 	
-	titleStr = titleStr + " - " + APP_NAME;
+	OSMutex_Lock(prefetchMtx);
+	prefetch.songIdx = songIdx;
+	prefetch.dLoad = dLoad;
+	prefetch.searchAlbumImg = mediaInfo._enableAlbumImage;
+	prefetch.albumImgPath = std::string();
+	prefetch.status = PFSTAT_QUEUED;
+	prefetchCancel = false;
+	OSMutex_Unlock(prefetchMtx);
+	OSSignal_Signal(prefetchReqSignal);
 	
-#ifdef WIN32
-	size_t titleWLen = 0;
-	wchar_t* titleWStr = NULL;
-	UINT8 retVal = CPConv_StrConvert(cpcU8_Wide, &titleWLen, reinterpret_cast<char**>(&titleWStr),
-		titleStr.length() + 1, titleStr.c_str());	// length()+1 to include the \0
-	if (retVal < 0x80)
-		SetConsoleTitleW(titleWStr);		// Set Windows Console Title
-	free(titleWStr);
-#else
-	printf("\x1B]0;%s\x07", titleStr.c_str());	// Set xterm/rxvt Terminal Title
-#endif
+	return;
+}
+
+// wait for the current request to finish
+static void WaitForPrefetch(void)
+{
+	while(true)
+	{
+		OSMutex_Lock(prefetchMtx);
+		UINT8 status = prefetch.status;
+		OSMutex_Unlock(prefetchMtx);
+		if (status != PFSTAT_QUEUED && status != PFSTAT_LOADING)
+			break;
+		OSSignal_Wait(prefetchDoneSignal);
+	}
 	
 	return;
 }
 
-static UINT8 PlayFile(void)
+static void CancelPrefetch(void)
 {
-	const GeneralOptions& genOpts = mediaInfo._genOpts;
-	PlayerA& myPlayer = mediaInfo._player;
-	UINT8 retVal;
-	bool needRefresh;
+	if (prefetchThread == NULL)
+		return;
 	
-	pauseAfterEnd = false;
-	quitAfterEnd = false;
+	prefetchCancel = true;
+	WaitForPrefetch();
 	
-	const std::vector<VGMPlayer::DACSTRM_DEV>* vgmPcmStrms = NULL;
-	if (myPlayer.GetPlayer()->GetPlayerType() == FCC_VGM)
+	OSMutex_Lock(prefetchMtx);
+	if (prefetch.dLoad != NULL)
 	{
-		VGMPlayer* vgmplay = dynamic_cast<VGMPlayer*>(myPlayer.GetPlayer());
-		vgmPcmStrms = &vgmplay->GetStreamDevInfo();
+		DataLoader_CancelLoading(prefetch.dLoad);
+		DataLoader_Deinit(prefetch.dLoad);
 	}
+	prefetch.songIdx = (size_t)-1;
+	prefetch.dLoad = NULL;
+	prefetch.status = PFSTAT_IDLE;
+	OSMutex_Unlock(prefetchMtx);
 	
-	if (adOut.data != NULL)
-		retVal = AudioDrv_SetCallback(adOut.data, FillBuffer, &myPlayer);
-	else
-		retVal = 0xFF;
-	manualRenderLoop = (retVal != AERR_OK);
-	controlVal = 0;
-	mediaInfo._playState &= ~(PLAYSTATE_END | PLAYSTATE_FIN);
-	noDispTime = 0;
-	needRefresh = true;
-	while(! (mediaInfo._playState & PLAYSTATE_END))
+	return;
+}
+
+// returns the prefetched data loader for a song or NULL, if it wasn't prefetched
+// Songs that exceed the memory budget are returned partly loaded.
+static DATA_LOADER* TakePrefetchedSong(size_t songIdx, bool& hasAlbumImg, std::string& albumImgPath)
+{
+	DATA_LOADER* dLoad;
+	
+	hasAlbumImg = false;
+	if (prefetchThread == NULL)
+		return NULL;
+	
+	OSMutex_Lock(prefetchMtx);
+	bool isRequested = (prefetch.songIdx == songIdx);
+	OSMutex_Unlock(prefetchMtx);
+	if (! isRequested)
 	{
-		if (! (mediaInfo._playState & PLAYSTATE_PAUSE) && noDispTime <= 0)
-			needRefresh = true;	// always update when playing
-		if (needRefresh)
-		{
-			const char* pState;
-			
-			if (mediaInfo._playState & PLAYSTATE_PAUSE)
-				pState = "Paused ";
-			else if (myPlayer.GetState() & PLAYSTATE_END)
-				pState = "Finish ";
-			else if (myPlayer.GetState() & PLAYSTATE_FADE)
-				pState = "Fading ";
-			else
-				pState = "Playing";
-			
-			UINT32 dataLen = mediaInfo._fileEndPos - mediaInfo._fileStartPos;
-			UINT32 dataPos = myPlayer.GetCurPos(PLAYPOS_FILEOFS);
-			dataPos = (dataPos >= mediaInfo._fileStartPos) ? (dataPos - mediaInfo._fileStartPos) : 0x00;
-			
-			if (vgmPcmStrms == NULL || vgmPcmStrms->empty())
-			{
-				printf("%s%6.2f%%  %s / %s seconds  \r", pState,
-					100.0 * dataPos / dataLen,
-					GetTimeStr(myPlayer.GetCurTime(genOpts.timeDispStyle), timeDispMode).c_str(),
-					GetTimeStr(myPlayer.GetTotalTime(genOpts.timeDispStyle), timeDispMode).c_str());
-			}
-			else
-			{
-				const VGMPlayer::DACSTRM_DEV* strmDev = &(*vgmPcmStrms)[0];
-				std::string pbMode;
-				if (strmDev->pbMode & 0x10)
-					pbMode += 'R';	// reverse playback
-				if (strmDev->pbMode & 0x80)
-					pbMode += 'L';	// looping
-				printf("%s%6.2f%%  %s / %s seconds", pState,
-					100.0 * dataPos / dataLen,
-					GetTimeStr(myPlayer.GetCurTime(genOpts.timeDispStyle), timeDispMode).c_str(),
-					GetTimeStr(myPlayer.GetTotalTime(genOpts.timeDispStyle), timeDispMode).c_str());
-				if (genOpts.showStrmCmds == 0x01)
-					printf("  %02X / %02X %s", 1 + strmDev->lastItem, strmDev->maxItems, pbMode.c_str());
-				else if (genOpts.showStrmCmds == 0x02)
-					printf("  %02X / %02X at %5u Hz %s", 1 + strmDev->lastItem, strmDev->maxItems,
-						strmDev->freq, pbMode.c_str());
-				else if (genOpts.showStrmCmds == 0x03)
-					printf("  %02X / %02X at %4.1f KHz %s", 1 + strmDev->lastItem, strmDev->maxItems,
-						strmDev->freq / 1000.0, pbMode.c_str());
-				printf("  \r");
-			}
-			fflush(stdout);
-			needRefresh = false;
-			noDispTime = 0;
-		}
-		
-		if (manualRenderLoop && ! (mediaInfo._playState & PLAYSTATE_PAUSE))
-		{
-			UINT32 wrtBytes = FillBuffer(NULL, &myPlayer, (UINT32)audioBuf.size(), &audioBuf[0]);
-			if (adOut.data != NULL)
-				AudioDrv_WriteData(adOut.data, wrtBytes, &audioBuf[0]);
-			else if (adLog.data != NULL)
-				AudioDrv_WriteData(adLog.data, wrtBytes, &audioBuf[0]);
-			if (noDispTime > 0)
-			{
-				noDispTime -= 200;
-				if (noDispTime <= 0)
-					needRefresh = true;
-			}
-		}
-		else
-		{
-			Sleep(50);
-			if (noDispTime > 0)
-			{
-				noDispTime -= 50;
-				if (noDispTime <= 0)
-					needRefresh = true;
-			}
-		}
-		
-		if (genOpts.fadeRawLogs && mediaInfo._isRawLog && genOpts.fadeTime_single > 0)
-		{
-			// TODO: Thread-safety
-			if (! (mediaInfo._playState & PLAYSTATE_PAUSE) && ! (myPlayer.GetState() & PLAYSTATE_FADE))
-			{
-				const UINT8 timeFlags = PLAYTIME_LOOP_INCL | PLAYTIME_TIME_PBK;
-				double fadeStart = myPlayer.GetTotalTime(timeFlags) - genOpts.fadeTime_single / 1500.0;
-				if (myPlayer.GetCurTime(timeFlags) >= fadeStart)
-				{
-					myPlayer.SetFadeSamples(MSec2Samples(genOpts.fadeTime_single, myPlayer));
-					myPlayer.FadeOut();	// (FadeTime / 1500) ends at 33%
-				}
-			}
-		}
-		if (mediaInfo._playState & PLAYSTATE_FIN)
-		{
-			if (! (mediaInfo._playState & PLAYSTATE_PAUSE))
-			{
-				if (pauseAfterEnd)
-				{
-					mediaInfo.Event(MI_EVT_PAUSE, MIE_PS_PAUSE);
-					pauseAfterEnd = false;
-				}
-				else
-				{
-					mediaInfo._playState |= PLAYSTATE_END;
-				}
-			}
-			if (! (myPlayer.GetState() & PLAYSTATE_END))
-				mediaInfo._playState &= ~PLAYSTATE_FIN;	// remove "finished" flag when seeking back
-		}
+		CancelPrefetch();	// The user skipped to a different song.
+		return NULL;
+	}
+	// If the song is still loading, waiting for the thread is faster than starting again.
+	WaitForPrefetch();
+	
+	OSMutex_Lock(prefetchMtx);
+	dLoad = NULL;
+	if (prefetch.status == PFSTAT_READY || prefetch.status == PFSTAT_PARTIAL)
+	{
+		dLoad = prefetch.dLoad;
+		hasAlbumImg = (prefetch.status == PFSTAT_READY) && prefetch.searchAlbumImg;
+		albumImgPath = prefetch.albumImgPath;
+		prefetch.dLoad = NULL;
+	}
+	OSMutex_Unlock(prefetchMtx);
+	CancelPrefetch();	// frees the data loader in case of failure
+	
+	return dLoad;
+}
+
+// Loads (and decompresses) a song using the prefetch thread, while the main thread keeps handling controls.
+// This way, skipping over large compressed files doesn't have to wait until they are fully loaded.
+// "aborted" is set when the user selected another song meanwhile.
+static DATA_LOADER* LoadSongInBackground(size_t songIdx, bool& hasAlbumImg, std::string& albumImgPath, bool& aborted)
+{
+	aborted = false;
+	hasAlbumImg = false;
+	if (prefetchThread == NULL)
+		return NULL;
+	
+	PrefetchSong(songIdx);
+	evtWaiter.SetTimer((UINT32)-1);
+	while(true)
+	{
+		OSMutex_Lock(prefetchMtx);
+		UINT8 status = prefetch.status;
+		OSMutex_Unlock(prefetchMtx);
+		if (status != PFSTAT_QUEUED && status != PFSTAT_LOADING)
+			break;
 		
-		HandleKeyPress(false);
-		retVal = 0x00;
-		if (! mediaInfo._evtQueue.empty())	// TODO: thread-safety
-		{
-			MediaInfo::EventData ed = mediaInfo._evtQueue.front();
-			mediaInfo._evtQueue.pop();
-			retVal = HandleCtrlEvent(ed.evt, ed.value);
-		}
-		if (retVal)
+		evtWaiter.Wait();
+		if (ProcessControls() >= 0x10)
 		{
-			needRefresh = true;
-			if (retVal >= 0x10)
-				break;
+			CancelPrefetch();
+			aborted = true;
+			return NULL;
 		}
 	}
-	// remove callback to prevent further rendering
-	// also waits for render thread to finish its work
-	if (adOut.data != NULL)
+	
+	return TakePrefetchedSong(songIdx, hasAlbumImg, albumImgPath);
+}
+
+// Can the song be followed by the next one without a gap?
+static bool IsGaplessTransition(size_t songIdx)
+{
+	if (! mediaInfo._genOpts.gaplessPb || renderThread == NULL || adLog.data != NULL)
+		return false;
+	if (songIdx + 1 >= songList.size())
+		return false;
+	
+	const SongFileList& sfl1 = songList[songIdx + 0];
+	const SongFileList& sfl2 = songList[songIdx + 1];
+	if (sfl1.playlistSongID == (size_t)-1 || sfl2.playlistSongID == (size_t)-1)
+		return false;
+	return (sfl1.playlistID == sfl2.playlistID);
+}
+
+// Prepare the next song on gaplessPlayer as soon as it was prefetched and hand it over to the render thread.
+// Loading and starting the song can take a while (e.g. for sample ROMs), so the render thread doesn't do it.
+static void ArmGaplessSwitch(void)
+{
+	DATA_LOADER* dLoad;
+	bool hasAlbumImg;
+	std::string albumImgPath;
+	
+	if (gapless.songIdx != (size_t)-1 || prefetchThread == NULL || gaplessPlayer == NULL)
+		return;
+	if (! IsGaplessTransition(curSong))
+		return;
+	
+	OSMutex_Lock(prefetchMtx);
+	// partly loaded songs are started normally, so that loading the rest doesn't block this thread
+	bool isReady = (prefetch.songIdx == curSong + 1 && prefetch.status == PFSTAT_READY);
+	OSMutex_Unlock(prefetchMtx);
+	if (! isReady)
+		return;
+	
+	dLoad = TakePrefetchedSong(curSong + 1, hasAlbumImg, albumImgPath);
+	if (dLoad == NULL)
+		return;
+	
+	PlayerA& nextPlayer = *gaplessPlayer;
+	if (LoadFileToPlayer(dLoad, nextPlayer))
+		return;	// The song is loaded again when the current one ends.
+	PreparePlayback(mediaInfo, nextPlayer, curSong + 1);
+	nextPlayer.SetMasterVolume(masterVol);
+	nextPlayer.SetPlaybackSpeed(masterSpeed);
+	OSMutex_Lock(startMtx);
+	nextPlayer.Start();
+	OSMutex_Unlock(startMtx);
+	nextPlayer.Render(0, NULL);	// process first sample
+	UINT32 fileStartPos = nextPlayer.GetCurPos(PLAYPOS_FILEOFS);
+	UINT64 cacheKey = GetRenderCacheKey(nextPlayer, dLoad);
+	
+	OSMutex_Lock(renderMtx);
+	gapless.dLoad = dLoad;
+	gapless.player = gaplessPlayer;
+	gapless.cacheKey = cacheKey;
+	gapless.fileStartPos = fileStartPos;
+	gapless.hasAlbumImg = hasAlbumImg;
+	gapless.albumImgPath = albumImgPath;
+	gapless.switched = false;
+	gapless.songIdx = curSong + 1;
+	OSMutex_Unlock(renderMtx);
+	gaplessPlayer = NULL;
+	
+	return;
+}
+
+// The render thread must not be able to access the song anymore. (i.e. renderRingActive == false)
+static void FreeGaplessSong(void)
+{
+	OSMutex_Lock(renderMtx);
+	if (gapless.player != NULL)
 	{
-		if (dummyRenderAtLoad)
-			AudioDrv_SetCallback(adOut.data, FillBufferDummy, NULL);
-		else
-			AudioDrv_SetCallback(adOut.data, NULL, NULL);
+		gapless.player->Stop();
+		gapless.player->UnloadFile();
+		gaplessPlayer = gapless.player;
+	}
+	if (gapless.dLoad != NULL)
+	{
+		DataLoader_CancelLoading(gapless.dLoad);
+		DataLoader_Deinit(gapless.dLoad);
 	}
+	gapless.songIdx = (size_t)-1;
+	gapless.dLoad = NULL;
+	gapless.player = NULL;
+	gapless.switched = false;
+	OSMutex_Unlock(renderMtx);
 	
-	if (! controlVal)
+	return;
+}
+
+// swaps in the next song's player right after the current one ended
+// called by the render thread with renderMtx held
+static bool GaplessSwitch(void)
+{
+	PlayerA* prevPlr = mediaInfo._player;
+	PlayerA* nextPlr = gapless.player;
+	
+	if (pauseAfterEnd || quitAfterEnd)
+		return false;
+	
+	CancelSeekRequest();
+	StopReplay(false);
+	StopLoopReplay(false);
+	seekHist.Clear();
+	if (nextPlr->GetMasterVolume() != prevPlr->GetMasterVolume() ||
+		nextPlr->GetPlaybackSpeed() != prevPlr->GetPlaybackSpeed())
 	{
-		if (quitAfterEnd)
-			controlVal = 9;	// quit
-		else
-			controlVal = +1;	// finished normally - next song
+		// changed after the song was prepared
+		nextPlr->SetMasterVolume(prevPlr->GetMasterVolume());
+		nextPlr->SetPlaybackSpeed(prevPlr->GetPlaybackSpeed());
+		gapless.cacheKey = 0;
 	}
-	printf("\n");
+	prevPlr->SetEventCallback(NULL, NULL);
+	nextPlr->SetEventCallback(FilePlayCallback, &mediaInfo);
+	mediaInfo._player = nextPlr;
+	gapless.player = prevPlr;	// stopped by the main thread
+	curSongData = gapless.dLoad;
+	StartRenderCache(gapless.cacheKey);
 	
-	return 0x00;
+	gapless.switched = true;
+	mediaInfo._playState &= ~PLAYSTATE_FIN;
+	mediaInfo.WakeUp();
+	return true;
 }
 
-static UINT8 HandleCtrlEvent(UINT8 evtType, INT32 evtParam)
+static void PreparePlayback(MediaInfo& mInfo, PlayerA& myPlayer, size_t songIdx)
 {
-	const GeneralOptions& genOpts = mediaInfo._genOpts;
-	PlayerA& myPlayer = mediaInfo._player;
+	const GeneralOptions& genOpts = mInfo._genOpts;
+	UINT32 timeMS;
 	
-	switch(evtType)
+	if (myPlayer.GetPlayer()->GetPlayerType() == FCC_VGM)
 	{
-	case MI_EVT_PLIST:
-		switch(evtParam)
-		{
-		case MIE_PL_QUIT:	// quit
-			mediaInfo._playState |= PLAYSTATE_END;
-			controlVal = +9;
-			return 0x10;
-		case MIE_PL_PREV:	// previous file
-			if (curSong <= 0)
+		VGMPlayer* vgmplay = dynamic_cast<VGMPlayer*>(myPlayer.GetPlayer());
+		myPlayer.SetLoopCount(vgmplay->GetModifiedLoopCount(genOpts.maxLoops));
+	}
+	else
+	{
+		// reset the loop count, else the VGM loop modifier of the previous song sticks
+		myPlayer.SetLoopCount(genOpts.maxLoops);
+	}
+	
+	// last song: fadeTime_single, others: fadeTime_plist
+	timeMS = (songIdx + 1 == songList.size()) ? genOpts.fadeTime_single : genOpts.fadeTime_plist;
+	myPlayer.SetFadeSamples(MSec2Samples(timeMS, myPlayer));
+	
+	timeMS = (myPlayer.GetPlayer()->GetLoopTicks() == 0) ? genOpts.pauseTime_jingle : genOpts.pauseTime_loop;
+	if (&mInfo == &mediaInfo && IsGaplessTransition(songIdx))
+		timeMS = 0;
+	myPlayer.SetEndSilenceSamples(MSec2Samples(timeMS, myPlayer));
+	
+	return;
+}
+
+// returns the number of samples until the fade-out of raw logs starts, (UINT32)-1 if there is none
+static UINT32 CheckRawLogFade(MediaInfo& mInfo)
+{
+	const GeneralOptions& genOpts = mInfo._genOpts;
+	PlayerA& myPlayer = *mInfo._player;
+	
+	if (! (genOpts.fadeRawLogs && mInfo._isRawLog && genOpts.fadeTime_single > 0))
+		return (UINT32)-1;
+	if (myPlayer.GetState() & (PLAYSTATE_FADE | PLAYSTATE_END))
+		return (UINT32)-1;
+	
+	const UINT8 timeFlags = PLAYTIME_LOOP_INCL | PLAYTIME_TIME_PBK;
+	double fadeStart = myPlayer.GetTotalTime(timeFlags) - genOpts.fadeTime_single / 1500.0;
+	double curTime = myPlayer.GetCurTime(timeFlags);
+	if (curTime >= fadeStart)
+	{
+		myPlayer.SetFadeSamples(MSec2Samples(genOpts.fadeTime_single, myPlayer));
+		myPlayer.FadeOut();	// (FadeTime / 1500) ends at 33%
+		return (UINT32)-1;
+	}
+	
+	double smplDist = ceil((fadeStart - curTime) * myPlayer.GetSampleRate());
+	return (smplDist < 1.0) ? 1 : (smplDist >= 0xFFFFFFFE) ? 0xFFFFFFFE : (UINT32)smplDist;
+}
+
+// Renders until the buffer is full or the song finished.
+// Render calls are split at the start of raw log fades, so that the result doesn't depend on the buffer size.
+static UINT32 RenderOfflineBlock(MediaInfo& mInfo, UINT32 bufSize, UINT8* data, UINT32 smplSize)
+{
+	PlayerA& myPlayer = *mInfo._player;
+	UINT32 bufPos;
+	
+	bufPos = 0;
+	while(bufPos < bufSize && ! (mInfo._playState & PLAYSTATE_FIN))
+	{
+		UINT32 renderSize = bufSize - bufPos;
+		UINT32 fadeDist = CheckRawLogFade(mInfo);
+		if (fadeDist != (UINT32)-1 && fadeDist < renderSize / smplSize)
+			renderSize = fadeDist * smplSize;
+		
+		UINT32 wrtBytes = myPlayer.Render(renderSize, &data[bufPos]);
+		if (wrtBytes == 0)
+			break;
+		bufPos += wrtBytes;
+	}
+	
+	return bufPos;
+}
+
+// returns the estimated song length in samples at 44.1 KHz, (UINT32)-1 if unknown
+static UINT32 GetSongLengthEstimate(const std::string& fileName, UINT32 maxLoops)
+{
+	DATA_LOADER* dLoad;
+	const UINT8* fileHdr;
+	UINT32 hdrSize;
+	UINT64 smplCnt;
+	UINT8 retVal;
+	SongIndexEntry sie;
+	
+	if (LookupSongIndex(fileName, sie))
+	{
+		double songLen = GetIndexedSongLength(sie, maxLoops) * 44100;
+		return (songLen < (UINT32)-1) ? (UINT32)songLen : (UINT32)-1;
+	}
+	
+	dLoad = GetFileLoaderUTF8(fileName);
+	if (dLoad == NULL)
+		return (UINT32)-1;
+	DataLoader_SetPreloadBytes(dLoad, 0x40);
+	retVal = DataLoader_Load(dLoad);
+	if (retVal)
+	{
+		DataLoader_CancelLoading(dLoad);
+		DataLoader_Deinit(dLoad);
+		return (UINT32)-1;
+	}
+	
+	fileHdr = DataLoader_GetData(dLoad);
+	hdrSize = DataLoader_GetSize(dLoad);
+	smplCnt = (UINT64)-1;
+	if (hdrSize >= 0x24 && ! memcmp(&fileHdr[0x00], "Vgm ", 4))
+	{
+		UINT32 totalSmpls = ReadLE32(&fileHdr[0x18]);
+		UINT32 loopSmpls = ReadLE32(&fileHdr[0x20]);
+		smplCnt = totalSmpls;
+		if (loopSmpls > 0 && maxLoops > 1)
+			smplCnt += (UINT64)loopSmpls * (maxLoops - 1);
+	}
+	else if (hdrSize >= 0x14 && ! memcmp(&fileHdr[0x00], "DBRAWOPL", 8))
+	{
+		// DRO v1 has the length (in msec) at offset 0x0C, DRO v2 at offset 0x10
+		UINT16 verMajor = ReadLE16(&fileHdr[0x08]);
+		UINT32 lenMS = ReadLE32(&fileHdr[(verMajor >= 2) ? 0x10 : 0x0C]);
+		smplCnt = (UINT64)lenMS * 44100 / 1000;
+	}
+	// S98 and GYM headers have no length information.
+	
+	DataLoader_CancelLoading(dLoad);
+	DataLoader_Deinit(dLoad);
+	return (smplCnt < (UINT32)-1) ? (UINT32)smplCnt : (UINT32)-1;
+}
+
+// The index uses absolute paths with '/' as separator.
+static std::string GetIndexPath(const std::string& fileName)
+{
+	std::string absPath = GetAbsolutePath(fileName);
+	StandardizeDirSeparators(absPath);
+	return absPath;
+}
+
+static bool LookupSongIndex(const std::string& fileName, SongIndexEntry& sie)
+{
+	UINT64 fileTime;
+	UINT64 fileSize;
+	
+	if (! songIndex.IsLoaded())
+		return false;
+	std::string absPath = GetIndexPath(fileName);
+	if (! GetFileStats(absPath, fileTime, fileSize))
+		return false;
+	return songIndex.Find(absPath, fileTime, fileSize, sie);
+}
+
+// copies the song information from the player, returns false if there is nothing to index
+static bool GetSongIndexInfo(PlayerA& player, SongIndexEntry& sie)
+{
+	PlayerBase* plrEngine = player.GetPlayer();
+	std::vector<PLR_DEV_INFO> diList;
+	
+	if (! songIndex.IsLoaded() || plrEngine == NULL)
+		return false;
+	sie.fmtFCC = plrEngine->GetPlayerType();
+	sie.totalTicks = plrEngine->GetTotalTicks();
+	sie.loopTicks = plrEngine->GetLoopTicks();
+	sie.lengthMS = (UINT32)(plrEngine->Tick2Second(sie.totalTicks) * 1000.0 + 0.5);
+	sie.loopMS = (UINT32)(plrEngine->Tick2Second(sie.loopTicks) * 1000.0 + 0.5);
+	
+	memset(sie.chipMask, 0x00, SIDX_CHIP_BYTES);
+	plrEngine->GetSongDeviceInfo(diList);
+	for (size_t curDev = 0; curDev < diList.size(); curDev ++)
+	{
+		if (diList[curDev].parentIdx != (UINT32)-1)
+			continue;	// skip linked/child devices
+		sie.chipMask[diList[curDev].type >> 3] |= (1 << (diList[curDev].type & 7));
+	}
+	
+	const char* const* tagList = plrEngine->GetTags();
+	sie.tags.clear();
+	for (const char* const* t = tagList; t != NULL && *t != NULL; t += 2)
+	{
+		if (t[1][0] != '\0')
+			sie.tags.push_back(std::pair<std::string, std::string>(t[0], t[1]));
+	}
+	
+	return true;
+}
+
+// adds the song information from GetSongIndexInfo() to the index
+static void AddSongToIndex(SongIndexEntry& sie, DATA_LOADER* dLoad, const std::string& fileName)
+{
+	SongIndexEntry oldSie;
+	
+	sie.path = GetIndexPath(fileName);
+	if (! GetFileStats(sie.path, sie.fileTime, sie.fileSize))
+		return;
+	if (songIndex.Find(sie.path, sie.fileTime, sie.fileSize, oldSie))
+		return;	// already up-to-date
+	
+	sie.hash = SongIndex::HashData(DataLoader_GetData(dLoad), DataLoader_GetSize(dLoad));
+	songIndex.Update(sie);
+	return;
+}
+
+// Note: The file must be loaded into the player completely.
+static void AddSongToIndex(PlayerA& player, DATA_LOADER* dLoad, const std::string& fileName)
+{
+	SongIndexEntry sie;
+	
+	if (! songIndex.IsLoaded() || player.GetPlayer() == NULL)
+		return;
+	if (GetSongIndexInfo(player, sie))
+		AddSongToIndex(sie, dLoad, fileName);
+	return;
+}
+
+static double GetIndexedSongLength(const SongIndexEntry& sie, UINT32 maxLoops)
+{
+	double songLen = sie.lengthMS / 1000.0;
+	if (sie.loopMS > 0 && maxLoops > 1)
+		songLen += sie.loopMS / 1000.0 * (maxLoops - 1);
+	return songLen;
+}
+
+static void CloseSongIndex(void)
+{
+	UINT8 retVal;
+	
+	if (! songIndex.IsLoaded())
+		return;
+	retVal = songIndex.Save();
+	if (retVal)
+		fprintf(stderr, "Warning: Unable to save song index %s%s (error 0x%02X)\n",
+			userCfgDir.c_str(), SONG_INDEX_FILE, retVal);
+	songIndex.Unload();
+	
+	return;
+}
+
+static UINT8 StartIndexScan(UINT32 thrCnt)
+{
+	UINT8 retVal;
+	
+	if (thrCnt > scanFiles.size())
+		thrCnt = (UINT32)scanFiles.size();
+	retVal = OSMutex_Init(&scanMtx, 0);
+	if (retVal)
+	{
+		scanMtx = NULL;
+		return 0xFF;
+	}
+	songLengths.assign(scanFiles.size(), -1.0);
+	scanNextFile = 0;
+	scanDoneCnt = 0;
+	scanNewCnt = 0;
+	scanFailCnt = 0;
+	scanStop = false;
+	
+	scanWorkers.resize(thrCnt);
+	for (size_t curWrk = 0; curWrk < scanWorkers.size(); curWrk ++)
+	{
+		IndexScanWorker& sw = scanWorkers[curWrk];
+		MediaInfo* mInfo = new MediaInfo;
+		
+		mInfo->_genOpts = mediaInfo._genOpts;
+		for (size_t curChp = 0; curChp < 0x100; curChp ++)
+			mInfo->_chipOpts[curChp] = mediaInfo._chipOpts[curChp];
+		mInfo->_playState = 0x00;
+		mInfo->_enableAlbumImage = false;
+		InitPlayerEngines(*mInfo);
+		mInfo->_player->SetLogCallback(NULL, NULL);	// don't mess up the display of the current song
+		
+		sw.mInfo = mInfo;
+		retVal = OSThread_Init(&sw.hThread, IndexScanThread, &sw);
+		if (retVal)
+			sw.hThread = NULL;
+	}
+	
+	return 0x00;
+}
+
+// cancel = false: wait for all files to be scanned
+static void StopIndexScan(bool cancel)
+{
+	if (scanMtx == NULL)
+		return;
+	
+	if (cancel)
+		scanStop = true;
+	for (size_t curWrk = 0; curWrk < scanWorkers.size(); curWrk ++)
+	{
+		IndexScanWorker& sw = scanWorkers[curWrk];
+		if (sw.hThread != NULL)
+		{
+			OSThread_Join(sw.hThread);
+			OSThread_Deinit(sw.hThread);
+			sw.hThread = NULL;
+		}
+		sw.mInfo->_player->UnregisterAllPlayers();
+		delete sw.mInfo;
+		sw.mInfo = NULL;
+	}
+	scanWorkers.clear();
+	scanFiles.clear();
+	songLengths.clear();
+	OSMutex_Deinit(scanMtx);	scanMtx = NULL;
+	
+	return;
+}
+
+static void IndexScanThread(void* args)
+{
+	IndexScanWorker* sw = (IndexScanWorker*)args;
+	
+	while(! scanStop)
+	{
+		size_t fileIdx;
+		UINT8 retVal;
+		
+		OSMutex_Lock(scanMtx);
+		fileIdx = scanNextFile;
+		if (scanNextFile < scanFiles.size())
+			scanNextFile ++;
+		OSMutex_Unlock(scanMtx);
+		if (fileIdx >= scanFiles.size())
+			break;
+		
+		retVal = ScanSongFile(*sw->mInfo, fileIdx);
+		OSMutex_Lock(scanMtx);
+		scanDoneCnt ++;
+		if (retVal & 0x80)
+			scanFailCnt ++;
+		else if (retVal == 0x01)
+			scanNewCnt ++;
+		OSMutex_Unlock(scanMtx);
+	}
+	
+	return;
+}
+
+// returns 0x00 if the file was already indexed, 0x01 if it was added, 0x80+ on errors
+static UINT8 ScanSongFile(MediaInfo& mInfo, size_t fileIdx)
+{
+	PlayerA& player = *mInfo._player;
+	const std::string& fileName = scanFiles[fileIdx];
+	DATA_LOADER* dLoad;
+	SongIndexEntry sie;
+	UINT8 retVal;
+	
+	retVal = 0x00;
+	if (! LookupSongIndex(fileName, sie))
+	{
+		dLoad = GetFileLoaderUTF8(fileName);
+		if (dLoad == NULL)
+			return 0xFF;
+		DataLoader_SetPreloadBytes(dLoad, 0x100);
+		retVal = DataLoader_Load(dLoad);
+		if (retVal)
+		{
+			DataLoader_CancelLoading(dLoad);
+			DataLoader_Deinit(dLoad);
+			return 0xFF;
+		}
+		
+		// A renamed or copied file doesn't need to be parsed again.
+		DataLoader_ReadAll(dLoad);
+		if (songIndex.FindHash(SongIndex::HashData(DataLoader_GetData(dLoad), DataLoader_GetSize(dLoad)), sie))
+		{
+			sie.path = GetIndexPath(fileName);
+			if (GetFileStats(sie.path, sie.fileTime, sie.fileSize))
+				songIndex.Update(sie);
+		}
+		else if (! player.LoadFile(dLoad))
+		{
+			AddSongToIndex(player, dLoad, fileName);
+			player.UnloadFile();
+		}
+		DataLoader_Deinit(dLoad);
+		if (! LookupSongIndex(fileName, sie))
+			return 0x80;	// unknown format or the file was changed in the meantime
+		retVal = 0x01;
+	}
+	
+	OSMutex_Lock(scanMtx);
+	songLengths[fileIdx] = GetIndexedSongLength(sie, mInfo._genOpts.maxLoops);
+	OSMutex_Unlock(scanMtx);
+	
+	return retVal;
+}
+
+// returns " (total: h:mm:ss)" or an empty string if the playlist wasn't scanned
+static std::string GetPlaylistLengthStr(size_t playlistID)
+{
+	double totalLen;
+	size_t unknownCnt;
+	char buffer[0x20];
+	
+	if (scanMtx == NULL)
+		return std::string();
+	
+	totalLen = 0.0;
+	unknownCnt = 0;
+	OSMutex_Lock(scanMtx);
+	for (size_t curSng = 0; curSng < songList.size() && curSng < songLengths.size(); curSng ++)
+	{
+		if (songList[curSng].playlistID != playlistID)
+			continue;
+		if (songLengths[curSng] < 0.0)
+			unknownCnt ++;
+		else
+			totalLen += songLengths[curSng];
+	}
+	OSMutex_Unlock(scanMtx);
+	
+	std::string result = "  (total: " + GetTimeStr(totalLen, -1);
+	if (unknownCnt > 0)
+	{
+		sprintf(buffer, " + %u unknown", (unsigned)unknownCnt);
+		result += buffer;
+	}
+	result += ")";
+	return result;
+}
+
+static void ShowSongInfo(void)
+{
+	PlayerBase* player = mediaInfo._player->GetPlayer();
+	
+	u8printf("Track Title:    %s\n", mediaInfo.GetSongTagForDisp("TITLE"));
+	u8printf("Game Name:      %s\n", mediaInfo.GetSongTagForDisp("GAME"));
+	if (player->GetPlayerType() == FCC_GYM)
+		u8printf("Emulator:       %s\n", mediaInfo.GetSongTagForDisp("EMULATOR"));
+	else
+		u8printf("System:         %s\n", mediaInfo.GetSongTagForDisp("SYSTEM"));
+	if (player->GetPlayerType() == FCC_GYM)
+		u8printf("Publisher:      %s\n", mediaInfo.GetSongTagForDisp("PUBLISHER"));
+	else
+		u8printf("Composer:       %s\n", mediaInfo.GetSongTagForDisp("ARTIST"));
+	if (player->GetPlayerType() == FCC_S98)
+	{
+		S98Player* s98play = dynamic_cast<S98Player*>(player);
+		const S98_HEADER* s98hdr = s98play->GetFileHeader();
+		
+		u8printf("Release:        %-11s Tick Rate: %u/%u\n", mediaInfo.GetSongTagForDisp("DATE"),
+			s98hdr->tickMult, s98hdr->tickDiv);
+	}
+	else
+	{
+		u8printf("Release:        %s\n", mediaInfo.GetSongTagForDisp("DATE"));
+	}
+	printf("Format:         %-11s ", mediaInfo._fileVerStr.c_str());
+	printf("Gain:%5.2f    ", mediaInfo._volGain);
+	if (player->GetPlayerType() == FCC_DRO)
+	{
+		DROPlayer* droplay = dynamic_cast<DROPlayer*>(player);
+		const DRO_HEADER* drohdr = droplay->GetFileHeader();
+		const char* hwType;
+		
+		if (drohdr->hwType == 0)
+			hwType = "OPL2";
+		else if (drohdr->hwType == 1)
+			hwType = "DualOPL2";
+		else if (drohdr->hwType == 2)
+			hwType = "OPL3";
+		else
+			hwType = "unknown";
+		printf("HWType: %s\n", hwType);
+	}
+	else
+	{
+		if (mediaInfo._looping)
+			printf("Loop: Yes (%s)\n", GetTimeStr(mediaInfo._player->GetLoopTime(), -1).c_str());
+		else if (mediaInfo._isRawLog && mediaInfo._genOpts.fadeRawLogs)
+			printf("Loop: No (raw)\n");
+		else
+			printf("Loop: No\n");
+	}
+	u8printf("VGM by:         %s\n", mediaInfo.GetSongTagForDisp("ENCODED_BY"));
+	u8printf("Notes:          %s\n", mediaInfo.GetSongTagForDisp("COMMENT"));
+	printf("\n");
+	
+	printf("Used chips:     ");
+	for (size_t curDev = 0; curDev < mediaInfo._chipList.size(); curDev ++)
+	{
+		const MediaInfo::DeviceItem& di = mediaInfo._chipList[curDev];
+		unsigned int devCnt = 1;
+		
+		for (; curDev + 1 < mediaInfo._chipList.size(); curDev ++)
+		{
+			const MediaInfo::DeviceItem& di1 = mediaInfo._chipList[curDev + 1];
+			if (di1.name != di.name)
 				break;
-			mediaInfo._playState |= PLAYSTATE_END;
-			controlVal = -1;
-			return 0x10;
-		case MIE_PL_NEXT:	// next file
-			if (curSong + 1 >= songList.size())
+			if (mediaInfo._genOpts.showDevCore && di1.core != di.core)
 				break;
-			mediaInfo._playState |= PLAYSTATE_END;
-			controlVal = +1;
-			return 0x10;
+			devCnt ++;
 		}
-		break;
-	case MI_EVT_CONTROL:
-		switch(evtParam)
+		
+		if (devCnt > 1)
+			printf("%ux", devCnt);
+		if (mediaInfo._genOpts.showDevCore)
+			printf("%s (%s), ", di.name.c_str(), di.core.c_str());
+		else
+			printf("%s, ", di.name.c_str());
+	}
+	printf("\b\b \n\n");
+	return;
+}
+
+static void ShowConsoleTitle(void)
+{
+	const std::string& fileName = mediaInfo._songPath;
+	std::string titleTag = mediaInfo.GetSongTagForDisp("TITLE");
+	std::string gameTag = mediaInfo.GetSongTagForDisp("GAME");
+	std::string titleStr;
+	
+	// show "Song (Game) - VGM Player" as console title
+	if (! titleTag.empty())
+		titleStr = titleTag;
+	else
+		titleStr = GetFileTitle(fileName.c_str());
+	
+	if (! gameTag.empty())
+		titleStr = titleStr + " (" + gameTag + ")";
+	
+	titleStr = titleStr + " - " + APP_NAME;
+	
+#ifdef WIN32
+	size_t titleWLen = 0;
+	wchar_t* titleWStr = NULL;
+	UINT8 retVal = CPConv_StrConvert(cpcU8_Wide, &titleWLen, reinterpret_cast<char**>(&titleWStr),
+		titleStr.length() + 1, titleStr.c_str());	// length()+1 to include the \0
+	if (retVal < 0x80)
+		SetConsoleTitleW(titleWStr);		// Set Windows Console Title
+	free(titleWStr);
+#else
+	printf("\x1B]0;%s\x07", titleStr.c_str());	// Set xterm/rxvt Terminal Title
+#endif
+	
+	return;
+}
+
+static void ShowPlaybackStatus(void)
+{
+	const GeneralOptions& genOpts = mediaInfo._genOpts;
+	PlayerA& myPlayer = *mediaInfo._player;
+	const std::vector<VGMPlayer::DACSTRM_DEV>* vgmPcmStrms = NULL;
+	const char* pState;
+	
+	if (myPlayer.GetPlayer()->GetPlayerType() == FCC_VGM)
+	{
+		VGMPlayer* vgmplay = dynamic_cast<VGMPlayer*>(myPlayer.GetPlayer());
+		vgmPcmStrms = &vgmplay->GetStreamDevInfo();
+	}
+	
+	if (mediaInfo._playState & PLAYSTATE_PAUSE)
+		pState = "Paused ";
+	else if (myPlayer.GetState() & PLAYSTATE_END)
+		pState = "Finish ";
+	else if (myPlayer.GetState() & PLAYSTATE_FADE)
+		pState = "Fading ";
+	else
+		pState = "Playing";
+	
+	UINT32 dataLen = mediaInfo._fileEndPos - mediaInfo._fileStartPos;
+	UINT32 dataPos = myPlayer.GetCurPos(PLAYPOS_FILEOFS);
+	dataPos = (dataPos >= mediaInfo._fileStartPos) ? (dataPos - mediaInfo._fileStartPos) : 0x00;
+	
+	if ((chipTimingOn || showAudioStats) && adOut.data != NULL)
+	{
+		std::string statStr;
+		if (showAudioStats)
+			statStr = GetAudioStatsStr();
+		if (chipTimingOn)
+			statStr += (statStr.empty() ? "" : "  ") + GetChipTimingStr();
+		printf("%s%6.2f%%  %s / %s seconds  %s  \r", pState,
+			100.0 * dataPos / dataLen,
+			GetTimeStr(mediaInfo.GetCurTime(genOpts.timeDispStyle), timeDispMode).c_str(),
+			GetTimeStr(myPlayer.GetTotalTime(genOpts.timeDispStyle), timeDispMode).c_str(),
+			statStr.c_str());
+	}
+	else if (vgmPcmStrms == NULL || vgmPcmStrms->empty())
+	{
+		printf("%s%6.2f%%  %s / %s seconds  \r", pState,
+			100.0 * dataPos / dataLen,
+			GetTimeStr(mediaInfo.GetCurTime(genOpts.timeDispStyle), timeDispMode).c_str(),
+			GetTimeStr(myPlayer.GetTotalTime(genOpts.timeDispStyle), timeDispMode).c_str());
+	}
+	else
+	{
+		const VGMPlayer::DACSTRM_DEV* strmDev = &(*vgmPcmStrms)[0];
+		std::string pbMode;
+		if (strmDev->pbMode & 0x10)
+			pbMode += 'R';	// reverse playback
+		if (strmDev->pbMode & 0x80)
+			pbMode += 'L';	// looping
+		printf("%s%6.2f%%  %s / %s seconds", pState,
+			100.0 * dataPos / dataLen,
+			GetTimeStr(mediaInfo.GetCurTime(genOpts.timeDispStyle), timeDispMode).c_str(),
+			GetTimeStr(myPlayer.GetTotalTime(genOpts.timeDispStyle), timeDispMode).c_str());
+		if (genOpts.showStrmCmds == 0x01)
+			printf("  %02X / %02X %s", 1 + strmDev->lastItem, strmDev->maxItems, pbMode.c_str());
+		else if (genOpts.showStrmCmds == 0x02)
+			printf("  %02X / %02X at %5u Hz %s", 1 + strmDev->lastItem, strmDev->maxItems,
+				strmDev->freq, pbMode.c_str());
+		else if (genOpts.showStrmCmds == 0x03)
+			printf("  %02X / %02X at %4.1f KHz %s", 1 + strmDev->lastItem, strmDev->maxItems,
+				strmDev->freq / 1000.0, pbMode.c_str());
+		printf("  \r");
+	}
+	fflush(stdout);
+	
+	return;
+}
+
+static UINT8 PlayFile(void)
+{
+	PlayerA& myPlayer = *mediaInfo._player;
+	UINT8 retVal;
+	bool needRefresh;
+	UINT32 fadeDist;	// samples until the raw log fade-out starts
+	
+	pauseAfterEnd = false;
+	quitAfterEnd = false;
+	
+	if (adOut.data == NULL && adLog.data != NULL)
+		return PlayFileOffline();
+	
+	cbStats.Reset();
+	if (adOut.data == NULL)
+	{
+		retVal = 0xFF;
+	}
+	else if (gaplessNext)
+	{
+		// The render thread already started this song and the callback is still active.
+		retVal = AERR_OK;
+	}
+	else if (renderThread != NULL)
+	{
+		UINT64 cacheKey = GetRenderCacheKey(myPlayer, curSongData);
+		
+		OSMutex_Lock(renderMtx);
+		renderRing.Reset();
+		CancelSeekRequest();
+		seekRendering = false;
+		StopReplay(false);
+		StopLoopReplay(false);
+		seekHist.Clear();
+		StartRenderCache(cacheKey);
+		gaplessSwitching = false;
+		while(RenderToRing() > 0)
+			;	// fill the whole buffer before starting playback
+		renderRingActive = true;
+		OSMutex_Unlock(renderMtx);
+		retVal = AudioDrv_SetCallback(adOut.data, FillBufferFromRing, NULL);
+	}
+	else
+	{
+		retVal = AudioDrv_SetCallback(adOut.data, FillBuffer, &myPlayer);
+	}
+	manualRenderLoop = (retVal != AERR_OK);
+	controlVal = 0;
+	mediaInfo._playState &= ~(PLAYSTATE_END | PLAYSTATE_FIN);
+	noDispTime = 0;
+	needRefresh = true;
+	fadeDist = (UINT32)-1;
+	while(! (mediaInfo._playState & PLAYSTATE_END))
+	{
+		if (! (mediaInfo._playState & PLAYSTATE_PAUSE) && noDispTime <= 0)
+			needRefresh = true;	// always update when playing
+		if (needRefresh)
+		{
+			ShowPlaybackStatus();
+			needRefresh = false;
+			noDispTime = 0;
+		}
+		
+		if (manualRenderLoop && ! (mediaInfo._playState & PLAYSTATE_PAUSE))
+		{
+			UINT32 wrtBytes = FillBuffer(NULL, &myPlayer, (UINT32)audioBuf.size(), &audioBuf[0]);
+			AudioDrv_WriteData(adOut.data, wrtBytes, &audioBuf[0]);
+			if (noDispTime > 0)
+			{
+				noDispTime -= 200;
+				if (noDispTime <= 0)
+					needRefresh = true;
+			}
+		}
+		else
+		{
+			// Sleep until a key is pressed, a control event arrives or something needs to be updated.
+			// When paused, there are no wakeups at all.
+			UINT32 waitTime = (UINT32)-1;
+			UINT64 waitStart;
+			if (! (mediaInfo._playState & PLAYSTATE_PAUSE))
+			{
+				waitTime = STATUS_REFRESH_TIME;
+				if (fadeDist != (UINT32)-1)
+				{
+					UINT32 fadeTime = (UINT32)((UINT64)fadeDist * 1000 / myPlayer.GetSampleRate());
+					if (waitTime > fadeTime)
+						waitTime = fadeTime;
+				}
+				if ((mediaInfo._playState & PLAYSTATE_FIN) && waitTime > 10)
+					waitTime = 10;	// waiting for the render thread's buffer to drain
+			}
+			if (noDispTime > 0 && waitTime > (UINT32)noDispTime)
+				waitTime = (UINT32)noDispTime;
+			waitStart = GetTimeUSec();
+			evtWaiter.SetTimer(waitTime);
+			evtWaiter.Wait();
+			if (noDispTime > 0)
+			{
+				noDispTime -= (INT32)((GetTimeUSec() - waitStart) / 1000);
+				if (noDispTime <= 0)
+					needRefresh = true;
+			}
+		}
+		
+		if (renderRingActive)
+			ArmGaplessSwitch();
+		
+		fadeDist = (UINT32)-1;
+		if (! (mediaInfo._playState & PLAYSTATE_PAUSE))
+		{
+			// The player is rendered by the audio callback or the render thread, both hold renderMtx.
+			OSMutex_Lock(renderMtx);
+			fadeDist = CheckRawLogFade(mediaInfo);
+			OSMutex_Unlock(renderMtx);
+		}
+		// with an active render thread, the song ends when the ring buffer ran empty
+		if (! renderRingActive || renderRing.GetFillLevel() == 0 || (mediaInfo._playState & PLAYSTATE_PAUSE))
+			CheckSongEnd();
+		
+		retVal = ProcessControls();
+		if (retVal)
+		{
+			needRefresh = true;
+			if (retVal >= 0x10)
+				break;
+		}
+		if (gapless.switched)
+			break;	// The render thread moved on to the next song.
+	}
+	if (! controlVal)
+	{
+		if (quitAfterEnd)
+			controlVal = 9;	// quit
+		else
+			controlVal = +1;	// finished normally - next song
+	}
+	
+	gaplessNext = false;
+	if (renderRingActive)
+	{
+		OSMutex_Lock(renderMtx);
+		gaplessNext = (gapless.switched && controlVal == +1);
+		if (! gaplessNext)
+			gapless.songIdx = (size_t)-1;	// prevent a switch after we decided to stop
+		OSMutex_Unlock(renderMtx);
+	}
+	// With gapless playback, the render thread keeps running and the callback stays active.
+	if (! gaplessNext)
+	{
+		// remove callback to prevent further rendering
+		// also waits for render thread to finish its work
+		if (adOut.data != NULL)
+		{
+			if (dummyRenderAtLoad)
+				AudioDrv_SetCallback(adOut.data, FillBufferDummy, NULL);
+			else
+				AudioDrv_SetCallback(adOut.data, NULL, NULL);
+		}
+		if (renderRingActive)
+		{
+			OSMutex_Lock(renderMtx);
+			renderRingActive = false;
+			gaplessSwitching = false;
+			OSMutex_Unlock(renderMtx);
+		}
+	}
+	printf("\n");
+	if (adOut.data != NULL)
+	{
+		AudioCallbackStats::Summary cbSum;
+		cbStats.GetSummary(cbSum);
+		if (showAudioStats)
+			PrintAudioStats(cbSum);
+		if (! mediaInfo._genOpts.audioStatsLog.empty())
+			WriteAudioStatsLog(cbSum);
+		if (cbSum.underruns > cbSum.transUnderruns)
+			fprintf(stderr, "Warning: %u buffer underruns - try increasing RenderAhead.\n",
+				cbSum.underruns - cbSum.transUnderruns);
+		if (cbSum.transUnderruns > 0)
+			fprintf(stderr, "Warning: %u buffer underruns while switching to the next song.\n", cbSum.transUnderruns);
+	}
+	
+	return 0x00;
+}
+
+// "log only" mode: render as fast as possible, straight into the WAV writer
+static UINT8 PlayFileOffline(void)
+{
+	const AUDIO_OPTS* logOpts = AudioDrv_GetOptions(adLog.data);
+	UINT32 smplSize = logOpts->numChannels * logOpts->numBitsPerSmpl / 8;
+	UINT64 renderTime;	// time spent rendering/writing, in microseconds
+	UINT64 renderSmpls;
+	UINT64 lastCtrlTime;
+	UINT8 retVal;
+	
+	manualRenderLoop = true;
+	controlVal = 0;
+	mediaInfo._playState &= ~(PLAYSTATE_END | PLAYSTATE_FIN);
+	noDispTime = 0;
+	renderTime = 0;
+	renderSmpls = 0;
+	ShowPlaybackStatus();
+	lastCtrlTime = GetTimeUSec();
+	while(! (mediaInfo._playState & PLAYSTATE_END))
+	{
+		UINT64 curTime;
+		
+		if (mediaInfo._playState & PLAYSTATE_PAUSE)
+		{
+			evtWaiter.SetTimer((noDispTime > 0) ? (UINT32)noDispTime : (UINT32)-1);
+			evtWaiter.Wait();
+		}
+		else
+		{
+			UINT64 startTime = GetTimeUSec();
+			UINT32 wrtBytes = RenderOfflineBlock(mediaInfo, (UINT32)audioBuf.size(), &audioBuf[0], smplSize);
+			AudioDrv_WriteData(adLog.data, wrtBytes, &audioBuf[0]);
+			renderTime += GetTimeUSec() - startTime;
+			renderSmpls += wrtBytes / smplSize;
+		}
+		CheckSongEnd();
+		
+		// Keys and the status line are handled in fixed intervals instead of once per block.
+		curTime = GetTimeUSec();
+		if (! (mediaInfo._playState & (PLAYSTATE_PAUSE | PLAYSTATE_END)) &&
+			curTime - lastCtrlTime < OFFLINE_CTRL_INTERVAL * 1000)
+			continue;
+		if (noDispTime > 0)
+			noDispTime -= (INT32)((curTime - lastCtrlTime) / 1000);
+		lastCtrlTime = curTime;
+		
+		retVal = ProcessControls();
+		if (retVal >= 0x10)
+			break;
+		if (noDispTime <= 0)
+		{
+			ShowPlaybackStatus();
+			noDispTime = 0;
+		}
+	}
+	
+	if (! controlVal)
+	{
+		if (quitAfterEnd)
+			controlVal = 9;	// quit
+		else
+			controlVal = +1;	// finished normally - next song
+	}
+	printf("\n");
+	if (renderTime > 0)
+	{
+		double smplTime = (double)renderSmpls / logOpts->sampleRate;
+		double cpuTime = renderTime / 1000000.0;
+		printf("Rendered %s in %.2f s (%.1fx realtime)\n", GetTimeStr(smplTime, -1).c_str(),
+			cpuTime, smplTime / cpuTime);
+	}
+	
+	return 0x00;
+}
+
+static void CheckSongEnd(void)
+{
+	if (! (mediaInfo._playState & PLAYSTATE_FIN))
+		return;
+	
+	if (! (mediaInfo._playState & PLAYSTATE_PAUSE))
+	{
+		if (pauseAfterEnd)
+		{
+			mediaInfo.Event(MI_EVT_PAUSE, MIE_PS_PAUSE);
+			pauseAfterEnd = false;
+		}
+		else
+		{
+			mediaInfo._playState |= PLAYSTATE_END;
+		}
+	}
+	if (! (mediaInfo._player->GetState() & PLAYSTATE_END) && ! cacheReplayEnd)
+		mediaInfo._playState &= ~PLAYSTATE_FIN;	// remove "finished" flag when seeking back
+	
+	return;
+}
+
+static void MainLoopWakeup(MediaInfo* mInfo, void* userParam)
+{
+	evtWaiter.Wake();
+	return;
+}
+
+static UINT8 ProcessControls(void)
+{
+	UINT8 evtType;
+	INT32 evtParam;
+	UINT8 retVal;
+	
+	HandleKeyPress(false);
+	retVal = 0x00;
+	while(retVal < 0x10 && mediaInfo.PopEvent(evtType, evtParam))
+	{
+		UINT8 evtRet = HandleCtrlEvent(evtType, evtParam);
+		if (evtRet > retVal)
+			retVal = evtRet;
+	}
+	if (seekDone)
+	{
+		seekDone = false;
+		mediaInfo.Signal(MI_SIG_POSITION);
+		if (retVal < 0x01)
+			retVal = 0x01;
+	}
+	
+	return retVal;
+}
+
+static UINT8 HandleCtrlEvent(UINT8 evtType, INT32 evtParam)
+{
+	const GeneralOptions& genOpts = mediaInfo._genOpts;
+	
+	switch(evtType)
+	{
+	case MI_EVT_PLIST:
+		switch(evtParam)
+		{
+		case MIE_PL_QUIT:	// quit
+			mediaInfo._playState |= PLAYSTATE_END;
+			controlVal = +9;
+			return 0x10;
+		case MIE_PL_PREV:	// previous file
+			if (curSong <= 0)
+				break;
+			mediaInfo._playState |= PLAYSTATE_END;
+			controlVal = -1;
+			return 0x10;
+		case MIE_PL_NEXT:	// next file
+			if (curSong + 1 >= songList.size())
+				break;
+			mediaInfo._playState |= PLAYSTATE_END;
+			controlVal = +1;
+			return 0x10;
+		}
+		break;
+	case MI_EVT_CONTROL:
+		switch(evtParam)
+		{
+		case MIE_CTRL_START:	// start
+			if (! (mediaInfo._playState & PLAYSTATE_PLAY))
+				break;
+			OSMutex_Lock(renderMtx);
+			mediaInfo._playState &= ~PLAYSTATE_PAUSE;
+			OSMutex_Unlock(renderMtx);
+			if (adOut.data != NULL)
+			{
+				cbStats.SkipInterval();
+				AudioDrv_Resume(adOut.data);
+			}
+			mediaInfo.Signal(MI_SIG_PLAY_STATE);
+			return 0x01;
+		case MIE_CTRL_STOP:	// stop
+			if (! (mediaInfo._playState & PLAYSTATE_PLAY))
+				break;
+			OSMutex_Lock(renderMtx);
+			mediaInfo._playState |= PLAYSTATE_PAUSE;
+			CancelSeekRequest();
+			seekRendering = false;
+			StopReplay(false);
+			StopLoopReplay(false);
+			StopRenderCache(false);
+			mediaInfo._player->Reset();
+			DiscardRenderAhead();
+			OSMutex_Unlock(renderMtx);
+			if (adOut.data != NULL)
+				AudioDrv_Pause(adOut.data);
+			mediaInfo.Signal(MI_SIG_POSITION | MI_SIG_PLAY_STATE);
+			return 0x01;
+			//return 0x10;
+		case MIE_CTRL_RESTART:	// restart
+			if (! (mediaInfo._playState & PLAYSTATE_PLAY))
+				break;
+			OSMutex_Lock(renderMtx);
+			CancelSeekRequest();
+			seekRendering = false;
+			StopReplay(false);
+			StopLoopReplay(false);
+			StopRenderCache(false);
+			mediaInfo._player->Reset();
+			DiscardRenderAhead();
+			OSMutex_Unlock(renderMtx);
+			mediaInfo.Signal(MI_SIG_POSITION);
+			return 0x01;
+		}
+		break;
+	case MI_EVT_PAUSE:
+		if (! (mediaInfo._playState & PLAYSTATE_PLAY))
+			break;
+		switch(evtParam)
+		{
+		case MIE_PS_PAUSE:	// pause
+			mediaInfo._playState |= PLAYSTATE_PAUSE;
+			break;
+		case MIE_PS_RESUME:	// resume
+			mediaInfo._playState &= ~PLAYSTATE_PAUSE;
+			break;
+		case MIE_PS_TOGGLE:	// pause toggle
+			mediaInfo._playState ^= PLAYSTATE_PAUSE;
+			break;
+		}
+		/*if (genOpts.soundWhilePaused)
+		{
+			// TODO
+		}
+		else*/ if (adOut.data != NULL)
+		{
+			if (mediaInfo._playState & PLAYSTATE_PAUSE)
+			{
+				AudioDrv_Pause(adOut.data);
+			}
+			else
+			{
+				cbStats.SkipInterval();
+				AudioDrv_Resume(adOut.data);
+			}
+		}
+		mediaInfo.Signal(MI_SIG_PLAY_STATE);
+		return 0x01;
+	case MI_EVT_FADE:	// fade out
+		if (! (mediaInfo._playState & PLAYSTATE_PLAY))
+			break;
+		// enforce "non-playlist" fade-out
+		OSMutex_Lock(renderMtx);
+		StopLoopReplay(true);	// The player has to render the fade.
+		StopRenderCache(true);
+		mediaInfo._player->SetFadeSamples(MSec2Samples(genOpts.fadeTime_single, *mediaInfo._player));
+		mediaInfo._player->FadeOut();
+		OSMutex_Unlock(renderMtx);
+		return 0x01;
+	case MI_EVT_SEEK_REL:
+		if (! (mediaInfo._playState & PLAYSTATE_PLAY))
+			break;
+		{
+			UINT32 destPos = GetSeekBasePos();
+			if ((genOpts.timeDispStyle & PLAYTIME_TIME_PBK) == PLAYTIME_TIME_FILE)
+				evtParam = (INT32)(evtParam / mediaInfo._player->GetPlaybackSpeed() + 0.5);	// scale according to playback speed
+			if (evtParam < 0 && (UINT32)-evtParam > destPos)
+				destPos = 0;
+			else
+				destPos += evtParam;
+			RequestSeek(PLAYPOS_SAMPLE, destPos);
+		}
+		return 0x01;
+	case MI_EVT_SEEK_ABS:
+		if (! (mediaInfo._playState & PLAYSTATE_PLAY))
+			break;
+		RequestSeek(PLAYPOS_SAMPLE, (UINT32)evtParam);
+		return 0x01;
+	case MI_EVT_SEEK_PERC:
+		if (! (mediaInfo._playState & PLAYSTATE_PLAY))
+			break;
+		if (evtParam < 0)
+			evtParam = 0;
+		{
+			UINT32 maxPos;
+			UINT32 destPos;
+			
+			maxPos = mediaInfo._player->GetPlayer()->GetTotalPlayTicks(genOpts.maxLoops);
+			destPos = maxPos * evtParam / 100;
+			RequestSeek(PLAYPOS_TICK, destPos);
+		}
+		return 0x01;
+	case MI_EVT_VOL_SET:
+		masterVol = evtParam;
+		OSMutex_Lock(renderMtx);
+		mediaInfo._player->SetMasterVolume(masterVol);
+		ClearSeekHistory();	// The stored audio uses the old volume.
+		OSMutex_Unlock(renderMtx);
+		{
+			double vol = masterVol / (double)0x10000;
+			double volDB = log(vol) / M_LN2 * 6.0;
+			printf("Volume: %.3f (%+5.1f db)%*s  \r", vol, volDB, 19, "");	fflush(stdout);
+			noDispTime = 1000;
+		}
+		break;
+	case MI_EVT_VOL_CHG:
+		{
+			double vol = masterVol / (double)0x10000;
+			vol *= pow(2.0, evtParam / 60.0);
+			masterVol = (INT32)(vol * 0x10000 + 0.5);
+			if (masterVol < 0x0800)	// 1.0/32 = -30 db
+				masterVol = 0x0800;
+			else if (masterVol > 0x200000)	// 1.0*32 = +30 db
+				masterVol = 0x200000;
+		}
+		OSMutex_Lock(renderMtx);
+		mediaInfo._player->SetMasterVolume(masterVol);
+		ClearSeekHistory();	// The stored audio uses the old volume.
+		OSMutex_Unlock(renderMtx);
+		{
+			double vol = masterVol / (double)0x10000;
+			double volDB = log(vol) / M_LN2 * 6.0;
+			printf("Volume: %.3f (%+5.1f db)%*s  \r", vol, volDB, 19, "");	fflush(stdout);
+			noDispTime = 1000;
+		}
+		break;
+	case MI_EVT_SPD_SET:
+		masterSpeed = evtParam;
+		OSMutex_Lock(renderMtx);
+		mediaInfo._player->SetPlaybackSpeed(masterSpeed);
+		ClearSeekHistory();
+		OSMutex_Unlock(renderMtx);
+		printf("Speed: %6.3fx%*s  \r", masterSpeed, 29, "");	fflush(stdout);
+		noDispTime = 1000;
+		break;
+	case MI_EVT_SPD_CHG:
+		{
+			int logSpeed = (int)floor(log(masterSpeed) / M_LN2 * 0x100 + 0.5);
+			logSpeed += evtParam;
+			if (logSpeed < -0x600)
+				logSpeed = -0x600;
+			else if (logSpeed > +0x600)
+				logSpeed = +0x600;
+			masterSpeed = pow(2.0, logSpeed / (double)0x100);
+		}
+		OSMutex_Lock(renderMtx);
+		mediaInfo._player->SetPlaybackSpeed(masterSpeed);
+		ClearSeekHistory();
+		OSMutex_Unlock(renderMtx);
+		printf("Speed: %6.3fx%*s  \r", masterSpeed, 29, "");	fflush(stdout);
+		noDispTime = 1000;
+		break;
+	}
+	
+	return 0x00;
+}
+
+static bool SongLenGreater(const std::pair<UINT32, size_t>& a, const std::pair<UINT32, size_t>& b)
+{
+	return a.first > b.first;
+}
+
+// starts measuring the render time of the current song
+static void StartChipTiming(void)
+{
+	const AUDIO_OPTS* opts = AudioDrv_GetOptions(adOut.data);
+	
+	StopChipTiming(false);
+	OSMutex_Lock(renderMtx);
+	chipRenderTime = 0;
+	chipRenderSmpls = 0;
+	chipPeakLoad = 0;
+	chipSmplSize = opts->numChannels * opts->numBitsPerSmpl / 8;
+	chipTimingOn = true;
+	OSMutex_Unlock(renderMtx);
+	
+	return;
+}
+
+// showResult = true: print the results of the song and append them to the log file
+static void StopChipTiming(bool showResult)
+{
+	if (! chipTimingOn)
+		return;
+	
+	OSMutex_Lock(renderMtx);
+	chipTimingOn = false;
+	OSMutex_Unlock(renderMtx);
+	if (! showResult || chipRenderSmpls == 0)
+		return;
+	
+	double songTime = (double)chipRenderSmpls / mediaInfo._player->GetSampleRate();
+	double cpuLoad = chipRenderTime / 10000.0 / songTime;
+	printf("Render time: %.2f s for %s (%.1f %% CPU, peak %u %%)\n", chipRenderTime / 1000000.0,
+		GetTimeStr(songTime, -1).c_str(), cpuLoad, chipPeakLoad);
+	if (! mediaInfo._genOpts.chipTimingLog.empty())
+		WriteChipTimingLog(songTime, cpuLoad);
+	
+	return;
+}
+
+// returns the CPU usage for the status line, e.g. "CPU 12.3%"
+static std::string GetChipTimingStr(void)
+{
+	std::string result;
+	char buffer[0x40];
+	
+	OSMutex_Lock(renderMtx);
+	if (chipRenderSmpls > 0)
+	{
+		double songTime = (double)chipRenderSmpls / mediaInfo._player->GetSampleRate();
+		double cpuLoad = chipRenderTime / 10000.0 / songTime;
+		sprintf(buffer, "CPU %.1f%%", cpuLoad);
+		result = buffer;
+	}
+	OSMutex_Unlock(renderMtx);
+	
+	return result;
+}
+
+static void WriteChipTimingLog(double songTime, double cpuLoad)
+{
+	FILE* hFile;
+	
+	hFile = fopen(mediaInfo._genOpts.chipTimingLog.c_str(), "at");
+	if (hFile == NULL)
+		return;
+	
+	fprintf(hFile, "{\"file\": \"%s\", \"seconds\": %.3f, \"renderSeconds\": %.3f, \"cpu\": %.2f, \"peak\": %u}\n",
+		GetJSONSongPath().c_str(), songTime, chipRenderTime / 1000000.0, cpuLoad, chipPeakLoad);
+	fclose(hFile);
+	
+	return;
+}
+
+// returns the audio callback statistics for the status line, e.g. "buf 10.0 ms, load 4.5%, late 0, underruns 0"
+static std::string GetAudioStatsStr(void)
+{
+	AudioCallbackStats::Summary sum;
+	char buffer[0x60];
+	
+	cbStats.GetSummary(sum);
+	sprintf(buffer, "buf %.1f ms, load %.1f%%, late %u, underruns %u", sum.bufTime / 1000.0,
+		sum.avgLoad / 10.0, sum.lateCalls, sum.underruns);
+	return std::string(buffer);
+}
+
+// returns all non-empty histogram buckets, e.g. "<10%: 3, 90-110%: 5000"
+static std::string GetHistogramStr(const UINT32* hist)
+{
+	const UINT32* bktLimits = AudioCallbackStats::GetBucketLimits();
+	std::string result;
+	char buffer[0x40];
+	
+	for (UINT32 curBkt = 0; curBkt < ACS_BUCKETS; curBkt ++)
+	{
+		if (! hist[curBkt])
+			continue;
+		if (curBkt == 0)
+			sprintf(buffer, "<%u%%: %u", bktLimits[curBkt], hist[curBkt]);
+		else if (curBkt == ACS_BUCKETS - 1)
+			sprintf(buffer, ">%u%%: %u", bktLimits[curBkt - 1], hist[curBkt]);
+		else
+			sprintf(buffer, "%u-%u%%: %u", bktLimits[curBkt - 1], bktLimits[curBkt], hist[curBkt]);
+		if (! result.empty())
+			result += ", ";
+		result += buffer;
+	}
+	return result;
+}
+
+static void PrintAudioStats(const AudioCallbackStats::Summary& sum)
+{
+	if (sum.calls == 0)
+		return;
+	
+	printf("Audio callback: %u calls, %.1f ms buffer, render avg %.1f %% / max %.1f ms, interval max %.1f ms\n",
+		sum.calls, sum.bufTime / 1000.0, sum.avgLoad / 10.0, sum.maxRender / 1000.0, sum.maxInterval / 1000.0);
+	printf("    late calls: %u, slow calls: %u, underruns: %u (%u at the song change)\n", sum.lateCalls, sum.slowCalls,
+		sum.underruns, sum.transUnderruns);
+	printf("    intervals: %s\n", GetHistogramStr(sum.intvHist).c_str());
+	printf("    render times: %s\n", GetHistogramStr(sum.renderHist).c_str());
+	
+	return;
+}
+
+static void WriteAudioStatsLog(const AudioCallbackStats::Summary& sum)
+{
+	const GeneralOptions& genOpts = mediaInfo._genOpts;
+	const UINT32* bktLimits = AudioCallbackStats::GetBucketLimits();
+	FILE* hFile;
+	
+	hFile = fopen(genOpts.audioStatsLog.c_str(), "at");
+	if (hFile == NULL)
+		return;
+	
+	fprintf(hFile, "{\"file\": \"%s\", \"audioBuffers\": %u, \"audioBufferSize\": %u, \"renderAhead\": %u, "
+		"\"calls\": %u, \"bufferUSec\": %u, \"avgLoad\": %.1f, \"maxRenderUSec\": %u, \"maxIntervalUSec\": %u, "
+		"\"lateCalls\": %u, \"slowCalls\": %u, \"underruns\": %u, \"transitionUnderruns\": %u, \"bucketLimits\": [",
+		GetJSONSongPath().c_str(), genOpts.audBufCnt, genOpts.audBufTime, (renderThread != NULL) ? genOpts.renderAhead : 0,
+		sum.calls, sum.bufTime, sum.avgLoad / 10.0, sum.maxRender, sum.maxInterval,
+		sum.lateCalls, sum.slowCalls, sum.underruns, sum.transUnderruns);
+	for (UINT32 curBkt = 0; curBkt < ACS_BUCKETS - 1; curBkt ++)
+		fprintf(hFile, "%s%u", curBkt ? ", " : "", bktLimits[curBkt]);
+	fprintf(hFile, "], \"intervals\": [");
+	for (UINT32 curBkt = 0; curBkt < ACS_BUCKETS; curBkt ++)
+		fprintf(hFile, "%s%u", curBkt ? ", " : "", sum.intvHist[curBkt]);
+	fprintf(hFile, "], \"renderTimes\": [");
+	for (UINT32 curBkt = 0; curBkt < ACS_BUCKETS; curBkt ++)
+		fprintf(hFile, "%s%u", curBkt ? ", " : "", sum.renderHist[curBkt]);
+	fprintf(hFile, "]}\n");
+	fclose(hFile);
+	
+	return;
+}
+
+// returns the path of the current song, usable within a JSON string
+static std::string GetJSONSongPath(void)
+{
+	std::string fileName = mediaInfo._songPath;
+	
+	StandardizeDirSeparators(fileName);	// no backslashes that would need escaping
+	for (size_t curChr = 0; curChr < fileName.length(); curChr ++)
+	{
+		if (fileName[curChr] == '"')
+			fileName[curChr] = '\'';
+	}
+	return fileName;
+}
+
+static UINT8 BatchRenderMain(UINT32 jobCount)
+{
+	const GeneralOptions& genOpts = mediaInfo._genOpts;
+	const AUDIO_OPTS* logOpts = AudioDrv_GetOptions(adLog.data);
+	std::vector< std::pair<UINT32, size_t> > songLens;
+	std::vector<BatchWorker> workers;
+	UINT32 smplSize;
+	UINT32 songsDone;
+	size_t curSng;
+	size_t curWrk;
+	UINT8 retVal;
+	
+	if (jobCount > songList.size())
+		jobCount = (UINT32)songList.size();
+	retVal = OSMutex_Init(&batchMtx, 0);
+	if (retVal)
+		return 0xFF;
+	
+	// Schedule the longest songs first, so that a long song at the end of the list
+	// doesn't keep a single thread busy after all the others are done.
+	// Songs of unknown length are treated as "very long".
+	songLens.resize(songList.size());
+	for (curSng = 0; curSng < songList.size(); curSng ++)
+	{
+		songLens[curSng].first = GetSongLengthEstimate(songList[curSng].fileName, genOpts.maxLoops);
+		songLens[curSng].second = curSng;
+	}
+	std::stable_sort(songLens.begin(), songLens.end(), SongLenGreater);
+	batchQueue.resize(songLens.size());
+	for (curSng = 0; curSng < songLens.size(); curSng ++)
+		batchQueue[curSng] = songLens[curSng].second;
+	batchNextJob = 0;
+	batchDoneCnt = 0;
+	
+	printf("Rendering %u %s using %u %s ...\n", (unsigned)songList.size(), (songList.size() == 1) ? "file" : "files",
+		jobCount, (jobCount == 1) ? "thread" : "threads");
+	smplSize = logOpts->numChannels * logOpts->numBitsPerSmpl / 8;
+	workers.resize(jobCount);
+	for (curWrk = 0; curWrk < workers.size(); curWrk ++)
+	{
+		BatchWorker& bw = workers[curWrk];
+		
+		bw.hThread = NULL;
+		bw.mInfo = CreateBatchPlayer(logOpts);
+		bw.smplSize = smplSize;
+		bw.smplBuf.resize(logOpts->sampleRate * smplSize);	// same as audioBuf in StartAudioDevice()
+		bw.songCnt = 0;
+		if (curWrk == 0)
+		{
+			bw.drvLog = adLog.data;	// the first worker reuses the main WAV writer
+		}
+		else
+		{
+			retVal = AudioDrv_Init(adLog.driverID, &bw.drvLog);
+			if (retVal)
+			{
+				fprintf(stderr, "WAV Writer Init Error 0x%02X\n", retVal);
+				bw.drvLog = NULL;
+				continue;
+			}
+			*AudioDrv_GetOptions(bw.drvLog) = *logOpts;
+		}
+	}
+	for (curWrk = 0; curWrk < workers.size(); curWrk ++)
+	{
+		BatchWorker& bw = workers[curWrk];
+		if (bw.drvLog == NULL)
+			continue;
+		retVal = OSThread_Init(&bw.hThread, BatchRenderThread, &bw);
+		if (retVal)
+		{
+			fprintf(stderr, "Error creating render thread %u!\n", (unsigned)curWrk);
+			bw.hThread = NULL;
+		}
+	}
+	
+	songsDone = 0;
+	for (curWrk = 0; curWrk < workers.size(); curWrk ++)
+	{
+		BatchWorker& bw = workers[curWrk];
+		if (bw.hThread != NULL)
+		{
+			OSThread_Join(bw.hThread);
+			OSThread_Deinit(bw.hThread);
+			bw.hThread = NULL;
+		}
+		songsDone += bw.songCnt;
+		
+		if (bw.drvLog != NULL && bw.drvLog != adLog.data)
+			AudioDrv_Deinit(&bw.drvLog);
+		bw.drvLog = NULL;
+		bw.mInfo->_player->UnregisterAllPlayers();
+		delete bw.mInfo;
+		bw.mInfo = NULL;
+	}
+	OSMutex_Deinit(batchMtx);	batchMtx = NULL;
+	batchQueue.clear();
+	
+	printf("Done. %u of %u %s rendered.\n", songsDone, (unsigned)songList.size(),
+		(songList.size() == 1) ? "file" : "files");
+	return (songsDone == songList.size()) ? 0x00 : 0x01;
+}
+
+static void BatchRenderThread(void* args)
+{
+	BatchWorker* bw = (BatchWorker*)args;
+	
+	while(true)
+	{
+		size_t jobID;
+		size_t songIdx;
+		UINT8 retVal;
+		
+		OSMutex_Lock(batchMtx);
+		jobID = batchNextJob;
+		if (batchNextJob < batchQueue.size())
+			batchNextJob ++;
+		OSMutex_Unlock(batchMtx);
+		if (jobID >= batchQueue.size())
+			break;
+		
+		songIdx = batchQueue[jobID];
+		retVal = BatchRenderSong(*bw, songIdx);
+		if (! (retVal & 0x80))
+			bw->songCnt ++;
+		
+		OSMutex_Lock(batchMtx);
+		batchDoneCnt ++;
+		u8printf("[%*u/%u] %s%s\n", count_digits((int)batchQueue.size()), (unsigned)batchDoneCnt,
+			(unsigned)batchQueue.size(), songList[songIdx].fileName.c_str(), (retVal & 0x80) ? " - failed" : "");
+		fflush(stdout);
+		OSMutex_Unlock(batchMtx);
+	}
+	
+	return;
+}
+
+static UINT8 BatchRenderSong(BatchWorker& bw, size_t songIdx)
+{
+	MediaInfo& mInfo = *bw.mInfo;
+	PlayerA& myPlayer = *mInfo._player;
+	const std::string& fileName = songList[songIdx].fileName;
+	DATA_LOADER* dLoad;
+	std::string outFName;
+	UINT8 retVal;
+	
+	retVal = OpenFile(fileName, dLoad, myPlayer);
+	if (retVal & 0x80)
+		return retVal;
+	AddSongToIndex(myPlayer, dLoad, fileName);
+	
+	// This follows the sequence of PlayerMain() and PlayFileOffline(),
+	// so that the output is identical to the one of a single-threaded run.
+	mInfo._songPath = fileName;
+	mInfo._fileEndPos = myPlayer.GetFileSize();
+	mInfo.PreparePlayback();
+	PreparePlayback(mInfo, myPlayer, songIdx);
+	
+	// Some sound cores initialize global lookup tables when being started,
+	// so device initialization is serialized.
+	OSMutex_Lock(startMtx);
+	myPlayer.Start();
+	OSMutex_Unlock(startMtx);
+	mInfo._playState = PLAYSTATE_PLAY;
+	myPlayer.Render(0, NULL);	// process first sample
+	
+	outFName = GetWavLogFileName(fileName);
+	WavWrt_SetFileName(AudioDrv_GetDrvData(bw.drvLog), outFName.c_str());
+	retVal = AudioDrv_Start(bw.drvLog, 0);
+	if (retVal)
+	{
+		fprintf(stderr, "Error 0x%02X opening %s for writing!\n", retVal, outFName.c_str());
+		retVal = 0xC0;
+	}
+	else
+	{
+		do
+		{
+			UINT32 wrtBytes = RenderOfflineBlock(mInfo, (UINT32)bw.smplBuf.size(), &bw.smplBuf[0], bw.smplSize);
+			if (wrtBytes == 0)
+				break;
+			AudioDrv_WriteData(bw.drvLog, wrtBytes, &bw.smplBuf[0]);
+		} while(! (mInfo._playState & PLAYSTATE_FIN));
+		AudioDrv_Stop(bw.drvLog);
+		retVal = 0x00;
+	}
+	
+	mInfo._playState = 0x00;
+	myPlayer.Stop();
+	myPlayer.UnloadFile();
+	DataLoader_Deinit(dLoad);
+	
+	return retVal;
+}
+
+// creates a player instance for a render thread
+static MediaInfo* CreateBatchPlayer(const AUDIO_OPTS* logOpts)
+{
+	MediaInfo* mInfo = new MediaInfo;
+	
+	// use exactly the same settings as the single-threaded playback
+	mInfo->_genOpts = mediaInfo._genOpts;
+	for (size_t curChp = 0; curChp < 0x100; curChp ++)
+		mInfo->_chipOpts[curChp] = mediaInfo._chipOpts[curChp];
+	mInfo->_playState = 0x00;
+	mInfo->_enableAlbumImage = false;
+	mInfo->_player->SetOutputSettings(logOpts->sampleRate, logOpts->numChannels, logOpts->numBitsPerSmpl,
+		logOpts->sampleRate / 4);
+	InitPlayerEngines(*mInfo);
+	mInfo->_player->SetEventCallback(FilePlayCallback, mInfo);
+	
+	return mInfo;
+}
+
+// renders the songs one after another, each one is split into segments that are rendered in parallel
+static UINT8 SegmentRenderMain(UINT32 jobCount)
+{
+	const AUDIO_OPTS* logOpts = AudioDrv_GetOptions(adLog.data);
+	std::vector<BatchWorker> workers;
+	UINT32 songsDone;
+	size_t curSng;
+	size_t curWrk;
+	UINT8 retVal;
+	
+	printf("Rendering %u %s in segments using %u threads ...\n", (unsigned)songList.size(),
+		(songList.size() == 1) ? "file" : "files", jobCount);
+	workers.resize(jobCount);
+	for (curWrk = 0; curWrk < workers.size(); curWrk ++)
+	{
+		BatchWorker& bw = workers[curWrk];
+		
+		bw.hThread = NULL;
+		bw.mInfo = CreateBatchPlayer(logOpts);
+		bw.drvLog = (curWrk == 0) ? adLog.data : NULL;	// The segments are joined by the first worker.
+		bw.smplSize = logOpts->numChannels * logOpts->numBitsPerSmpl / 8;
+		bw.smplBuf.resize(logOpts->sampleRate * bw.smplSize);
+		bw.songCnt = 0;
+	}
+	
+	songsDone = 0;
+	for (curSng = 0; curSng < songList.size(); curSng ++)
+	{
+		UINT64 startTime = GetTimeUSec();
+		retVal = SegmentRenderSong(workers, curSng);
+		if (! (retVal & 0x80))
+			songsDone ++;
+		u8printf("[%*u/%u] %s%s (%.1f s)\n", count_digits((int)songList.size()), (unsigned)(curSng + 1),
+			(unsigned)songList.size(), songList[curSng].fileName.c_str(), (retVal & 0x80) ? " - failed" : "",
+			(GetTimeUSec() - startTime) / 1000000.0);
+		fflush(stdout);
+	}
+	
+	for (curWrk = 0; curWrk < workers.size(); curWrk ++)
+	{
+		BatchWorker& bw = workers[curWrk];
+		bw.drvLog = NULL;
+		bw.mInfo->_player->UnregisterAllPlayers();
+		delete bw.mInfo;
+		bw.mInfo = NULL;
+	}
+	
+	printf("Done. %u of %u %s rendered.\n", songsDone, (unsigned)songList.size(),
+		(songList.size() == 1) ? "file" : "files");
+	return (songsDone == songList.size()) ? 0x00 : 0x01;
+}
+
+// Splits the part before the fade-out into one segment per thread. Each thread except the first one
+// seeks to the start of its segment minus SegmentWarmup and renders up to there without keeping the audio.
+// The audio after the end of each segment is compared with the start of the next one. When all borders
+// match, the segments are joined, else the song is rendered again in one piece.
+// Only the first segment is rendered without seeking, so the later borders compare two seeked renders.
+static UINT8 SegmentRenderSong(std::vector<BatchWorker>& workers, size_t songIdx)
+{
+	BatchWorker& bw = workers[0];
+	MediaInfo& mInfo = *bw.mInfo;
+	PlayerA& myPlayer = *mInfo._player;
+	const GeneralOptions& genOpts = mInfo._genOpts;
+	const std::string& fileName = songList[songIdx].fileName;
+	std::vector<SegmentJob> segments;
+	DATA_LOADER* dLoad;
+	std::string outFName;
+	double splitTime;
+	UINT32 splitEnd;
+	UINT32 segCnt;
+	UINT32 curSeg;
+	UINT8 retVal;
+	
+	retVal = OpenFile(fileName, dLoad, myPlayer);
+	if (retVal & 0x80)
+		return retVal;
+	AddSongToIndex(myPlayer, dLoad, fileName);
+	mInfo._songPath = fileName;
+	mInfo._fileEndPos = myPlayer.GetFileSize();
+	mInfo.PreparePlayback();
+	PreparePlayback(mInfo, myPlayer, songIdx);
+	splitTime = myPlayer.GetTotalTime(PLAYTIME_LOOP_INCL);	// fading starts here
+	if (genOpts.fadeRawLogs && mInfo._isRawLog)
+		splitTime -= genOpts.fadeTime_single / 1500.0;	// see CheckRawLogFade()
+	if (myPlayer.GetLoopCount() == 0 && myPlayer.GetPlayer()->GetLoopTicks() > 0)
+		splitTime = 0.0;	// endless loop
+	splitEnd = (splitTime > 0.0) ? (UINT32)(splitTime * myPlayer.GetSampleRate()) : 0;
+	myPlayer.UnloadFile();
+	DataLoader_Deinit(dLoad);
+	
+	// Positions of the player and the output only match at normal speed.
+	segCnt = 1;
+	if (genOpts.pbSpeed == 1.0)
+	{
+		segCnt = splitEnd / (genOpts.segmentLen * myPlayer.GetSampleRate());
+		if (segCnt > workers.size())
+			segCnt = (UINT32)workers.size();
+	}
+	if (segCnt < 2)
+		return BatchRenderSong(bw, songIdx);
+	
+	outFName = GetWavLogFileName(fileName);
+	segments.resize(segCnt);
+	for (curSeg = 0; curSeg < segCnt; curSeg ++)
+	{
+		SegmentJob& sj = segments[curSeg];
+		char buffer[0x10];
+		
+		sj.hThread = NULL;
+		sj.bw = &workers[curSeg];
+		sj.songIdx = songIdx;
+		sj.startPos = (UINT32)((UINT64)splitEnd * curSeg / segCnt);
+		sj.endPos = (curSeg + 1 < segCnt) ? (UINT32)((UINT64)splitEnd * (curSeg + 1) / segCnt) : (UINT32)-1;
+		sprintf(buffer, ".seg%u", curSeg);
+		sj.tmpFile = outFName + buffer;
+		sj.status = 0xFF;
+	}
+	for (curSeg = 1; curSeg < segCnt; curSeg ++)
+	{
+		if (OSThread_Init(&segments[curSeg].hThread, SegmentRenderThread, &segments[curSeg]))
+			segments[curSeg].hThread = NULL;
+	}
+	SegmentRenderThread(&segments[0]);	// the main thread renders the first segment
+	for (curSeg = 1; curSeg < segCnt; curSeg ++)
+	{
+		SegmentJob& sj = segments[curSeg];
+		if (sj.hThread == NULL)
+			continue;
+		OSThread_Join(sj.hThread);
+		OSThread_Deinit(sj.hThread);
+		sj.hThread = NULL;
+	}
+	
+	retVal = 0x00;
+	for (curSeg = 0; curSeg < segCnt && ! retVal; curSeg ++)
+	{
+		const SegmentJob& sj = segments[curSeg];
+		if (sj.status)
+		{
+			fprintf(stderr, "Error 0x%02X rendering segment %u, rendering in one piece ...\n", sj.status, curSeg);
+			retVal = 0x01;
+		}
+		else if (curSeg > 0 && sj.headData != segments[curSeg - 1].tailData)
+		{
+			fprintf(stderr, "Segment border at %s differs, rendering in one piece ...\n",
+				GetTimeStr((double)sj.startPos / myPlayer.GetSampleRate()).c_str());
+			retVal = 0x01;
+		}
+	}
+	if (! retVal)
+		retVal = JoinSegments(bw, outFName, segments);
+	for (curSeg = 0; curSeg < segCnt; curSeg ++)
+		remove(segments[curSeg].tmpFile.c_str());
+	if (retVal == 0x01)
+		retVal = BatchRenderSong(bw, songIdx);
+	
+	return retVal;
+}
+
+static void SegmentRenderThread(void* args)
+{
+	SegmentJob* sj = (SegmentJob*)args;
+	BatchWorker& bw = *sj->bw;
+	MediaInfo& mInfo = *bw.mInfo;
+	PlayerA& myPlayer = *mInfo._player;
+	const std::string& fileName = songList[sj->songIdx].fileName;
+	DATA_LOADER* dLoad;
+	FILE* hFile;
+	UINT32 checkSize;
+	UINT8 retVal;
+	
+	sj->headData.clear();
+	sj->tailData.clear();
+	retVal = OpenFile(fileName, dLoad, myPlayer);
+	if (retVal & 0x80)
+	{
+		sj->status = retVal;
+		return;
+	}
+	hFile = fopen(sj->tmpFile.c_str(), "wb");
+	if (hFile == NULL)
+	{
+		myPlayer.UnloadFile();
+		DataLoader_Deinit(dLoad);
+		sj->status = 0xC0;
+		return;
+	}
+	
+	// same sequence as BatchRenderSong()
+	mInfo._songPath = fileName;
+	mInfo._fileEndPos = myPlayer.GetFileSize();
+	mInfo.PreparePlayback();
+	PreparePlayback(mInfo, myPlayer, sj->songIdx);
+	OSMutex_Lock(startMtx);
+	myPlayer.Start();
+	OSMutex_Unlock(startMtx);
+	mInfo._playState = PLAYSTATE_PLAY;
+	myPlayer.Render(0, NULL);	// process first sample
+	
+	sj->status = 0x00;
+	if (sj->startPos > 0)
+	{
+		UINT32 warmup = mInfo._genOpts.segmentWarmup * myPlayer.GetSampleRate();
+		UINT32 seekPos = (sj->startPos > warmup) ? sj->startPos - warmup : 0;
+		if (seekPos > 0)
+			myPlayer.Seek(PLAYPOS_SAMPLE, seekPos);
+		sj->status = RenderSegmentData(bw, sj->startPos - seekPos, NULL, NULL, 0);
+	}
+	checkSize = SEGMENT_CHECK_TIME * myPlayer.GetSampleRate() * bw.smplSize;
+	if (! sj->status)
+		sj->status = RenderSegmentData(bw, (sj->endPos != (UINT32)-1) ? sj->endPos - sj->startPos : (UINT32)-1,
+			hFile, &sj->headData, checkSize);
+	if (! sj->status && sj->endPos != (UINT32)-1)
+		sj->status = RenderSegmentData(bw, checkSize / bw.smplSize, NULL, &sj->tailData, checkSize);
+	fclose(hFile);
+	
+	mInfo._playState = 0x00;
+	myPlayer.Stop();
+	myPlayer.UnloadFile();
+	DataLoader_Deinit(dLoad);
+	
+	return;
+}
+
+// renders smplCnt samples ((UINT32)-1 = until the song ends)
+// The audio is written to hFile and its first dataSize bytes are copied to "data", both are optional.
+static UINT8 RenderSegmentData(BatchWorker& bw, UINT32 smplCnt, FILE* hFile, std::vector<UINT8>* data, size_t dataSize)
+{
+	MediaInfo& mInfo = *bw.mInfo;
+	
+	while(smplCnt > 0 && ! (mInfo._playState & PLAYSTATE_FIN))
+	{
+		UINT32 renderSize = (UINT32)bw.smplBuf.size();
+		if (smplCnt < renderSize / bw.smplSize)
+			renderSize = smplCnt * bw.smplSize;
+		UINT32 wrtBytes = RenderOfflineBlock(mInfo, renderSize, &bw.smplBuf[0], bw.smplSize);
+		if (wrtBytes == 0)
+			break;
+		if (smplCnt != (UINT32)-1)
+			smplCnt -= wrtBytes / bw.smplSize;
+		
+		if (data != NULL && data->size() < dataSize)
+		{
+			size_t copySize = dataSize - data->size();
+			if (copySize > wrtBytes)
+				copySize = wrtBytes;
+			data->insert(data->end(), bw.smplBuf.begin(), bw.smplBuf.begin() + copySize);
+		}
+		if (hFile != NULL && fwrite(&bw.smplBuf[0], 1, wrtBytes, hFile) != wrtBytes)
+			return 0xC1;
+	}
+	
+	return 0x00;
+}
+
+// writes the rendered segments to the WAV file
+static UINT8 JoinSegments(BatchWorker& bw, const std::string& outFName, const std::vector<SegmentJob>& segments)
+{
+	UINT8 retVal;
+	
+	WavWrt_SetFileName(AudioDrv_GetDrvData(bw.drvLog), outFName.c_str());
+	retVal = AudioDrv_Start(bw.drvLog, 0);
+	if (retVal)
+	{
+		fprintf(stderr, "Error 0x%02X opening %s for writing!\n", retVal, outFName.c_str());
+		return 0xC0;
+	}
+	
+	retVal = 0x00;
+	for (size_t curSeg = 0; curSeg < segments.size() && ! retVal; curSeg ++)
+	{
+		FILE* hFile = fopen(segments[curSeg].tmpFile.c_str(), "rb");
+		if (hFile == NULL)
+		{
+			retVal = 0x01;	// render in one piece
+			break;
+		}
+		while(true)
+		{
+			size_t readBytes = fread(&bw.smplBuf[0], 1, bw.smplBuf.size(), hFile);
+			if (readBytes == 0)
+				break;
+			AudioDrv_WriteData(bw.drvLog, (UINT32)readBytes, &bw.smplBuf[0]);
+		}
+		fclose(hFile);
+	}
+	AudioDrv_Stop(bw.drvLog);
+	
+	return retVal;
+}
+
+
+#ifdef WIN32
+static int GetPressedKey(void)
+{
+	int keyCode = _getch();
+	if (keyCode >= 0x01 && keyCode <= 0x1A)
+		return KEY_CTRL | (keyCode - 0x01 + 'A');
+	switch(keyCode)
+	{
+	case 0xE0:	// Special Key #1
+		// Windows cursor key codes
+		// Shift + Cursor results in the same code as if Shift wasn't pressed
+		//	Key     None    Ctrl    Alt
+		//	Up      E0 48   E0 8D   00 98
+		//	Down    E0 50   E0 91   00 A0
+		//	Left    E0 4B   E0 73   00 9B
+		//	Right   E0 4D   E0 74   00 9D
+		keyCode = _getch();	// Get 2nd Key
+		switch(keyCode)
+		{
+		case 0x48:
+			return KEY_UP;
+		case 0x49:
+			return KEY_PPAGE;
+		case 0x4B:
+			return KEY_LEFT;
+		case 0x4D:
+			return KEY_RIGHT;
+		case 0x50:
+			return KEY_DOWN;
+		case 0x51:
+			return KEY_NPAGE;
+		case 0x73:
+			return KEY_CTRL | KEY_LEFT;
+		case 0x74:
+			return KEY_CTRL | KEY_RIGHT;
+		case 0x8D:
+			return KEY_CTRL | KEY_UP;
+		case 0x91:
+			return KEY_CTRL | KEY_DOWN;
+		}
+		break;
+	case 0x00:	// Special Key #2
+		keyCode = _getch();	// Get 2nd Key
+		switch(keyCode)
+		{
+		case 0x98:
+			return KEY_ALT | KEY_UP;
+		case 0x9B:
+			return KEY_ALT | KEY_LEFT;
+		case 0x9D:
+			return KEY_ALT | KEY_RIGHT;
+		case 0xA0:
+			return KEY_ALT | KEY_DOWN;
+		}
+		break;
+	}
+	return keyCode;
+}
+#else
+static int GetPressedKey(void)
+{
+	int keyCode = _getch();
+	if (keyCode >= 0x01 && keyCode <= 0x1A)
+		return KEY_CTRL | (keyCode - 0x01 + 'A');
+	if (keyCode != 0x1B)
+		return keyCode;
+	
+	int keyModifers = 0x00;
+	
+	// handle escape codes
+	keyCode = _getch();
+	if (keyCode == 0x1B || keyCode == 0x00)
+		return 0x1B;	// ESC Key pressed
+	switch(keyCode)
+	{
+	case 0x5B:
+		// cursor only:     1B 41..44
+		// Shift + cursor:  1B 31 3B 32 41..44
+		// Alt + cursor:    1B 31 3B 33 41..44
+		// Ctrl + cursor:   1B 31 3B 35 41..44
+		// page down/up:    1B 35/36 7E
+		keyCode = _getch();	// get 2nd Key
+		if (keyCode == 0x31)	// Ctrl or Alt key
+		{
+			keyCode = _getch();
+			if (keyCode == 0x3B)
+			{
+				keyCode = _getch();
+				if ((keyCode - 0x31) & 0x01)
+					keyModifers |= KEY_SHIFT;
+				if ((keyCode - 0x31) & 0x02)
+					keyModifers |= KEY_ALT;
+				if ((keyCode - 0x31) & 0x04)
+					keyModifers |= KEY_CTRL;
+				keyCode = _getch();
+			}
+		}
+		switch(keyCode)
+		{
+		case 0x35:
+			_getch();	// skip 7E key code
+			return KEY_PPAGE;
+		case 0x36:
+			_getch();	// skip 7E key code
+			return KEY_NPAGE;
+		case 0x41:
+			return keyModifers | KEY_UP;
+		case 0x42:
+			return keyModifers | KEY_DOWN;
+		case 0x43:
+			return keyModifers | KEY_RIGHT;
+		case 0x44:
+			return keyModifers | KEY_LEFT;
+		}
+	}
+	return keyCode;
+}
+#endif
+
+static UINT8 HandleKeyPress(bool waitForKey)
+{
+	if (! waitForKey && ! _kbhit())
+		return 0;
+	
+	int keyCode = GetPressedKey();
+	if (keyCode >= 'a' && keyCode <= 'z')
+		keyCode = toupper(keyCode);
+	switch(keyCode)
+	{
+	case 0x1B:	// ESC
+	case 'Q':	// quit
+		mediaInfo.Event(MI_EVT_PLIST, MIE_PL_QUIT);
+		break;
+	case ' ':
+	case 'P':	// pause
+		mediaInfo.Event(MI_EVT_PAUSE, MIE_PS_TOGGLE);
+		break;
+	case 'F':	// fade out
+		mediaInfo.Event(MI_EVT_FADE, 0);
+		break;
+	case 'R':	// restart
+		mediaInfo.Event(MI_EVT_CONTROL, MIE_CTRL_RESTART);
+		break;
+	case 'T':	// render time measurement
+		if (! (mediaInfo._playState & PLAYSTATE_PLAY) || adOut.data == NULL)
+			break;
+		if (chipTimingOn)
+		{
+			StopChipTiming(false);
+			printf("%-70s\r", "Chip timing disabled.");	fflush(stdout);
+			noDispTime = 1000;
+		}
+		else
+		{
+			StartChipTiming();
+		}
+		break;
+	case 'L':	// audio callback statistics
+		if (adOut.data == NULL)
+			break;
+		showAudioStats = ! showAudioStats;
+		if (! showAudioStats)
+		{
+			printf("%-70s\r", "Audio statistics disabled.");	fflush(stdout);
+			noDispTime = 1000;
+		}
+		break;
+	case KEY_CTRL | 'X':
+		quitAfterEnd = ! quitAfterEnd;
+		printf("%s after song end.%*s  \r", quitAfterEnd ? "Quitting" : "Not quitting", 19, "");	fflush(stdout);
+		noDispTime = 1000;
+		break;
+	case KEY_CTRL | 'P':
+		pauseAfterEnd = ! pauseAfterEnd;
+		printf("%s after song end.%*s  \r", pauseAfterEnd ? "Pausing" : "Not pausing", 20, "");	fflush(stdout);
+		noDispTime = 1000;
+		break;
+	case KEY_LEFT:
+	case KEY_RIGHT:
+	case KEY_CTRL | KEY_LEFT:
+	case KEY_CTRL | KEY_RIGHT:
+		{
+			INT32 secs = (keyCode & KEY_CTRL) ? 60 : 5;	// 5s [not ctrl] or 60s [ctrl]
+			if ((keyCode & KEY_MASK) == KEY_LEFT)
+				secs *= -1;	// seek back
+			mediaInfo.Event(MI_EVT_SEEK_REL, mediaInfo._player->GetSampleRate() * secs);
+		}
+		break;
+	case 'B':	// previous file (back)
+	case KEY_PPAGE:
+		mediaInfo.Event(MI_EVT_PLIST, MIE_PL_PREV);
+		break;
+	case 'N':	// next file
+	case KEY_NPAGE:
+		mediaInfo.Event(MI_EVT_PLIST, MIE_PL_NEXT);
+		break;
+	case KEY_UP:
+	case KEY_DOWN:
+	case KEY_CTRL | KEY_UP:
+	case KEY_CTRL | KEY_DOWN:
+		{
+			INT32 amount = (keyCode & KEY_CTRL) ? 30 : 2;	// 0.2 db [not ctrl] or 3.0 db [ctrl]
+			if ((keyCode & KEY_MASK) == KEY_DOWN)
+				amount *= -1;	// volume down
+			mediaInfo.Event(MI_EVT_VOL_CHG, amount);
+		}
+		break;
+	case '[':
+	case ']':
+	case '{':
+	case '}':
+		{
+			INT32 amount = 0;
+			if (keyCode == '[')
+				amount = -0x10;		// 1/16th slower
+			else if (keyCode == ']')
+				amount = +0x10;		// 1/16th faster
+			else if (keyCode == '{')
+				amount = -0x100;	// half the speed
+			else if (keyCode == '}')
+				amount = +0x100;	// double the speed
+			mediaInfo.Event(MI_EVT_SPD_CHG, amount);
+		}
+		break;
+	default:
+		if (keyCode >= '0' && keyCode <= '9')
+		{
+			UINT8 pbPos10 = keyCode - '0';
+			mediaInfo.Event(MI_EVT_SEEK_PERC, pbPos10 * 10);
+			break;
+		}
+		//printf("Unhandled key press: 0x%02X    \n", keyCode);
+		break;
+	}
+	
+	return 1;
+}
+
+static INT8 GetTimeDispMode(double seconds)
+{
+	UINT32 csec;
+	UINT32 sec;
+	UINT32 min;
+	
+	csec = (UINT32)(seconds * 100 + 0.5);
+	sec = csec / 100;
+	min = sec / 60;
+	return (min >= 60);
+}
+
+static std::string GetTimeStr(double seconds, INT8 showHours)
+{
+	// showHours:
+	//	-1 - auto
+	//	 0 - show mm:ss
+	//	 1 - show h:mm:ss
+	UINT32 csec;
+	UINT32 sec;
+	UINT32 min;
+	UINT32 hrs;
+	char timeStr[0x20];
+	
+	csec = (UINT32)(seconds * 100 + 0.5);
+	sec = csec / 100;
+	csec %= 100;
+	min = sec / 60;
+	sec %= 60;
+	if (showHours < 0)
+		showHours = (min >= 60);
+	if (showHours == 0)
+	{
+		sprintf(timeStr, "%02u:%02u.%02u", min, sec, csec);
+	}
+	else
+	{
+		showHours ++;
+		hrs = min / 60;
+		min %= 60;
+		sprintf(timeStr, "%0*u:%02u:%02u.%02u", showHours, hrs, min, sec, csec);
+	}
+	
+	return std::string(timeStr);
+}
+
+static UINT32 FillBuffer(void* drvStruct, void* userParam, UINT32 bufSize, void* data)
+{
+	PlayerA* myPlr = (PlayerA*)userParam;
+	if (! (myPlr->GetState() & PLAYSTATE_PLAY))
+	{
+		fprintf(stderr, "Player Warning: calling Render while not playing! playState = 0x%02X\n", myPlr->GetState());
+		memset(data, 0x00, bufSize);
+		return bufSize;
+	}
+	
+	UINT64 startTime = GetTimeUSec();
+	UINT32 renderedBytes;
+	OSMutex_Lock(renderMtx);
+	if (seekRendering)
+	{
+		memset(data, 0x00, bufSize);	// RequestSeek() is still rendering up to the destination
+		renderedBytes = bufSize;
+	}
+	else
+	{
+		renderedBytes = RenderTimed(*myPlr, bufSize, data);
+	}
+	OSMutex_Unlock(renderMtx);
+	cbStats.Record(startTime, bufSize, false);
+	
+	return renderedBytes;
+}
+
+static UINT32 FillBufferDummy(void* drvStruct, void* userParam, UINT32 bufSize, void* data)
+{
+	memset(data, 0x00, bufSize);
+	return bufSize;
+}
+
+static UINT32 FillBufferFromRing(void* drvStruct, void* userParam, UINT32 bufSize, void* data)
+{
+	UINT64 startTime = GetTimeUSec();
+	bool underrun = false;
+	bool transition = false;
+	UINT32 readBytes = renderRing.Read(bufSize, data);
+	OSSignal_Signal(renderSignal);
+	if (readBytes < bufSize)
+	{
+		// Don't wait for the render thread here. Output silence instead.
+		memset((UINT8*)data + readBytes, 0x00, bufSize - readBytes);
+		transition = gaplessSwitching;
+		underrun = transition || ! (mediaInfo._player->GetState() & PLAYSTATE_END);
+	}
+	cbStats.Record(startTime, bufSize, underrun, transition);
+	return bufSize;
+}
+
+static void RenderThread(void* args)
+{
+	while(true)
+	{
+		OSSignal_Wait(renderSignal);
+		if (renderThrStop)
+			break;
+		
+		// The lock is released after each block, so that control events don't have to wait for long.
+		UINT32 wrtBytes;
+		do
 		{
-		case MIE_CTRL_START:	// start
-			if (! (mediaInfo._playState & PLAYSTATE_PLAY))
-				break;
-			OSMutex_Lock(renderMtx);
-			mediaInfo._playState &= ~PLAYSTATE_PAUSE;
-			OSMutex_Unlock(renderMtx);
-			if (adOut.data != NULL)
-				AudioDrv_Resume(adOut.data);
-			mediaInfo.Signal(MI_SIG_PLAY_STATE);
-			return 0x01;
-		case MIE_CTRL_STOP:	// stop
-			if (! (mediaInfo._playState & PLAYSTATE_PLAY))
-				break;
-			OSMutex_Lock(renderMtx);
-			mediaInfo._playState |= PLAYSTATE_PAUSE;
-			myPlayer.Reset();
-			OSMutex_Unlock(renderMtx);
-			if (adOut.data != NULL)
-				AudioDrv_Pause(adOut.data);
-			mediaInfo.Signal(MI_SIG_POSITION | MI_SIG_PLAY_STATE);
-			return 0x01;
-			//return 0x10;
-		case MIE_CTRL_RESTART:	// restart
-			if (! (mediaInfo._playState & PLAYSTATE_PLAY))
-				break;
 			OSMutex_Lock(renderMtx);
-			myPlayer.Reset();
+			wrtBytes = renderRingActive ? RenderToRing() : 0;
 			OSMutex_Unlock(renderMtx);
-			mediaInfo.Signal(MI_SIG_POSITION);
-			return 0x01;
+		} while(wrtBytes > 0);
+	}
+	
+	return;
+}
+
+// renders one block into the ring buffer, returns the number of bytes written
+// The caller must hold renderMtx.
+static UINT32 RenderToRing(void)
+{
+	PlayerA& myPlayer = *mediaInfo._player;
+	UINT8* blkPtr;
+	UINT32 blkSize;
+	UINT32 smplPos;
+	
+	if (replayPos != replayEnd)
+	{
+		if (renderRing.GetFreeSpace() < renderBlkSize)
+			return 0;
+		blkSize = renderRing.GetWriteBlock(&blkPtr);
+		if (blkSize > renderBlkSize)
+			blkSize = renderBlkSize;
+		UINT32 smplCnt = blkSize / renderRing.GetBlockAlign();
+		if (smplCnt > replayEnd - replayPos)
+			smplCnt = replayEnd - replayPos;
+		smplCnt = seekHist.Read(replayPos, smplCnt, blkPtr);
+		if (smplCnt == 0)
+		{
+			StopReplay(true);	// should never happen, but let's be safe
+			return 0;
 		}
-		break;
-	case MI_EVT_PAUSE:
-		if (! (mediaInfo._playState & PLAYSTATE_PLAY))
-			break;
-		switch(evtParam)
+		replayPos += smplCnt;
+		mediaInfo._replaySmpls = replayEnd - replayPos;
+		blkSize = smplCnt * renderRing.GetBlockAlign();
+		renderRing.CommitWrite(blkSize);
+		return blkSize;
+	}
+	if (loopReplay)
+	{
+		UINT32 loopLen = loopCache.GetLoopLength();
+		if (renderRing.GetFreeSpace() < renderBlkSize)
+			return 0;
+		blkSize = renderRing.GetWriteBlock(&blkPtr);
+		if (blkSize > renderBlkSize)
+			blkSize = renderBlkSize;
+		UINT32 smplCnt = blkSize / renderRing.GetBlockAlign();
+		loopCache.Read(loopReplayPos, smplCnt, blkPtr);
+		loopReplayPos += smplCnt;
+		while(loopReplayPos - myPlayer.GetCurPos(PLAYPOS_SAMPLE) >= loopLen)
+			loopReplayPos -= loopLen;
+		mediaInfo._loopSmpls += smplCnt;
+		while(mediaInfo._loopSmpls >= loopLen)
 		{
-		case MIE_PS_PAUSE:	// pause
-			mediaInfo._playState |= PLAYSTATE_PAUSE;
-			break;
-		case MIE_PS_RESUME:	// resume
-			mediaInfo._playState &= ~PLAYSTATE_PAUSE;
-			break;
-		case MIE_PS_TOGGLE:	// pause toggle
-			mediaInfo._playState ^= PLAYSTATE_PAUSE;
-			break;
+			// count whole loops separately, so that the offset doesn't overflow when looping for days
+			mediaInfo._loopCnt ++;
+			mediaInfo._loopSmpls -= loopLen;
 		}
-		/*if (genOpts.soundWhilePaused)
+		blkSize = smplCnt * renderRing.GetBlockAlign();
+		renderRing.CommitWrite(blkSize);
+		return blkSize;
+	}
+	if (cacheReplay && cacheReplayPos < renderCache.GetLength())
+	{
+		if (renderRing.GetFreeSpace() < renderBlkSize)
+			return 0;
+		blkSize = renderRing.GetWriteBlock(&blkPtr);
+		if (blkSize > renderBlkSize)
+			blkSize = renderBlkSize;
+		UINT32 smplCnt = renderCache.Read(cacheReplayPos, blkSize / renderRing.GetBlockAlign(), blkPtr);
+		if (smplCnt > 0)
 		{
-			// TODO
+			cacheReplayPos += smplCnt;
+			mediaInfo._loopSmpls = cacheReplayPos;
+			blkSize = smplCnt * renderRing.GetBlockAlign();
+			renderRing.CommitWrite(blkSize);
+			return blkSize;
 		}
-		else*/ if (adOut.data != NULL)
+		StopRenderCache(true);	// broken cache file - continue with emulation
+	}
+	if (cacheReplay || (myPlayer.GetState() & PLAYSTATE_END))
+	{
+		if (renderCache.IsWriting())
+			renderCache.Finish();
+		if (cacheReplay && ! cacheReplayEnd)
 		{
-			if (mediaInfo._playState & PLAYSTATE_PAUSE)
-				AudioDrv_Pause(adOut.data);
-			else
-				AudioDrv_Resume(adOut.data);
+			// end of the cached song, like PLREVT_END
+			cacheReplayEnd = true;
+			mediaInfo._playState |= PLAYSTATE_FIN;
+			mediaInfo.WakeUp();
 		}
-		mediaInfo.Signal(MI_SIG_PLAY_STATE);
-		return 0x01;
-	case MI_EVT_FADE:	// fade out
-		if (! (mediaInfo._playState & PLAYSTATE_PLAY))
-			break;
-		// enforce "non-playlist" fade-out
-		OSMutex_Lock(renderMtx);
-		myPlayer.SetFadeSamples(MSec2Samples(genOpts.fadeTime_single, myPlayer));
-		myPlayer.FadeOut();
-		OSMutex_Unlock(renderMtx);
-		return 0x01;
-	case MI_EVT_SEEK_REL:
-		if (! (mediaInfo._playState & PLAYSTATE_PLAY))
-			break;
-		OSMutex_Lock(renderMtx);
+		if (! gapless.switched && ! pauseAfterEnd && ! quitAfterEnd && IsGaplessTransition(curSong))
+			gaplessSwitching = true;
+		if (gapless.songIdx == (size_t)-1 || gapless.switched || ! GaplessSwitch())
+			return 0;
+		blkSize = RenderToRing();	// first block of the next song
+		gaplessSwitching = false;
+		return blkSize;
+	}
+	if (! (myPlayer.GetState() & PLAYSTATE_PLAY))
+		return 0;
+	if (renderRing.GetFreeSpace() < renderBlkSize)
+		return 0;
+	
+	blkSize = renderRing.GetWriteBlock(&blkPtr);
+	if (blkSize > renderBlkSize)
+		blkSize = renderBlkSize;
+	smplPos = myPlayer.GetCurPos(PLAYPOS_SAMPLE);
+	blkSize = RenderTimed(myPlayer, blkSize, blkPtr);
+	if (seekHist.IsEnabled() || loopCache.IsEnabled() || renderCache.IsWriting())
+	{
+		// Only keep audio that maps 1:1 to song positions. (not true for end silence or speed changes)
+		UINT32 smplCnt = blkSize / renderRing.GetBlockAlign();
+		bool posMatch = (myPlayer.GetCurPos(PLAYPOS_SAMPLE) - smplPos == smplCnt && myPlayer.GetPlaybackSpeed() == 1.0);
+		if (posMatch)
+			seekHist.Store(smplPos, smplCnt, blkPtr);
+		if (renderCache.IsWriting())
+			renderCache.Write(smplCnt, blkPtr);
+		if (loopCache.IsEnabled() && myPlayer.GetLoopCount() == 0)
 		{
-			UINT32 destPos = mediaInfo._player.GetCurPos(PLAYPOS_SAMPLE);
-			if ((genOpts.timeDispStyle & PLAYTIME_TIME_PBK) == PLAYTIME_TIME_FILE)
-				evtParam = (INT32)(evtParam / mediaInfo._player.GetPlaybackSpeed() + 0.5);	// scale according to playback speed
-			if (evtParam < 0 && (UINT32)-evtParam > destPos)
-				destPos = 0;
+			if (posMatch)
+				loopCache.Feed(smplPos, smplCnt, blkPtr);
 			else
-				destPos += evtParam;
-			mediaInfo._player.Seek(PLAYPOS_SAMPLE, destPos);
+				loopCache.Reset();
+			if (loopCache.IsReady())
+				StartLoopReplay();
 		}
-		OSMutex_Unlock(renderMtx);
-		mediaInfo.Signal(MI_SIG_POSITION);
-		return 0x01;
-	case MI_EVT_SEEK_ABS:
-		if (! (mediaInfo._playState & PLAYSTATE_PLAY))
-			break;
+	}
+	renderRing.CommitWrite(blkSize);
+	return blkSize;
+}
+
+// PlayerA::Render() with time measurement, the caller must hold renderMtx
+static inline UINT32 RenderTimed(PlayerA& player, UINT32 bufSize, void* data)
+{
+	if (! chipTimingOn)
+		return player.Render(bufSize, data);
+	
+	UINT64 startTime = GetTimeUSec();
+	UINT32 wrtBytes = player.Render(bufSize, data);
+	UINT64 renderTime = GetTimeUSec() - startTime;
+	UINT32 smplCnt = wrtBytes / chipSmplSize;
+	if (smplCnt > 0)
+	{
+		UINT32 blkLoad = (UINT32)(renderTime * player.GetSampleRate() / 10000 / smplCnt);
+		if (chipPeakLoad < blkLoad)
+			chipPeakLoad = blkLoad;
+	}
+	chipRenderTime += renderTime;
+	chipRenderSmpls += smplCnt;
+	return wrtBytes;
+}
+
+// drop already rendered data after seeking, the caller must hold renderMtx
+static inline void DiscardRenderAhead(void)
+{
+	if (renderRingActive)
+		renderRing.Discard();
+	return;
+}
+
+// seek to a position, using the seek history when possible
+// The caller must hold renderMtx.
+static void SeekPlayer(UINT8 unit, UINT32 pos)
+{
+	PlayerA& myPlayer = *mediaInfo._player;
+	UINT32 destPos = (unit == PLAYPOS_SAMPLE) ? pos : myPlayer.GetPlayer()->Tick2Sample(pos);
+	
+	seekRendering = false;	// A rendered seek that wasn't finished yet continues from the current position.
+	if (! SeekInRenderedAudio(destPos))
+	{
+		StopLoopReplay(false);
+		StopRenderCache(false);	// The recording has to cover the whole song.
+		StopReplay(false);
+		if (NeedsRenderedSeek())
+			StartRenderedSeek(destPos);
+		else
+			myPlayer.Seek(unit, pos);
+	}
+	DiscardRenderAhead();
+	
+	return;
+}
+
+// seek within audio that was already rendered (loop cache, render cache, seek history)
+// Returns false when the player has to seek. Nothing is changed in that case.
+// The caller must hold renderMtx.
+static bool SeekInRenderedAudio(UINT32 destPos)
+{
+	UINT32 curPos = mediaInfo._player->GetCurPos(PLAYPOS_SAMPLE);
+	
+	if (loopReplay && destPos >= curPos)
+	{
+		// Positions after the player's one are still within the looping part.
+		// The seek base position doesn't include _loopCnt, so loops that were skipped are added to it.
+		UINT32 loopLen = loopCache.GetLoopLength();
+		loopReplayPos = curPos + (destPos - curPos) % loopLen;
+		mediaInfo._loopSmpls = (destPos - curPos) % loopLen;
+		mediaInfo._loopCnt += (destPos - curPos) / loopLen;
+		return true;
+	}
+	if (cacheReplay)
+	{
+		// The whole song is in the cache.
+		cacheReplayPos = (destPos > cacheStartPos) ? destPos - cacheStartPos : 0;
+		if (cacheReplayPos > renderCache.GetLength())
+			cacheReplayPos = renderCache.GetLength();
+		cacheReplayEnd = false;
+		mediaInfo._loopSmpls = cacheReplayPos;
+		return true;
+	}
+	if (renderRingActive && seekHist.IsEnabled() && destPos < curPos && seekHist.Covers(destPos, curPos))
+	{
+		StopLoopReplay(false);
+		StopRenderCache(false);
+		if (replayPos == replayEnd)
+			replayEnd = curPos;
+		replayPos = destPos;
+		mediaInfo._replaySmpls = replayEnd - replayPos;
+		return true;
+	}
+	return false;
+}
+
+// returns true if the song uses a chip with the SeekRender option
+static bool NeedsRenderedSeek(void)
+{
+	PlayerBase* pBase = mediaInfo._player->GetPlayer();
+	std::vector<PLR_DEV_INFO> devList;
+	
+	if (pBase == NULL)
+		return false;
+	pBase->GetSongDeviceInfo(devList);
+	for (size_t curDev = 0; curDev < devList.size(); curDev ++)
+	{
+		const ChipOptions& cOpt = mediaInfo._chipOpts[devList[curDev].type];
+		if (cOpt.chipType != 0xFF && cOpt.seekRender)
+			return true;
+	}
+	return false;
+}
+
+// start seeking by rendering everything up to the destination and throwing the audio away
+// PlayerA::Seek() only processes the song's commands, which isn't enough for some sound cores.
+// The rendering is done by RenderSeekBlock(), so that renderMtx is released between blocks.
+// This is used when there is no render thread, else RenderSeekPlayer() does it on seekPlayer.
+// The caller must hold renderMtx.
+static void StartRenderedSeek(UINT32 destPos)
+{
+	PlayerA& myPlayer = *mediaInfo._player;
+	
+	if (destPos < myPlayer.GetCurPos(PLAYPOS_SAMPLE))
+		myPlayer.Seek(PLAYPOS_SAMPLE, 0);	// restart the song, this resets all chips
+	seekRenderEnd = destPos;
+	seekRendering = ! seekRenderBuf.empty();
+	
+	return;
+}
+
+// renders one block of a rendered seek, returns false when the destination was reached
+// The caller must hold renderMtx.
+static bool RenderSeekBlock(void)
+{
+	PlayerA& myPlayer = *mediaInfo._player;
+	UINT32 smplPos = myPlayer.GetCurPos(PLAYPOS_SAMPLE);
+	UINT32 renderSize = (UINT32)seekRenderBuf.size();
+	UINT32 wrtBytes;
+	
+	if (! seekRendering)
+		return false;
+	if (smplPos >= seekRenderEnd || (myPlayer.GetState() & PLAYSTATE_END) || ! (myPlayer.GetState() & PLAYSTATE_PLAY))
+	{
+		seekRendering = false;
+		return false;
+	}
+	
+	if (seekRenderEnd - smplPos < renderSize / seekRenderSmplSize)
+		renderSize = (seekRenderEnd - smplPos) * seekRenderSmplSize;
+	wrtBytes = myPlayer.Render(renderSize, &seekRenderBuf[0]);
+	if (wrtBytes == 0)
+	{
+		seekRendering = false;
+		return false;
+	}
+	
+	return true;
+}
+
+// end replaying from the seek history, the caller must hold renderMtx
+// seekBack = true: move the player to the current replay position
+static void StopReplay(bool seekBack)
+{
+	if (replayPos != replayEnd && seekBack)
+		mediaInfo._player->Seek(PLAYPOS_SAMPLE, replayPos);
+	replayPos = replayEnd = 0;
+	mediaInfo._replaySmpls = 0;
+	
+	return;
+}
+
+// The caller must hold renderMtx.
+static void ClearSeekHistory(void)
+{
+	StopReplay(true);
+	StopLoopReplay(true);
+	StopRenderCache(true);
+	seekHist.Clear();
+	
+	return;
+}
+
+// The caller must hold renderMtx.
+static void StartLoopReplay(void)
+{
+	loopReplay = true;
+	loopReplayPos = mediaInfo._player->GetCurPos(PLAYPOS_SAMPLE);
+	mediaInfo._loopSmpls = 0;
+	mediaInfo._loopCnt = 0;
+	mediaInfo._loopLen = loopCache.GetLoopLength();
+	
+	return;
+}
+
+// end replaying from the loop cache and start recording again, the caller must hold renderMtx
+// resync = true: move the player to a position that matches the replayed audio
+static void StopLoopReplay(bool resync)
+{
+	// The player is in the looping part, so a short seek forward is enough.
+	// The displayed time may jump back by a few loops.
+	if (loopReplay && resync && loopReplayPos != mediaInfo._player->GetCurPos(PLAYPOS_SAMPLE))
+		mediaInfo._player->Seek(PLAYPOS_SAMPLE, loopReplayPos);
+	loopReplay = false;
+	mediaInfo._loopSmpls = 0;
+	mediaInfo._loopCnt = 0;
+	loopCache.Reset();
+	
+	return;
+}
+
+static std::string GetRenderCacheDir(void)
+{
+	const GeneralOptions& genOpts = mediaInfo._genOpts;
+	if (! genOpts.renderCacheDir.empty())
+		return genOpts.renderCacheDir;
+	return userCfgDir + RENDER_CACHE_DIR;
+}
+
+static inline void AddKeyValue(std::vector<UINT8>& keyData, UINT32 value)
+{
+	keyData.push_back((UINT8)(value >>  0));
+	keyData.push_back((UINT8)(value >>  8));
+	keyData.push_back((UINT8)(value >> 16));
+	keyData.push_back((UINT8)(value >> 24));
+	return;
+}
+
+static inline void AddKeyString(std::vector<UINT8>& keyData, const char* str)
+{
+	keyData.insert(keyData.end(), str, str + strlen(str) + 1);
+	return;
+}
+
+// hash of the song data and all settings that affect the rendered audio, 0 = the song can't be cached
+// This reads the whole song, so it should be called without holding renderMtx.
+static UINT64 GetRenderCacheKey(PlayerA& myPlayer, DATA_LOADER* dLoad)
+{
+	const GeneralOptions& genOpts = mediaInfo._genOpts;
+	PlayerBase* player = myPlayer.GetPlayer();
+	const PlayerA::Config& pCfg = myPlayer.GetConfiguration();
+	std::vector<PLR_DEV_INFO> diList;
+	std::vector<UINT8> keyData;
+	UINT64 hash;
+	
+	if (! renderCache.IsEnabled() || dLoad == NULL)
+		return 0;
+	// endless songs never finish, other speeds don't map 1:1 to song positions
+	if (myPlayer.GetLoopCount() == 0 && player->GetLoopTicks() > 0)
+		return 0;
+	if (myPlayer.GetPlaybackSpeed() != 1.0)
+		return 0;
+	
+	hash = HashFNV1a(DataLoader_GetData(dLoad), DataLoader_GetSize(dLoad), FNV1A_INIT);
+	
+	// other versions may emulate the song differently
+	AddKeyString(keyData, VGMPLAY_VER_STR);
+	AddKeyString(keyData, LIBVGM_VER_STR);
+	AddKeyString(keyData, player->GetPlayerName());
+	AddKeyValue(keyData, myPlayer.GetSampleRate());
+	AddKeyValue(keyData, genOpts.smplBits);
+	AddKeyValue(keyData, (UINT32)pCfg.masterVol);
+	AddKeyValue(keyData, pCfg.chnInvert);
+	AddKeyValue(keyData, pCfg.loopCount);
+	AddKeyValue(keyData, pCfg.fadeSmpls);
+	AddKeyValue(keyData, pCfg.endSilenceSmpls);
+	AddKeyValue(keyData, genOpts.resmplMode);
+	AddKeyValue(keyData, genOpts.chipSmplMode);
+	AddKeyValue(keyData, genOpts.chipSmplRate);
+	AddKeyValue(keyData, genOpts.hardStopOld);
+	AddKeyValue(keyData, genOpts.fadeRawLogs);
+	
+	// The chip options of the configuration were applied to the devices already.
+	player->GetSongDeviceInfo(diList);
+	for (size_t curDev = 0; curDev < diList.size(); curDev ++)
+	{
+		PLR_DEV_OPTS devOpts;
+		if (player->GetDeviceOptions(diList[curDev].id, devOpts))
+			continue;
+		AddKeyValue(keyData, diList[curDev].id);
+		AddKeyValue(keyData, devOpts.emuCore[0]);
+		AddKeyValue(keyData, devOpts.emuCore[1]);
+		AddKeyValue(keyData, devOpts.srMode);
+		AddKeyValue(keyData, devOpts.resmplMode);
+		AddKeyValue(keyData, devOpts.smplRate);
+		AddKeyValue(keyData, devOpts.coreOpts);
+		AddKeyValue(keyData, devOpts.muteOpts.disable);
+		AddKeyValue(keyData, devOpts.muteOpts.chnMute[0]);
+		AddKeyValue(keyData, devOpts.muteOpts.chnMute[1]);
+		for (UINT8 curChn = 0; curChn < 32; curChn ++)
+			AddKeyValue(keyData, ((UINT32)(UINT16)devOpts.panOpts.chnPan[0][curChn] << 16) |
+				(UINT16)devOpts.panOpts.chnPan[1][curChn]);
+	}
+	
+	hash = HashFNV1a(&keyData[0], (UINT32)keyData.size(), hash);
+	return hash ? hash : 1;
+}
+
+// look up the current song in the render cache, or start recording it, the caller must hold renderMtx
+// key: from GetRenderCacheKey()
+static void StartRenderCache(UINT64 key)
+{
+	StopRenderCache(false);
+	if (! key)
+		return;
+	
+	if (renderCache.Open(key))
+	{
+		cacheReplay = true;
+		cacheReplayPos = 0;
+		cacheStartPos = mediaInfo._player->GetCurPos(PLAYPOS_SAMPLE);
+	}
+	else
+	{
+		renderCache.Create(key);
+	}
+	
+	return;
+}
+
+// end reading from the render cache or discard the recording, the caller must hold renderMtx
+// resync = true: move the player to the position of the replayed audio
+static void StopRenderCache(bool resync)
+{
+	if (cacheReplay && resync)
+		mediaInfo._player->Seek(PLAYPOS_SAMPLE, cacheStartPos + cacheReplayPos);
+	renderCache.Close();
+	if (cacheReplay)
+		mediaInfo._loopSmpls = 0;
+	cacheReplay = false;
+	cacheReplayEnd = false;
+	
+	return;
+}
+
+static void RequestSeek(UINT8 unit, UINT32 pos)
+{
+	if (! renderRingActive)
+	{
+		bool seeking;
+		
 		OSMutex_Lock(renderMtx);
-		mediaInfo._player.Seek(PLAYPOS_SAMPLE, (UINT32)evtParam);
+		SeekPlayer(unit, pos);
 		OSMutex_Unlock(renderMtx);
-		mediaInfo.Signal(MI_SIG_POSITION);
-		return 0x01;
-	case MI_EVT_SEEK_PERC:
-		if (! (mediaInfo._playState & PLAYSTATE_PLAY))
-			break;
-		if (evtParam < 0)
-			evtParam = 0;
+		// Rendered seeks are done block by block, so that the audio callback isn't blocked for long.
+		do
 		{
-			UINT32 maxPos;
-			UINT32 destPos;
-			
 			OSMutex_Lock(renderMtx);
-			maxPos = myPlayer.GetPlayer()->GetTotalPlayTicks(genOpts.maxLoops);
-			destPos = maxPos * evtParam / 100;
-			myPlayer.Seek(PLAYPOS_TICK, destPos);
+			seeking = RenderSeekBlock();
 			OSMutex_Unlock(renderMtx);
-			mediaInfo.Signal(MI_SIG_POSITION);
-		}
-		return 0x01;
-	case MI_EVT_VOL_SET:
-		masterVol = evtParam;
-		OSMutex_Lock(renderMtx);
-		mediaInfo._player.SetMasterVolume(masterVol);
-		OSMutex_Unlock(renderMtx);
-		{
-			double vol = masterVol / (double)0x10000;
-			double volDB = log(vol) / M_LN2 * 6.0;
-			printf("Volume: %.3f (%+5.1f db)%*s  \r", vol, volDB, 19, "");	fflush(stdout);
-			noDispTime = 1000;
-		}
-		break;
-	case MI_EVT_VOL_CHG:
-		{
-			double vol = masterVol / (double)0x10000;
-			vol *= pow(2.0, evtParam / 60.0);
-			masterVol = (INT32)(vol * 0x10000 + 0.5);
-			if (masterVol < 0x0800)	// 1.0/32 = -30 db
-				masterVol = 0x0800;
-			else if (masterVol > 0x200000)	// 1.0*32 = +30 db
-				masterVol = 0x200000;
-		}
-		OSMutex_Lock(renderMtx);
-		mediaInfo._player.SetMasterVolume(masterVol);
-		OSMutex_Unlock(renderMtx);
-		{
-			double vol = masterVol / (double)0x10000;
-			double volDB = log(vol) / M_LN2 * 6.0;
-			printf("Volume: %.3f (%+5.1f db)%*s  \r", vol, volDB, 19, "");	fflush(stdout);
-			noDispTime = 1000;
-		}
-		break;
-	case MI_EVT_SPD_SET:
-		masterSpeed = evtParam;
-		OSMutex_Lock(renderMtx);
-		mediaInfo._player.SetPlaybackSpeed(masterSpeed);
-		OSMutex_Unlock(renderMtx);
-		printf("Speed: %6.3fx%*s  \r", masterSpeed, 29, "");	fflush(stdout);
-		noDispTime = 1000;
-		break;
-	case MI_EVT_SPD_CHG:
-		{
-			int logSpeed = (int)floor(log(masterSpeed) / M_LN2 * 0x100 + 0.5);
-			logSpeed += evtParam;
-			if (logSpeed < -0x600)
-				logSpeed = -0x600;
-			else if (logSpeed > +0x600)
-				logSpeed = +0x600;
-			masterSpeed = pow(2.0, logSpeed / (double)0x100);
-		}
-		OSMutex_Lock(renderMtx);
-		mediaInfo._player.SetPlaybackSpeed(masterSpeed);
-		OSMutex_Unlock(renderMtx);
-		printf("Speed: %6.3fx%*s  \r", masterSpeed, 29, "");	fflush(stdout);
-		noDispTime = 1000;
-		break;
+		} while(seeking);
+		mediaInfo.Signal(MI_SIG_POSITION);
+		return;
 	}
 	
-	return 0x00;
+	// A newer request replaces an older one that wasn't processed yet.
+	OSMutex_Lock(seekMtx);
+	seekReq.pending = true;
+	seekReq.unit = unit;
+	seekReq.pos = pos;
+	OSMutex_Unlock(seekMtx);
+	OSSignal_Signal(seekSignal);
+	
+	return;
 }
 
-
-#ifdef WIN32
-static int GetPressedKey(void)
+// returns the position relative seeks are based on, in samples
+// Whole loops that were played from the loop cache are left out, they don't change the position within the song.
+static UINT32 GetSeekBasePos(void)
 {
-	int keyCode = _getch();
-	if (keyCode >= 0x01 && keyCode <= 0x1A)
-		return KEY_CTRL | (keyCode - 0x01 + 'A');
-	switch(keyCode)
+	UINT32 basePos;
+	
+	OSMutex_Lock(seekMtx);
+	if (seekReq.pending || seekReq.busy)
 	{
-	case 0xE0:	// Special Key #1
-		// Windows cursor key codes
-		// Shift + Cursor results in the same code as if Shift wasn't pressed
-		//	Key     None    Ctrl    Alt
-		//	Up      E0 48   E0 8D   00 98
-		//	Down    E0 50   E0 91   00 A0
-		//	Left    E0 4B   E0 73   00 9B
-		//	Right   E0 4D   E0 74   00 9D
-		keyCode = _getch();	// Get 2nd Key
-		switch(keyCode)
-		{
-		case 0x48:
-			return KEY_UP;
-		case 0x49:
-			return KEY_PPAGE;
-		case 0x4B:
-			return KEY_LEFT;
-		case 0x4D:
-			return KEY_RIGHT;
-		case 0x50:
-			return KEY_DOWN;
-		case 0x51:
-			return KEY_NPAGE;
-		case 0x73:
-			return KEY_CTRL | KEY_LEFT;
-		case 0x74:
-			return KEY_CTRL | KEY_RIGHT;
-		case 0x8D:
-			return KEY_CTRL | KEY_UP;
-		case 0x91:
-			return KEY_CTRL | KEY_DOWN;
-		}
-		break;
-	case 0x00:	// Special Key #2
-		keyCode = _getch();	// Get 2nd Key
-		switch(keyCode)
-		{
-		case 0x98:
-			return KEY_ALT | KEY_UP;
-		case 0x9B:
-			return KEY_ALT | KEY_LEFT;
-		case 0x9D:
-			return KEY_ALT | KEY_RIGHT;
-		case 0xA0:
-			return KEY_ALT | KEY_DOWN;
-		}
-		break;
+		basePos = seekReq.pos;
+		if (seekReq.unit != PLAYPOS_SAMPLE)
+			basePos = mediaInfo._player->GetPlayer()->Tick2Sample(basePos);
+		OSMutex_Unlock(seekMtx);
+		return basePos;
 	}
-	return keyCode;
+	OSMutex_Unlock(seekMtx);
+	
+	// The render thread changes all of these while rendering.
+	OSMutex_Lock(renderMtx);
+	if (seekRendering)
+		basePos = seekRenderEnd;
+	else
+		basePos = mediaInfo._player->GetCurPos(PLAYPOS_SAMPLE) - mediaInfo._replaySmpls + mediaInfo._loopSmpls;
+	OSMutex_Unlock(renderMtx);
+	return basePos;
 }
-#else
-static int GetPressedKey(void)
+
+static void SeekThread(void* args)
 {
-	int keyCode = _getch();
-	if (keyCode >= 0x01 && keyCode <= 0x1A)
-		return KEY_CTRL | (keyCode - 0x01 + 'A');
-	if (keyCode != 0x1B)
-		return keyCode;
+	std::vector<UINT8> renderBuf(seekRenderBuf.size());	// for rendered seeks
 	
-	int keyModifers = 0x00;
-	
-	// handle escape codes
-	keyCode = _getch();
-	if (keyCode == 0x1B || keyCode == 0x00)
-		return 0x1B;	// ESC Key pressed
-	switch(keyCode)
+	while(true)
 	{
-	case 0x5B:
-		// cursor only:     1B 41..44
-		// Shift + cursor:  1B 31 3B 32 41..44
-		// Alt + cursor:    1B 31 3B 33 41..44
-		// Ctrl + cursor:   1B 31 3B 35 41..44
-		// page down/up:    1B 35/36 7E
-		keyCode = _getch();	// get 2nd Key
-		if (keyCode == 0x31)	// Ctrl or Alt key
-		{
-			keyCode = _getch();
-			if (keyCode == 0x3B)
-			{
-				keyCode = _getch();
-				if ((keyCode - 0x31) & 0x01)
-					keyModifers |= KEY_SHIFT;
-				if ((keyCode - 0x31) & 0x02)
-					keyModifers |= KEY_ALT;
-				if ((keyCode - 0x31) & 0x04)
-					keyModifers |= KEY_CTRL;
-				keyCode = _getch();
-			}
-		}
-		switch(keyCode)
-		{
-		case 0x35:
-			_getch();	// skip 7E key code
-			return KEY_PPAGE;
-		case 0x36:
-			_getch();	// skip 7E key code
-			return KEY_NPAGE;
-		case 0x41:
-			return keyModifers | KEY_UP;
-		case 0x42:
-			return keyModifers | KEY_DOWN;
-		case 0x43:
-			return keyModifers | KEY_RIGHT;
-		case 0x44:
-			return keyModifers | KEY_LEFT;
-		}
+		OSSignal_Wait(seekSignal);
+		if (seekThrStop)
+			break;
+		
+		ProcessSeekRequest(renderBuf);
 	}
-	return keyCode;
+	
+	return;
 }
-#endif
 
-static UINT8 HandleKeyPress(bool waitForKey)
+// called by the seek thread
+// Only seeks within already rendered audio are done directly. All others are prepared on seekPlayer
+// without holding renderMtx, so that the render thread keeps filling the ring buffer meanwhile.
+static void ProcessSeekRequest(std::vector<UINT8>& renderBuf)
 {
-	if (! waitForKey && ! _kbhit())
-		return 0;
-	
-	int keyCode = GetPressedKey();
-	if (keyCode >= 'a' && keyCode <= 'z')
-		keyCode = toupper(keyCode);
-	switch(keyCode)
+	while(true)
 	{
-	case 0x1B:	// ESC
-	case 'Q':	// quit
-		mediaInfo.Event(MI_EVT_PLIST, MIE_PL_QUIT);
-		break;
-	case ' ':
-	case 'P':	// pause
-		mediaInfo.Event(MI_EVT_PAUSE, MIE_PS_TOGGLE);
-		break;
-	case 'F':	// fade out
-		mediaInfo.Event(MI_EVT_FADE, 0);
-		break;
-	case 'R':	// restart
-		mediaInfo.Event(MI_EVT_CONTROL, MIE_CTRL_RESTART);
-		break;
-	case KEY_CTRL | 'X':
-		quitAfterEnd = ! quitAfterEnd;
-		printf("%s after song end.%*s  \r", quitAfterEnd ? "Quitting" : "Not quitting", 19, "");	fflush(stdout);
-		noDispTime = 1000;
-		break;
-	case KEY_CTRL | 'P':
-		pauseAfterEnd = ! pauseAfterEnd;
-		printf("%s after song end.%*s  \r", pauseAfterEnd ? "Pausing" : "Not pausing", 20, "");	fflush(stdout);
-		noDispTime = 1000;
-		break;
-	case KEY_LEFT:
-	case KEY_RIGHT:
-	case KEY_CTRL | KEY_LEFT:
-	case KEY_CTRL | KEY_RIGHT:
+		SeekRequest req;
+		UINT32 gen;
+		
+		OSMutex_Lock(seekMtx);
+		req = seekReq;
+		seekReq.pending = false;
+		seekReq.busy = req.pending;
+		gen = seekGen;
+		OSMutex_Unlock(seekMtx);
+		if (! req.pending)
+			break;
+		
+		OSMutex_Lock(renderMtx);
+		if (! renderRingActive)
+		{
+			OSMutex_Unlock(renderMtx);
+			continue;
+		}
+		UINT32 destPos = (req.unit == PLAYPOS_SAMPLE) ? req.pos : mediaInfo._player->GetPlayer()->Tick2Sample(req.pos);
+		if (SeekInRenderedAudio(destPos))
+		{
+			DiscardRenderAhead();
+			OSMutex_Unlock(renderMtx);
+			seekDone = true;
+			mediaInfo.WakeUp();
+			continue;
+		}
+		PlayerA::Config pCfg = mediaInfo._player->GetConfiguration();
+		bool renderSeek = NeedsRenderedSeek();
+		DATA_LOADER* dLoad = curSongData;
+		OSMutex_Unlock(renderMtx);
+		
+		if (! PrepareSeekPlayer(dLoad, pCfg))
+			continue;
+		if (renderSeek)
 		{
-			INT32 secs = (keyCode & KEY_CTRL) ? 60 : 5;	// 5s [not ctrl] or 60s [ctrl]
-			if ((keyCode & KEY_MASK) == KEY_LEFT)
-				secs *= -1;	// seek back
-			mediaInfo.Event(MI_EVT_SEEK_REL, mediaInfo._player.GetSampleRate() * secs);
+			if (! RenderSeekPlayer(destPos, gen, renderBuf))
+				continue;
 		}
-		break;
-	case 'B':	// previous file (back)
-	case KEY_PPAGE:
-		mediaInfo.Event(MI_EVT_PLIST, MIE_PL_PREV);
-		break;
-	case 'N':	// next file
-	case KEY_NPAGE:
-		mediaInfo.Event(MI_EVT_PLIST, MIE_PL_NEXT);
-		break;
-	case KEY_UP:
-	case KEY_DOWN:
-	case KEY_CTRL | KEY_UP:
-	case KEY_CTRL | KEY_DOWN:
+		else
 		{
-			INT32 amount = (keyCode & KEY_CTRL) ? 30 : 2;	// 0.2 db [not ctrl] or 3.0 db [ctrl]
-			if ((keyCode & KEY_MASK) == KEY_DOWN)
-				amount *= -1;	// volume down
-			mediaInfo.Event(MI_EVT_VOL_CHG, amount);
+			seekPlayer->Seek(req.unit, req.pos);
 		}
-		break;
-	case '[':
-	case ']':
-	case '{':
-	case '}':
+		
+		OSMutex_Lock(renderMtx);
+		if (renderRingActive && ! IsSeekCancelled(gen))
 		{
-			INT32 amount = 0;
-			if (keyCode == '[')
-				amount = -0x10;		// 1/16th slower
-			else if (keyCode == ']')
-				amount = +0x10;		// 1/16th faster
-			else if (keyCode == '{')
-				amount = -0x100;	// half the speed
-			else if (keyCode == '}')
-				amount = +0x100;	// double the speed
-			mediaInfo.Event(MI_EVT_SPD_CHG, amount);
+			SwapSeekPlayer();
+			seekDone = true;
 		}
-		break;
-	default:
-		if (keyCode >= '0' && keyCode <= '9')
+		OSMutex_Unlock(renderMtx);
+		if (seekDone)
+			mediaInfo.WakeUp();
+	}
+	OSSignal_Signal(seekIdleSignal);
+	
+	return;
+}
+
+// returns true when the seek that is being prepared is outdated
+static bool IsSeekCancelled(UINT32 gen)
+{
+	bool cancel;
+	
+	OSMutex_Lock(seekMtx);
+	cancel = (gen != seekGen || seekReq.pending || seekThrStop);	// a newer request replaces the current one
+	OSMutex_Unlock(seekMtx);
+	return cancel;
+}
+
+// makes sure that seekPlayer plays the current song with the main player's configuration
+// called by the seek thread
+static bool PrepareSeekPlayer(DATA_LOADER* dLoad, const PlayerA::Config& pCfg)
+{
+	if (seekPlayerData != dLoad)
+	{
+		if (seekPlayerData != NULL)
 		{
-			UINT8 pbPos10 = keyCode - '0';
-			mediaInfo.Event(MI_EVT_SEEK_PERC, pbPos10 * 10);
-			break;
+			seekPlayer->Stop();
+			seekPlayer->UnloadFile();
+			seekPlayerData = NULL;
 		}
-		//printf("Unhandled key press: 0x%02X    \n", keyCode);
-		break;
+		if (dLoad == NULL || seekPlayer->LoadFile(dLoad))
+			return false;
+		seekPlayerData = dLoad;
+		seekPlayer->SetConfiguration(pCfg);
+		OSMutex_Lock(startMtx);
+		seekPlayer->Start();
+		OSMutex_Unlock(startMtx);
+	}
+	else
+	{
+		seekPlayer->SetConfiguration(pCfg);	// The volume or speed may have been changed.
 	}
 	
-	return 1;
+	return true;
 }
 
-static INT8 GetTimeDispMode(double seconds)
+// SeekRender on seekPlayer: render everything up to the destination and throw the audio away
+// Returns false when the seek was cancelled. Called by the seek thread.
+static bool RenderSeekPlayer(UINT32 destPos, UINT32 gen, std::vector<UINT8>& buf)
 {
-	UINT32 csec;
-	UINT32 sec;
-	UINT32 min;
+	if (destPos < seekPlayer->GetCurPos(PLAYPOS_SAMPLE))
+		seekPlayer->Seek(PLAYPOS_SAMPLE, 0);	// restart the song, this resets all chips
+	while(true)
+	{
+		UINT32 smplPos = seekPlayer->GetCurPos(PLAYPOS_SAMPLE);
+		UINT32 renderSize = (UINT32)buf.size();
+		
+		if (smplPos >= destPos || (seekPlayer->GetState() & PLAYSTATE_END) ||
+			! (seekPlayer->GetState() & PLAYSTATE_PLAY))
+			break;
+		if (IsSeekCancelled(gen))
+			return false;
+		if (destPos - smplPos < renderSize / seekRenderSmplSize)
+			renderSize = (destPos - smplPos) * seekRenderSmplSize;
+		if (! seekPlayer->Render(renderSize, &buf[0]))
+			break;
+	}
 	
-	csec = (UINT32)(seconds * 100 + 0.5);
-	sec = csec / 100;
-	min = sec / 60;
-	return (min >= 60);
+	return true;
 }
 
-static std::string GetTimeStr(double seconds, INT8 showHours)
+// make seekPlayer the main player, the caller must hold renderMtx
+static void SwapSeekPlayer(void)
 {
-	// showHours:
-	//	-1 - auto
-	//	 0 - show mm:ss
-	//	 1 - show h:mm:ss
-	UINT32 csec;
-	UINT32 sec;
-	UINT32 min;
-	UINT32 hrs;
-	char timeStr[0x20];
+	PlayerA* oldPlr = mediaInfo._player;
+	PlayerA* newPlr = seekPlayer;
 	
-	csec = (UINT32)(seconds * 100 + 0.5);
-	sec = csec / 100;
-	csec %= 100;
-	min = sec / 60;
-	sec %= 60;
-	if (showHours < 0)
-		showHours = (min >= 60);
-	if (showHours == 0)
+	StopReplay(false);
+	StopLoopReplay(false);
+	StopRenderCache(false);	// The recording has to cover the whole song.
+	newPlr->SetMasterVolume(oldPlr->GetMasterVolume());
+	newPlr->SetPlaybackSpeed(oldPlr->GetPlaybackSpeed());
+	if ((oldPlr->GetState() & PLAYSTATE_FADE) && ! (newPlr->GetState() & PLAYSTATE_FADE))
 	{
-		sprintf(timeStr, "%02u:%02u.%02u", min, sec, csec);
+		newPlr->SetFadeSamples(oldPlr->GetFadeSamples());
+		newPlr->FadeOut();
 	}
-	else
+	oldPlr->SetEventCallback(NULL, NULL);
+	newPlr->SetEventCallback(FilePlayCallback, &mediaInfo);
+	// The old player stays loaded, because the main thread may still be reading its status.
+	mediaInfo._player = newPlr;
+	seekPlayer = oldPlr;
+	DiscardRenderAhead();
+	
+	return;
+}
+
+// The caller may hold renderMtx.
+static void CancelSeekRequest(void)
+{
+	OSMutex_Lock(seekMtx);
+	seekReq.pending = false;
+	seekGen ++;	// don't use the result of a seek that is being prepared
+	OSMutex_Unlock(seekMtx);
+	
+	return;
+}
+
+// wait until the seek thread finished its current request
+static void WaitForSeekThread(void)
+{
+	while(true)
 	{
-		showHours ++;
-		hrs = min / 60;
-		min %= 60;
-		sprintf(timeStr, "%0*u:%02u:%02u.%02u", showHours, hrs, min, sec, csec);
+		OSMutex_Lock(seekMtx);
+		bool busy = seekReq.pending || seekReq.busy;
+		OSMutex_Unlock(seekMtx);
+		if (! busy)
+			break;
+		OSSignal_Wait(seekIdleSignal);
 	}
 	
-	return std::string(timeStr);
+	return;
 }
 
-static UINT32 FillBuffer(void* drvStruct, void* userParam, UINT32 bufSize, void* data)
+// unload the song from seekPlayer, has to be done before the song's data is freed
+// called by the main thread, which is the only one that sends seek requests
+static void ResetSeekPlayer(void)
 {
-	PlayerA* myPlr = (PlayerA*)userParam;
-	if (! (myPlr->GetState() & PLAYSTATE_PLAY))
+	if (seekThread == NULL)
+		return;
+	
+	CancelSeekRequest();
+	WaitForSeekThread();
+	if (seekPlayerData != NULL)
 	{
-		fprintf(stderr, "Player Warning: calling Render while not playing! playState = 0x%02X\n", myPlr->GetState());
-		memset(data, 0x00, bufSize);
-		return bufSize;
+		seekPlayer->Stop();
+		seekPlayer->UnloadFile();
+		seekPlayerData = NULL;
 	}
 	
-	UINT32 renderedBytes;
-	OSMutex_Lock(renderMtx);
-	renderedBytes = myPlr->Render(bufSize, data);
-	OSMutex_Unlock(renderMtx);
+	return;
+}
+
+// creates a player with the same settings as mediaInfo._player
+static PlayerA* CreateSparePlayer(UINT32 smplRate, UINT32 smplAlloc)
+{
+	PlayerA* player = new PlayerA;
 	
-	return renderedBytes;
+	InitPlayerEngines(*player, mediaInfo._genOpts, mediaInfo._chipOpts);
+	player->SetFileReqCallback(PlayerFileReqCallback, NULL);
+	player->SetLogCallback(PlayerLogCallback, NULL);
+	if (player->SetOutputSettings(smplRate, 2, mediaInfo._genOpts.smplBits, smplAlloc))
+	{
+		DeleteSparePlayer(player);
+		return NULL;
+	}
+	return player;
 }
 
-static UINT32 FillBufferDummy(void* drvStruct, void* userParam, UINT32 bufSize, void* data)
+static void DeleteSparePlayer(PlayerA* player)
 {
-	memset(data, 0x00, bufSize);
-	return bufSize;
+	if (player->GetPlayer() != NULL)
+	{
+		player->Stop();
+		player->UnloadFile();
+	}
+	player->UnregisterAllPlayers();
+	delete player;
+	
+	return;
+}
+
+static UINT8 StartSeekThread(UINT32 smplRate, UINT32 smplAlloc)
+{
+	UINT8 retVal;
+	
+	seekPlayer = CreateSparePlayer(smplRate, smplAlloc);
+	if (seekPlayer == NULL)
+		return 0xFF;
+	seekPlayerData = NULL;
+	seekThrStop = false;
+	seekSignal = NULL;
+	seekIdleSignal = NULL;
+	retVal = OSSignal_Init(&seekSignal, 0);
+	if (! retVal)
+		retVal = OSSignal_Init(&seekIdleSignal, 0);
+	if (! retVal)
+		retVal = OSThread_Init(&seekThread, SeekThread, NULL);
+	if (retVal)
+	{
+		seekThread = NULL;
+		StopSeekThread();
+		return retVal;
+	}
+	
+	return 0x00;
+}
+
+static void StopSeekThread(void)
+{
+	if (seekThread != NULL)
+	{
+		seekThrStop = true;
+		OSSignal_Signal(seekSignal);
+		OSThread_Join(seekThread);
+		OSThread_Deinit(seekThread);	seekThread = NULL;
+	}
+	if (seekIdleSignal != NULL)
+	{
+		OSSignal_Deinit(seekIdleSignal);	seekIdleSignal = NULL;
+	}
+	if (seekSignal != NULL)
+	{
+		OSSignal_Deinit(seekSignal);	seekSignal = NULL;
+	}
+	if (seekPlayer != NULL)
+	{
+		DeleteSparePlayer(seekPlayer);	seekPlayer = NULL;
+	}
+	seekPlayerData = NULL;
+	
+	return;
+}
+
+static UINT8 StartRenderThread(UINT32 smplRate, UINT32 smplSize, UINT32 blockSize)
+{
+	const GeneralOptions& genOpts = mediaInfo._genOpts;
+	UINT32 ringSize;
+	UINT8 retVal;
+	
+	renderBlkSize = blockSize;
+	ringSize = (UINT32)((UINT64)genOpts.renderAhead * smplRate / 1000) * smplSize;
+	if (ringSize < renderBlkSize * 2)
+		ringSize = renderBlkSize * 2;
+	renderRing.Init(ringSize, smplSize);
+	seekHist.Init(smplRate, genOpts.seekHistory, smplSize);	// 1 block = 1 second
+	replayPos = replayEnd = 0;
+	loopCache.Init((UINT64)genOpts.loopCache * 1024 * 1024, smplSize);
+	loopReplay = false;
+	renderCache.Init(GetRenderCacheDir(), (UINT64)genOpts.renderCache * 1024 * 1024, smplRate, 2, genOpts.smplBits);
+	cacheReplay = false;
+	renderRingActive = false;
+	renderThrStop = false;
+	
+	retVal = OSSignal_Init(&renderSignal, 0);
+	if (retVal)
+		return retVal;
+	retVal = StartSeekThread(smplRate, blockSize / smplSize);
+	if (retVal)
+	{
+		OSSignal_Deinit(renderSignal);	renderSignal = NULL;
+		return retVal;
+	}
+	retVal = OSThread_Init(&renderThread, RenderThread, NULL);
+	if (retVal)
+	{
+		StopSeekThread();
+		OSSignal_Deinit(renderSignal);	renderSignal = NULL;
+		renderThread = NULL;
+		return retVal;
+	}
+	if (genOpts.gaplessPb)
+		gaplessPlayer = CreateSparePlayer(smplRate, blockSize / smplSize);	// NULL disables gapless playback
+	
+	return 0x00;
+}
+
+static void StopRenderThread(void)
+{
+	if (renderThread == NULL)
+		return;
+	
+	renderThrStop = true;
+	OSSignal_Signal(renderSignal);
+	OSThread_Join(renderThread);
+	OSThread_Deinit(renderThread);	renderThread = NULL;
+	OSSignal_Deinit(renderSignal);	renderSignal = NULL;
+	StopSeekThread();
+	if (gaplessPlayer != NULL)
+	{
+		DeleteSparePlayer(gaplessPlayer);	gaplessPlayer = NULL;
+	}
+	renderRing.Init(0, 1);
+	seekHist.Init(0, 0, 1);
+	loopCache.Init(0, 1);
+	renderCache.Deinit();
+	
+	return;
 }
 
 static UINT8 FilePlayCallback(PlayerBase* player, void* userParam, UINT8 evtType, void* evtParam)
 {
+	MediaInfo* mInfo = (MediaInfo*)userParam;
+	
 	switch(evtType)
 	{
 	case PLREVT_START:
@@ -1251,13 +4549,16 @@ static UINT8 FilePlayCallback(PlayerBase* player, void* userParam, UINT8 evtType
 		//printf("Playback stopped.\n");
 		break;
 	case PLREVT_LOOP:
-		if (mediaInfo._player.GetState() & PLAYSTATE_SEEK)
+		if (mInfo->_player->GetState() & PLAYSTATE_SEEK)
 			break;
 		//printf("Loop %u.\n", 1 + *(UINT32*)evtParam);
-		mediaInfo.Signal(MI_SIG_POSITION);
+		if (mInfo == &mediaInfo && loopCache.IsEnabled())
+			loopCache.LoopJump(mInfo->_player->GetCurPos(PLAYPOS_SAMPLE));	// called by the render thread
+		mInfo->Signal(MI_SIG_POSITION);
 		break;
 	case PLREVT_END:
-		mediaInfo._playState |= PLAYSTATE_FIN;
+		mInfo->_playState |= PLAYSTATE_FIN;
+		mInfo->WakeUp();
 		//printf("Song End.\n");
 		break;
 	}
@@ -1266,20 +4567,10 @@ static UINT8 FilePlayCallback(PlayerBase* player, void* userParam, UINT8 evtType
 
 static DATA_LOADER* PlayerFileReqCallback(void* userParam, PlayerBase* player, const char* fileName)
 {
-	std::string filePath = FindFile_Single(fileName, appSearchPaths);
-	if (filePath.empty())
-	{
+	DATA_LOADER* dLoad = romCache.GetFile(fileName, appSearchPaths);
+	if (dLoad == NULL)
 		fprintf(stderr, "Unable to find %s!\n", fileName);
-		return NULL;
-	}
-	//fprintf(stderr, "Player requested file - found at %s\n", filePath.c_str());
-
-	DATA_LOADER* dLoad = FileLoader_Init(filePath.c_str());
-	UINT8 retVal = DataLoader_Load(dLoad);
-	if (! retVal)
-		return dLoad;
-	DataLoader_Deinit(dLoad);
-	return NULL;
+	return dLoad;
 }
 
 static void PlayerLogCallback(void* userParam, PlayerBase* player, UINT8 level, UINT8 srcType,
@@ -1488,8 +4779,36 @@ static UINT8 InitAudioSystem(void)
 			}
 		}
 	}
-
+	
+	renderMtx = NULL;
+	startMtx = NULL;
+	seekMtx = NULL;
 	retVal = OSMutex_Init(&renderMtx, 0);
+	if (! retVal)
+		retVal = OSMutex_Init(&startMtx, 0);
+	if (! retVal)
+		retVal = OSMutex_Init(&seekMtx, 0);
+	if (retVal)
+	{
+		fprintf(stderr, "Mutex Init Error 0x%02X\n", retVal);
+		if (startMtx != NULL)
+			OSMutex_Deinit(startMtx);
+		if (renderMtx != NULL)
+			OSMutex_Deinit(renderMtx);
+		if (adLog.data != NULL)
+		{
+			AudioDrv_Deinit(&adLog.data);	adLog.data = NULL;
+		}
+		if (adOut.data != NULL)
+		{
+			AudioDrv_Deinit(&adOut.data);	adOut.data = NULL;
+		}
+		Audio_Deinit();
+		return retVal;
+	}
+	seekReq.pending = false;
+	seekReq.busy = false;
+	seekGen = 0;
 	
 	return AERR_OK;
 }
@@ -1509,6 +4828,8 @@ static UINT8 DeinitAudioSystem(void)
 	}
 	Audio_Deinit();
 	
+	OSMutex_Deinit(seekMtx);	seekMtx = NULL;
+	OSMutex_Deinit(startMtx);	startMtx = NULL;
 	OSMutex_Deinit(renderMtx);	renderMtx = NULL;
 	
 	return retVal;
@@ -1540,6 +4861,9 @@ static UINT8 StartAudioDevice(void)
 	smplSize = opts->numChannels * opts->numBitsPerSmpl / 8;
 	smplAlloc = opts->sampleRate / 4;
 	localBufSize = smplAlloc * smplSize;
+	cbStats.SetFormat(opts->sampleRate, smplSize);
+	seekRenderSmplSize = smplSize;
+	seekRenderBuf.resize(opts->sampleRate / 100 * smplSize);	// rendered seeks are done in 10 ms blocks
 	
 	if (adOut.data != NULL)
 	{
@@ -1553,21 +4877,31 @@ static UINT8 StartAudioDevice(void)
 		
 		smplAlloc = AudioDrv_GetBufferSize(adOut.data) / smplSize;
 		if (AudioDrv_SetCallback(adOut.data, NULL, NULL) == AERR_OK)
+		{
 			localBufSize = 0;	// we don't need a local buffer when the audio driver itself comes with one
+			if (genOpts.renderAhead > 0)
+			{
+				retVal = StartRenderThread(opts->sampleRate, smplSize, smplAlloc * smplSize);
+				if (retVal)
+					fprintf(stderr, "Warning: Unable to start render thread (error 0x%02X)\n", retVal);
+			}
+		}
 	}
 	else if (adLog.data != NULL)
 	{
 		smplAlloc = opts->sampleRate / 4;
+		localBufSize = opts->sampleRate * smplSize;	// render in larger blocks when only writing to disk
 	}
 	
 	audioBuf.resize(localBufSize);
-	retVal = mediaInfo._player.SetOutputSettings(opts->sampleRate, opts->numChannels, opts->numBitsPerSmpl, smplAlloc);
+	retVal = mediaInfo._player->SetOutputSettings(opts->sampleRate, opts->numChannels, opts->numBitsPerSmpl, smplAlloc);
 	if (retVal)
 	{
 		const char* errMsg = NULL;
 		
 		if (adOut.data != NULL)
 			AudioDrv_Stop(adOut.data);
+		StopRenderThread();
 		
 		if (retVal == 0xF0)
 			errMsg = "Invalid number of channels.";
@@ -1590,26 +4924,17 @@ static UINT8 StopAudioDevice(void)
 	retVal = AERR_OK;
 	if (adOut.data != NULL)
 		retVal = AudioDrv_Stop(adOut.data);
+	StopRenderThread();
 	audioBuf.clear();
+	seekRenderBuf.clear();
 	
 	return retVal;
 }
 
-static UINT8 StartDiskWriter(const std::string& songFileName)
+static std::string GetWavLogFileName(const std::string& songFileName)
 {
-	if (adLog.data == NULL)
-		return 0x00;
-	
 	std::string outFName;
 	const char* extPtr;
-	UINT8 retVal;
-	
-	if (adOut.data != NULL)
-	{
-		AUDIO_OPTS* optsOut = AudioDrv_GetOptions(adOut.data);
-		AUDIO_OPTS* optsLog = AudioDrv_GetOptions(adLog.data);
-		*optsLog = *optsOut;
-	}
 	
 	extPtr = GetFileExtension(songFileName.c_str());
 	outFName = (extPtr != NULL) ? std::string(songFileName.c_str(), extPtr - 1) : songFileName;
@@ -1629,6 +4954,25 @@ static UINT8 StartDiskWriter(const std::string& songFileName)
 			outFName = mediaInfo._genOpts.wavLogPath;
 	}
 	
+	return outFName;
+}
+
+static UINT8 StartDiskWriter(const std::string& songFileName)
+{
+	if (adLog.data == NULL)
+		return 0x00;
+	
+	std::string outFName;
+	UINT8 retVal;
+	
+	if (adOut.data != NULL)
+	{
+		AUDIO_OPTS* optsOut = AudioDrv_GetOptions(adOut.data);
+		AUDIO_OPTS* optsLog = AudioDrv_GetOptions(adLog.data);
+		*optsLog = *optsOut;
+	}
+	
+	outFName = GetWavLogFileName(songFileName);
 	WavWrt_SetFileName(AudioDrv_GetDrvData(adLog.data), outFName.c_str());
 	retVal = AudioDrv_Start(adLog.data, 0);
 	if (! retVal && adOut.data != NULL)
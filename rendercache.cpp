@@ -0,0 +1,986 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <string>
+
+#ifdef _WIN32
+#include <direct.h>	// for _mkdir()
+#else
+#include <sys/stat.h>	// for mkdir()
+#endif
+
+#include <stdtype.h>
+#include <utils/OSMutex.h>
+#include <utils/OSSignal.h>
+#include <utils/OSThread.h>
+#include "rendercache.hpp"
+
+#define RCF_VERSION		0x100
+#define RCF_HDR_SIZE	0x30
+#define RC_INDEX_FILE	"index.txt"
+#define RC_FILE_EXT		".vrc"
+#define RC_MAX_QUEUED_BLKS	30	// the writer thread may fall behind by up to 30 blocks (seconds)
+
+// writer thread jobs
+#define RCJ_CREATE		0x00
+#define RCJ_BLOCK		0x01	// compress and write a block
+#define RCJ_FINISH		0x02
+#define RCJ_DISCARD		0x03
+#define RCJ_REMOVE		0x04	// remove a broken entry
+#define RCJ_SAVEINDEX	0x05
+
+// block compression
+#define RCB_RAW		0x00	// uncompressed
+#define RCB_RICE	0x01	// 2nd order prediction + Rice codes, each channel separately
+#define RICE_ESCAPE	24	// quotient that is followed by the plain 32-bit value
+
+static const char RCF_SIGNATURE[8] = {'V', 'G', 'M', 'P', 'R', 'C', 'F', 0x1A};
+
+struct BitWriter
+{
+	std::vector<UINT8>* data;
+	UINT64 bitBuf;
+	UINT8 bitCnt;
+};
+
+struct BitReader
+{
+	const UINT8* data;
+	UINT32 size;
+	UINT32 pos;
+	UINT64 bitBuf;
+	UINT8 bitCnt;
+};
+
+static inline UINT32 ReadLE32(const UINT8* data)
+{
+	return	(data[0x03] << 24) | (data[0x02] << 16) |
+			(data[0x01] <<  8) | (data[0x00] <<  0);
+}
+
+static inline UINT64 ReadLE64(const UINT8* data)
+{
+	return ((UINT64)ReadLE32(&data[0x04]) << 32) | ReadLE32(&data[0x00]);
+}
+
+static inline void WriteLE32(UINT8* data, UINT32 value)
+{
+	data[0x00] = (UINT8)(value >>  0);
+	data[0x01] = (UINT8)(value >>  8);
+	data[0x02] = (UINT8)(value >> 16);
+	data[0x03] = (UINT8)(value >> 24);
+}
+
+static inline void WriteLE64(UINT8* data, UINT64 value)
+{
+	WriteLE32(&data[0x00], (UINT32)(value >>  0));
+	WriteLE32(&data[0x04], (UINT32)(value >> 32));
+}
+
+static inline INT32 ReadSample(const UINT8* data, UINT8 smplBytes)
+{
+	if (smplBytes == 2)
+		return (INT16)((data[0x01] << 8) | (data[0x00] << 0));
+	else
+		return (INT32)((data[0x02] << 24) | (data[0x01] << 16) | (data[0x00] << 8)) >> 8;
+}
+
+static inline void WriteSample(UINT8* data, UINT8 smplBytes, INT32 value)
+{
+	data[0x00] = (UINT8)(value >> 0);
+	data[0x01] = (UINT8)(value >> 8);
+	if (smplBytes == 3)
+		data[0x02] = (UINT8)(value >> 16);
+}
+
+static inline void PutBits(BitWriter& bw, UINT32 value, UINT8 bits)	// bits = 0..32
+{
+	bw.bitBuf = (bw.bitBuf << bits) | (value & (((UINT64)1 << bits) - 1));
+	bw.bitCnt += bits;
+	while(bw.bitCnt >= 8)
+	{
+		bw.bitCnt -= 8;
+		bw.data->push_back((UINT8)(bw.bitBuf >> bw.bitCnt));
+	}
+}
+
+static inline void FlushBits(BitWriter& bw)
+{
+	if (bw.bitCnt > 0)
+		PutBits(bw, 0, 8 - bw.bitCnt);
+}
+
+static inline UINT32 GetBits(BitReader& br, UINT8 bits)	// bits = 0..32
+{
+	while(br.bitCnt < bits)
+	{
+		br.bitBuf = (br.bitBuf << 8) | ((br.pos < br.size) ? br.data[br.pos] : 0x00);
+		br.pos ++;
+		br.bitCnt += 8;
+	}
+	br.bitCnt -= bits;
+	return (UINT32)((br.bitBuf >> br.bitCnt) & (((UINT64)1 << bits) - 1));
+}
+
+static void EncodeBlock(const UINT8* pcm, UINT32 smplCnt, UINT8 channels, UINT8 smplBytes, std::vector<UINT8>& out)
+{
+	UINT32 smplSize = channels * smplBytes;
+	
+	out.clear();
+	if (smplBytes == 2 || smplBytes == 3)
+	{
+		std::vector<UINT32> resid(smplCnt);
+		BitWriter bw;
+		
+		bw.data = &out;
+		bw.bitBuf = 0;
+		bw.bitCnt = 0;
+		out.push_back(RCB_RICE);
+		for (UINT8 curChn = 0; curChn < channels; curChn ++)
+		{
+			const UINT8* smplPtr = &pcm[curChn * smplBytes];
+			INT32 prev1 = 0;
+			INT32 prev2 = 0;
+			UINT64 residSum = 0;
+			UINT32 curSmpl;
+			
+			for (curSmpl = 0; curSmpl < smplCnt; curSmpl ++, smplPtr += smplSize)
+			{
+				INT32 value = ReadSample(smplPtr, smplBytes);
+				INT32 diff = value - 2 * prev1 + prev2;
+				resid[curSmpl] = ((UINT32)diff << 1) ^ (UINT32)(diff >> 31);	// zig-zag: 0, -1, 1, -2, ...
+				residSum += resid[curSmpl];
+				prev2 = prev1;
+				prev1 = value;
+			}
+			
+			UINT8 riceK = 0;	// Rice parameter, about log2(average residual)
+			while(riceK < 24 && ((UINT64)smplCnt << (riceK + 1)) <= residSum)
+				riceK ++;
+			out.push_back(riceK);
+			for (curSmpl = 0; curSmpl < smplCnt; curSmpl ++)
+			{
+				UINT32 quot = resid[curSmpl] >> riceK;
+				if (quot < RICE_ESCAPE)
+				{
+					PutBits(bw, ((1 << quot) - 1) << 1, (UINT8)(quot + 1));	// unary code
+					PutBits(bw, resid[curSmpl], riceK);
+				}
+				else
+				{
+					PutBits(bw, (1 << RICE_ESCAPE) - 1, RICE_ESCAPE);
+					PutBits(bw, resid[curSmpl], 32);
+				}
+			}
+			FlushBits(bw);	// each channel starts at a byte boundary
+		}
+		if (out.size() < 1 + smplCnt * smplSize)
+			return;
+	}
+	
+	out.assign(1, RCB_RAW);
+	out.insert(out.end(), pcm, pcm + smplCnt * smplSize);
+	return;
+}
+
+static bool DecodeBlock(const UINT8* data, UINT32 size, UINT32 smplCnt, UINT8 channels, UINT8 smplBytes, UINT8* pcm)
+{
+	UINT32 smplSize = channels * smplBytes;
+	
+	if (size < 1)
+		return false;
+	if (data[0x00] == RCB_RAW)
+	{
+		if (size - 1 < smplCnt * smplSize)
+			return false;
+		memcpy(pcm, &data[0x01], smplCnt * smplSize);
+		return true;
+	}
+	if (data[0x00] != RCB_RICE || ! (smplBytes == 2 || smplBytes == 3))
+		return false;
+	
+	BitReader br;
+	br.data = data;
+	br.size = size;
+	br.pos = 0x01;
+	for (UINT8 curChn = 0; curChn < channels; curChn ++)
+	{
+		UINT8* smplPtr = &pcm[curChn * smplBytes];
+		INT32 prev1 = 0;
+		INT32 prev2 = 0;
+		
+		if (br.pos >= size)
+			return false;
+		UINT8 riceK = data[br.pos];
+		br.pos ++;
+		br.bitBuf = 0;
+		br.bitCnt = 0;
+		if (riceK > 24)
+			return false;
+		for (UINT32 curSmpl = 0; curSmpl < smplCnt; curSmpl ++, smplPtr += smplSize)
+		{
+			UINT32 quot = 0;
+			while(quot < RICE_ESCAPE && GetBits(br, 1))
+				quot ++;
+			UINT32 resid = (quot < RICE_ESCAPE) ? ((quot << riceK) | GetBits(br, riceK)) : GetBits(br, 32);
+			INT32 diff = (INT32)(resid >> 1) ^ -(INT32)(resid & 1);
+			INT32 value = (INT32)((UINT32)diff + 2 * (UINT32)prev1 - (UINT32)prev2);
+			WriteSample(smplPtr, smplBytes, value);
+			prev2 = prev1;
+			prev1 = value;
+		}
+	}
+	
+	return (br.pos <= size);
+}
+
+static void MakeDirectory(const std::string& dirPath)
+{
+#ifdef _WIN32
+	_mkdir(dirPath.c_str());
+#else
+	mkdir(dirPath.c_str(), 0755);
+#endif
+}
+
+RenderCache::RenderCache() :
+	_maxSize(0),
+	_smplRate(0),
+	_channels(0),
+	_smplBits(0),
+	_smplSize(1),
+	_totalSize(0),
+	_useCntr(0),
+	_hits(0),
+	_misses(0),
+	_stored(0),
+	_evicted(0),
+	_mtx(NULL),
+	_readKey(0),
+	_reading(false),
+	_hFile(NULL),
+	_writing(false),
+	_key(0),
+	_smplCnt(0),
+	_blkID((UINT32)-1),
+	_writeError(false),
+	_wrThread(NULL),
+	_wrSignal(NULL),
+	_wrStop(false),
+	_queuedBlks(0),
+	_wrFile(NULL),
+	_wrKey(0),
+	_wrSmplCnt(0),
+	_wrError(false)
+{
+}
+
+RenderCache::~RenderCache()
+{
+	Deinit();
+}
+
+UINT8 RenderCache::Init(const std::string& dirPath, UINT64 maxSize, UINT32 smplRate, UINT8 channels, UINT8 smplBits)
+{
+	UINT8 retVal;
+	
+	Deinit();
+	_dirPath = dirPath;
+	if (! _dirPath.empty() && _dirPath[_dirPath.length() - 1] != '/' && _dirPath[_dirPath.length() - 1] != '\\')
+		_dirPath += '/';
+	_smplRate = smplRate;
+	_channels = channels;
+	_smplBits = smplBits;
+	_smplSize = channels * smplBits / 8;
+	if (! _smplRate || ! _smplSize)
+		return 0xFF;
+	retVal = OSMutex_Init(&_mtx, 0);
+	if (retVal)
+		return 0xFF;
+	
+	LoadIndex();	// A missing index results in an empty cache.
+	if (maxSize == 0)
+		return 0x00;
+	
+	MakeDirectory(_dirPath);
+	_wrStop = false;
+	retVal = OSSignal_Init(&_wrSignal, 0);
+	if (! retVal)
+		retVal = OSThread_Init(&_wrThread, WriterThread, this);
+	if (retVal)
+	{
+		_wrThread = NULL;
+		Deinit();
+		return 0xFF;
+	}
+	_maxSize = maxSize;
+	return 0x00;
+}
+
+void RenderCache::Deinit(void)
+{
+	Close();
+	if (_wrThread != NULL)
+	{
+		// The thread finishes all queued jobs before it quits.
+		_wrStop = true;
+		OSSignal_Signal(_wrSignal);
+		OSThread_Join(_wrThread);
+		OSThread_Deinit(_wrThread);	_wrThread = NULL;
+	}
+	DiscardEntry();
+	if (IsEnabled())
+		SaveIndex();
+	if (_wrSignal != NULL)
+	{
+		OSSignal_Deinit(_wrSignal);	_wrSignal = NULL;
+	}
+	if (_mtx != NULL)
+	{
+		OSMutex_Deinit(_mtx);	_mtx = NULL;
+	}
+	_maxSize = 0;
+	_index.clear();
+	_totalSize = 0;
+	_jobs.clear();
+	_queuedBlks = 0;
+	
+	return;
+}
+
+void RenderCache::GetStats(Stats& stats) const
+{
+	std::map<UINT64, IndexEntry>::const_iterator idxIt;
+	
+	if (_mtx != NULL)
+		OSMutex_Lock(_mtx);
+	stats.entries = (UINT32)_index.size();
+	stats.fileSize = _totalSize;
+	stats.pcmSize = 0;
+	for (idxIt = _index.begin(); idxIt != _index.end(); ++idxIt)
+		stats.pcmSize += idxIt->second.pcmSize;
+	stats.maxSize = _maxSize;
+	stats.hits = _hits;
+	stats.misses = _misses;
+	stats.stored = _stored;
+	stats.evicted = _evicted;
+	if (_mtx != NULL)
+		OSMutex_Unlock(_mtx);
+	
+	return;
+}
+
+// index file format (text, tab-separated):
+//	stats	hits	misses	stored	evicted	useCounter
+//	key (16 hex digits)	fileSize	pcmSize	lastUse
+// called before the writer thread is started
+UINT8 RenderCache::LoadIndex(void)
+{
+	FILE* hFile;
+	char line[0x100];
+	
+	_index.clear();
+	_totalSize = 0;
+	_useCntr = 0;
+	_hits = _misses = _stored = _evicted = 0;
+	
+	hFile = fopen((_dirPath + RC_INDEX_FILE).c_str(), "rt");
+	if (hFile == NULL)
+		return 0x00;
+	while(fgets(line, sizeof(line), hFile) != NULL)
+	{
+		if (! strncmp(line, "stats\t", 6))
+		{
+			unsigned int vals[5] = {0, 0, 0, 0, 0};
+			sscanf(&line[6], "%u %u %u %u %u", &vals[0], &vals[1], &vals[2], &vals[3], &vals[4]);
+			_hits = vals[0];
+			_misses = vals[1];
+			_stored = vals[2];
+			_evicted = vals[3];
+			_useCntr = vals[4];
+			continue;
+		}
+		if (strlen(line) < 17 || line[16] != '\t')
+			continue;
+		
+		char hexStr[9];
+		unsigned int fileSize;
+		unsigned int pcmSize;
+		unsigned int lastUse;
+		if (sscanf(&line[17], "%u %u %u", &fileSize, &pcmSize, &lastUse) != 3)
+			continue;
+		hexStr[8] = '\0';
+		memcpy(hexStr, &line[0], 8);
+		UINT64 key = (UINT64)strtoul(hexStr, NULL, 16) << 32;
+		memcpy(hexStr, &line[8], 8);
+		key |= (UINT32)strtoul(hexStr, NULL, 16);
+		
+		IndexEntry& ie = _index[key];
+		ie.fileSize = fileSize;
+		ie.pcmSize = pcmSize;
+		ie.lastUse = lastUse;
+		_totalSize += ie.fileSize;
+	}
+	fclose(hFile);
+	
+	return 0x00;
+}
+
+// called by the writer thread, or after it was stopped
+UINT8 RenderCache::SaveIndex(void)
+{
+	std::map<UINT64, IndexEntry>::const_iterator idxIt;
+	std::string fileName = _dirPath + RC_INDEX_FILE;
+	std::string tempName = fileName + ".tmp";
+	std::string idxText;
+	char line[0x60];
+	FILE* hFile;
+	
+	// format the index first, so that the lock isn't held while writing the file
+	OSMutex_Lock(_mtx);
+	sprintf(line, "stats\t%u\t%u\t%u\t%u\t%u\n", _hits, _misses, _stored, _evicted, _useCntr);
+	idxText = line;
+	for (idxIt = _index.begin(); idxIt != _index.end(); ++idxIt)
+	{
+		const IndexEntry& ie = idxIt->second;
+		sprintf(line, "%08X%08X\t%u\t%u\t%u\n", (UINT32)(idxIt->first >> 32), (UINT32)(idxIt->first >> 0),
+			ie.fileSize, ie.pcmSize, ie.lastUse);
+		idxText += line;
+	}
+	OSMutex_Unlock(_mtx);
+	
+	hFile = fopen(tempName.c_str(), "wt");
+	if (hFile == NULL)
+		return 0xC0;
+	bool writeOK = (fputs(idxText.c_str(), hFile) >= 0);
+	writeOK &= ! fclose(hFile);
+	if (! writeOK)
+	{
+		remove(tempName.c_str());
+		return 0xC1;
+	}
+	remove(fileName.c_str());	// rename() doesn't replace existing files on Windows
+	if (rename(tempName.c_str(), fileName.c_str()))
+		return 0xC2;
+	
+	return 0x00;
+}
+
+std::string RenderCache::GetEntryPath(UINT64 key) const
+{
+	char keyStr[0x11];
+	
+	sprintf(keyStr, "%08X%08X", (UINT32)(key >> 32), (UINT32)(key >> 0));
+	return _dirPath + keyStr + RC_FILE_EXT;
+}
+
+// called by the writer thread
+void RenderCache::RemoveEntry(UINT64 key)
+{
+	std::map<UINT64, IndexEntry>::iterator idxIt;
+	
+	OSMutex_Lock(_mtx);
+	idxIt = _index.find(key);
+	if (idxIt == _index.end())
+	{
+		OSMutex_Unlock(_mtx);
+		return;
+	}
+	_totalSize -= idxIt->second.fileSize;
+	_index.erase(idxIt);
+	OSMutex_Unlock(_mtx);
+	remove(GetEntryPath(key).c_str());
+	
+	return;
+}
+
+// delete least recently used entries until the cache fits into its size limit
+// called by the writer thread, the entry that is being read is kept as well
+void RenderCache::Evict(UINT64 keepKey)
+{
+	while(true)
+	{
+		std::map<UINT64, IndexEntry>::const_iterator idxIt;
+		std::map<UINT64, IndexEntry>::const_iterator lruIt;
+		UINT64 lruKey;
+		
+		OSMutex_Lock(_mtx);
+		if (_totalSize <= _maxSize)
+		{
+			OSMutex_Unlock(_mtx);
+			break;
+		}
+		lruIt = _index.end();
+		for (idxIt = _index.begin(); idxIt != _index.end(); ++idxIt)
+		{
+			if (idxIt->first == keepKey || (_reading && idxIt->first == _readKey))
+				continue;
+			if (lruIt == _index.end() || idxIt->second.lastUse < lruIt->second.lastUse)
+				lruIt = idxIt;
+		}
+		if (lruIt == _index.end())
+		{
+			OSMutex_Unlock(_mtx);
+			break;
+		}
+		lruKey = lruIt->first;
+		_evicted ++;
+		OSMutex_Unlock(_mtx);
+		RemoveEntry(lruKey);
+	}
+	
+	return;
+}
+
+// entry file layout (all values little endian):
+//	header (0x30 bytes), compressed blocks, block offset table (block count + 1 values)
+bool RenderCache::Open(UINT64 key)
+{
+	std::map<UINT64, IndexEntry>::iterator idxIt;
+	UINT8 hdrData[RCF_HDR_SIZE];
+	FILE* hFile;
+	bool isValid;
+	
+	Close();
+	if (! IsEnabled())
+		return false;
+	OSMutex_Lock(_mtx);
+	idxIt = _index.find(key);
+	isValid = (idxIt != _index.end());
+	if (isValid)
+	{
+		// keep the writer thread from evicting the entry while it is read
+		_readKey = key;
+		_reading = true;
+	}
+	else
+	{
+		_misses ++;
+	}
+	OSMutex_Unlock(_mtx);
+	if (! isValid)
+		return false;
+	
+	isValid = false;
+	hFile = fopen(GetEntryPath(key).c_str(), "rb");
+	if (hFile != NULL && fread(hdrData, 1, RCF_HDR_SIZE, hFile) == RCF_HDR_SIZE &&
+		! memcmp(&hdrData[0x00], RCF_SIGNATURE, 8) && ReadLE32(&hdrData[0x08]) == RCF_VERSION &&
+		ReadLE32(&hdrData[0x0C]) == _smplRate && hdrData[0x10] == _channels && hdrData[0x11] == _smplBits &&
+		ReadLE32(&hdrData[0x14]) == _smplRate && ReadLE64(&hdrData[0x18]) == key)
+	{
+		UINT32 smplCnt = ReadLE32(&hdrData[0x20]);
+		UINT32 blkCnt = ReadLE32(&hdrData[0x24]);
+		UINT32 tblOfs = ReadLE32(&hdrData[0x28]);
+		if (blkCnt == (UINT32)(((UINT64)smplCnt + _smplRate - 1) / _smplRate))
+		{
+			std::vector<UINT8> tblData((blkCnt + 1) * 4);
+			if (! fseek(hFile, tblOfs, SEEK_SET) && fread(&tblData[0], 1, tblData.size(), hFile) == tblData.size())
+			{
+				_blkOfs.resize(blkCnt + 1);
+				for (UINT32 curBlk = 0; curBlk <= blkCnt; curBlk ++)
+					_blkOfs[curBlk] = ReadLE32(&tblData[curBlk * 4]);
+				_smplCnt = smplCnt;
+				isValid = true;
+			}
+		}
+	}
+	if (! isValid)
+	{
+		// missing or broken file
+		if (hFile != NULL)
+			fclose(hFile);
+		_blkOfs.clear();
+		OSMutex_Lock(_mtx);
+		_reading = false;
+		_misses ++;
+		OSMutex_Unlock(_mtx);
+		QueueJob(RCJ_REMOVE, key);
+		return false;
+	}
+	
+	_hFile = hFile;
+	_key = key;
+	_blkID = (UINT32)-1;
+	_blkPCM.resize(_smplRate * _smplSize);
+	OSMutex_Lock(_mtx);
+	idxIt = _index.find(key);
+	if (idxIt != _index.end())
+		idxIt->second.lastUse = ++_useCntr;
+	_hits ++;
+	OSMutex_Unlock(_mtx);
+	QueueJob(RCJ_SAVEINDEX, key);
+	
+	return true;
+}
+
+bool RenderCache::LoadBlock(UINT32 blkID)
+{
+	if (blkID == _blkID)
+		return true;
+	if (blkID + 1 >= _blkOfs.size() || _blkOfs[blkID + 1] < _blkOfs[blkID])
+		return false;
+	
+	UINT32 dataSize = _blkOfs[blkID + 1] - _blkOfs[blkID];
+	UINT32 blkSmpls = _smplCnt - blkID * _smplRate;
+	if (blkSmpls > _smplRate)
+		blkSmpls = _smplRate;
+	if (dataSize > 1 + _smplRate * _smplSize)
+		return false;
+	_blkData.resize(dataSize);
+	if (fseek(_hFile, _blkOfs[blkID], SEEK_SET) || fread(&_blkData[0], 1, dataSize, _hFile) != dataSize)
+		return false;
+	if (! DecodeBlock(&_blkData[0], dataSize, blkSmpls, _channels, _smplBits / 8, &_blkPCM[0]))
+		return false;
+	_blkID = blkID;
+	
+	return true;
+}
+
+UINT32 RenderCache::Read(UINT32 pos, UINT32 smplCnt, void* data)
+{
+	UINT8* dataPtr = (UINT8*)data;
+	UINT32 readSmpls;
+	
+	if (! IsReading() || pos >= _smplCnt)
+		return 0;
+	if (smplCnt > _smplCnt - pos)
+		smplCnt = _smplCnt - pos;
+	
+	readSmpls = 0;
+	while(readSmpls < smplCnt)
+	{
+		if (! LoadBlock(pos / _smplRate))
+		{
+			// The file is broken, so remove it from the cache.
+			UINT64 key = _key;
+			Close();
+			QueueJob(RCJ_REMOVE, key);
+			break;
+		}
+		UINT32 blkOfs = pos % _smplRate;
+		UINT32 cpySmpls = _smplRate - blkOfs;
+		if (cpySmpls > smplCnt - readSmpls)
+			cpySmpls = smplCnt - readSmpls;
+		memcpy(dataPtr, &_blkPCM[blkOfs * _smplSize], cpySmpls * _smplSize);
+		dataPtr += cpySmpls * _smplSize;
+		pos += cpySmpls;
+		readSmpls += cpySmpls;
+	}
+	
+	return readSmpls;
+}
+
+// The file is created by the writer thread.
+UINT8 RenderCache::Create(UINT64 key)
+{
+	Close();
+	if (! IsEnabled())
+		return 0xFF;
+	
+	_writing = true;
+	_key = key;
+	_blkPCM.clear();
+	_blkPCM.reserve(_smplRate * _smplSize);
+	_writeError = false;
+	QueueJob(RCJ_CREATE, key);
+	
+	return 0x00;
+}
+
+void RenderCache::Write(UINT32 smplCnt, const void* data)
+{
+	const UINT8* dataPtr = (const UINT8*)data;
+	UINT32 blkSize = _smplRate * _smplSize;
+	
+	if (! IsWriting() || _writeError)
+		return;
+	
+	while(smplCnt > 0)
+	{
+		UINT32 wrtSmpls = (UINT32)(blkSize - _blkPCM.size()) / _smplSize;
+		if (wrtSmpls > smplCnt)
+			wrtSmpls = smplCnt;
+		_blkPCM.insert(_blkPCM.end(), dataPtr, dataPtr + wrtSmpls * _smplSize);
+		dataPtr += wrtSmpls * _smplSize;
+		smplCnt -= wrtSmpls;
+		if (_blkPCM.size() >= blkSize)
+		{
+			QueueBlock();
+			if (_writeError)
+				return;
+		}
+	}
+	
+	return;
+}
+
+// The entry is stored by the writer thread. It is available as soon as that is done.
+UINT8 RenderCache::Finish(void)
+{
+	if (! IsWriting())
+		return 0xFF;
+	if (! _blkPCM.empty() && ! _writeError)
+		QueueBlock();
+	if (_writeError)
+	{
+		Close();
+		return 0xC1;
+	}
+	
+	QueueJob(RCJ_FINISH, _key);
+	_writing = false;
+	std::vector<UINT8>().swap(_blkPCM);
+	
+	return 0x00;
+}
+
+void RenderCache::Close(void)
+{
+	if (_hFile != NULL)
+	{
+		fclose(_hFile);
+		_hFile = NULL;
+		OSMutex_Lock(_mtx);
+		_reading = false;
+		OSMutex_Unlock(_mtx);
+	}
+	if (_writing)
+		QueueJob(RCJ_DISCARD, _key);
+	_writing = false;
+	_smplCnt = 0;
+	_blkOfs.clear();
+	std::vector<UINT8>().swap(_blkPCM);
+	std::vector<UINT8>().swap(_blkData);
+	_blkID = (UINT32)-1;
+	_writeError = false;
+	
+	return;
+}
+
+void RenderCache::QueueJob(UINT8 type, UINT64 key)
+{
+	OSMutex_Lock(_mtx);
+	_jobs.push_back(WriteJob());
+	_jobs.back().type = type;
+	_jobs.back().key = key;
+	OSMutex_Unlock(_mtx);
+	OSSignal_Signal(_wrSignal);
+	
+	return;
+}
+
+// hands the filled block over to the writer thread
+void RenderCache::QueueBlock(void)
+{
+	OSMutex_Lock(_mtx);
+	if (_queuedBlks >= RC_MAX_QUEUED_BLKS)
+	{
+		// The writer thread can't keep up. Give up on the entry instead of using more and more memory.
+		OSMutex_Unlock(_mtx);
+		_writeError = true;
+		_blkPCM.clear();
+		return;
+	}
+	_jobs.push_back(WriteJob());
+	_jobs.back().type = RCJ_BLOCK;
+	_jobs.back().key = _key;
+	_jobs.back().pcm.swap(_blkPCM);
+	_queuedBlks ++;
+	OSMutex_Unlock(_mtx);
+	OSSignal_Signal(_wrSignal);
+	_blkPCM.reserve(_smplRate * _smplSize);
+	
+	return;
+}
+
+void RenderCache::WriterThread(void* args)
+{
+	RenderCache* rc = (RenderCache*)args;
+	
+	while(true)
+	{
+		OSSignal_Wait(rc->_wrSignal);
+		while(rc->ProcessJob())
+			;
+		if (rc->_wrStop)
+			break;
+	}
+	
+	return;
+}
+
+// returns false when there was no job
+bool RenderCache::ProcessJob(void)
+{
+	WriteJob job;
+	
+	OSMutex_Lock(_mtx);
+	if (_jobs.empty())
+	{
+		OSMutex_Unlock(_mtx);
+		return false;
+	}
+	job.type = _jobs.front().type;
+	job.key = _jobs.front().key;
+	job.pcm.swap(_jobs.front().pcm);
+	_jobs.pop_front();
+	if (job.type == RCJ_BLOCK)
+		_queuedBlks --;
+	OSMutex_Unlock(_mtx);
+	
+	switch(job.type)
+	{
+	case RCJ_CREATE:
+		StartEntry(job.key);
+		break;
+	case RCJ_BLOCK:
+		WriteBlock(job.pcm);
+		break;
+	case RCJ_FINISH:
+		FinishEntry();
+		break;
+	case RCJ_DISCARD:
+		DiscardEntry();
+		break;
+	case RCJ_REMOVE:
+		RemoveEntry(job.key);
+		SaveIndex();
+		break;
+	case RCJ_SAVEINDEX:
+		SaveIndex();
+		break;
+	}
+	
+	return true;
+}
+
+// writer thread: creates the temporary file of an entry
+void RenderCache::StartEntry(UINT64 key)
+{
+	UINT8 hdrData[RCF_HDR_SIZE];
+	
+	DiscardEntry();
+	_wrFile = fopen((GetEntryPath(key) + ".tmp").c_str(), "wb");
+	if (_wrFile == NULL)
+		return;	// The blocks are dropped.
+	
+	_wrKey = key;
+	_wrSmplCnt = 0;
+	_wrBlkOfs.assign(1, RCF_HDR_SIZE);
+	memset(hdrData, 0x00, RCF_HDR_SIZE);	// written again by FinishEntry()
+	_wrError = (fwrite(hdrData, 1, RCF_HDR_SIZE, _wrFile) != RCF_HDR_SIZE);
+	
+	return;
+}
+
+// writer thread: compresses a block and appends it to the entry
+void RenderCache::WriteBlock(const std::vector<UINT8>& pcm)
+{
+	UINT32 blkSmpls = (UINT32)(pcm.size() / _smplSize);
+	
+	if (_wrFile == NULL || _wrError || blkSmpls == 0)
+		return;
+	EncodeBlock(&pcm[0], blkSmpls, _channels, _smplBits / 8, _wrBlkData);
+	
+	UINT64 fileEnd = (UINT64)_wrBlkOfs.back() + _wrBlkData.size();
+	if (fileEnd > _maxSize || fileEnd > 0xFFFFFFF0)
+	{
+		_wrError = true;	// The song is too large for the cache.
+		return;
+	}
+	if (fwrite(&_wrBlkData[0], 1, _wrBlkData.size(), _wrFile) != _wrBlkData.size())
+	{
+		_wrError = true;
+		return;
+	}
+	_wrBlkOfs.push_back((UINT32)fileEnd);
+	_wrSmplCnt += blkSmpls;
+	
+	return;
+}
+
+// writer thread: completes the entry, adds it to the index and makes room for it
+void RenderCache::FinishEntry(void)
+{
+	UINT8 hdrData[RCF_HDR_SIZE];
+	std::vector<UINT8> tblData;
+	std::string fileName;
+	std::string tempName;
+	UINT32 blkCnt;
+	UINT32 fileSize;
+	
+	if (_wrFile == NULL)
+		return;
+	if (_wrError || _wrSmplCnt == 0 || (UINT64)_wrSmplCnt * _smplSize > 0xFFFFFFFF)
+	{
+		DiscardEntry();
+		return;
+	}
+	
+	blkCnt = (UINT32)_wrBlkOfs.size() - 1;
+	tblData.resize((blkCnt + 1) * 4);
+	for (UINT32 curBlk = 0; curBlk <= blkCnt; curBlk ++)
+		WriteLE32(&tblData[curBlk * 4], _wrBlkOfs[curBlk]);
+	fileSize = _wrBlkOfs.back() + (UINT32)tblData.size();
+	
+	memset(hdrData, 0x00, RCF_HDR_SIZE);
+	memcpy(&hdrData[0x00], RCF_SIGNATURE, 8);
+	WriteLE32(&hdrData[0x08], RCF_VERSION);
+	WriteLE32(&hdrData[0x0C], _smplRate);
+	hdrData[0x10] = _channels;
+	hdrData[0x11] = _smplBits;
+	WriteLE32(&hdrData[0x14], _smplRate);	// samples per block
+	WriteLE64(&hdrData[0x18], _wrKey);
+	WriteLE32(&hdrData[0x20], _wrSmplCnt);
+	WriteLE32(&hdrData[0x24], blkCnt);
+	WriteLE32(&hdrData[0x28], _wrBlkOfs.back());
+	
+	bool writeOK = (fwrite(&tblData[0], 1, tblData.size(), _wrFile) == tblData.size());
+	writeOK &= ! fseek(_wrFile, 0, SEEK_SET);
+	writeOK &= (fwrite(hdrData, 1, RCF_HDR_SIZE, _wrFile) == RCF_HDR_SIZE);
+	writeOK &= ! fclose(_wrFile);
+	_wrFile = NULL;
+	fileName = GetEntryPath(_wrKey);
+	tempName = fileName + ".tmp";
+	if (! writeOK)
+	{
+		remove(tempName.c_str());
+		return;
+	}
+	RemoveEntry(_wrKey);	// replace an older version
+	if (rename(tempName.c_str(), fileName.c_str()))
+	{
+		remove(tempName.c_str());
+		return;
+	}
+	
+	OSMutex_Lock(_mtx);
+	IndexEntry& ie = _index[_wrKey];
+	ie.fileSize = fileSize;
+	ie.pcmSize = _wrSmplCnt * _smplSize;
+	ie.lastUse = ++_useCntr;
+	_totalSize += ie.fileSize;
+	_stored ++;
+	OSMutex_Unlock(_mtx);
+	Evict(_wrKey);
+	SaveIndex();
+	
+	return;
+}
+
+// writer thread: deletes an unfinished entry
+void RenderCache::DiscardEntry(void)
+{
+	if (_wrFile != NULL)
+	{
+		fclose(_wrFile);	_wrFile = NULL;
+		remove((GetEntryPath(_wrKey) + ".tmp").c_str());
+	}
+	_wrBlkOfs.clear();
+	std::vector<UINT8>().swap(_wrBlkData);
+	_wrError = false;
+	
+	return;
+}
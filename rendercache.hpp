@@ -0,0 +1,139 @@
+#ifndef __RENDERCACHE_HPP__
+#define __RENDERCACHE_HPP__
+
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <stdtype.h>
+#include <utils/OSMutex.h>
+#include <utils/OSSignal.h>
+#include <utils/OSThread.h>
+
+#define RENDER_CACHE_DIR	"rendercache"	// default location, in the user's config directory
+
+// on-disk cache of completely rendered songs
+// Each entry is stored in its own file, named after its key. (a hash of the song data and
+// all settings that affect the output)
+// The audio is split into blocks of 1 second that are compressed losslessly using a 2nd order
+// predictor and Rice codes. 16 and 24 bit samples are compressed, other formats are stored as-is.
+// The file "index.txt" in the cache directory lists all entries with their size and last use,
+// as well as the usage statistics. When the size limit is exceeded, the least recently used
+// entries are deleted.
+// Only one entry can be open at a time, either for reading or for writing.
+// The public functions must not be called by multiple threads at once. Compressing and writing
+// entries, saving the index and evicting entries is done by a separate writer thread, so that
+// Write() and Finish() only have to copy the samples.
+class RenderCache
+{
+public:
+	struct Stats
+	{
+		UINT32 entries;
+		UINT64 fileSize;	// sum of all entry files
+		UINT64 pcmSize;	// uncompressed size of all entries
+		UINT64 maxSize;
+		UINT32 hits;
+		UINT32 misses;
+		UINT32 stored;
+		UINT32 evicted;
+	};
+	
+	RenderCache();
+	~RenderCache();
+	// maxSize = size limit in bytes, the directory is created if necessary
+	UINT8 Init(const std::string& dirPath, UINT64 maxSize, UINT32 smplRate, UINT8 channels, UINT8 smplBits);
+	void Deinit(void);
+	bool IsEnabled(void) const	{ return _maxSize > 0; }
+	const std::string& GetDirectory(void) const	{ return _dirPath; }
+	void GetStats(Stats& stats) const;
+	
+	// returns true if the entry exists, it stays open for reading until Close() is called
+	bool Open(UINT64 key);
+	bool IsReading(void) const	{ return _hFile != NULL; }
+	UINT32 GetLength(void) const	{ return _smplCnt; }	// in samples
+	UINT32 Read(UINT32 pos, UINT32 smplCnt, void* data);	// returns the number of samples read
+	
+	// An entry that is written becomes available only after Finish() was called and the
+	// writer thread stored it.
+	UINT8 Create(UINT64 key);
+	bool IsWriting(void) const	{ return _writing; }
+	void Write(UINT32 smplCnt, const void* data);
+	UINT8 Finish(void);
+	
+	void Close(void);	// also discards an entry that is being written
+	
+private:
+	struct IndexEntry
+	{
+		UINT32 fileSize;
+		UINT32 pcmSize;	// uncompressed size
+		UINT32 lastUse;
+	};
+	struct WriteJob
+	{
+		UINT8 type;	// RCJ_*
+		UINT64 key;
+		std::vector<UINT8> pcm;	// RCJ_BLOCK: samples of the block
+	};
+	
+	UINT8 LoadIndex(void);
+	UINT8 SaveIndex(void);
+	std::string GetEntryPath(UINT64 key) const;
+	void RemoveEntry(UINT64 key);
+	void Evict(UINT64 keepKey);
+	bool LoadBlock(UINT32 blkID);
+	void QueueJob(UINT8 type, UINT64 key);
+	void QueueBlock(void);
+	static void WriterThread(void* args);
+	bool ProcessJob(void);
+	void StartEntry(UINT64 key);
+	void WriteBlock(const std::vector<UINT8>& pcm);
+	void FinishEntry(void);
+	void DiscardEntry(void);
+	
+	std::string _dirPath;	// with trailing slash
+	UINT64 _maxSize;
+	UINT32 _smplRate;
+	UINT8 _channels;
+	UINT8 _smplBits;
+	UINT32 _smplSize;
+	
+	std::map<UINT64, IndexEntry> _index;
+	UINT64 _totalSize;	// sum of all entry files
+	UINT32 _useCntr;
+	UINT32 _hits;
+	UINT32 _misses;
+	UINT32 _stored;
+	UINT32 _evicted;
+	OS_MUTEX* _mtx;	// protects the index, the statistics, _readKey/_reading and the job queue
+	UINT64 _readKey;	// entry that must not be evicted
+	bool _reading;
+	
+	// currently open entry
+	FILE* _hFile;	// entry that is read
+	bool _writing;
+	UINT64 _key;
+	UINT32 _smplCnt;	// length of the entry that is read
+	std::vector<UINT32> _blkOfs;	// file offsets of all blocks, plus the end of the last one
+	std::vector<UINT8> _blkPCM;	// decoded block (reading) or block being filled (writing)
+	UINT32 _blkID;	// block in _blkPCM, (UINT32)-1 = none
+	std::vector<UINT8> _blkData;	// compressed block
+	bool _writeError;	// the writer thread fell behind, the entry will be discarded
+	
+	// writer thread
+	OS_THREAD* _wrThread;
+	OS_SIGNAL* _wrSignal;
+	volatile bool _wrStop;
+	std::deque<WriteJob> _jobs;
+	UINT32 _queuedBlks;	// number of RCJ_BLOCK jobs in _jobs
+	FILE* _wrFile;	// entry that is written
+	UINT64 _wrKey;
+	UINT32 _wrSmplCnt;
+	std::vector<UINT32> _wrBlkOfs;
+	std::vector<UINT8> _wrBlkData;
+	bool _wrError;	// the entry will be discarded
+};
+
+#endif	// __RENDERCACHE_HPP__
@@ -0,0 +1,131 @@
+#include <string.h>
+#include <vector>
+
+#include "stdtype.h"
+#include "atomics.hpp"
+#include "ringbuffer.hpp"
+
+RingBuffer::RingBuffer() :
+	_bufSize(0),
+	_blkAlign(1),
+	_readPos(0),
+	_writePos(0),
+	_discardPos(0),
+	_discardReq(0)
+{
+}
+
+void RingBuffer::Init(UINT32 bufSize, UINT32 blockAlign)
+{
+	_blkAlign = blockAlign ? blockAlign : 1;
+	bufSize -= bufSize % _blkAlign;
+	_bufSize = bufSize + _blkAlign;	// The additional block allows us to distinguish between "full" and "empty".
+	_buffer.resize(_bufSize);
+	Reset();
+	
+	return;
+}
+
+void RingBuffer::Reset(void)
+{
+	_readPos = 0;
+	_writePos = 0;
+	_discardPos = 0;
+	_discardReq = 0;
+	
+	return;
+}
+
+UINT32 RingBuffer::GetFillLevel(void) const
+{
+	UINT32 readPos = Atomic_LoadU32(&_readPos);
+	UINT32 writePos = Atomic_LoadU32(&_writePos);
+	return (writePos >= readPos) ? (writePos - readPos) : (_bufSize - readPos + writePos);
+}
+
+UINT32 RingBuffer::GetFreeSpace(void) const
+{
+	if (! _bufSize)
+		return 0;
+	return _bufSize - _blkAlign - GetFillLevel();
+}
+
+UINT32 RingBuffer::GetWriteBlock(UINT8** data)
+{
+	UINT32 readPos = Atomic_LoadU32(&_readPos);
+	UINT32 writePos = _writePos;
+	UINT32 size;
+	
+	if (! _bufSize)
+		return 0;
+	if (writePos >= readPos)
+	{
+		size = _bufSize - writePos;	// up to the end of the buffer
+		if (readPos == 0)
+			size -= _blkAlign;	// keep the last block free, else we would end up with writePos == readPos
+	}
+	else
+	{
+		size = readPos - writePos - _blkAlign;
+	}
+	*data = &_buffer[writePos];
+	return size;
+}
+
+void RingBuffer::CommitWrite(UINT32 size)
+{
+	UINT32 writePos = _writePos + size;
+	if (writePos >= _bufSize)
+		writePos -= _bufSize;
+	Atomic_StoreU32(&_writePos, writePos);
+	
+	return;
+}
+
+void RingBuffer::Discard(void)
+{
+	Atomic_StoreU32(&_discardPos, _writePos);
+	Atomic_StoreU32(&_discardReq, 1);
+	
+	return;
+}
+
+UINT32 RingBuffer::Read(UINT32 size, void* data)
+{
+	UINT8* dataPtr = (UINT8*)data;
+	UINT32 readPos = _readPos;
+	UINT32 writePos;
+	UINT32 fillSize;
+	UINT32 readSize;
+	
+	if (! _bufSize)
+		return 0;
+	if (Atomic_ExchangeU32(&_discardReq, 0))
+	{
+		UINT32 discardPos = Atomic_LoadU32(&_discardPos);
+		UINT32 discardDist = (discardPos >= readPos) ? (discardPos - readPos) : (_bufSize - readPos + discardPos);
+		// When we already read beyond the "discard" position, the request is outdated.
+		if (discardDist <= GetFillLevel())
+			readPos = discardPos;
+	}
+	
+	writePos = Atomic_LoadU32(&_writePos);
+	fillSize = (writePos >= readPos) ? (writePos - readPos) : (_bufSize - readPos + writePos);
+	size -= size % _blkAlign;
+	if (size > fillSize)
+		size = fillSize;
+	
+	readSize = _bufSize - readPos;	// up to the end of the buffer
+	if (readSize > size)
+		readSize = size;
+	memcpy(dataPtr, &_buffer[readPos], readSize);
+	if (readSize < size)
+		memcpy(dataPtr + readSize, &_buffer[0], size - readSize);
+	
+	readPos += size;
+	if (readPos >= _bufSize)
+		readPos -= _bufSize;
+	Atomic_StoreU32(&_readPos, readPos);
+	
+	return size;
+}
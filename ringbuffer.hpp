@@ -0,0 +1,39 @@
+#ifndef __RINGBUFFER_HPP__
+#define __RINGBUFFER_HPP__
+
+#include <vector>
+#include "stdtype.h"
+
+// lock-free single-producer/single-consumer byte ring
+// All positions and sizes are multiples of the "block alignment" (i.e. the size of a sample frame),
+// so that data is never split in the middle of a sample.
+class RingBuffer
+{
+public:
+	RingBuffer();
+	void Init(UINT32 bufSize, UINT32 blockAlign);	// not thread-safe
+	void Reset(void);	// not thread-safe
+	UINT32 GetSize(void) const	{ return _bufSize - _blkAlign; }
+	UINT32 GetBlockAlign(void) const	{ return _blkAlign; }
+	UINT32 GetFillLevel(void) const;
+	UINT32 GetFreeSpace(void) const;
+	
+	// producer side
+	UINT32 GetWriteBlock(UINT8** data);	// returns size of the contiguous free space
+	void CommitWrite(UINT32 size);
+	void Discard(void);	// drop all data that was written so far (applied by the consumer on its next Read())
+	
+	// consumer side
+	UINT32 Read(UINT32 size, void* data);
+	
+private:
+	std::vector<UINT8> _buffer;
+	UINT32 _bufSize;	// buffer size, including one block that always stays unused
+	UINT32 _blkAlign;
+	volatile UINT32 _readPos;	// written by consumer only
+	volatile UINT32 _writePos;	// written by producer only
+	volatile UINT32 _discardPos;
+	volatile UINT32 _discardReq;
+};
+
+#endif	// __RINGBUFFER_HPP__
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <string>
+
+#include <stdtype.h>
+#include <utils/DataLoader.h>
+#include <utils/OSMutex.h>
+#include "utils.hpp"
+#include "romcache.hpp"
+
+const DATA_LOADER_CALLBACKS RomCache::_loaderCB =
+{
+	0x524F4D43,	// "ROMC"
+	"ROM Cache Loader",
+	RomCache::Loader_dopen,
+	RomCache::Loader_dread,
+	RomCache::Loader_dseek,
+	RomCache::Loader_dclose,
+	RomCache::Loader_dtell,
+	RomCache::Loader_dlength,
+	RomCache::Loader_deof,
+	RomCache::Loader_ddeinit,
+};
+
+RomCache::RomCache() :
+	_mtx(NULL),
+	_maxSize(0),
+	_curSize(0),
+	_useCntr(0),
+	_hits(0),
+	_misses(0)
+{
+}
+
+RomCache::~RomCache()
+{
+	Deinit();
+}
+
+UINT8 RomCache::Init(UINT64 maxSize)
+{
+	UINT8 retVal;
+	
+	if (_mtx != NULL)
+		return 0x01;
+	retVal = OSMutex_Init(&_mtx, 0);
+	if (retVal)
+		return retVal;
+	_maxSize = maxSize;
+	_curSize = 0;
+	_useCntr = 0;
+	_hits = 0;
+	_misses = 0;
+	
+	return 0x00;
+}
+
+void RomCache::Deinit(void)
+{
+	if (_mtx == NULL)
+		return;
+	
+	for (size_t curEnt = 0; curEnt < _entries.size(); curEnt ++)
+		delete _entries[curEnt];
+	_entries.clear();
+	_pathCache.clear();
+	_curSize = 0;
+	OSMutex_Deinit(_mtx);	_mtx = NULL;
+	
+	return;
+}
+
+// returns the full path of the file, using the cached result of earlier searches if it is still valid
+std::string RomCache::ResolvePath(const std::string& fileName, const std::vector<std::string>& searchPaths,
+	UINT64& fileTime, UINT64& fileSize)
+{
+	std::map<std::string, std::string>::iterator pcIt = _pathCache.find(fileName);
+	if (pcIt != _pathCache.end())
+	{
+		if (GetFileStats(pcIt->second, fileTime, fileSize))
+			return pcIt->second;
+		_pathCache.erase(pcIt);	// file was removed - search again
+	}
+	
+	std::string filePath = FindFile_Single(fileName, searchPaths);
+	if (filePath.empty() || ! GetFileStats(filePath, fileTime, fileSize))
+		return std::string();
+	_pathCache[fileName] = filePath;
+	return filePath;
+}
+
+RomCache::Entry* RomCache::LoadEntry(const std::string& path, UINT64 fileTime, UINT64 fileSize)
+{
+	Entry* entry;
+	FILE* hFile;
+	
+	if (fileSize > 0xFFFFFFFF)
+		return NULL;
+	hFile = fopen(path.c_str(), "rb");
+	if (hFile == NULL)
+		return NULL;
+	
+	entry = new Entry;
+	entry->path = path;
+	entry->fileTime = fileTime;
+	entry->fileSize = fileSize;
+	entry->data.resize((size_t)fileSize);
+	entry->refCnt = 0;
+	entry->lastUse = 0;
+	entry->stale = false;
+	if (fileSize > 0 && fread(&entry->data[0], 1, (size_t)fileSize, hFile) != fileSize)
+	{
+		fclose(hFile);
+		delete entry;
+		return NULL;
+	}
+	fclose(hFile);
+	
+	return entry;
+}
+
+DATA_LOADER* RomCache::GetFile(const std::string& fileName, const std::vector<std::string>& searchPaths)
+{
+	UINT64 fileTime;
+	UINT64 fileSize;
+	Entry* entry;
+	
+	OSMutex_Lock(_mtx);
+	std::string filePath = ResolvePath(fileName, searchPaths, fileTime, fileSize);
+	if (filePath.empty())
+	{
+		OSMutex_Unlock(_mtx);
+		return NULL;
+	}
+	
+	entry = NULL;
+	for (size_t curEnt = 0; curEnt < _entries.size(); curEnt ++)
+	{
+		Entry* ent = _entries[curEnt];
+		if (ent->path != filePath)
+			continue;
+		if (ent->fileTime == fileTime && ent->fileSize == fileSize)
+		{
+			entry = ent;
+		}
+		else
+		{
+			// The file was modified. Remove the old version from the cache.
+			_entries.erase(_entries.begin() + curEnt);
+			_curSize -= ent->data.size();
+			if (ent->refCnt > 0)
+				ent->stale = true;
+			else
+				delete ent;
+		}
+		break;
+	}
+	if (entry != NULL)
+	{
+		_hits ++;
+	}
+	else
+	{
+		_misses ++;
+		entry = LoadEntry(filePath, fileTime, fileSize);
+		if (entry == NULL)
+		{
+			OSMutex_Unlock(_mtx);
+			return NULL;
+		}
+		_entries.push_back(entry);
+		_curSize += entry->data.size();
+	}
+	entry->refCnt ++;
+	entry->lastUse = ++_useCntr;
+	TrimCache();
+	OSMutex_Unlock(_mtx);
+	
+	LoaderCtx* ctx = new LoaderCtx;
+	ctx->cache = this;
+	ctx->entry = entry;
+	ctx->pos = 0;
+	DATA_LOADER* dLoad = DataLoader_New(ctx, &_loaderCB);
+	if (dLoad == NULL)
+	{
+		Loader_ddeinit(ctx);
+		return NULL;
+	}
+	if (DataLoader_Load(dLoad))
+	{
+		DataLoader_Deinit(dLoad);
+		return NULL;
+	}
+	return dLoad;
+}
+
+void RomCache::ReleaseEntry(Entry* entry)
+{
+	OSMutex_Lock(_mtx);
+	entry->refCnt --;
+	if (entry->stale && entry->refCnt == 0)
+		delete entry;
+	else
+		TrimCache();
+	OSMutex_Unlock(_mtx);
+	
+	return;
+}
+
+// drop unused entries until the cache fits into its size limit, the caller must hold _mtx
+void RomCache::TrimCache(void)
+{
+	while(_curSize > _maxSize)
+	{
+		size_t lruEnt = (size_t)-1;
+		for (size_t curEnt = 0; curEnt < _entries.size(); curEnt ++)
+		{
+			if (_entries[curEnt]->refCnt > 0)
+				continue;
+			if (lruEnt == (size_t)-1 || _entries[curEnt]->lastUse < _entries[lruEnt]->lastUse)
+				lruEnt = curEnt;
+		}
+		if (lruEnt == (size_t)-1)
+			break;	// everything is in use
+		
+		_curSize -= _entries[lruEnt]->data.size();
+		delete _entries[lruEnt];
+		_entries.erase(_entries.begin() + lruEnt);
+	}
+	
+	return;
+}
+
+UINT8 RomCache::Loader_dopen(void* context)
+{
+	LoaderCtx* ctx = (LoaderCtx*)context;
+	ctx->pos = 0;
+	return 0x00;
+}
+
+UINT32 RomCache::Loader_dread(void* context, UINT8* buffer, UINT32 numBytes)
+{
+	LoaderCtx* ctx = (LoaderCtx*)context;
+	UINT32 length = (UINT32)ctx->entry->data.size();
+	
+	if (ctx->pos >= length)
+		return 0;
+	if (numBytes > length - ctx->pos)
+		numBytes = length - ctx->pos;
+	memcpy(buffer, &ctx->entry->data[ctx->pos], numBytes);
+	ctx->pos += numBytes;
+	return numBytes;
+}
+
+UINT8 RomCache::Loader_dseek(void* context, UINT32 offset, UINT8 whence)
+{
+	LoaderCtx* ctx = (LoaderCtx*)context;
+	UINT32 length = (UINT32)ctx->entry->data.size();
+	UINT32 newPos;
+	
+	if (whence == SEEK_SET)
+		newPos = offset;
+	else if (whence == SEEK_CUR)
+		newPos = ctx->pos + offset;
+	else if (whence == SEEK_END)
+		newPos = length + offset;
+	else
+		return 0xFF;
+	ctx->pos = (newPos < length) ? newPos : length;
+	return 0x00;
+}
+
+UINT8 RomCache::Loader_dclose(void* context)
+{
+	return 0x00;
+}
+
+INT32 RomCache::Loader_dtell(void* context)
+{
+	LoaderCtx* ctx = (LoaderCtx*)context;
+	return (INT32)ctx->pos;
+}
+
+UINT32 RomCache::Loader_dlength(void* context)
+{
+	LoaderCtx* ctx = (LoaderCtx*)context;
+	return (UINT32)ctx->entry->data.size();
+}
+
+UINT8 RomCache::Loader_deof(void* context)
+{
+	LoaderCtx* ctx = (LoaderCtx*)context;
+	return (ctx->pos >= ctx->entry->data.size());
+}
+
+void RomCache::Loader_ddeinit(void* context)
+{
+	LoaderCtx* ctx = (LoaderCtx*)context;
+	ctx->cache->ReleaseEntry(ctx->entry);
+	delete ctx;
+	return;
+}
@@ -0,0 +1,72 @@
+#ifndef __ROMCACHE_HPP__
+#define __ROMCACHE_HPP__
+
+#include <vector>
+#include <map>
+#include <string>
+#include <stdtype.h>
+#include <utils/DataLoader.h>
+#include <utils/OSMutex.h>
+
+// process-wide cache for files requested by the players (e.g. sample ROMs like yrw801.rom)
+// Files are identified by their resolved path, size and modification time.
+// Entries are reference-counted by the data loaders that use them. Unused entries are
+// dropped (least recently used first) when the cache grows beyond its size limit.
+// All functions are thread-safe.
+class RomCache
+{
+public:
+	RomCache();
+	~RomCache();
+	UINT8 Init(UINT64 maxSize);
+	void Deinit(void);
+	// returns a loaded DATA_LOADER or NULL if the file wasn't found
+	DATA_LOADER* GetFile(const std::string& fileName, const std::vector<std::string>& searchPaths);
+	UINT32 GetHitCount(void) const	{ return _hits; }
+	UINT32 GetMissCount(void) const	{ return _misses; }
+	
+private:
+	struct Entry
+	{
+		std::string path;
+		UINT64 fileTime;
+		UINT64 fileSize;
+		std::vector<UINT8> data;
+		UINT32 refCnt;
+		UINT32 lastUse;
+		bool stale;	// file was changed, delete when it isn't used anymore
+	};
+	struct LoaderCtx
+	{
+		RomCache* cache;
+		Entry* entry;
+		UINT32 pos;
+	};
+	
+	std::string ResolvePath(const std::string& fileName, const std::vector<std::string>& searchPaths,
+		UINT64& fileTime, UINT64& fileSize);
+	Entry* LoadEntry(const std::string& path, UINT64 fileTime, UINT64 fileSize);
+	void ReleaseEntry(Entry* entry);
+	void TrimCache(void);
+	
+	static UINT8 Loader_dopen(void* context);
+	static UINT32 Loader_dread(void* context, UINT8* buffer, UINT32 numBytes);
+	static UINT8 Loader_dseek(void* context, UINT32 offset, UINT8 whence);
+	static UINT8 Loader_dclose(void* context);
+	static INT32 Loader_dtell(void* context);
+	static UINT32 Loader_dlength(void* context);
+	static UINT8 Loader_deof(void* context);
+	static void Loader_ddeinit(void* context);
+	static const DATA_LOADER_CALLBACKS _loaderCB;
+	
+	OS_MUTEX* _mtx;
+	UINT64 _maxSize;
+	UINT64 _curSize;
+	std::map<std::string, std::string> _pathCache;	// requested file name -> resolved path
+	std::vector<Entry*> _entries;
+	UINT32 _useCntr;
+	UINT32 _hits;
+	UINT32 _misses;
+};
+
+#endif	// __ROMCACHE_HPP__
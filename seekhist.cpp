@@ -0,0 +1,138 @@
+#include <string.h>
+#include <vector>
+
+#include "stdtype.h"
+#include "seekhist.hpp"
+
+SeekHistory::SeekHistory() :
+	_blkSmpls(0),
+	_smplSize(1),
+	_curBlk((size_t)-1),
+	_useCntr(0)
+{
+}
+
+void SeekHistory::Init(UINT32 blockSmpls, UINT32 blockCount, UINT32 smplSize)
+{
+	_blkSmpls = blockSmpls;
+	_smplSize = smplSize ? smplSize : 1;
+	if (! _blkSmpls)
+		blockCount = 0;
+	_blocks.clear();
+	_blocks.resize(blockCount);
+	for (size_t curBlk = 0; curBlk < _blocks.size(); curBlk ++)
+		_blocks[curBlk].data.resize(_blkSmpls * _smplSize);
+	Clear();
+	
+	return;
+}
+
+void SeekHistory::Clear(void)
+{
+	for (size_t curBlk = 0; curBlk < _blocks.size(); curBlk ++)
+	{
+		_blocks[curBlk].startPos = 0;
+		_blocks[curBlk].smplCnt = 0;
+		_blocks[curBlk].lastUse = 0;
+	}
+	_curBlk = (size_t)-1;
+	_useCntr = 0;
+	
+	return;
+}
+
+size_t SeekHistory::FindBlock(UINT32 pos) const
+{
+	for (size_t curBlk = 0; curBlk < _blocks.size(); curBlk ++)
+	{
+		const Block& blk = _blocks[curBlk];
+		if (blk.smplCnt > 0 && pos >= blk.startPos && pos - blk.startPos < blk.smplCnt)
+			return curBlk;
+	}
+	return (size_t)-1;
+}
+
+size_t SeekHistory::GetFreeBlock(void)
+{
+	size_t lruBlk = 0;
+	
+	for (size_t curBlk = 0; curBlk < _blocks.size(); curBlk ++)
+	{
+		if (_blocks[curBlk].smplCnt == 0)
+			return curBlk;
+		if (_blocks[curBlk].lastUse < _blocks[lruBlk].lastUse)
+			lruBlk = curBlk;
+	}
+	return lruBlk;
+}
+
+void SeekHistory::Store(UINT32 pos, UINT32 smplCnt, const void* data)
+{
+	const UINT8* dataPtr = (const UINT8*)data;
+	
+	if (_blocks.empty())
+		return;
+	
+	while(smplCnt > 0)
+	{
+		Block* blk = (_curBlk != (size_t)-1) ? &_blocks[_curBlk] : NULL;
+		if (blk == NULL || blk->startPos + blk->smplCnt != pos || blk->smplCnt >= _blkSmpls)
+		{
+			// not continuous or full - start a new block
+			size_t oldBlk = FindBlock(pos);
+			_curBlk = (oldBlk != (size_t)-1) ? oldBlk : GetFreeBlock();
+			blk = &_blocks[_curBlk];
+			if (oldBlk != (size_t)-1)
+			{
+				blk->smplCnt = pos - blk->startPos;	// overwrite the old data from this position on
+			}
+			else
+			{
+				blk->startPos = pos;
+				blk->smplCnt = 0;
+			}
+		}
+		
+		UINT32 wrtSmpls = _blkSmpls - blk->smplCnt;
+		if (wrtSmpls > smplCnt)
+			wrtSmpls = smplCnt;
+		memcpy(&blk->data[blk->smplCnt * _smplSize], dataPtr, wrtSmpls * _smplSize);
+		blk->smplCnt += wrtSmpls;
+		blk->lastUse = ++_useCntr;
+		pos += wrtSmpls;
+		dataPtr += wrtSmpls * _smplSize;
+		smplCnt -= wrtSmpls;
+	}
+	
+	return;
+}
+
+bool SeekHistory::Covers(UINT32 startPos, UINT32 endPos) const
+{
+	UINT32 pos = startPos;
+	
+	while(pos < endPos)
+	{
+		size_t curBlk = FindBlock(pos);
+		if (curBlk == (size_t)-1)
+			return false;
+		pos = _blocks[curBlk].startPos + _blocks[curBlk].smplCnt;
+	}
+	return true;
+}
+
+UINT32 SeekHistory::Read(UINT32 pos, UINT32 smplCnt, void* data)
+{
+	size_t curBlk = FindBlock(pos);
+	if (curBlk == (size_t)-1)
+		return 0;
+	
+	Block& blk = _blocks[curBlk];
+	UINT32 blkOfs = pos - blk.startPos;
+	if (smplCnt > blk.smplCnt - blkOfs)
+		smplCnt = blk.smplCnt - blkOfs;
+	memcpy(data, &blk.data[blkOfs * _smplSize], smplCnt * _smplSize);
+	blk.lastUse = ++_useCntr;
+	
+	return smplCnt;
+}
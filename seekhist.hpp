@@ -0,0 +1,42 @@
+#ifndef __SEEKHIST_HPP__
+#define __SEEKHIST_HPP__
+
+#include <vector>
+#include "stdtype.h"
+
+// history of rendered audio, split into blocks of fixed length
+// Backwards seeks can be served from here instead of re-emulating the song from the beginning.
+// Positions are in samples, as returned by PlayerA::GetCurPos(PLAYPOS_SAMPLE).
+// When all blocks are used, the least recently used one is recycled.
+// Not thread-safe.
+class SeekHistory
+{
+public:
+	SeekHistory();
+	void Init(UINT32 blockSmpls, UINT32 blockCount, UINT32 smplSize);
+	void Clear(void);
+	bool IsEnabled(void) const	{ return ! _blocks.empty(); }
+	void Store(UINT32 pos, UINT32 smplCnt, const void* data);
+	bool Covers(UINT32 startPos, UINT32 endPos) const;	// is the range [startPos, endPos) available?
+	UINT32 Read(UINT32 pos, UINT32 smplCnt, void* data);	// returns the number of samples read
+	
+private:
+	struct Block
+	{
+		UINT32 startPos;
+		UINT32 smplCnt;	// 0 = unused
+		UINT32 lastUse;
+		std::vector<UINT8> data;
+	};
+	
+	size_t FindBlock(UINT32 pos) const;	// returns (size_t)-1 if not found
+	size_t GetFreeBlock(void);
+	
+	std::vector<Block> _blocks;
+	UINT32 _blkSmpls;
+	UINT32 _smplSize;
+	size_t _curBlk;	// block that is currently being written to, (size_t)-1 = none
+	UINT32 _useCntr;
+};
+
+#endif	// __SEEKHIST_HPP__
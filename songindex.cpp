@@ -0,0 +1,617 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <stdtype.h>
+#include <utils/OSMutex.h>
+#include "utils.hpp"
+#include "songindex.hpp"
+
+#define SIDX_VERSION	0x100
+#define SIDX_HDR_SIZE	0x20
+#define SIDX_ENT_SIZE	0x60
+#define SIDX_TAG_SIZE	0x08
+
+// entry layout
+#define SEO_PATH		0x00
+#define SEO_FORMAT		0x04
+#define SEO_FILETIME	0x08
+#define SEO_FILESIZE	0x10
+#define SEO_HASH		0x18
+#define SEO_TOTALTICKS	0x20
+#define SEO_LOOPTICKS	0x24
+#define SEO_LENGTHMS	0x28
+#define SEO_LOOPMS		0x2C
+#define SEO_TAGSTART	0x30
+#define SEO_TAGCOUNT	0x34
+#define SEO_CHIPMASK	0x38	// 0x20 bytes, followed by 8 reserved bytes
+
+static const char SIDX_SIGNATURE[8] = {'V', 'G', 'M', 'P', 'I', 'D', 'X', 0x1A};
+
+#ifdef _WIN32
+static std::wstring UTF8toWide(const std::string& str);
+#endif
+static FILE* OpenFileUTF8(const std::string& fileName, const char* mode);
+static bool RemoveFileUTF8(const std::string& fileName);
+static bool ReplaceFileUTF8(const std::string& srcName, const std::string& dstName);
+
+static inline UINT32 ReadLE32(const UINT8* data)
+{
+	return	(data[0x03] << 24) | (data[0x02] << 16) |
+			(data[0x01] <<  8) | (data[0x00] <<  0);
+}
+
+static inline UINT64 ReadLE64(const UINT8* data)
+{
+	return ((UINT64)ReadLE32(&data[0x04]) << 32) | ReadLE32(&data[0x00]);
+}
+
+#ifdef _WIN32
+static std::wstring UTF8toWide(const std::string& str)
+{
+	std::vector<wchar_t> strW;
+	
+	strW.resize(MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, NULL, 0) + 1);
+	MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, &strW[0], (int)strW.size());
+	return std::wstring(&strW[0]);
+}
+#endif
+
+// The index path is UTF-8, which the ANSI functions on Windows don't understand.
+static FILE* OpenFileUTF8(const std::string& fileName, const char* mode)
+{
+#ifdef _WIN32
+	return _wfopen(UTF8toWide(fileName).c_str(), UTF8toWide(mode).c_str());
+#else
+	return fopen(fileName.c_str(), mode);
+#endif
+}
+
+static bool RemoveFileUTF8(const std::string& fileName)
+{
+#ifdef _WIN32
+	return (DeleteFileW(UTF8toWide(fileName).c_str()) != FALSE);
+#else
+	return ! remove(fileName.c_str());
+#endif
+}
+
+// atomically replaces dstName with srcName, so that there is always a valid file
+static bool ReplaceFileUTF8(const std::string& srcName, const std::string& dstName)
+{
+#ifdef _WIN32
+	return (MoveFileExW(UTF8toWide(srcName).c_str(), UTF8toWide(dstName).c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE);
+#else
+	return ! rename(srcName.c_str(), dstName.c_str());
+#endif
+}
+
+static inline void WriteLE32(UINT8* data, UINT32 value)
+{
+	data[0x00] = (UINT8)(value >>  0);
+	data[0x01] = (UINT8)(value >>  8);
+	data[0x02] = (UINT8)(value >> 16);
+	data[0x03] = (UINT8)(value >> 24);
+}
+
+static inline void WriteLE64(UINT8* data, UINT64 value)
+{
+	WriteLE32(&data[0x00], (UINT32)(value >>  0));
+	WriteLE32(&data[0x04], (UINT32)(value >> 32));
+}
+
+// returns the offset of the string in the string table, adding it if necessary
+static UINT32 InternString(const std::string& str, std::map<std::string, UINT32>& strMap, std::vector<char>& strTab)
+{
+	std::map<std::string, UINT32>::const_iterator smIt = strMap.find(str);
+	if (smIt != strMap.end())
+		return smIt->second;
+	
+	UINT32 ofs = (UINT32)strTab.size();
+	strTab.insert(strTab.end(), str.begin(), str.end());
+	strTab.push_back('\0');
+	strMap[str] = ofs;
+	return ofs;
+}
+
+SongIndex::SongIndex() :
+	_mtx(NULL),
+	_mapData(NULL),
+	_mapSize(0),
+	_entryCnt(0),
+	_tagCnt(0),
+	_strSize(0),
+	_entries(NULL),
+	_tagRecs(NULL),
+	_strTab(NULL),
+	_hashMapValid(false)
+{
+}
+
+SongIndex::~SongIndex()
+{
+	Unload();
+}
+
+UINT8 SongIndex::Load(const std::string& fileName)
+{
+	UINT8 retVal;
+	
+	if (_mtx != NULL)
+		return 0x01;
+	retVal = OSMutex_Init(&_mtx, 0);
+	if (retVal)
+		return 0xFF;
+	_fileName = fileName;
+	_changes.clear();
+	_removed.clear();
+	_hashMap.clear();
+	_hashMapValid = false;
+	
+	return MapFile();
+}
+
+void SongIndex::Unload(void)
+{
+	if (_mtx == NULL)
+		return;
+	
+	UnmapFile();
+	_changes.clear();
+	_removed.clear();
+	_hashMap.clear();
+	_hashMapValid = false;
+	OSMutex_Deinit(_mtx);	_mtx = NULL;
+	
+	return;
+}
+
+// maps the index file into memory and checks its header
+// A missing file is not an error, invalid files are ignored. (They are overwritten by Save().)
+UINT8 SongIndex::MapFile(void)
+{
+	_entryCnt = _tagCnt = _strSize = 0;
+#ifdef _WIN32
+	HANDLE hFile;
+	HANDLE hMap;
+	DWORD sizeLow;
+	DWORD sizeHigh;
+	
+	hFile = CreateFileW(UTF8toWide(_fileName).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return 0x00;	// not created yet
+	sizeLow = GetFileSize(hFile, &sizeHigh);
+	if (sizeLow == INVALID_FILE_SIZE || sizeHigh > 0 || sizeLow < SIDX_HDR_SIZE)
+	{
+		CloseHandle(hFile);
+		return 0x10;
+	}
+	_mapSize = (UINT32)sizeLow;
+	hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMap != NULL)
+	{
+		_mapData = (const UINT8*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(hMap);	// the view keeps the mapping alive
+	}
+	CloseHandle(hFile);
+#else
+	struct stat fileStat;
+	void* mapPtr;
+	int hFile;
+	
+	hFile = open(_fileName.c_str(), O_RDONLY);
+	if (hFile < 0)
+		return 0x00;	// not created yet
+	if (fstat(hFile, &fileStat) || (UINT64)fileStat.st_size > 0xFFFFFFFF || fileStat.st_size < SIDX_HDR_SIZE)
+	{
+		close(hFile);
+		return 0x10;
+	}
+	_mapSize = (UINT32)fileStat.st_size;
+	mapPtr = mmap(NULL, _mapSize, PROT_READ, MAP_SHARED, hFile, 0);
+	close(hFile);	// the mapping stays valid
+	_mapData = (mapPtr != MAP_FAILED) ? (const UINT8*)mapPtr : NULL;
+#endif
+	if (_mapData == NULL)
+		return 0xFF;
+	
+	if (memcmp(&_mapData[0x00], SIDX_SIGNATURE, 8) || ReadLE32(&_mapData[0x08]) != SIDX_VERSION)
+	{
+		UnmapFile();
+		return 0x10;	// invalid or incompatible
+	}
+	UINT64 entCnt = ReadLE32(&_mapData[0x0C]);
+	UINT64 tagCnt = ReadLE32(&_mapData[0x10]);
+	UINT64 strSize = ReadLE32(&_mapData[0x14]);
+	UINT64 dataEnd = SIDX_HDR_SIZE + entCnt * SIDX_ENT_SIZE + tagCnt * SIDX_TAG_SIZE + strSize;
+	if (dataEnd > _mapSize || strSize == 0 || _mapData[dataEnd - 1] != '\0')
+	{
+		UnmapFile();
+		return 0x11;	// truncated
+	}
+	_entryCnt = (UINT32)entCnt;
+	_tagCnt = (UINT32)tagCnt;
+	_strSize = (UINT32)strSize;
+	_entries = &_mapData[SIDX_HDR_SIZE];
+	_tagRecs = _entries + _entryCnt * SIDX_ENT_SIZE;
+	_strTab = reinterpret_cast<const char*>(_tagRecs + _tagCnt * SIDX_TAG_SIZE);
+	
+	return 0x00;
+}
+
+void SongIndex::UnmapFile(void)
+{
+	if (_mapData != NULL)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(_mapData);
+#else
+		munmap((void*)_mapData, _mapSize);
+#endif
+	}
+	_mapData = NULL;
+	_mapSize = 0;
+	_entryCnt = _tagCnt = _strSize = 0;
+	
+	return;
+}
+
+const char* SongIndex::GetString(UINT32 ofs) const
+{
+	// The string table ends with '\0', so this is always a valid string.
+	return (ofs < _strSize) ? &_strTab[ofs] : "";
+}
+
+const char* SongIndex::GetStoredPath(UINT32 idx) const
+{
+	return GetString(ReadLE32(&_entries[idx * SIDX_ENT_SIZE + SEO_PATH]));
+}
+
+const UINT8* SongIndex::GetStoredChipMask(UINT32 idx) const
+{
+	return &_entries[idx * SIDX_ENT_SIZE + SEO_CHIPMASK];
+}
+
+UINT32 SongIndex::GetStoredTagCount(UINT32 idx) const
+{
+	const UINT8* entData = &_entries[idx * SIDX_ENT_SIZE];
+	UINT32 tagStart = ReadLE32(&entData[SEO_TAGSTART]);
+	UINT32 tagCnt = ReadLE32(&entData[SEO_TAGCOUNT]);
+	
+	if (tagStart > _tagCnt || tagCnt > _tagCnt - tagStart)
+		return 0;
+	return tagCnt;
+}
+
+void SongIndex::GetStoredTag(UINT32 idx, UINT32 tagID, UINT32& keyStr, UINT32& valStr) const
+{
+	const UINT8* entData = &_entries[idx * SIDX_ENT_SIZE];
+	const UINT8* tagData = &_tagRecs[(ReadLE32(&entData[SEO_TAGSTART]) + tagID) * SIDX_TAG_SIZE];
+	
+	keyStr = ReadLE32(&tagData[0x00]);
+	valStr = ReadLE32(&tagData[0x04]);
+	return;
+}
+
+void SongIndex::DecodeEntry(UINT32 idx, SongIndexEntry& entry) const
+{
+	const UINT8* entData = &_entries[idx * SIDX_ENT_SIZE];
+	UINT32 tagStart = ReadLE32(&entData[SEO_TAGSTART]);
+	UINT32 tagCnt = ReadLE32(&entData[SEO_TAGCOUNT]);
+	
+	entry.path = GetString(ReadLE32(&entData[SEO_PATH]));
+	entry.fmtFCC = ReadLE32(&entData[SEO_FORMAT]);
+	entry.fileTime = ReadLE64(&entData[SEO_FILETIME]);
+	entry.fileSize = ReadLE64(&entData[SEO_FILESIZE]);
+	entry.hash = ReadLE64(&entData[SEO_HASH]);
+	entry.totalTicks = ReadLE32(&entData[SEO_TOTALTICKS]);
+	entry.loopTicks = ReadLE32(&entData[SEO_LOOPTICKS]);
+	entry.lengthMS = ReadLE32(&entData[SEO_LENGTHMS]);
+	entry.loopMS = ReadLE32(&entData[SEO_LOOPMS]);
+	memcpy(entry.chipMask, &entData[SEO_CHIPMASK], SIDX_CHIP_BYTES);
+	
+	entry.tags.clear();
+	if (tagStart > _tagCnt || tagCnt > _tagCnt - tagStart)
+		return;
+	entry.tags.resize(tagCnt);
+	for (UINT32 curTag = 0; curTag < tagCnt; curTag ++)
+	{
+		const UINT8* tagData = &_tagRecs[(tagStart + curTag) * SIDX_TAG_SIZE];
+		entry.tags[curTag].first = GetString(ReadLE32(&tagData[0x00]));
+		entry.tags[curTag].second = GetString(ReadLE32(&tagData[0x04]));
+	}
+	
+	return;
+}
+
+// binary search in the stored entries, returns (UINT32)-1 if not found
+UINT32 SongIndex::FindStoredPath(const std::string& path) const
+{
+	UINT32 lo = 0;
+	UINT32 hi = _entryCnt;
+	while(lo < hi)
+	{
+		UINT32 mid = lo + (hi - lo) / 2;
+		int cmpRes = strcmp(GetStoredPath(mid), path.c_str());
+		if (cmpRes == 0)
+			return mid;
+		else if (cmpRes < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (UINT32)-1;
+}
+
+bool SongIndex::Find(const std::string& path, UINT64 fileTime, UINT64 fileSize, SongIndexEntry& entry)
+{
+	bool found = false;
+	
+	if (_mtx == NULL)
+		return false;
+	OSMutex_Lock(_mtx);
+	std::map<std::string, SongIndexEntry>::const_iterator chgIt = _changes.find(path);
+	if (chgIt != _changes.end())
+	{
+		entry = chgIt->second;
+		found = true;
+	}
+	else if (_removed.find(path) == _removed.end())
+	{
+		UINT32 idx = FindStoredPath(path);
+		if (idx != (UINT32)-1)
+		{
+			DecodeEntry(idx, entry);
+			found = true;
+		}
+	}
+	OSMutex_Unlock(_mtx);
+	
+	return found && entry.fileTime == fileTime && entry.fileSize == fileSize;
+}
+
+bool SongIndex::FindHash(UINT64 hash, SongIndexEntry& entry)
+{
+	bool found = false;
+	
+	if (_mtx == NULL)
+		return false;
+	OSMutex_Lock(_mtx);
+	std::map<std::string, SongIndexEntry>::const_iterator chgIt;
+	for (chgIt = _changes.begin(); chgIt != _changes.end(); ++chgIt)
+	{
+		if (chgIt->second.hash == hash)
+		{
+			entry = chgIt->second;
+			found = true;
+			break;
+		}
+	}
+	if (! found)
+	{
+		if (! _hashMapValid)
+		{
+			for (UINT32 curEnt = 0; curEnt < _entryCnt; curEnt ++)
+				_hashMap[ReadLE64(&_entries[curEnt * SIDX_ENT_SIZE + SEO_HASH])] = curEnt;
+			_hashMapValid = true;
+		}
+		std::map<UINT64, UINT32>::const_iterator hmIt = _hashMap.find(hash);
+		if (hmIt != _hashMap.end())
+		{
+			DecodeEntry(hmIt->second, entry);
+			found = (_removed.find(entry.path) == _removed.end());
+		}
+	}
+	OSMutex_Unlock(_mtx);
+	
+	return found;
+}
+
+void SongIndex::Update(const SongIndexEntry& entry)
+{
+	if (_mtx == NULL)
+		return;
+	OSMutex_Lock(_mtx);
+	_changes[entry.path] = entry;
+	_removed.erase(entry.path);
+	OSMutex_Unlock(_mtx);
+	
+	return;
+}
+
+void SongIndex::Remove(const std::string& path)
+{
+	if (_mtx == NULL)
+		return;
+	OSMutex_Lock(_mtx);
+	_changes.erase(path);
+	if (FindStoredPath(path) != (UINT32)-1)
+		_removed.insert(path);
+	OSMutex_Unlock(_mtx);
+	
+	return;
+}
+
+void SongIndex::GetPathsInDir(const std::string& dirPath, std::vector<std::string>& paths)
+{
+	UINT32 lo;
+	UINT32 hi;
+	
+	paths.clear();
+	if (_mtx == NULL)
+		return;
+	OSMutex_Lock(_mtx);
+	// find the first entry >= dirPath, all matching paths follow it
+	lo = 0;
+	hi = _entryCnt;
+	while(lo < hi)
+	{
+		UINT32 mid = lo + (hi - lo) / 2;
+		if (strcmp(GetStoredPath(mid), dirPath.c_str()) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < _entryCnt; lo ++)
+	{
+		const char* path = GetStoredPath(lo);
+		if (strncmp(path, dirPath.c_str(), dirPath.length()))
+			break;
+		if (_removed.find(path) == _removed.end() && _changes.find(path) == _changes.end())
+			paths.push_back(path);
+	}
+	
+	std::map<std::string, SongIndexEntry>::const_iterator chgIt;
+	for (chgIt = _changes.lower_bound(dirPath); chgIt != _changes.end(); ++chgIt)
+	{
+		if (chgIt->first.compare(0, dirPath.length(), dirPath))
+			break;
+		paths.push_back(chgIt->first);
+	}
+	OSMutex_Unlock(_mtx);
+	
+	return;
+}
+
+UINT8 SongIndex::Save(void)
+{
+	std::vector<SongIndexEntry> entries;
+	std::map<std::string, UINT32> strMap;
+	std::vector<char> strTab;
+	std::vector<UINT8> entData;
+	std::vector<UINT8> tagData;
+	std::vector<UINT8> fileData;
+	UINT32 curEnt;
+	UINT32 tagCnt;
+	FILE* hFile;
+	UINT8 retVal;
+	
+	if (_mtx == NULL)
+		return 0xFF;
+	OSMutex_Lock(_mtx);
+	if (_changes.empty() && _removed.empty())
+	{
+		OSMutex_Unlock(_mtx);
+		return 0x00;
+	}
+	
+	// merge stored and changed entries, both are sorted by path
+	std::map<std::string, SongIndexEntry>::const_iterator chgIt = _changes.begin();
+	entries.reserve(_entryCnt + _changes.size());
+	for (curEnt = 0; curEnt < _entryCnt; curEnt ++)
+	{
+		const char* path = GetStoredPath(curEnt);
+		while(chgIt != _changes.end() && strcmp(chgIt->first.c_str(), path) < 0)
+		{
+			entries.push_back(chgIt->second);
+			++chgIt;
+		}
+		if (chgIt != _changes.end() && chgIt->first == path)
+		{
+			entries.push_back(chgIt->second);	// replaces the old entry
+			++chgIt;
+			continue;
+		}
+		if (_removed.find(path) != _removed.end())
+			continue;
+		entries.push_back(SongIndexEntry());
+		DecodeEntry(curEnt, entries.back());
+	}
+	for (; chgIt != _changes.end(); ++chgIt)
+		entries.push_back(chgIt->second);
+	
+	entData.resize(entries.size() * SIDX_ENT_SIZE, 0x00);
+	tagCnt = 0;
+	for (curEnt = 0; curEnt < entries.size(); curEnt ++)
+	{
+		const SongIndexEntry& sie = entries[curEnt];
+		UINT8* ed = &entData[curEnt * SIDX_ENT_SIZE];
+	
+		WriteLE32(&ed[SEO_PATH], InternString(sie.path, strMap, strTab));
+		WriteLE32(&ed[SEO_FORMAT], sie.fmtFCC);
+		WriteLE64(&ed[SEO_FILETIME], sie.fileTime);
+		WriteLE64(&ed[SEO_FILESIZE], sie.fileSize);
+		WriteLE64(&ed[SEO_HASH], sie.hash);
+		WriteLE32(&ed[SEO_TOTALTICKS], sie.totalTicks);
+		WriteLE32(&ed[SEO_LOOPTICKS], sie.loopTicks);
+		WriteLE32(&ed[SEO_LENGTHMS], sie.lengthMS);
+		WriteLE32(&ed[SEO_LOOPMS], sie.loopMS);
+		WriteLE32(&ed[SEO_TAGSTART], tagCnt);
+		WriteLE32(&ed[SEO_TAGCOUNT], (UINT32)sie.tags.size());
+		memcpy(&ed[SEO_CHIPMASK], sie.chipMask, SIDX_CHIP_BYTES);
+	
+		tagData.resize((tagCnt + sie.tags.size()) * SIDX_TAG_SIZE);
+		for (size_t curTag = 0; curTag < sie.tags.size(); curTag ++, tagCnt ++)
+		{
+			UINT8* td = &tagData[tagCnt * SIDX_TAG_SIZE];
+			WriteLE32(&td[0x00], InternString(sie.tags[curTag].first, strMap, strTab));
+			WriteLE32(&td[0x04], InternString(sie.tags[curTag].second, strMap, strTab));
+		}
+	}
+	if (strTab.empty())
+		strTab.push_back('\0');
+	
+	fileData.resize(SIDX_HDR_SIZE, 0x00);
+	memcpy(&fileData[0x00], SIDX_SIGNATURE, 8);
+	WriteLE32(&fileData[0x08], SIDX_VERSION);
+	WriteLE32(&fileData[0x0C], (UINT32)entries.size());
+	WriteLE32(&fileData[0x10], tagCnt);
+	WriteLE32(&fileData[0x14], (UINT32)strTab.size());
+	fileData.insert(fileData.end(), entData.begin(), entData.end());
+	fileData.insert(fileData.end(), tagData.begin(), tagData.end());
+	fileData.insert(fileData.end(), strTab.begin(), strTab.end());
+	
+	// write to a temporary file first, so that an interrupted write doesn't destroy the index
+	std::string tempName = _fileName + ".tmp";
+	hFile = OpenFileUTF8(tempName, "wb");
+	if (hFile == NULL)
+	{
+		OSMutex_Unlock(_mtx);
+		return 0xC0;
+	}
+	bool writeOK = (fwrite(&fileData[0], 1, fileData.size(), hFile) == fileData.size());
+	writeOK &= ! fclose(hFile);
+	if (! writeOK)
+	{
+		RemoveFileUTF8(tempName);
+		OSMutex_Unlock(_mtx);
+		return 0xC1;
+	}
+	UnmapFile();	// Windows can't replace files that are in use
+	if (! ReplaceFileUTF8(tempName, _fileName))
+	{
+		RemoveFileUTF8(tempName);
+		MapFile();
+		OSMutex_Unlock(_mtx);
+		return 0xC2;
+	}
+	
+	// continue with the new file
+	_changes.clear();
+	_removed.clear();
+	_hashMap.clear();
+	_hashMapValid = false;
+	retVal = MapFile();
+	OSMutex_Unlock(_mtx);
+	
+	return retVal;
+}
+
+// 64-bit FNV-1a
+UINT64 SongIndex::HashData(const UINT8* data, UINT32 size)
+{
+	return HashFNV1a(data, size, FNV1A_INIT);
+}
@@ -0,0 +1,86 @@
+#ifndef __SONGINDEX_HPP__
+#define __SONGINDEX_HPP__
+
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <stdtype.h>
+#include <utils/OSMutex.h>
+
+#define SIDX_CHIP_BYTES	0x20	// enough bits for all 256 possible chip types
+#define SONG_INDEX_FILE	"songindex.dat"	// stored in the user's config directory
+
+struct SongIndexEntry
+{
+	std::string path;	// absolute path, UTF-8
+	UINT64 fileTime;
+	UINT64 fileSize;
+	UINT64 hash;	// hash of the (decompressed) file data
+	UINT32 fmtFCC;	// player type
+	UINT32 totalTicks;
+	UINT32 loopTicks;	// 0 = song doesn't loop
+	UINT32 lengthMS;	// length of a single playthrough, in msec
+	UINT32 loopMS;	// length of the looping part, in msec
+	UINT8 chipMask[SIDX_CHIP_BYTES];	// bit (type & 7) of byte (type >> 3) = uses chip "type"
+	std::vector< std::pair<std::string, std::string> > tags;	// all tags as stored in the file
+};
+
+// persistent index of song lengths, loop points, chips and tags
+// The index file is memory-mapped and looked up in place. Added/changed/removed entries are kept
+// separately until Save() merges them into a new file.
+// File layout (all values little endian):
+//	header (0x20 bytes), entries (sorted by path), tag records (key/value string offsets), string table
+// Strings are stored only once, so tag names and common values (system, composer, ...) are shared.
+// All functions except for the direct access to the stored entries are thread-safe.
+class SongIndex
+{
+public:
+	SongIndex();
+	~SongIndex();
+	UINT8 Load(const std::string& fileName);	// a missing file results in an empty index
+	UINT8 Save(void);	// writes the file back if there were changes
+	void Unload(void);
+	bool IsLoaded(void) const	{ return _mtx != NULL; }
+	// returns false if the file isn't indexed or was modified since then
+	bool Find(const std::string& path, UINT64 fileTime, UINT64 fileSize, SongIndexEntry& entry);
+	bool FindHash(UINT64 hash, SongIndexEntry& entry);
+	void Update(const SongIndexEntry& entry);
+	void Remove(const std::string& path);
+	// returns the paths of all indexed files whose path starts with "dirPath"
+	void GetPathsInDir(const std::string& dirPath, std::vector<std::string>& paths);
+	
+	static UINT64 HashData(const UINT8* data, UINT32 size);
+	
+	// direct access to the entries of the index file (without changes that weren't saved yet),
+	// only valid until the next call of Save() or Unload()
+	UINT32 GetStoredCount(void) const	{ return _entryCnt; }
+	const char* GetStoredPath(UINT32 idx) const;
+	const UINT8* GetStoredChipMask(UINT32 idx) const;
+	UINT32 GetStoredTagCount(UINT32 idx) const;
+	void GetStoredTag(UINT32 idx, UINT32 tagID, UINT32& keyStr, UINT32& valStr) const;	// returns string offsets
+	const char* GetString(UINT32 ofs) const;
+	
+private:
+	UINT8 MapFile(void);
+	void UnmapFile(void);
+	void DecodeEntry(UINT32 idx, SongIndexEntry& entry) const;
+	UINT32 FindStoredPath(const std::string& path) const;
+	
+	OS_MUTEX* _mtx;
+	std::string _fileName;
+	const UINT8* _mapData;	// contents of the index file, NULL = not mapped
+	UINT32 _mapSize;
+	UINT32 _entryCnt;
+	UINT32 _tagCnt;
+	UINT32 _strSize;
+	const UINT8* _entries;
+	const UINT8* _tagRecs;
+	const char* _strTab;
+	std::map<std::string, SongIndexEntry> _changes;	// path -> new/updated entry
+	std::set<std::string> _removed;
+	std::map<UINT64, UINT32> _hashMap;	// hash -> stored entry, built on first use
+	bool _hashMapValid;
+};
+
+#endif	// __SONGINDEX_HPP__
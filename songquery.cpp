@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+#include <map>
+#include <string>
+
+#include <stdtype.h>
+#include <emu/SoundEmu.h>	// for SndEmu_GetDevName()
+#include "songindex.hpp"
+#include "songquery.hpp"
+
+#ifdef _MSC_VER
+#define snprintf	_snprintf
+#endif
+
+// query field name -> tag name
+static const char* const FIELD_NAMES[][2] =
+{
+	{"title", "TITLE"},
+	{"game", "GAME"},
+	{"system", "SYSTEM"},
+	{"composer", "ARTIST"},
+	{"artist", "ARTIST"},
+	{NULL, NULL},
+};
+
+static inline char ToLowerASCII(char chr)
+{
+	return (chr >= 'A' && chr <= 'Z') ? (chr - 'A' + 'a') : chr;
+}
+
+static inline char ToUpperASCII(char chr)
+{
+	return (chr >= 'a' && chr <= 'z') ? (chr - 'a' + 'A') : chr;
+}
+
+static inline bool IsWordChar(char chr)
+{
+	return	(chr >= '0' && chr <= '9') || (chr >= 'A' && chr <= 'Z') || (chr >= 'a' && chr <= 'z') ||
+			(chr & 0x80);	// treat all non-ASCII characters as letters
+}
+
+static inline bool IsFieldChar(char chr)
+{
+	return IsWordChar(chr) || chr == '_' || chr == '-';
+}
+
+static void EntrySet_Init(std::vector<UINT32>& set, UINT32 entryCnt)
+{
+	set.assign((entryCnt + 31) / 32, 0);
+}
+
+static inline void EntrySet_Add(std::vector<UINT32>& set, UINT32 entry)
+{
+	set[entry / 32] |= ((UINT32)1 << (entry % 32));
+}
+
+SongQuery::SongQuery(const SongIndex& index) :
+	_index(index),
+	_entryCnt(0),
+	_pos(0)
+{
+}
+
+UINT8 SongQuery::Run(const std::string& query, std::vector<std::string>& fileList)
+{
+	EntrySet result;
+	
+	_query = query;
+	_pos = 0;
+	_errMsg = std::string();
+	if (_entryCnt != _index.GetStoredCount())
+	{
+		_entryCnt = _index.GetStoredCount();
+		_fieldIdx.clear();
+	}
+	
+	if (! ParseOr(result))
+		return 0x01;
+	SkipSpaces();
+	if (_pos < _query.length())
+	{
+		SetError(_query[_pos] == ')' ? "unmatched \")\"" : "operator expected");
+		return 0x01;
+	}
+	
+	// entries are sorted by path, so songs of the same directory stay together
+	for (UINT32 curEnt = 0; curEnt < _entryCnt; curEnt ++)
+	{
+		if (result[curEnt / 32] & ((UINT32)1 << (curEnt % 32)))
+			fileList.push_back(_index.GetStoredPath(curEnt));
+	}
+	return 0x00;
+}
+
+bool SongQuery::ParseOr(EntrySet& result)
+{
+	if (! ParseAnd(result))
+		return false;
+	while(CheckKeyword("OR"))
+	{
+		EntrySet rhs;
+		if (! ParseAnd(rhs))
+			return false;
+		for (size_t curWrd = 0; curWrd < result.size(); curWrd ++)
+			result[curWrd] |= rhs[curWrd];
+	}
+	return true;
+}
+
+bool SongQuery::ParseAnd(EntrySet& result)
+{
+	if (! ParseNot(result))
+		return false;
+	while(true)
+	{
+		size_t oldPos;
+	
+		SkipSpaces();
+		if (_pos >= _query.length() || _query[_pos] == ')')
+			break;
+		oldPos = _pos;
+		if (CheckKeyword("OR"))
+		{
+			_pos = oldPos;	// let ParseOr() handle it
+			break;
+		}
+		CheckKeyword("AND");	// optional
+	
+		EntrySet rhs;
+		if (! ParseNot(rhs))
+			return false;
+		for (size_t curWrd = 0; curWrd < result.size(); curWrd ++)
+			result[curWrd] &= rhs[curWrd];
+	}
+	return true;
+}
+
+bool SongQuery::ParseNot(EntrySet& result)
+{
+	if (! CheckKeyword("NOT"))
+		return ParsePrimary(result);
+	
+	if (! ParseNot(result))
+		return false;
+	for (size_t curWrd = 0; curWrd < result.size(); curWrd ++)
+		result[curWrd] = ~result[curWrd];
+	if (_entryCnt % 32)
+		result.back() &= ((UINT32)1 << (_entryCnt % 32)) - 1;	// clear bits of non-existing entries
+	return true;
+}
+
+bool SongQuery::ParsePrimary(EntrySet& result)
+{
+	SkipSpaces();
+	if (_pos < _query.length() && _query[_pos] == '(')
+	{
+		_pos ++;
+		if (! ParseOr(result))
+			return false;
+		SkipSpaces();
+		if (_pos >= _query.length() || _query[_pos] != ')')
+			return SetError("\")\" expected");
+		_pos ++;
+		return true;
+	}
+	return ParseTerm(result);
+}
+
+bool SongQuery::ParseTerm(EntrySet& result)
+{
+	size_t startPos;
+	std::string field;
+	std::string value;
+	char op;
+	
+	SkipSpaces();
+	startPos = _pos;
+	while(_pos < _query.length() && IsFieldChar(_query[_pos]))
+		_pos ++;
+	if (_pos == startPos)
+		return SetError("field name expected");
+	field = _query.substr(startPos, _pos - startPos);
+	
+	if (_pos >= _query.length() || (_query[_pos] != ':' && _query[_pos] != '~' && _query[_pos] != '='))
+		return SetError("\":\", \"~\" or \"=\" expected after \"" + field + "\"");
+	op = _query[_pos];
+	_pos ++;
+	
+	if (_pos < _query.length() && _query[_pos] == '"')
+	{
+		size_t endPos = _query.find('"', _pos + 1);
+		if (endPos == std::string::npos)
+			return SetError("missing closing quotation mark");
+		value = _query.substr(_pos + 1, endPos - (_pos + 1));
+		_pos = endPos + 1;
+	}
+	else
+	{
+		startPos = _pos;
+		while(_pos < _query.length() && ! isspace((unsigned char)_query[_pos]) && _query[_pos] != ')')
+			_pos ++;
+		value = _query.substr(startPos, _pos - startPos);
+	}
+	if (value.empty())
+		return SetError("missing value for \"" + field + "\"");
+	
+	size_t curChr;
+	for (curChr = 0; curChr < value.length(); curChr ++)
+		value[curChr] = ToLowerASCII(value[curChr]);
+	for (curChr = 0; curChr < field.length(); curChr ++)
+		field[curChr] = ToLowerASCII(field[curChr]);
+	
+	if (field == "chip")
+	{
+		MatchChip(op, value, result);
+		return true;
+	}
+	
+	std::string tagName;
+	for (size_t curFld = 0; FIELD_NAMES[curFld][0] != NULL; curFld ++)
+	{
+		if (field == FIELD_NAMES[curFld][0])
+		{
+			tagName = FIELD_NAMES[curFld][1];
+			break;
+		}
+	}
+	if (tagName.empty())
+	{
+		// use any other tag name as it is
+		tagName = field;
+		for (curChr = 0; curChr < tagName.length(); curChr ++)
+			tagName[curChr] = ToUpperASCII(tagName[curChr]);
+	}
+	MatchTag(tagName, op, value, result);
+	return true;
+}
+
+// checks for a keyword (case-insensitive) and skips it
+bool SongQuery::CheckKeyword(const char* keyword)
+{
+	size_t kwLen = strlen(keyword);
+	size_t curChr;
+	
+	SkipSpaces();
+	if (_pos + kwLen > _query.length())
+		return false;
+	for (curChr = 0; curChr < kwLen; curChr ++)
+	{
+		if (ToUpperASCII(_query[_pos + curChr]) != keyword[curChr])
+			return false;
+	}
+	if (_pos + kwLen < _query.length() && IsFieldChar(_query[_pos + kwLen]))
+		return false;	// part of a longer word
+	_pos += kwLen;
+	return true;
+}
+
+void SongQuery::SkipSpaces(void)
+{
+	while(_pos < _query.length() && isspace((unsigned char)_query[_pos]))
+		_pos ++;
+	return;
+}
+
+bool SongQuery::SetError(const std::string& msg)
+{
+	char posStr[0x20];
+	
+	snprintf(posStr, 0x20, "column %u: ", 1 + (unsigned)_pos);
+	_errMsg = posStr + msg;
+	return false;
+}
+
+void SongQuery::MatchTag(const std::string& tagName, char op, const std::string& value, EntrySet& result)
+{
+	const FieldIndex& fi = GetFieldIndex(tagName);
+	
+	EntrySet_Init(result, _entryCnt);
+	for (size_t curVal = 0; curVal < fi.values.size(); curVal ++)
+	{
+		if (! MatchText(_index.GetString(fi.values[curVal]), op, value))
+			continue;
+		const std::vector<UINT32>& entries = fi.entries[curVal];
+		for (size_t curEnt = 0; curEnt < entries.size(); curEnt ++)
+			EntrySet_Add(result, entries[curEnt]);
+	}
+	
+	return;
+}
+
+void SongQuery::MatchChip(char op, const std::string& value, EntrySet& result)
+{
+	UINT8 typeMask[SIDX_CHIP_BYTES];
+	bool anyChip;
+	
+	memset(typeMask, 0x00, SIDX_CHIP_BYTES);
+	anyChip = false;
+	for (UINT32 devType = 0x00; devType < 0x100; devType ++)
+	{
+		const char* devName = SndEmu_GetDevName((DEV_ID)devType, 0x01, NULL);	// NULL = default name
+		if (devName == NULL || ! MatchText(devName, op, value))
+			continue;
+		typeMask[devType >> 3] |= (1 << (devType & 7));
+		anyChip = true;
+	}
+	
+	EntrySet_Init(result, _entryCnt);
+	if (! anyChip)
+		return;
+	for (UINT32 curEnt = 0; curEnt < _entryCnt; curEnt ++)
+	{
+		const UINT8* chipMask = _index.GetStoredChipMask(curEnt);
+		for (UINT32 curByte = 0; curByte < SIDX_CHIP_BYTES; curByte ++)
+		{
+			if (chipMask[curByte] & typeMask[curByte])
+			{
+				EntrySet_Add(result, curEnt);
+				break;
+			}
+		}
+	}
+	
+	return;
+}
+
+// returns an inverted index for a tag (including its "-JPN" variant)
+const SongQuery::FieldIndex& SongQuery::GetFieldIndex(const std::string& tagName)
+{
+	std::map<std::string, FieldIndex>::const_iterator fiIt = _fieldIdx.find(tagName);
+	if (fiIt != _fieldIdx.end())
+		return fiIt->second;
+	
+	FieldIndex& fi = _fieldIdx[tagName];
+	std::string tagNameJP = tagName + "-JPN";
+	std::map<UINT32, bool> keyMatch;	// tag key string -> is wanted tag
+	std::map<UINT32, size_t> valueIDs;	// tag value string -> index into fi.values
+	
+	for (UINT32 curEnt = 0; curEnt < _entryCnt; curEnt ++)
+	{
+		UINT32 tagCnt = _index.GetStoredTagCount(curEnt);
+		for (UINT32 curTag = 0; curTag < tagCnt; curTag ++)
+		{
+			UINT32 keyStr;
+			UINT32 valStr;
+	
+			_index.GetStoredTag(curEnt, curTag, keyStr, valStr);
+			std::map<UINT32, bool>::iterator kmIt = keyMatch.find(keyStr);
+			if (kmIt == keyMatch.end())
+			{
+				const char* key = _index.GetString(keyStr);
+				bool isMatch = (tagName == key || tagNameJP == key);
+				kmIt = keyMatch.insert(std::pair<UINT32, bool>(keyStr, isMatch)).first;
+			}
+			if (! kmIt->second)
+				continue;
+	
+			std::map<UINT32, size_t>::iterator viIt = valueIDs.find(valStr);
+			if (viIt == valueIDs.end())
+			{
+				viIt = valueIDs.insert(std::pair<UINT32, size_t>(valStr, fi.values.size())).first;
+				fi.values.push_back(valStr);
+				fi.entries.push_back(std::vector<UINT32>());
+			}
+			std::vector<UINT32>& entries = fi.entries[viIt->second];
+			if (entries.empty() || entries.back() != curEnt)
+				entries.push_back(curEnt);
+		}
+	}
+	
+	return fi;
+}
+
+// "value" must be lowercase
+bool SongQuery::MatchText(const char* text, char op, const std::string& value)
+{
+	std::string textLC(text);
+	size_t curChr;
+	
+	for (curChr = 0; curChr < textLC.length(); curChr ++)
+		textLC[curChr] = ToLowerASCII(textLC[curChr]);
+	
+	if (op == '=')
+		return (textLC == value);
+	else if (op == '~')
+		return (textLC.find(value) != std::string::npos);
+	
+	// ':' - the value must appear as whole word(s)
+	for (curChr = textLC.find(value); curChr != std::string::npos; curChr = textLC.find(value, curChr + 1))
+	{
+		size_t endChr = curChr + value.length();
+		if (curChr > 0 && IsWordChar(textLC[curChr - 1]) && IsWordChar(value[0]))
+			continue;
+		if (endChr < textLC.length() && IsWordChar(textLC[endChr]) && IsWordChar(value[value.length() - 1]))
+			continue;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,57 @@
+#ifndef __SONGQUERY_HPP__
+#define __SONGQUERY_HPP__
+
+#include <vector>
+#include <map>
+#include <string>
+#include <stdtype.h>
+
+class SongIndex;
+
+// evaluates search expressions over the entries of a song index file
+// Syntax:
+//	expr := term | "(" expr ")" | "NOT" expr | expr ["AND"] expr | expr "OR" expr
+//	term := field op value
+//		field: title, game, system, composer/artist, chip or any other tag name
+//		op: ":" (contains the words), "~" (contains the text), "=" (equals)
+//		value: word or "quoted text", case-insensitive
+// Per-field indexes (tag value -> list of songs) are built on first use, so each distinct
+// value is compared only once.
+class SongQuery
+{
+public:
+	SongQuery(const SongIndex& index);
+	// returns 0x00 on success, 0x01 on syntax errors (see GetError())
+	UINT8 Run(const std::string& query, std::vector<std::string>& fileList);
+	const std::string& GetError(void) const	{ return _errMsg; }
+	
+private:
+	typedef std::vector<UINT32> EntrySet;	// bit mask of index entries
+	struct FieldIndex
+	{
+		std::vector<UINT32> values;	// string table offsets of all distinct values
+		std::vector< std::vector<UINT32> > entries;	// entries that use values[i]
+	};
+	
+	bool ParseOr(EntrySet& result);
+	bool ParseAnd(EntrySet& result);
+	bool ParseNot(EntrySet& result);
+	bool ParsePrimary(EntrySet& result);
+	bool ParseTerm(EntrySet& result);
+	bool CheckKeyword(const char* keyword);
+	void SkipSpaces(void);
+	bool SetError(const std::string& msg);
+	void MatchTag(const std::string& tagName, char op, const std::string& value, EntrySet& result);
+	void MatchChip(char op, const std::string& value, EntrySet& result);
+	const FieldIndex& GetFieldIndex(const std::string& tagName);
+	static bool MatchText(const char* text, char op, const std::string& value);
+	
+	const SongIndex& _index;
+	UINT32 _entryCnt;
+	std::map<std::string, FieldIndex> _fieldIdx;	// tag name -> index
+	std::string _query;
+	size_t _pos;	// parsing position
+	std::string _errMsg;
+};
+
+#endif	// __SONGQUERY_HPP__
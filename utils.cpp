@@ -7,11 +7,15 @@
 
 #ifdef _WIN32
 #include <Windows.h>	// for WriteConsoleW etc.
+#include <sys/types.h>
+#include <sys/stat.h>
 #else
 #include <limits.h>		// for PATH_MAX
 #include <unistd.h>		// for getcwd()
+#include <time.h>		// for clock_gettime()
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <dirent.h>		// for opendir()
 #endif
 
 #include "stdtype.h"
@@ -25,6 +29,8 @@ static const char* GetLastDirSeparator(const char* filePath);
 //bool IsAbsolutePath(const char* filePath);
 //std::string CombinePaths(const std::string& basePath, const std::string& addPath);
 //std::string GetAbsolutePath(const std::string& relPath);
+//bool GetFileStats(const std::string& path, UINT64& fileTime, UINT64& fileSize);
+//bool ReadDirectory(const std::string& dirPath, std::vector<std::string>& fileNames, std::vector<std::string>& dirNames);
 //std::string FindFile_List(const std::vector<std::string>& fileList, const std::vector<std::string>& pathList);
 //std::string FindFile_Single(const std::string& fileName, const std::vector<std::string>& pathList);
 //std::string Vector2String(const std::vector<char>& data, size_t startPos, size_t endPos);
@@ -38,6 +44,9 @@ static bool utf8_advance(const char** str);
 //std::string FCC2Str(UINT32 fcc);
 //UINT32 Str2FCC(const std::string& fcc);
 //void u8printf(const char* format, ...);
+//UINT32 GetCPUCoreCount(void);
+//UINT64 GetTimeUSec(void);
+//UINT64 HashFNV1a(const UINT8* data, UINT32 size, UINT64 hash);
 
 
 static const char* GetLastDirSeparator(const char* filePath)
@@ -192,6 +201,96 @@ bool PathIsDirectory(const std::string& path)
 	return CheckFileDirMode(path) == 1;
 }
 
+// returns modification time and size of a regular file
+bool GetFileStats(const std::string& path, UINT64& fileTime, UINT64& fileSize)
+{
+#ifdef _WIN32
+	struct _stat st;
+	if (_stat(path.c_str(), &st) || ! (st.st_mode & _S_IFREG))
+		return false;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) || ! S_ISREG(st.st_mode))
+		return false;
+#endif
+	fileTime = (UINT64)st.st_mtime;
+	fileSize = (UINT64)st.st_size;
+	return true;
+}
+
+// lists the files and subdirectories of a directory (names only, UTF-8)
+// Symbolic links to directories are not reported, so that walking a directory tree can't end up in a loop.
+bool ReadDirectory(const std::string& dirPath, std::vector<std::string>& fileNames, std::vector<std::string>& dirNames)
+{
+	fileNames.clear();
+	dirNames.clear();
+#ifdef _WIN32
+	std::string searchPath = CombinePaths(dirPath, "*");
+	std::vector<wchar_t> searchPathW;
+	WIN32_FIND_DATAW findData;
+	HANDLE hFind;
+	
+	searchPathW.resize(MultiByteToWideChar(CP_UTF8, 0, searchPath.c_str(), -1, NULL, 0) + 1);
+	MultiByteToWideChar(CP_UTF8, 0, searchPath.c_str(), -1, &searchPathW[0], (int)searchPathW.size());
+	hFind = FindFirstFileW(&searchPathW[0], &findData);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return false;
+	do
+	{
+		const wchar_t* nameW = findData.cFileName;
+		if (! wcscmp(nameW, L".") || ! wcscmp(nameW, L".."))
+			continue;
+		
+		int bufSize = WideCharToMultiByte(CP_UTF8, 0, nameW, -1, NULL, 0, NULL, NULL);
+		std::string name(bufSize, '\0');
+		WideCharToMultiByte(CP_UTF8, 0, nameW, -1, &name[0], bufSize, NULL, NULL);
+		name.resize(strlen(name.c_str()));
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			if (! (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+				dirNames.push_back(name);
+		}
+		else
+		{
+			fileNames.push_back(name);
+		}
+	} while(FindNextFileW(hFind, &findData));
+	FindClose(hFind);
+#else
+	DIR* hDir;
+	struct dirent* dirEnt;
+	
+	hDir = opendir(dirPath.c_str());
+	if (hDir == NULL)
+		return false;
+	while((dirEnt = readdir(hDir)) != NULL)
+	{
+		const char* name = dirEnt->d_name;
+		struct stat st;
+		if (! strcmp(name, ".") || ! strcmp(name, ".."))
+			continue;
+		
+		std::string fullPath = CombinePaths(dirPath, name);
+		if (lstat(fullPath.c_str(), &st))
+			continue;
+		if (S_ISDIR(st.st_mode))
+		{
+			dirNames.push_back(name);
+		}
+		else
+		{
+			if (S_ISLNK(st.st_mode) && stat(fullPath.c_str(), &st))
+				continue;	// dangling link
+			if (S_ISREG(st.st_mode))
+				fileNames.push_back(name);
+		}
+	}
+	closedir(hDir);
+#endif
+	
+	return true;
+}
+
 std::string FindFile_List(const std::vector<std::string>& fileList, const std::vector<std::string>& pathList)
 {
 	std::vector<std::string>::const_reverse_iterator pathIt;
@@ -478,3 +577,45 @@ std::string urlencode(const std::string& str)
 	}
 	return newstr;
 }
+
+UINT32 GetCPUCoreCount(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO sysInfo;
+	
+	GetSystemInfo(&sysInfo);
+	return (sysInfo.dwNumberOfProcessors > 0) ? (UINT32)sysInfo.dwNumberOfProcessors : 1;
+#else
+	long cpuCnt = sysconf(_SC_NPROCESSORS_ONLN);
+	return (cpuCnt > 0) ? (UINT32)cpuCnt : 1;
+#endif
+}
+
+// returns a monotonic timestamp in microseconds
+UINT64 GetTimeUSec(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER cntFreq;
+	LARGE_INTEGER cntVal;
+	
+	QueryPerformanceFrequency(&cntFreq);
+	QueryPerformanceCounter(&cntVal);
+	return (UINT64)(cntVal.QuadPart / cntFreq.QuadPart) * 1000000 +
+		(UINT64)(cntVal.QuadPart % cntFreq.QuadPart) * 1000000 / cntFreq.QuadPart;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (UINT64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+UINT64 HashFNV1a(const UINT8* data, UINT32 size, UINT64 hash)
+{
+	for (UINT32 curPos = 0; curPos < size; curPos ++)
+	{
+		hash ^= data[curPos];
+		hash *= ((UINT64)0x00000100 << 32) | 0x000001B3;
+	}
+	return hash;
+}
@@ -20,6 +20,8 @@ std::string GetAbsolutePath(const std::string& relPath);
 int CheckFileDirMode(const std::string& path);
 bool PathIsFile(const std::string& path);
 bool PathIsDirectory(const std::string& path);
+bool GetFileStats(const std::string& path, UINT64& fileTime, UINT64& fileSize);
+bool ReadDirectory(const std::string& dirPath, std::vector<std::string>& fileNames, std::vector<std::string>& dirNames);
 std::string FindFile_List(const std::vector<std::string>& fileList, const std::vector<std::string>& pathList);
 std::string FindFile_Single(const std::string& fileName, const std::vector<std::string>& pathList);
 std::string Vector2String(const std::vector<char>& data, size_t startPos = 0, size_t endPos = std::string::npos);
@@ -34,5 +36,9 @@ std::string FCC2Str(UINT32 fcc);
 UINT32 Str2FCC(const std::string& fcc);
 void u8printf(const char* format, ...);
 std::string urlencode(const std::string& str);
+UINT32 GetCPUCoreCount(void);
+UINT64 GetTimeUSec(void);
+#define FNV1A_INIT	(((UINT64)0xCBF29CE4 << 32) | 0x84222325)
+UINT64 HashFNV1a(const UINT8* data, UINT32 size, UINT64 hash);	// 64-bit FNV-1a, start with hash = FNV1A_INIT
 
 #endif	// __UTILS_HPP__